@@ -1,47 +1,244 @@
 #include <lib/base/cachedtssource.h>
-
-static const unsigned int CACHE_SIZE = 32*1024;
+#include <algorithm>
+#include <lib/base/eerror.h>
 
 DEFINE_REF(eCachedSource);
 
-eCachedSource::eCachedSource(ePtr<iTsSource>& source)
+eCachedSource::eCachedSource(ePtr<iTsSource>& source, int blocks)
 	: iTsSource(source->getPacketSize())
 	, m_source(source)
-	, m_cache_buffer((char*)malloc(CACHE_SIZE))
-	, m_cache_offset(0)
-	, m_cache_bytes(0)
+	, m_buffer(NULL)
+	, m_clock(0)
+	, m_offset(0)
+	, m_last_block(-1)
+	, m_prefetcher(*this)
+	, m_prefetcher_running(false)
+	, m_prefetch_offset(-1)
+	, m_stop(false)
+	, m_hits(0)
+	, m_misses(0)
+	, m_prefetched(0)
 {
+	/* the prefetcher and the reader may both be loading a block */
+	if (blocks < 4)
+		blocks = 4;
+	m_buffer = (char*)malloc((size_t)blocks * BLOCK_SIZE);
+	if (!m_buffer)
+		return;
+	m_blocks.resize(blocks);
+	for (int i = 0; i < blocks; ++i)
+	{
+		Block &block = m_blocks[i];
+		block.data = m_buffer + (size_t)i * BLOCK_SIZE;
+		block.offset = -1;
+		block.bytes = 0;
+		block.used = 0;
+		block.loading = false;
+		block.prefetched = false;
+	}
 }
 
 eCachedSource::~eCachedSource()
 {
-	free(m_cache_buffer);
+	if (m_prefetcher_running)
+	{
+		{
+			eSingleLocker lock(m_lock);
+			m_stop = true;
+			m_cond.broadcast();
+		}
+		m_prefetcher.kill();
+	}
+	if (m_hits || m_misses)
+		eDebug("[eCachedSource] %u hits, %u misses, %u of them read ahead", m_hits, m_misses, m_prefetched);
+	free(m_buffer);
+}
+
+eCachedSource::Block *eCachedSource::find(off_t offset)
+{
+	for (std::vector<Block>::iterator it = m_blocks.begin(); it != m_blocks.end(); ++it)
+		if (it->offset == offset)
+			return &*it;
+	return NULL;
+}
+
+/* called with m_lock held, takes the least recently used block which is not being loaded */
+eCachedSource::Block *eCachedSource::replace(off_t offset)
+{
+	Block *victim = NULL;
+	for (std::vector<Block>::iterator it = m_blocks.begin(); it != m_blocks.end(); ++it)
+	{
+		if (it->loading)
+			continue;
+		if (it->offset == -1)
+		{
+			victim = &*it;
+			break;
+		}
+		if (!victim || it->used < victim->used)
+			victim = &*it;
+	}
+	victim->offset = offset;
+	victim->bytes = 0;
+	victim->loading = true;
+	victim->prefetched = false;
+	return victim;
+}
+
+/* called with m_lock held, which is released while reading */
+void eCachedSource::load(Block *block)
+{
+	off_t offset = block->offset;
+	ssize_t bytes = 0;
+	m_lock.unlock();
+	while (bytes < BLOCK_SIZE)
+	{
+		ssize_t r = m_source->read(offset + bytes, block->data + bytes, BLOCK_SIZE - bytes);
+		if (r <= 0)
+		{
+			if (!bytes)
+				bytes = r;
+			break;
+		}
+		bytes += r;
+	}
+	m_lock.lock();
+	block->bytes = bytes;
+	block->loading = false;
+	if (bytes <= 0)
+		block->offset = -1;
+	m_cond.broadcast();
+}
+
+/* called with m_lock held for each miss and the first use of a read ahead block */
+void eCachedSource::detectSequential(off_t offset)
+{
+	int direction = 0;
+	if (m_last_block != -1)
+	{
+		if (offset == m_last_block + BLOCK_SIZE)
+			direction = 1;
+		else if (offset == m_last_block - BLOCK_SIZE)
+			direction = -1;
+	}
+	m_last_block = offset;
+	if (!direction || m_source->isStream())
+		return;
+	off_t next = offset + direction * BLOCK_SIZE;
+	if (next < 0 || find(next))
+		return;
+	m_prefetch_offset = next;
+	if (!m_prefetcher_running)
+	{
+		m_prefetcher_running = true;
+		m_prefetcher.run();
+	}
+	m_cond.broadcast();
+}
+
+void eCachedSource::Prefetcher::thread()
+{
+	hasStarted();
+	m_cache.prefetchThread();
+}
+
+void eCachedSource::prefetchThread()
+{
+	eSingleLocker lock(m_lock);
+	while (!m_stop)
+	{
+		if (m_prefetch_offset == -1)
+		{
+			m_cond.wait(m_lock);
+			continue;
+		}
+		off_t offset = m_prefetch_offset;
+		m_prefetch_offset = -1;
+		if (find(offset))
+			continue;
+		Block *block = replace(offset);
+		/* keep it until it has been used once */
+		block->used = ++m_clock;
+		load(block);
+		if (block->offset == offset)
+			block->prefetched = true;
+	}
 }
 
 ssize_t eCachedSource::read(off_t offset, void *buf, size_t count)
 {
-	/* Not quite optimal, but just enough to read bit more efficient than tiny 188 byte chunks */
-	if (count >= CACHE_SIZE)
+	if (!m_buffer || count >= BLOCK_SIZE)
+		return m_source->read(offset, buf, count);
+	/* the start of a ring buffer is not block aligned */
+	off_t first = m_source->firstOffset();
+	if (first && offset < first + BLOCK_SIZE)
 		return m_source->read(offset, buf, count);
-	if ((offset < m_cache_offset) || (static_cast<size_t>(offset+count) >= static_cast<size_t>(m_cache_offset+m_cache_bytes)))
+
+	eSingleLocker lock(m_lock);
+	m_offset = offset;
+	size_t done = 0;
+	while (done < count)
 	{
-		/* Update the cache */
-		ssize_t bytes = m_source->read(offset, m_cache_buffer, CACHE_SIZE);
-		if (bytes <= 0)
-			return bytes;
-		if ((size_t)bytes < count)
-			count = bytes; /* probably past EOF */
-		m_cache_offset = offset;
-		m_cache_bytes = bytes;
+		off_t pos = offset + done;
+		off_t block_offset = pos & ~((off_t)BLOCK_SIZE - 1);
+		Block *block = find(block_offset);
+		while (block && block->loading)
+		{
+			m_cond.wait(m_lock);
+			block = find(block_offset);
+		}
+		size_t index = pos - block_offset;
+		/* a short block was the end of the file, it may have grown meanwhile */
+		if (block && (size_t)block->bytes <= index && block->bytes < BLOCK_SIZE)
+			block->offset = -1, block = NULL;
+		if (block)
+		{
+			++m_hits;
+			if (block->prefetched)
+			{
+				/* keep reading ahead */
+				block->prefetched = false;
+				++m_prefetched;
+				detectSequential(block_offset);
+			}
+		}
+		else
+		{
+			++m_misses;
+			detectSequential(block_offset);
+			block = replace(block_offset);
+			load(block);
+			if (block->offset != block_offset)
+			{
+				/* error or end of file */
+				if (done)
+					break;
+				return block->bytes;
+			}
+		}
+		block->used = ++m_clock;
+		if ((size_t)block->bytes <= index)
+			break;
+		size_t n = std::min(count - done, (size_t)block->bytes - index);
+		memcpy((char*)buf + done, block->data + index, n);
+		done += n;
+		if ((size_t)block->bytes < BLOCK_SIZE)
+			break;
 	}
-	unsigned int cache_index = offset - m_cache_offset;
-	memcpy(buf, m_cache_buffer + cache_index, count);
-	return count;
+	return done;
+}
+
+void eCachedSource::getStatistics(unsigned int &hits, unsigned int &misses, unsigned int &prefetched)
+{
+	eSingleLocker lock(m_lock);
+	hits = m_hits;
+	misses = m_misses;
+	prefetched = m_prefetched;
 }
 
 int eCachedSource::valid()
 {
-	return (m_cache_buffer != NULL) && m_source->valid();
+	return (m_buffer != NULL) && m_source->valid();
 }
 
 off_t eCachedSource::length()
@@ -51,5 +248,5 @@ off_t eCachedSource::length()
 
 off_t eCachedSource::offset()
 {
-	return m_cache_offset;
+	return m_offset;
 }
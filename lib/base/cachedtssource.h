@@ -1,13 +1,28 @@
 #ifndef __lib_base_cachedtssource_h
 #define __lib_base_cachedtssource_h
 
+#include <vector>
 #include <lib/base/itssource.h>
+#include <lib/base/elock.h>
+#include <lib/base/thread.h>
 
+/*
+ * Block cache in front of a source, for the small reads of eDVBTSTools.
+ *
+ * The file is cached in aligned blocks, of which the least recently used
+ * one is replaced on a miss, so jumping back and forth between a few
+ * positions while seeking does not read them again. When the reads walk
+ * through the file block by block, in either direction, the next block
+ * in that direction is read ahead by a thread. Streams are not read ahead,
+ * their reads return the next data whatever the offset.
+ */
 class eCachedSource: public iTsSource
 {
 	DECLARE_REF(eCachedSource);
 public:
-	eCachedSource(ePtr<iTsSource>& source);
+	enum { BLOCK_SIZE = 32 * 1024, DEFAULT_BLOCKS = 16 };
+
+	eCachedSource(ePtr<iTsSource>& source, int blocks = DEFAULT_BLOCKS);
 	~eCachedSource();
 
 	// iTsSource
@@ -16,11 +31,51 @@ public:
 	off_t offset();
 	int valid();
 	bool isStream() { return m_source->isStream(); };
+	void prefetch(off_t offset, size_t count) { m_source->prefetch(offset, count); }
+	off_t firstOffset() { return m_source->firstOffset(); }
+
+	/* prefetched counts the read ahead blocks which were used afterwards */
+	void getStatistics(unsigned int &hits, unsigned int &misses, unsigned int &prefetched);
 private:
+	struct Block
+	{
+		char *data;
+		off_t offset; /* -1 when unused */
+		ssize_t bytes;
+		unsigned int used;
+		bool loading, prefetched;
+	};
+
+	class Prefetcher: public eThread
+	{
+		eCachedSource &m_cache;
+	public:
+		Prefetcher(eCachedSource &cache): m_cache(cache) {}
+		void thread();
+	};
+
 	ePtr<iTsSource> m_source;
-	char* m_cache_buffer;
-	off_t m_cache_offset;
-	unsigned int m_cache_bytes;
+	char *m_buffer;
+	std::vector<Block> m_blocks;
+	unsigned int m_clock;
+	off_t m_offset;
+
+	off_t m_last_block;
+
+	eSingleLock m_lock;
+	eCondition m_cond;
+	Prefetcher m_prefetcher;
+	bool m_prefetcher_running;
+	off_t m_prefetch_offset; /* -1 when there is nothing to read ahead */
+	bool m_stop;
+
+	unsigned int m_hits, m_misses, m_prefetched;
+
+	Block *find(off_t offset);
+	Block *replace(off_t offset);
+	void load(Block *block);
+	void detectSequential(off_t offset);
+	void prefetchThread();
 };
 
 #endif
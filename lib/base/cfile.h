@@ -23,7 +23,7 @@ struct CFile
 		if (handle)
 			fclose(handle);
 	}
-	void sync() { fsync(fileno(handle)); }
+	int sync() { return fsync(fileno(handle)); }
 	operator bool() const { return handle != NULL; }
 	operator FILE *() const { return handle; }
 
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <lib/python/python.h>
+#include <lib/python/python_helpers.h>
 #include <lib/base/eerror.h>
 #include <lib/base/elock.h>
 #include <lib/gdi/grc.h>
@@ -11,7 +12,7 @@
 DEFINE_REF(eSocketNotifier);
 
 eSocketNotifier::eSocketNotifier(eMainloop *context, int fd, int requested, bool startnow):
-	context(*context), fd(fd), state(0), requested(requested)
+	context(*context), fd(fd), state(0), requested(requested), m_pollIndex(-1)
 {
 	if (startnow)
 		start();
@@ -43,6 +44,13 @@ void eSocketNotifier::stop()
 	}
 }
 
+void eSocketNotifier::setRequested(int req)
+{
+	requested = req;
+	if (state)
+		context.updateSocketNotifier(this);
+}
+
 DEFINE_REF(eTimer);
 
 void eTimer::start(long msek, bool singleShot)
@@ -123,6 +131,20 @@ void eTimer::activate()   // Internal Funktion... called from eApplication
 
 // mainloop
 ePtrList<eMainloop> eMainloop::existing_loops;
+bool eMainloop::s_useEpoll = false;
+
+eMainloop::eMainloop()
+	:m_epollfd(-1), m_epollBatch(0), m_timerSequence(0), m_iterations(0), m_timerFires(0), m_pollWakeups(0), m_pollTimeouts(0), m_pollSignals(0),
+	app_quit_now(0), retval(0), m_inActivate(0), m_interrupt_requested(0)
+{
+	if (s_useEpoll)
+	{
+		m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+		if (m_epollfd < 0)
+			eDebug("[eMainloop] epoll_create1 failed, using poll: %m");
+	}
+	existing_loops.push_back(this);
+}
 
 bool eMainloop::isValid(eMainloop *ml)
 {
@@ -134,8 +156,10 @@ eMainloop::~eMainloop()
 	existing_loops.remove(this);
 	for (std::map<int, eSocketNotifier*>::iterator it(notifiers.begin());it != notifiers.end();)
 		(it++)->second->stop();
-	while(m_timer_list.begin() != m_timer_list.end())
-		m_timer_list.begin()->stop();
+	while (!m_timers.empty())
+		m_timers.front()->stop();
+	if (m_epollfd >= 0)
+		::close(m_epollfd);
 }
 
 void eMainloop::addSocketNotifier(eSocketNotifier *sn)
@@ -154,6 +178,64 @@ void eMainloop::addSocketNotifier(eSocketNotifier *sn)
 	}
 	ASSERT(notifiers.find(fd) == notifiers.end());
 	notifiers[fd]=sn;
+	m_newNotifiers.push_back(sn);
+
+	watchNotifier(sn);
+}
+
+void eMainloop::watchNotifier(eSocketNotifier *sn)
+{
+	int fd = sn->getFD();
+	if (m_epollfd >= 0)
+	{
+		struct epoll_event ev = {};
+		ev.events = sn->getRequested(); // the EPOLL* flags have the values of the POLL* flags
+		ev.data.ptr = sn;
+		if (epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &ev) == 0)
+			return;
+		/* e.g. regular files can't be watched with epoll, poll them like before */
+		if (errno != EPERM)
+			eDebug("[eMainloop::addSocketNotifier] epoll_ctl fd=%d failed: %m", fd);
+	}
+
+	pollfd pfd = {};
+	pfd.fd = fd;
+	pfd.events = sn->getRequested();
+	sn->m_pollIndex = m_pollfds.size();
+	m_pollfds.push_back(pfd);
+	m_pollNotifiers.push_back(sn);
+}
+
+void eMainloop::rebuildEpoll()
+{
+	/*
+	 * An fd that was closed before its notifier was stopped can't be removed
+	 * from the epoll set anymore. Its entry stays as long as the file is open
+	 * somewhere else, e.g. through dup() or in a forked child, and would still
+	 * report events for the destroyed notifier. Only closing the epoll
+	 * instance drops it, so start over with the running notifiers.
+	 */
+	::close(m_epollfd);
+	m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if (m_epollfd < 0)
+		eWarning("[eMainloop] epoll_create1 failed, using poll: %m");
+	for (std::map<int, eSocketNotifier*>::iterator it(notifiers.begin()); it != notifiers.end(); ++it)
+		if (it->second->m_pollIndex < 0)
+			watchNotifier(it->second);
+}
+
+void eMainloop::updateSocketNotifier(eSocketNotifier *sn)
+{
+	if (sn->m_pollIndex >= 0)
+		m_pollfds[sn->m_pollIndex].events = sn->getRequested();
+	else if (m_epollfd >= 0)
+	{
+		struct epoll_event ev = {};
+		ev.events = sn->getRequested();
+		ev.data.ptr = sn;
+		if (epoll_ctl(m_epollfd, EPOLL_CTL_MOD, sn->getFD(), &ev) < 0)
+			eDebug("[eMainloop::updateSocketNotifier] epoll_ctl fd=%d failed: %m", sn->getFD());
+	}
 }
 
 void eMainloop::removeSocketNotifier(eSocketNotifier *sn)
@@ -163,6 +245,32 @@ void eMainloop::removeSocketNotifier(eSocketNotifier *sn)
 	if (i != notifiers.end())
 	{
 		notifiers.erase(i);
+		/* move the last entry of the poll set into the free slot */
+		int index = sn->m_pollIndex;
+		if (index >= 0)
+		{
+			m_pollfds[index] = m_pollfds.back();
+			m_pollNotifiers[index] = m_pollNotifiers.back();
+			m_pollNotifiers[index]->m_pollIndex = index;
+			m_pollfds.pop_back();
+			m_pollNotifiers.pop_back();
+			sn->m_pollIndex = -1;
+		}
+		else if (m_epollfd >= 0)
+		{
+			if (epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, NULL) < 0)
+			{
+				eDebug("[eMainloop::removeSocketNotifier] epoll_ctl fd=%d failed: %m, recreating the epoll set", fd);
+				rebuildEpoll();
+			}
+			for (EpollBatch *batch = m_epollBatch; batch; batch = batch->outer)
+				for (int e = 0; e < batch->count; ++e)
+					if (batch->events[e].data.ptr == sn)
+						batch->events[e].data.ptr = NULL;
+		}
+		std::vector<eSocketNotifier*>::iterator n = std::find(m_newNotifiers.begin(), m_newNotifiers.end(), sn);
+		if (n != m_newNotifiers.end())
+			m_newNotifiers.erase(n);
 		return;
 	}
 	for (i = notifiers.begin(); i != notifiers.end(); ++i)
@@ -180,29 +288,28 @@ int eMainloop::processOneEvent(long user_timeout, PyObject **res, ePyObject addi
 	if (additional && !res)
 		eFatal("[eMainloop::processOneEvent] additional, but no res");
 
+	++m_iterations;
+
 	long poll_timeout = -1; /* infinite in case of empty timer list */
 
+	if (!m_timers.empty())
 	{
-		ePtrList<eTimer>::iterator it = m_timer_list.begin();
-		if (it != m_timer_list.end())
+		/* get current time */
+		timespec now = {};
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		/* process all timers which are ready. first remove them out of the heap. */
+		while (!m_timers.empty() && m_timers.front()->needsActivation(now))
 		{
-			eTimer *tmr = *it;
-			/* get current time */
-			timespec now = {};
-			clock_gettime(CLOCK_MONOTONIC, &now);
-			/* process all timers which are ready. first remove them out of the list. */
-			while (tmr->needsActivation(now))
-			{
-				m_timer_list.erase(it);
-				tmr->AddRef();
-				tmr->activate();
-				tmr->Release();
-				it = m_timer_list.begin();
-				if (it == m_timer_list.end()) break;
-				tmr = *it;
-			}
-			it = m_timer_list.begin();
-			if (it != m_timer_list.end()) poll_timeout = timeout_usec((*it)->getNextActivation());
+			eTimer *tmr = m_timers.front();
+			removeTimer(tmr);
+			++m_timerFires;
+			tmr->AddRef();
+			tmr->activate();
+			tmr->Release();
+		}
+		if (!m_timers.empty())
+		{
+			poll_timeout = timeout_usec(m_timers.front()->getNextActivation());
 			if (poll_timeout < 0)
 				poll_timeout = 0;
 			else /* convert us to ms */
@@ -216,100 +323,214 @@ int eMainloop::processOneEvent(long user_timeout, PyObject **res, ePyObject addi
 		return_reason = 1;
 	}
 
-	int nativecount=notifiers.size(),
-		fdcount=nativecount,
+	int nativecount = m_pollfds.size(),
 		ret=0;
 
-	if (additional)
-		fdcount += PyDict_Size(additional);
-
-		// build the poll aray
-	pollfd pfd[fdcount] = {};  // make new pollfd array
-	std::map<int,eSocketNotifier*>::iterator it = notifiers.begin();
+	/* notifiers started since the last poll are part of this one */
+	for (std::vector<eSocketNotifier*>::iterator it(m_newNotifiers.begin()); it != m_newNotifiers.end(); ++it)
+		(*it)->state = 1; // running and in poll
+	m_newNotifiers.clear();
 
-	int i=0;
-	for (; i < nativecount; ++i, ++it)
+	/* the epoll fd and the entries of the additional dict are appended for this poll only */
+	if (m_epollfd >= 0)
 	{
-		it->second->state = 1; // running and in poll
-		pfd[i].fd = it->first;
-		pfd[i].events = it->second->getRequested();
+		pollfd pfd = {};
+		pfd.fd = m_epollfd;
+		pfd.events = POLLIN;
+		m_pollfds.push_back(pfd);
 	}
-
+	int additionalstart = m_pollfds.size();
 	if (additional)
 	{
 		PyObject *key, *val;
 		Py_ssize_t pos=0;
 		while (PyDict_Next(additional, &pos, &key, &val)) {
-			pfd[i].fd = PyObject_AsFileDescriptor(key);
-			pfd[i++].events = PyInt_AsLong(val);
+			pollfd pfd = {};
+			pfd.fd = PyObject_AsFileDescriptor(key);
+			pfd.events = PyInt_AsLong(val);
+			m_pollfds.push_back(pfd);
 		}
 	}
 
-
-	ret = _poll(pfd, fdcount, poll_timeout);
+	int fdcount = m_pollfds.size();
+	ret = _poll(fdcount ? &m_pollfds[0] : NULL, fdcount, poll_timeout);
 
 	/* ret > 0 means that there are some active poll entries. */
 	if (ret > 0)
 	{
-		int i=0;
+		++m_pollWakeups;
 		return_reason = 0;
-		for (; i < nativecount; ++i)
+
+		/*
+		 * the callbacks may start and stop notifiers, which reorders the
+		 * poll set, so the results are taken out before dispatching them
+		 */
+		pollfd ready[ret];
+		int readycount = 0;
+		int i=0;
+		for (; i < nativecount && readycount < ret; ++i)
 		{
-			if (pfd[i].revents)
-			{
-				it = notifiers.find(pfd[i].fd);
-				if (it != notifiers.end()
-					&& it->second->state == 1) // added and in poll
-				{
-					m_inActivate = it->second;
-					int req = m_inActivate->getRequested();
-					if (pfd[i].revents & req) {
-						m_inActivate->AddRef();
-						m_inActivate->activate(pfd[i].revents & req);
-						m_inActivate->Release();
-					}
-					pfd[i].revents &= ~req;
-					m_inActivate = 0;
-				}
-				if (pfd[i].revents & (POLLERR|POLLHUP|POLLNVAL))
-					eTrace("[eMainloop::processOneEvent] unhandled POLLERR/HUP/NVAL for fd %d(%d)", pfd[i].fd, pfd[i].revents);
-			}
+			if (m_pollfds[i].revents)
+				ready[readycount++] = m_pollfds[i];
 		}
-		for (; i < fdcount; ++i)
+		bool epoll_ready = m_epollfd >= 0 && m_pollfds[nativecount].revents;
+		for (i = additionalstart; i < fdcount; ++i)
 		{
-			if (pfd[i].revents)
+			if (m_pollfds[i].revents)
 			{
 				if (!*res)
 					*res = PyList_New(0);
 				ePyObject it = PyTuple_New(2);
-				PyTuple_SET_ITEM(it, 0, PyInt_FromLong(pfd[i].fd));
-				PyTuple_SET_ITEM(it, 1, PyInt_FromLong(pfd[i].revents));
+				PyTuple_SET_ITEM(it, 0, PyInt_FromLong(m_pollfds[i].fd));
+				PyTuple_SET_ITEM(it, 1, PyInt_FromLong(m_pollfds[i].revents));
 				PyList_Append(*res, it);
 				Py_DECREF(it);
 			}
 		}
+		m_pollfds.resize(nativecount);
+
+		for (i = 0; i < readycount; ++i)
+		{
+			std::map<int,eSocketNotifier*>::iterator it = notifiers.find(ready[i].fd);
+			if (it != notifiers.end())
+				activateNotifier(it->second, ready[i].revents);
+			else if (ready[i].revents & (POLLERR|POLLHUP|POLLNVAL))
+				eTrace("[eMainloop::processOneEvent] unhandled POLLERR/HUP/NVAL for fd %d(%d)", ready[i].fd, ready[i].revents);
+		}
+
+		if (epoll_ready)
+			dispatchEpoll();
 	}
-	else if (ret < 0)
+	else
 	{
-			/* when we got a signal, we get EINTR. */
-		if (errno != EINTR)
-			eDebug("[eMainloop::processOneEvent] poll made error: %m");
+		m_pollfds.resize(nativecount);
+		if (ret < 0)
+		{
+				/* when we got a signal, we get EINTR. */
+			if (errno != EINTR)
+				eDebug("[eMainloop::processOneEvent] poll made error: %m");
+			else
+			{
+				++m_pollSignals;
+				return_reason = 2; /* don't assume the timeout has passed when we got a signal */
+			}
+		}
 		else
-			return_reason = 2; /* don't assume the timeout has passed when we got a signal */
+			++m_pollTimeouts;
 	}
 
 	return return_reason;
 }
 
+void eMainloop::activateNotifier(eSocketNotifier *sn, int revents)
+{
+	if (sn->state == 1) // added and in poll
+	{
+		m_inActivate = sn;
+		int req = m_inActivate->getRequested();
+		if (revents & req) {
+			m_inActivate->AddRef();
+			m_inActivate->activate(revents & req);
+			m_inActivate->Release();
+		}
+		revents &= ~req;
+		m_inActivate = 0;
+	}
+	if (revents & (POLLERR|POLLHUP|POLLNVAL))
+		eTrace("[eMainloop::processOneEvent] unhandled POLLERR/HUP/NVAL for fd %d(%d)", sn->getFD(), revents);
+}
+
+void eMainloop::dispatchEpoll()
+{
+	struct epoll_event events[64];
+	int count = epoll_wait(m_epollfd, events, 64, 0);
+	if (count <= 0)
+		return;
+
+	/* callbacks may stop other notifiers of this batch, see removeSocketNotifier */
+	EpollBatch batch = { events, count, m_epollBatch };
+	m_epollBatch = &batch;
+	for (int i = 0; i < count; ++i)
+	{
+		eSocketNotifier *sn = (eSocketNotifier*)events[i].data.ptr;
+		if (sn)
+			activateNotifier(sn, events[i].events);
+	}
+	m_epollBatch = batch.outer;
+}
+
+bool eMainloop::timerBefore(const eTimer *a, const eTimer *b)
+{
+	if (a->nextActivation < b->nextActivation)
+		return true;
+	if (b->nextActivation < a->nextActivation)
+		return false;
+	/* timers due at the same time fire in the order they were started */
+	return a->m_sequence < b->m_sequence;
+}
+
+void eMainloop::timerSiftUp(int index)
+{
+	eTimer *e = m_timers[index];
+	while (index > 0)
+	{
+		int parent = (index - 1) / 2;
+		if (!timerBefore(e, m_timers[parent]))
+			break;
+		m_timers[index] = m_timers[parent];
+		m_timers[index]->m_heapIndex = index;
+		index = parent;
+	}
+	m_timers[index] = e;
+	e->m_heapIndex = index;
+}
+
+void eMainloop::timerSiftDown(int index)
+{
+	eTimer *e = m_timers[index];
+	int count = m_timers.size();
+	while (true)
+	{
+		int child = 2 * index + 1;
+		if (child >= count)
+			break;
+		if (child + 1 < count && timerBefore(m_timers[child + 1], m_timers[child]))
+			++child;
+		if (!timerBefore(m_timers[child], e))
+			break;
+		m_timers[index] = m_timers[child];
+		m_timers[index]->m_heapIndex = index;
+		index = child;
+	}
+	m_timers[index] = e;
+	e->m_heapIndex = index;
+}
+
 void eMainloop::addTimer(eTimer* e)
 {
-	m_timer_list.insert_in_order(e);
+	if (e->m_heapIndex >= 0)
+		removeTimer(e);
+	e->m_sequence = m_timerSequence++;
+	m_timers.push_back(e);
+	timerSiftUp(m_timers.size() - 1);
 }
 
 void eMainloop::removeTimer(eTimer* e)
 {
-	/* use singleremove, timers never occur in our list multiple times, and remove() is a lot more expensive */
-	m_timer_list.singleremove(e);
+	int index = e->m_heapIndex;
+	if (index < 0 || index >= (int)m_timers.size() || m_timers[index] != e)
+		return;
+	e->m_heapIndex = -1;
+	eTimer *last = m_timers.back();
+	m_timers.pop_back();
+	if (last == e)
+		return;
+	m_timers[index] = last;
+	last->m_heapIndex = index;
+	if (index > 0 && timerBefore(last, m_timers[(index - 1) / 2]))
+		timerSiftUp(index);
+	else
+		timerSiftDown(index);
 }
 
 int eMainloop::iterate(unsigned int twisted_timeout, PyObject **res, ePyObject dict)
@@ -383,6 +604,24 @@ void eMainloop::interruptPoll()
 	m_interrupt_requested = 1;
 }
 
+PyObject *eMainloop::getStatistics()
+{
+	ePyObject dict = PyDict_New();
+	PutToDict(dict, "iterations", m_iterations);
+	PutToDict(dict, "timer_fires", m_timerFires);
+	PutToDict(dict, "poll_wakeups", m_pollWakeups);
+	PutToDict(dict, "poll_timeouts", m_pollTimeouts);
+	PutToDict(dict, "poll_signals", m_pollSignals);
+	PutToDict(dict, "timers", m_timers.size());
+	PutToDict(dict, "notifiers", notifiers.size());
+	return dict;
+}
+
+void eMainloop::resetStatistics()
+{
+	m_iterations = m_timerFires = m_pollWakeups = m_pollTimeouts = m_pollSignals = 0;
+}
+
 void eMainloop::quit(int ret)
 {
 	retval = ret;
@@ -9,6 +9,7 @@
 #else
 #include <poll.h>
 #endif
+#include <sys/epoll.h>
 #include <sys/time.h>
 #include <asm/types.h>
 #include <time.h>
@@ -157,6 +158,7 @@ private:
 	int fd;
 	int state;
 	int requested;
+	int m_pollIndex; // in eMainloop::m_pollfds, -1 when stopped
 
 	void activate(int what) { /*emit*/ activated(what); }
 	eSocketNotifier(eMainloop *context, int fd, int req, bool startnow);
@@ -179,7 +181,7 @@ public:
 
 	int getFD() const { return fd; }
 	int getRequested() const { return requested; }
-	void setRequested(int req) { requested=req; }
+	void setRequested(int req);
 
 	/* Only eConsoleAppContainer uses this, purpose unkown */
 	eSmartPtrList<iObject> m_clients;
@@ -193,7 +195,26 @@ class eMainloop
 	friend class eSocketNotifier;
 
 	std::map<int, eSocketNotifier*> notifiers;
-	ePtrList<eTimer> m_timer_list;
+	/* poll set of all running notifiers, updated when they are started or stopped */
+	std::vector<pollfd> m_pollfds;
+	std::vector<eSocketNotifier*> m_pollNotifiers;
+	/* notifiers started since the last poll, they get state 1 when polled */
+	std::vector<eSocketNotifier*> m_newNotifiers;
+	/* epoll instance of the running notifiers, -1 when they are polled with m_pollfds */
+	int m_epollfd;
+	struct EpollBatch
+	{
+		struct epoll_event *events;
+		int count;
+		EpollBatch *outer;
+	};
+	/* ready events being dispatched, entries of stopped notifiers are cleared */
+	EpollBatch *m_epollBatch;
+	static bool s_useEpoll;
+	/* binary min heap of the active timers, ordered by activation and start order */
+	std::vector<eTimer*> m_timers;
+	unsigned long long m_timerSequence;
+	unsigned long long m_iterations, m_timerFires, m_pollWakeups, m_pollTimeouts, m_pollSignals;
 	bool app_quit_now;
 	int retval;
 	eSocketNotifier *m_inActivate;
@@ -207,18 +228,27 @@ class eMainloop
 	int processOneEvent(long user_timeout, PyObject **res=0, ePyObject additional=ePyObject());
 	void addSocketNotifier(eSocketNotifier *sn);
 	void removeSocketNotifier(eSocketNotifier *sn);
+	void updateSocketNotifier(eSocketNotifier *sn);
+	void watchNotifier(eSocketNotifier *sn);
+	void rebuildEpoll();
+	void activateNotifier(eSocketNotifier *sn, int revents);
+	void dispatchEpoll();
 	void addTimer(eTimer* e);
 	void removeTimer(eTimer* e);
+	static bool timerBefore(const eTimer *a, const eTimer *b);
+	void timerSiftUp(int index);
+	void timerSiftDown(int index);
 	static ePtrList<eMainloop> existing_loops;
 	static bool isValid(eMainloop *);
 public:
-	eMainloop()
-		:app_quit_now(0), retval(0), m_inActivate(0), m_interrupt_requested(0)
-	{
-		existing_loops.push_back(this);
-	}
+	eMainloop();
 	virtual ~eMainloop();
 
+#ifndef SWIG
+	/* use epoll instead of poll for the notifiers of mainloops created afterwards */
+	static void setUseEpoll(bool enable) { s_useEpoll = enable; }
+#endif
+
 #ifndef SWIG
 	void quit(int ret=0); // leave all pending loops (recursive leave())
 #endif
@@ -239,6 +269,10 @@ public:
 	void interruptPoll();
 	void reset();
 
+	/* counters of loop iterations, timer activations and poll results */
+	PyObject *getStatistics();
+	void resetStatistics();
+
 protected:
 	virtual int _poll(struct pollfd *fds, nfds_t nfds, int timeout);
 };
@@ -287,9 +321,11 @@ class eTimer: iObject
 	long interval;
 	bool bSingleShot;
 	bool bActive;
+	int m_heapIndex; // in eMainloop::m_timers, -1 when not queued
+	unsigned long long m_sequence;
 
 	void activate();
-	eTimer(eMainloop *context): context(*context), bActive(false) { }
+	eTimer(eMainloop *context): context(*context), bActive(false), m_heapIndex(-1), m_sequence(0) { }
 public:
 	/**
 	 * \brief Constructs a timer.
@@ -122,6 +122,10 @@ public:
 	{
 		pthread_cond_signal(&m_cond);
 	}
+	void broadcast()
+	{
+		pthread_cond_broadcast(&m_cond);
+	}
 	void wait(pthread_mutex_t& mutex)
 	{
 		pthread_cond_wait(&m_cond, &mutex);
@@ -446,28 +446,52 @@ static inline unsigned int recode(unsigned char d, int cp)
 	}
 }
 
-std::string UnicodeToUTF8(long c)
+static inline void appendUTF8(std::string &out, long c)
 {
-	if ( c < 0x80 ) {
-		char utf[2] = {static_cast<char>(c), 0};
-		return std::string(utf, 1);
-	}
+	if ( c < 0x80 )
+		out += static_cast<char>(c);
 	else if ( c < 0x800) {
-		char utf[3] = { static_cast<char>(0xc0 | (c >> 6)), static_cast<char>(0x80 | (c & 0x3f)), 0};
-		return std::string(utf, 2);
+		char utf[2] = { static_cast<char>(0xc0 | (c >> 6)), static_cast<char>(0x80 | (c & 0x3f))};
+		out.append(utf, 2);
 	}
 	else if ( c < 0x10000) {
-		char utf[4] = { static_cast<char>(0xe0 | (c >> 12)), static_cast<char>(0x80 | ((c >> 6) & 0x3f)),
-				static_cast<char>(0x80 | (c & 0x3f)), 0};
-		return std::string(utf, 3);
+		char utf[3] = { static_cast<char>(0xe0 | (c >> 12)), static_cast<char>(0x80 | ((c >> 6) & 0x3f)),
+				static_cast<char>(0x80 | (c & 0x3f))};
+		out.append(utf, 3);
 	}
 	else if ( c < 0x200000) {
-		char utf[5] = { static_cast<char>(0xf0 | (c >> 18)), static_cast<char>(0x80 | ((c >> 12) & 0x3f)),
-				static_cast<char>(0x80 | ((c >> 6) & 0x3f)), static_cast<char>(0x80 | (c & 0x3f)), 0};
-		return std::string(utf, 4);
+		char utf[4] = { static_cast<char>(0xf0 | (c >> 18)), static_cast<char>(0x80 | ((c >> 12) & 0x3f)),
+				static_cast<char>(0x80 | ((c >> 6) & 0x3f)), static_cast<char>(0x80 | (c & 0x3f))};
+		out.append(utf, 4);
+	}
+	else
+		eDebug("[UnicodeToUTF8] invalid unicode character: code=0x%08lx", c); // not a valid unicode
+}
+
+std::string UnicodeToUTF8(long c)
+{
+	std::string utf;
+	appendUTF8(utf, c);
+	return utf;
+}
+
+/*
+ * length of the run of 7-bit characters (without NUL) at the start of data,
+ * checked eight bytes at a time
+ */
+static inline int asciiRun(const unsigned char *data, int len)
+{
+	int i = 0;
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64_t v;
+		memcpy(&v, data + i, sizeof(v));
+		if ((v | ((v - 0x0101010101010101ULL) & ~v)) & 0x8080808080808080ULL)
+			break;
 	}
-	eDebug("[UnicodeToUTF8] invalid unicode character: code=0x%08lx", c); // not a valid unicode
-	return "";
+	while (i < len && (unsigned int)(data[i] - 1) < 0x7F)
+		++i;
+	return i;
 }
 
 std::string GB18030ToUTF8(const char *szIn, int len, int *pconvertedLen)
@@ -566,15 +590,22 @@ std::string GEOSTD8ToUTF8(const char *szIn, int len, int *pconvertedLen)
 
 std::string convertDVBUTF8(const unsigned char *data, int len, int table, int tsidonid,int *pconvertedLen)
 {
+	std::string output;
+	convertDVBUTF8Into(output, data, len, table, tsidonid, pconvertedLen);
+	return output;
+}
+
+void convertDVBUTF8Into(std::string &output, const unsigned char *data, int len, int table, int tsidonid, int *pconvertedLen)
+{
+	output.clear();
 	if (!len){
 		if (pconvertedLen)
 			*pconvertedLen = 0;
-		return "";
+		return;
 	}
 
 	int i = 0;
 	int mask_no_tableid = 0;
-	std::string output = "";
 	bool ignore_tableid = false;
 	int convertedLen = 0;
 
@@ -703,7 +734,7 @@ std::string convertDVBUTF8(const unsigned char *data, int len, int table, int ts
 			break;
 		}
 		case UTF8_ENCODING:
-			output = std::string((char*)data + i, len - i);
+			output.assign((char*)data + i, len - i);
 			convertedLen += i;
 			break;
 		case GB18030_ENCODING:
@@ -719,9 +750,20 @@ std::string convertDVBUTF8(const unsigned char *data, int len, int table, int ts
 			convertedLen += i;
 			break;
 		default:
-			std::string res = "";
+		{
+			const bool wide = table == UTF16BE_ENCODING || table == UNICODE_ENCODING || table == UTF16LE_ENCODING;
+			if (i < len)
+				output.reserve(len - i);
 			while (i < len)
 			{
+				if (!wide && (unsigned int)(data[i] - 1) < 0x7F)
+				{
+					// 7-bit characters are the same in every single byte table
+					int run = asciiRun(data + i, len - i);
+					output.append((const char*)data + i, run);
+					i += run;
+					continue;
+				}
 				unsigned long code = 0;
 				if (useTwoCharMapping && i+1 < len && (code = doVideoTexSuppl(data[i], data[i+1])))
 					i += 2;
@@ -738,7 +780,10 @@ std::string convertDVBUTF8(const unsigned char *data, int len, int table, int ts
 					else if (i+4 < len) {
 						unsigned long w2 = ((unsigned long)(data[i+2]) << 8) | ((unsigned long)(data[i+3]));
 						if (w2 < 0xDC00UL || w2 > 0xDFFFUL)
-							return std::string("");
+						{
+							output.clear();
+							return;
+						}
 						code = 0x10000UL + (((w1 & 0x03FFUL) << 10 ) | (w2 & 0x03FFUL));
 						i += 4;
 					}
@@ -770,11 +815,11 @@ std::string convertDVBUTF8(const unsigned char *data, int len, int table, int ts
 
 				if (!code)
 					continue;
-				res += UnicodeToUTF8(code);
+				appendUTF8(output, code);
 			}
 			convertedLen = i;
-			output = res;
 			break;
+		}
 	}
 
 	if (pconvertedLen)
@@ -789,12 +834,14 @@ std::string convertDVBUTF8(const unsigned char *data, int len, int table, int ts
 		string_to_hex(std::string((char*)data, len < 15 ? len : 15)).c_str(),
 		output.c_str());
 */
+	// all control characters below start with 0xC2 or 0xEE
+	if (output.find_first_of("\xC2\xEE") == std::string::npos)
+		return;
+
 	// replace EIT CR/LF with standard newline:
 	output = replace_all(replace_all(output, "\xC2\x8A", "\n"), "\xEE\x82\x8A", "\n");
 	// remove character emphasis control characters:
 	output = replace_all(replace_all(replace_all(replace_all(output, "\xC2\x86", ""), "\xEE\x82\x86", ""), "\xC2\x87", ""), "\xEE\x82\x87", "");
-
-	return output;
 }
 
 std::string convertUTF8DVB(const std::string &string, int table)
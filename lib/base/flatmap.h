@@ -0,0 +1,131 @@
+#ifndef __lib_base_flatmap_h
+#define __lib_base_flatmap_h
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/*
+ * Sorted vector with the subset of the std::map interface the EPG cache
+ * uses. Lookups are binary searches over contiguous memory and there is no
+ * per element node allocation.
+ *
+ * Unlike std::map, insert and erase invalidate all iterators at or behind
+ * the modified position. erase returns the iterator to the next element,
+ * so loops have to use "it = erase(it)" instead of "erase(it++)".
+ */
+template <class K, class V>
+class eFlatMap
+{
+public:
+	typedef K key_type;
+	typedef V mapped_type;
+	typedef std::pair<K, V> value_type;
+	typedef typename std::vector<value_type>::iterator iterator;
+	typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+	iterator begin() { return m_data.begin(); }
+	iterator end() { return m_data.end(); }
+	const_iterator begin() const { return m_data.begin(); }
+	const_iterator end() const { return m_data.end(); }
+	size_t size() const { return m_data.size(); }
+	bool empty() const { return m_data.empty(); }
+	void clear() { std::vector<value_type>().swap(m_data); }
+	void reserve(size_t n) { m_data.reserve(n); }
+	size_t capacity() const { return m_data.capacity(); }
+
+	iterator lower_bound(const K &key)
+	{
+		return std::lower_bound(m_data.begin(), m_data.end(), key, keyLess());
+	}
+	const_iterator lower_bound(const K &key) const
+	{
+		return std::lower_bound(m_data.begin(), m_data.end(), key, keyLess());
+	}
+	iterator upper_bound(const K &key)
+	{
+		return std::upper_bound(m_data.begin(), m_data.end(), key, keyLess());
+	}
+	const_iterator upper_bound(const K &key) const
+	{
+		return std::upper_bound(m_data.begin(), m_data.end(), key, keyLess());
+	}
+	iterator find(const K &key)
+	{
+		iterator it = lower_bound(key);
+		return (it != m_data.end() && !(key < it->first)) ? it : m_data.end();
+	}
+	const_iterator find(const K &key) const
+	{
+		const_iterator it = lower_bound(key);
+		return (it != m_data.end() && !(key < it->first)) ? it : m_data.end();
+	}
+	size_t count(const K &key) const { return find(key) != end(); }
+
+	std::pair<iterator, bool> insert(const value_type &value)
+	{
+		iterator it = lower_bound(value.first);
+		if (it != m_data.end() && !(value.first < it->first))
+			return std::make_pair(it, false);
+		return std::make_pair(m_data.insert(it, value), true);
+	}
+	/* the hint is ignored, new events are usually appended anyway */
+	iterator insert(iterator, const value_type &value)
+	{
+		return insert(value).first;
+	}
+	V &operator[](const K &key)
+	{
+		iterator it = lower_bound(key);
+		if (it == m_data.end() || key < it->first)
+			it = m_data.insert(it, value_type(key, V()));
+		return it->second;
+	}
+
+	iterator erase(iterator it) { return m_data.erase(it); }
+	size_t erase(const K &key)
+	{
+		iterator it = find(key);
+		if (it == m_data.end())
+			return 0;
+		m_data.erase(it);
+		return 1;
+	}
+
+	/*
+	 * Bulk loading: append in any order and sort once, which is much cheaper
+	 * than inserting one by one. For equal keys the first appended element
+	 * is kept, the others are returned in dropped.
+	 */
+	void append(const value_type &value) { m_data.push_back(value); }
+	void sort(std::vector<value_type> *dropped = NULL)
+	{
+		std::stable_sort(m_data.begin(), m_data.end(), valueLess());
+		iterator out = m_data.begin();
+		for (iterator it = m_data.begin(); it != m_data.end(); ++it)
+		{
+			if (out != m_data.begin() && !((out - 1)->first < it->first))
+			{
+				if (dropped)
+					dropped->push_back(*it);
+				continue;
+			}
+			*out++ = *it;
+		}
+		m_data.erase(out, m_data.end());
+	}
+
+private:
+	struct keyLess
+	{
+		bool operator()(const value_type &a, const K &b) const { return a.first < b; }
+		bool operator()(const K &a, const value_type &b) const { return a < b.first; }
+	};
+	struct valueLess
+	{
+		bool operator()(const value_type &a, const value_type &b) const { return a.first < b.first; }
+	};
+	std::vector<value_type> m_data;
+};
+
+#endif
@@ -49,11 +49,29 @@ struct huffTableEntry
 	{ }
 };
 
+/*
+ * Entry of the lookup table of one context, indexed by the next 8 bits.
+ * Codes of up to 8 bits are resolved with a single lookup. Slots sharing
+ * their first bits with a longer code that comes first in the list are
+ * marked to be scanned in the list, so the first matching entry still wins.
+ */
+struct huffLookupEntry
+{
+	uint8_t bits; // 0 if no code of up to 8 bits matches
+	uint8_t scan;
+	char next;
+};
+
 freesatHuffmanDecoder::freesatHuffmanDecoder()
 {
 	memset(m_tables, 0, sizeof(m_tables));
+	memset(m_lookup, 0, sizeof(m_lookup));
 	loadFile(&m_tables[0][0], TABLE1_FILENAME);
 	loadFile(&m_tables[1][0], TABLE2_FILENAME);
+	for (int j = 0; j < 2; j++)
+		for (int i = 0; i < 256; i++)
+			if (m_tables[j][i])
+				buildLookup(j, i);
 }
 
 freesatHuffmanDecoder::~freesatHuffmanDecoder()
@@ -72,10 +90,38 @@ freesatHuffmanDecoder::~freesatHuffmanDecoder()
 				currentEntry = nextEntry;
 			}
 			m_tables[j][i] = NULL;
+			delete [] m_lookup[j][i];
+			m_lookup[j][i] = NULL;
 		}
 	}
 }
 
+void freesatHuffmanDecoder::buildLookup(int table_index, int lastch)
+{
+	huffLookupEntry *lookup = new huffLookupEntry[256];
+	memset(lookup, 0, sizeof(huffLookupEntry) * 256);
+	for (huffTableEntry *currentEntry = m_tables[table_index][lastch]; currentEntry != NULL; currentEntry = currentEntry->nextEntry)
+	{
+		unsigned int first = currentEntry->value >> 24;
+		unsigned int count = currentEntry->bits > 0 && currentEntry->bits < 8 ? 1 << (8 - currentEntry->bits) : 1;
+		if (currentEntry->bits == 0)
+			count = 256;
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			if (lookup[i].bits || lookup[i].scan)
+				continue;
+			if (currentEntry->bits > 0 && currentEntry->bits <= 8)
+			{
+				lookup[i].bits = currentEntry->bits;
+				lookup[i].next = currentEntry->next;
+			}
+			else
+				lookup[i].scan = 1;
+		}
+	}
+	m_lookup[table_index][lastch] = lookup;
+}
+
 
 /** \brief Convert a textual character description into a value
 *
@@ -193,7 +239,22 @@ static void loadFile(huffTableEntry **table, const char *filename)
 *  \retval NULL - Can't decode
 *  \return A decoded string
 */
+/* 32 bits of the encoded string starting at bit pos, zero padded after the end */
+static inline uint32_t peekBits(const unsigned char *src, size_t size, unsigned int pos)
+{
+	size_t byte = 2 + (pos >> 3);
+	uint64_t window = 0;
+	for (int i = 0; i < 5; i++, byte++)
+		window = (window << 8) | (byte < size ? src[byte] : 0);
+	return window >> (8 - (pos & 7));
+}
+
 std::string freesatHuffmanDecoder::decode(const unsigned char *src, size_t size)
+{
+	return decode(src, size, true);
+}
+
+std::string freesatHuffmanDecoder::decode(const unsigned char *src, size_t size, bool lookup)
 {
 	std::string uncompressed;
 
@@ -205,16 +266,12 @@ std::string freesatHuffmanDecoder::decode(const unsigned char *src, size_t size)
 	if (table_index <= 1)
 	{
 		huffTableEntry **table = &m_tables[table_index][0];
-		unsigned int value = 0;
-		unsigned int byte = 2;
-		unsigned int bit = 0;
+		huffLookupEntry **lookupTable = &m_lookup[table_index][0];
+		unsigned int pos = 0;
+		unsigned int value = peekBits(src, size, pos);
 		int lastch = START;
 
-		while (byte < 6 && byte < size)
-		{
-			value |= src[byte] << ((5-byte) * 8);
-			byte++;
-		}
+		uncompressed.reserve(size * 2);
 
 		do
 		{
@@ -233,48 +290,50 @@ std::string freesatHuffmanDecoder::decode(const unsigned char *src, size_t size)
 			}
 			else
 			{
-				huffTableEntry * currentEntry = table[lastch];
-				while ( currentEntry != NULL )
+				const huffLookupEntry *context = lookupTable[(unsigned char)lastch];
+				char nextCh = STOP;
+				if (lookup && context && context[value >> 24].bits)
 				{
-					unsigned mask = 0, maskbit = 0x80000000;
-					short kk;
-					for ( kk = 0; kk < currentEntry->bits; kk++)
-					{
-						mask |= maskbit;
-						maskbit >>= 1;
-					}
-					if ((value & mask) == currentEntry->value)
+					found = 1;
+					bitShift = context[value >> 24].bits;
+					nextCh = context[value >> 24].next;
+				}
+				else if (!lookup || (context && context[value >> 24].scan))
+				{
+					huffTableEntry * currentEntry = table[(unsigned char)lastch];
+					while ( currentEntry != NULL )
 					{
-						char nextCh = currentEntry->next;
-						bitShift = currentEntry->bits;
-						if (nextCh != STOP && nextCh != ESCAPE)
+						unsigned mask = 0, maskbit = 0x80000000;
+						short kk;
+						for ( kk = 0; kk < currentEntry->bits; kk++)
 						{
-							uncompressed.append(&nextCh, 1);
+							mask |= maskbit;
+							maskbit >>= 1;
 						}
-						found = 1;
-						lastch = nextCh;
-						break;
+						if ((value & mask) == currentEntry->value)
+						{
+							found = 1;
+							bitShift = currentEntry->bits;
+							nextCh = currentEntry->next;
+							break;
+						}
+						currentEntry = currentEntry->nextEntry;
 					}
-					currentEntry = currentEntry->nextEntry;
 				}
-			}
-			if (found)
-			{
-				// Shift up by the number of bits.
-				unsigned b;
-				for ( b = 0; b < bitShift; b++)
+				if (found)
 				{
-					value = (value << 1) & 0xfffffffe;
-					if (byte < size)
-						value |= (src[byte] >> (7-bit)) & 1;
-					if (bit == 7)
+					if (nextCh != STOP && nextCh != ESCAPE)
 					{
-						bit = 0;
-						byte++;
+						uncompressed.append(&nextCh, 1);
 					}
-					else bit++;
+					lastch = nextCh;
 				}
 			}
+			if (found)
+			{
+				pos += bitShift;
+				value = peekBits(src, size, pos);
+			}
 			else
 			{
 #ifdef FREESATV2_DEBUG
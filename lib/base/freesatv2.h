@@ -6,15 +6,21 @@
 #include <string>
 
 struct huffTableEntry;
+struct huffLookupEntry;
 
 class freesatHuffmanDecoder
 {
 private:
 	huffTableEntry *m_tables[2][256];
+	/* indexed by the next 8 bits, per table and previous character */
+	huffLookupEntry *m_lookup[2][256];
+	void buildLookup(int table_index, int lastch);
 public:
 	freesatHuffmanDecoder();
 	~freesatHuffmanDecoder();
 	std::string decode(const unsigned char *src, size_t size);
+	/* without lookup, only the table lists are used, the reference for the lookup tables */
+	std::string decode(const unsigned char *src, size_t size, bool lookup);
 };
 #endif
 
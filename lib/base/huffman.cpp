@@ -2,13 +2,55 @@
 #include <strings.h>
 #include <memory.h>
 #include <malloc.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
 #include <lib/base/huffman.h>
 #include <lib/base/eerror.h>
 
 #define HUFFMAN_MAX_SIZE 4096
 
+/*
+ * define as the path of a corpus file to benchmark the table decoder against
+ * the tree walker: titles are recorded (hex, one per line) while decoding, and
+ * the recorded corpus is decoded with both when the next dictionary is read.
+ */
+// #define HUFFMAN_BENCHMARK "/tmp/opentv_titles.corpus"
+
+#ifdef HUFFMAN_BENCHMARK
+#include <string>
+#include <lib/base/benchmark.h>
+#define HUFFMAN_BENCHMARK_TITLES 20000
+static void huffman_benchmark (const char *corpus);
+#endif
+
 type_huffman_node huffman_root;
 
+/*
+ * Lookup tables built from the tree once the dictionary is read, so a code
+ * is decoded HUFFMAN_TABLE_BITS bits at a time instead of bit by bit.
+ *
+ * Each table belongs to a tree node and is indexed by the next bits of the
+ * input. An entry holds the symbol reached within those bits, the bit
+ * position where the walk failed, or the table of the node reached after
+ * all HUFFMAN_TABLE_BITS bits for codes longer than that.
+ */
+#define HUFFMAN_TABLE_BITS 8
+#define HUFFMAN_TABLE_SIZE (1 << HUFFMAN_TABLE_BITS)
+
+enum { HUFFMAN_INVALID, HUFFMAN_SYMBOL, HUFFMAN_TABLE };
+
+struct huffman_table_entry
+{
+	uint8_t type;
+	uint8_t bits; // consumed by the entry
+	uint16_t length; // of the symbol
+	uint32_t index; // offset of the symbol in huffman_values, or table number
+};
+
+static std::vector<huffman_table_entry> huffman_tables;
+static std::vector<char> huffman_values;
+
 bool huffman_read_dictionary (char *file)
 {
 	FILE *fd;
@@ -112,12 +154,80 @@ bool huffman_read_dictionary (char *file)
 	fclose (fd);
 	eDebug("[huffman] read.. dictionary completed, read %d values", count);
 
+	huffman_build_tables ();
+
+#ifdef HUFFMAN_BENCHMARK
+	huffman_benchmark (HUFFMAN_BENCHMARK);
+#endif
+
 	return true;
 }
 
+static int huffman_build_table (type_huffman_node *root, std::map<type_huffman_node*, int> &built, std::map<type_huffman_node*, uint32_t> &values)
+{
+	int table = huffman_tables.size() / HUFFMAN_TABLE_SIZE;
+	built[root] = table;
+	huffman_tables.resize(huffman_tables.size() + HUFFMAN_TABLE_SIZE);
+
+	for (int bits = 0; bits < HUFFMAN_TABLE_SIZE; bits++)
+	{
+		huffman_table_entry entry = { HUFFMAN_TABLE, HUFFMAN_TABLE_BITS, 0, 0 };
+		type_huffman_node *node = root;
+		int i;
+
+		for (i = 0; i < HUFFMAN_TABLE_BITS; i++)
+		{
+			node = (bits >> (HUFFMAN_TABLE_BITS - 1 - i)) & 1 ? node->p1 : node->p0;
+			if (node == NULL)
+			{
+				entry.type = HUFFMAN_INVALID;
+				entry.bits = i + 1;
+				break;
+			}
+			if (node->value != NULL)
+			{
+				std::map<type_huffman_node*, uint32_t>::iterator it = values.find(node);
+				if (it == values.end())
+				{
+					it = values.insert(std::make_pair(node, (uint32_t)huffman_values.size())).first;
+					huffman_values.insert(huffman_values.end(), node->value, node->value + strlen(node->value));
+				}
+				entry.type = HUFFMAN_SYMBOL;
+				entry.bits = i + 1;
+				entry.length = strlen(node->value);
+				entry.index = it->second;
+				break;
+			}
+		}
+
+		if (i == HUFFMAN_TABLE_BITS)
+		{
+			std::map<type_huffman_node*, int>::iterator it = built.find(node);
+			/* the recursion grows huffman_tables, so don't keep a reference */
+			entry.index = it != built.end() ? it->second : huffman_build_table(node, built, values);
+		}
+
+		huffman_tables[table * HUFFMAN_TABLE_SIZE + bits] = entry;
+	}
+	return table;
+}
+
+void huffman_build_tables ()
+{
+	std::map<type_huffman_node*, int> built;
+	std::map<type_huffman_node*, uint32_t> values;
+
+	huffman_tables.clear();
+	huffman_values.clear();
+	huffman_build_table(&huffman_root, built, values);
+	eDebug("[huffman] built %d lookup tables", (int)(huffman_tables.size() / HUFFMAN_TABLE_SIZE));
+}
+
 void huffman_free_dictionary ()
 {
 	huffman_free_node (&huffman_root);
+	std::vector<huffman_table_entry>().swap(huffman_tables);
+	std::vector<char>().swap(huffman_values);
 }
 
 void huffman_free_node (type_huffman_node *node)
@@ -137,7 +247,8 @@ void huffman_free_node (type_huffman_node *node)
 	if (node->value != NULL) free (node->value);
 }
 
-bool huffman_decode (const unsigned char *data, int length, char *result, int result_max_length, bool huffman_debug)
+/* decode one bit at a time, only used for debugging and benchmarking */
+static bool huffman_decode_tree (const unsigned char *data, int length, char *result, int result_max_length, bool huffman_debug)
 {
 	type_huffman_node *node = &huffman_root;
 	unsigned char byte;
@@ -202,7 +313,7 @@ bool huffman_decode (const unsigned char *data, int length, char *result, int re
 
 				if ((int)(index + strlen(node->value)) >= (result_max_length - 1))
 				{
-					size = result_max_length - length - 1;
+					size = result_max_length - 1 - index;
 					too_long = true;
 				}
 				else size = strlen(node->value);
@@ -238,3 +349,135 @@ bool huffman_decode (const unsigned char *data, int length, char *result, int re
 		return false;
 	}
 }
+
+/* HUFFMAN_TABLE_BITS bits starting at bit position pos, zero padded after the end */
+static inline unsigned int huffman_peek (const unsigned char *data, int length, int pos)
+{
+	int byte = pos >> 3;
+	unsigned int window = data[byte] << 16;
+	if (byte + 1 < length)
+		window |= data[byte + 1] << 8;
+	if (byte + 2 < length)
+		window |= data[byte + 2];
+	return (window >> (24 - HUFFMAN_TABLE_BITS - (pos & 7))) & (HUFFMAN_TABLE_SIZE - 1);
+}
+
+static bool huffman_decode_table (const unsigned char *data, int length, char *result, int result_max_length)
+{
+	/* the top two bits of the first byte are not part of the code */
+	int pos = 2;
+	const int end = length * 8;
+	int index = 0;
+	unsigned int table = 0;
+
+	if (result_max_length > HUFFMAN_MAX_SIZE) result_max_length = HUFFMAN_MAX_SIZE;
+
+	while (pos < end)
+	{
+		const huffman_table_entry &entry = huffman_tables[table * HUFFMAN_TABLE_SIZE + huffman_peek (data, length, pos)];
+
+		/* an incomplete code at the end is ignored, like the padding bits */
+		if (pos + entry.bits > end)
+			break;
+
+		pos += entry.bits;
+		if (entry.type == HUFFMAN_TABLE)
+		{
+			table = entry.index;
+			continue;
+		}
+		if (entry.type == HUFFMAN_INVALID)
+		{
+			eDebug("[huffman] Error. Cannot decode Huffman data");
+			result[index] = '\0';
+			return false;
+		}
+
+		int size = entry.length;
+		if (index + size >= result_max_length - 1)
+		{
+			memcpy (result + index, &huffman_values[entry.index], result_max_length - 1 - index);
+			index = result_max_length - 1;
+			eDebug("[huffman] Warning. Huffman string is too long. Truncated");
+			break;
+		}
+		memcpy (result + index, &huffman_values[entry.index], size);
+		index += size;
+		table = 0;
+	}
+
+	result[index] = '\0';
+	return true;
+}
+
+bool huffman_decode (const unsigned char *data, int length, char *result, int result_max_length, bool huffman_debug)
+{
+#ifdef HUFFMAN_BENCHMARK
+	static int recorded = 0;
+	if (recorded < HUFFMAN_BENCHMARK_TITLES)
+	{
+		FILE *corpus = fopen (HUFFMAN_BENCHMARK, "a");
+		if (corpus)
+		{
+			for (int i = 0; i < length; i++)
+				fprintf (corpus, "%02x", data[i]);
+			fprintf (corpus, "\n");
+			fclose (corpus);
+			recorded++;
+		}
+	}
+#endif
+
+	if (huffman_debug || huffman_tables.empty())
+		return huffman_decode_tree (data, length, result, result_max_length, huffman_debug);
+	return huffman_decode_table (data, length, result, result_max_length);
+}
+
+#ifdef HUFFMAN_BENCHMARK
+static void huffman_benchmark (const char *corpus)
+{
+	FILE *fd = fopen (corpus, "r");
+	if (!fd)
+		return;
+
+	std::vector<std::string> titles;
+	char line[2 * HUFFMAN_MAX_SIZE + 2];
+	while (fgets (line, sizeof(line), fd))
+	{
+		std::string title;
+		unsigned int byte;
+		for (const char *p = line; sscanf (p, "%02x", &byte) == 1; p += 2)
+			title.push_back((char)byte);
+		if (!title.empty())
+			titles.push_back(title);
+	}
+	fclose (fd);
+	if (titles.empty())
+		return;
+
+	char tree_result[HUFFMAN_MAX_SIZE], table_result[HUFFMAN_MAX_SIZE];
+	size_t bytes = 0;
+	int mismatches = 0;
+	unsigned int tree_us = 0, table_us = 0;
+	Stopwatch s;
+
+	for (std::vector<std::string>::const_iterator it(titles.begin()); it != titles.end(); ++it)
+	{
+		const unsigned char *data = (const unsigned char*)it->data();
+		bytes += it->size();
+		s.start();
+		bool tree_ok = huffman_decode_tree (data, it->size(), tree_result, sizeof(tree_result), false);
+		s.stop();
+		tree_us += s.elapsed_us();
+		s.start();
+		bool table_ok = huffman_decode_table (data, it->size(), table_result, sizeof(table_result));
+		s.stop();
+		table_us += s.elapsed_us();
+		if (tree_ok != table_ok || (tree_ok && strcmp (tree_result, table_result)))
+			mismatches++;
+	}
+
+	eDebug("[huffman] [BENCH] %d titles, %d bytes: tree %u us, table %u us, %d mismatches",
+		(int)titles.size(), (int)bytes, tree_us, table_us, mismatches);
+}
+#endif
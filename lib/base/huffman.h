@@ -9,6 +9,7 @@ typedef struct struct_huffman_node
 } type_huffman_node;
 
 bool huffman_read_dictionary (char *file);
+void huffman_build_tables ();
 void huffman_free_dictionary ();
 void huffman_free_node (type_huffman_node *node);
 bool huffman_decode (const unsigned char *data, int length, char *result, int result_max_length, bool huffman_debug);
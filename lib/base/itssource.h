@@ -20,6 +20,10 @@ public:
 	virtual off_t offset() = 0;
 	virtual bool isStream() { return false; }
 	virtual int reconnect() { return 0; }
+	/* hint that this range is going to be read soon */
+	virtual void prefetch(off_t offset, size_t count) {}
+	/* first offset which can be read, the start of a ring buffer file moves on */
+	virtual off_t firstOffset() { return 0; }
 	unsigned int getPacketSize() const { return packetSize; }
 };
 
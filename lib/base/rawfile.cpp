@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <lib/base/rawfile.h>
@@ -29,6 +30,8 @@ int eRawFile::open(const char *filename)
 {
 	close();
 	m_basename = filename;
+	if (m_ring.open(m_basename) == 0)
+		eDebug("[eRawFile] %s is a ring buffer", filename);
 	scan();
 	m_current_offset = 0;
 	m_last_offset = 0;
@@ -65,6 +68,37 @@ ssize_t eRawFile::read(off_t offset, void *buf, size_t count)
 {
 	eSingleLocker l(m_lock);
 
+	if (m_ring.valid())
+	{
+		eRingFile::State state;
+		m_ring.get(state);
+		if (offset < state.begin)
+		{
+			/* overwritten already */
+			errno = ENXIO;
+			return -1;
+		}
+		if (offset >= state.end)
+			return 0;
+		if ((off_t)count > state.end - offset)
+			count = state.end - offset;
+		off_t where = offset % state.size;
+		/* a short read at the end of the file, the rest is at its start */
+		if ((off_t)count > state.size - where)
+			count = state.size - where;
+		ssize_t ret = ::pread(m_fd, buf, count, where);
+		/* the writer may have overwritten the data while it was read */
+		m_ring.get(state);
+		if (ret > 0 && offset < state.begin)
+		{
+			errno = ENXIO;
+			return -1;
+		}
+		if (ret > 0)
+			m_last_offset = offset + ret;
+		return ret;
+	}
+
 	if (offset != m_current_offset)
 	{
 		m_current_offset = lseek_internal(offset);
@@ -91,6 +125,30 @@ ssize_t eRawFile::read(off_t offset, void *buf, size_t count)
 	return ret;
 }
 
+void eRawFile::prefetch(off_t offset, size_t count)
+{
+	eSingleLocker l(m_lock);
+	if (m_fd < 0)
+		return;
+	off_t base = 0;
+	if (m_ring.valid())
+	{
+		eRingFile::State state;
+		m_ring.get(state);
+		base = offset - offset % state.size;
+		if ((off_t)count > state.size - (offset - base))
+			count = state.size - (offset - base);
+	}
+	else if (m_splitsize)
+	{
+		/* only within the file that is open */
+		base = m_splitsize * m_current_file;
+		if (offset < base || offset >= base + m_splitsize)
+			return;
+	}
+	posix_fadvise(m_fd, offset - base, count, POSIX_FADV_WILLNEED);
+}
+
 int eRawFile::valid()
 {
 	return m_fd != -1;
@@ -156,6 +214,12 @@ int eRawFile::openFileUncached(int nr)
 
 off_t eRawFile::length()
 {
+	if (m_ring.valid())
+	{
+		eRingFile::State state;
+		m_ring.get(state);
+		return state.end;
+	}
 	if (m_nrfiles >= 2)
 	{
 		return m_totallength;
@@ -169,6 +233,15 @@ off_t eRawFile::length()
 	}
 }
 
+off_t eRawFile::firstOffset()
+{
+	if (!m_ring.valid())
+		return 0;
+	eRingFile::State state;
+	m_ring.get(state);
+	return state.begin;
+}
+
 off_t eRawFile::offset()
 {
 	return m_last_offset;
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <lib/base/itssource.h>
+#include <lib/base/ringfile.h>
 
 class eRawFile: public iTsSource
 {
@@ -18,6 +19,8 @@ public:
 	off_t length();
 	off_t offset();
 	int valid();
+	void prefetch(off_t offset, size_t count);
+	off_t firstOffset();
 private:
 	int m_fd;
 	int m_nrfiles;
@@ -28,6 +31,8 @@ private:
 	off_t m_last_offset;
 	int m_current_file;
 	std::string m_basename;
+	/* set if the file is written as a ring buffer */
+	eRingFile m_ring;
 
 	int close();
 	void scan();
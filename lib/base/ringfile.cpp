@@ -0,0 +1,375 @@
+#include <errno.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include <sys/mman.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <lib/base/ringfile.h>
+#include <lib/base/eerror.h>
+#include <lib/base/init.h>
+#include <lib/base/init_num.h>
+#include <lib/base/ioprio.h>
+
+struct eRingFile::Header
+{
+	uint32_t magic;
+	volatile uint32_t sequence; // odd while being updated
+	int64_t size, begin, end;
+	int64_t sc_size, sc_begin, sc_end;
+};
+
+static const uint32_t RING_MAGIC = 0x474e4952; // "RING"
+
+eRingFile::eRingFile()
+	: m_header(NULL), m_writable(false)
+{
+}
+
+eRingFile::~eRingFile()
+{
+	close();
+}
+
+int eRingFile::map(int fd, bool writable)
+{
+	void *map = ::mmap(NULL, sizeof(Header), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+	m_header = (Header*)map;
+	m_writable = writable;
+	return 0;
+}
+
+int eRingFile::create(const std::string &filename, off_t size, off_t sc_size)
+{
+	close();
+	int fd = ::open((filename + ".ring").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return -1;
+	Header header = {};
+	header.magic = RING_MAGIC;
+	header.size = size;
+	header.sc_size = sc_size;
+	if (::write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header))
+	{
+		eDebug("[eRingFile] failed to create %s.ring: %m", filename.c_str());
+		::close(fd);
+		return -1;
+	}
+	return map(fd, true);
+}
+
+int eRingFile::open(const std::string &filename, bool writable)
+{
+	close();
+	int fd = ::open((filename + ".ring").c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	struct stat st;
+	if (::fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(Header))
+	{
+		::close(fd);
+		return -1;
+	}
+	if (map(fd, writable) < 0)
+		return -1;
+	if (m_header->magic != RING_MAGIC || m_header->size <= 0)
+	{
+		eDebug("[eRingFile] %s.ring is invalid", filename.c_str());
+		close();
+		return -1;
+	}
+	return 0;
+}
+
+void eRingFile::close()
+{
+	if (m_header)
+	{
+		::munmap(m_header, sizeof(Header));
+		m_header = NULL;
+	}
+	m_writable = false;
+}
+
+void eRingFile::get(State &state) const
+{
+	uint32_t sequence;
+	/* a writer which died while updating leaves an odd sequence behind */
+	int tries = 1000;
+	do
+	{
+		while (((sequence = m_header->sequence) & 1) && --tries > 0)
+			sched_yield();
+		__sync_synchronize();
+		state.size = m_header->size;
+		state.begin = m_header->begin;
+		state.end = m_header->end;
+		state.sc_size = m_header->sc_size;
+		state.sc_begin = m_header->sc_begin;
+		state.sc_end = m_header->sc_end;
+		__sync_synchronize();
+	}
+	while (m_header->sequence != sequence && tries > 0);
+}
+
+void eRingFile::setData(off_t begin, off_t end)
+{
+	if (!m_writable)
+		return;
+	++m_header->sequence;
+	__sync_synchronize();
+	m_header->begin = begin;
+	m_header->end = end;
+	__sync_synchronize();
+	++m_header->sequence;
+}
+
+void eRingFile::setStructure(off_t begin, off_t end)
+{
+	if (!m_writable)
+		return;
+	++m_header->sequence;
+	__sync_synchronize();
+	m_header->sc_begin = begin;
+	m_header->sc_end = end;
+	__sync_synchronize();
+	++m_header->sequence;
+}
+
+static int writeAll(int fd, const void *buffer, size_t len)
+{
+	size_t done = 0;
+	while (done < len)
+	{
+		ssize_t r = ::write(fd, (const char*)buffer + done, len - done);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return r < 0 ? -errno : -EIO;
+		done += r;
+	}
+	return 0;
+}
+
+/* appends the len bytes of a ring of size at offset begin to out, oldest first */
+static int copyRing(int fd, off_t size, off_t begin, off_t len, int out, const volatile bool &abort)
+{
+	std::vector<char> buffer(1024 * 1024);
+	while (len > 0)
+	{
+		if (abort)
+			return -ECANCELED;
+		off_t where = begin % size;
+		ssize_t r = ::pread(fd, &buffer[0], std::min(std::min(len, size - where), (off_t)buffer.size()), where);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return r < 0 ? -errno : -EIO;
+		int err = writeAll(out, &buffer[0], r);
+		if (err < 0)
+			return err;
+		begin += r;
+		len -= r;
+	}
+	return 0;
+}
+
+/* appends the structure entries of the ring to out, relative to the oldest data and without the ones before it */
+static int copyStructure(int fd, const eRingFile::State &state, int out, const volatile bool &abort)
+{
+	unsigned long long buffer[2 * 1024];
+	off_t where = state.sc_begin, end = state.sc_end;
+	while (where < end)
+	{
+		if (abort)
+			return -ECANCELED;
+		off_t pos = where % state.sc_size;
+		ssize_t r = ::pread(fd, buffer, std::min(std::min(end - where, state.sc_size - pos), (off_t)sizeof(buffer)), pos);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0)
+			return -errno;
+		r -= r % 16;
+		if (!r)
+			break;
+		int kept = 0;
+		for (int i = 0; i < r / 16; ++i)
+		{
+			off_t offset = be64toh(buffer[i * 2]);
+			if (offset < state.begin)
+				continue;
+			if (offset != 0x7fffFFFFffffFFFFll)
+				offset -= state.begin;
+			buffer[kept * 2] = htobe64(offset);
+			buffer[kept * 2 + 1] = buffer[i * 2 + 1];
+			++kept;
+		}
+		int err = writeAll(out, buffer, kept * 16);
+		if (err < 0)
+			return err;
+		where += r;
+	}
+	return 0;
+}
+
+static bool sameFile(const std::string &filename, const struct stat &st)
+{
+	struct stat now;
+	return ::stat(filename.c_str(), &now) == 0 && now.st_dev == st.st_dev && now.st_ino == st.st_ino;
+}
+
+eRingFileUnroller *eRingFileUnroller::instance;
+
+eRingFileUnroller::eRingFileUnroller()
+	: m_running(false), m_abort(false)
+{
+	if (!instance)
+		instance = this;
+}
+
+eRingFileUnroller::~eRingFileUnroller()
+{
+	/* an unfinished file stays a ring, which can still be played */
+	m_abort = true;
+	kill();
+	if (instance == this)
+		instance = NULL;
+}
+
+void eRingFileUnroller::unroll(const std::string &filename)
+{
+	bool start = false;
+	{
+		eSingleLocker lock(m_lock);
+		m_queue.push_back(filename);
+		if (!m_running)
+			m_running = start = true;
+	}
+	if (start)
+	{
+		/* the last thread has given up the queue, join it */
+		kill();
+		if (run())
+		{
+			eWarning("[eRingFileUnroller] failed to start, %s stays a ring", filename.c_str());
+			eSingleLocker lock(m_lock);
+			m_queue.clear();
+			m_running = false;
+		}
+	}
+}
+
+void eRingFileUnroller::thread()
+{
+	hasStarted();
+	setIoPrio(IOPRIO_CLASS_BE, 7);
+	while (!m_abort)
+	{
+		std::string filename;
+		{
+			eSingleLocker lock(m_lock);
+			if (m_queue.empty())
+			{
+				m_running = false;
+				return;
+			}
+			filename = m_queue.front();
+			m_queue.pop_front();
+		}
+		int err = unrollFile(filename);
+		if (err < 0)
+			eWarning("[eRingFileUnroller] %s stays a ring: %s", filename.c_str(), strerror(-err));
+	}
+	eSingleLocker lock(m_lock);
+	m_running = false;
+}
+
+/*
+ * The plain recording is written next to the ring and renamed over it, the
+ * .ring file goes last. Until then the ring and its .ring file are
+ * untouched and can be played, moved or deleted as before; if the files
+ * were moved or deleted meanwhile, the copy is dropped.
+ */
+int eRingFileUnroller::unrollFile(const std::string &filename)
+{
+	eRingFile ring;
+	if (ring.open(filename) < 0)
+		return 0;
+	eRingFile::State state;
+	ring.get(state);
+	ring.close();
+
+	std::string sc_filename(filename + ".sc");
+	std::string tmp_filename(filename + ".unroll"), sc_tmp_filename(sc_filename + ".unroll");
+	off_t len = std::max((off_t)0, state.end - state.begin);
+	off_t sc_len = std::max((off_t)0, state.sc_end - state.sc_begin);
+	struct stat st, sc_st;
+	int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || ::fstat(fd, &st) < 0)
+	{
+		int err = -errno;
+		if (fd >= 0)
+			::close(fd);
+		return err;
+	}
+	int sc_fd = ::open(sc_filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (sc_fd >= 0 && ::fstat(sc_fd, &sc_st) < 0)
+	{
+		::close(sc_fd);
+		sc_fd = -1;
+	}
+
+	int err = 0, out = -1, sc_out = -1;
+	/* the copy needs as much room as the data in the ring, don't fill up the disk for it */
+	struct statvfs fs;
+	if (::fstatvfs(fd, &fs) == 0 && (off_t)fs.f_bavail * (off_t)fs.f_frsize < len + sc_len + (64 << 20))
+		err = -ENOSPC;
+	if (!err && (out = ::open(tmp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+		err = -errno;
+	if (!err)
+		err = copyRing(fd, state.size, state.begin, len, out, m_abort);
+	if (!err && sc_fd >= 0)
+	{
+		if ((sc_out = ::open(sc_tmp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+			err = -errno;
+		else
+			err = copyStructure(sc_fd, state, sc_out, m_abort);
+	}
+	/* the renames must not get ahead of the data */
+	if (!err && (::fdatasync(out) < 0 || (sc_out >= 0 && ::fdatasync(sc_out) < 0)))
+		err = -errno;
+	if (out >= 0)
+		::close(out);
+	if (sc_out >= 0)
+		::close(sc_out);
+	if (!err && (!sameFile(filename, st) || (sc_fd >= 0 && !sameFile(sc_filename, sc_st))))
+		err = -ESTALE;
+	if (!err && sc_fd >= 0 && ::rename(sc_tmp_filename.c_str(), sc_filename.c_str()) < 0)
+		err = -errno;
+	if (!err && ::rename(tmp_filename.c_str(), filename.c_str()) < 0)
+		err = -errno;
+	if (!err)
+	{
+		::unlink((filename + ".ring").c_str());
+		eDebug("[eRingFileUnroller] %s unrolled, %lld bytes", filename.c_str(), (long long)len);
+	}
+	else
+	{
+		::unlink(tmp_filename.c_str());
+		::unlink(sc_tmp_filename.c_str());
+	}
+	::close(fd);
+	if (sc_fd >= 0)
+		::close(sc_fd);
+	return err;
+}
+
+eAutoInitP0<eRingFileUnroller> init_eRingFileUnroller(eAutoInitNumbers::configuration+1, "Ring File Unroller");
@@ -0,0 +1,80 @@
+#ifndef __lib_base_ringfile_h
+#define __lib_base_ringfile_h
+
+#include <deque>
+#include <string>
+#include <sys/types.h>
+#include <lib/base/elock.h>
+#include <lib/base/thread.h>
+
+/*
+ * Companion of a file which is written as a ring buffer, like a timeshift
+ * file of bounded size.
+ *
+ * The file has a fixed size, and offset x is stored at x % size. So the
+ * offsets stay the same as in a normal file and keep growing, only the
+ * range [begin, end) of them can still be read. The .sc file of the ring
+ * is a ring of structure entries in the same way. Both ranges live in
+ * <file>.ring, which the writers and readers map and which is updated
+ * under a sequence counter, so reading it is cheap and needs no lock.
+ */
+#ifndef SWIG
+class eRingFile
+{
+public:
+	struct State
+	{
+		off_t size, begin, end;
+		off_t sc_size, sc_begin, sc_end; // in bytes
+	};
+
+	eRingFile();
+	~eRingFile();
+
+	/* create <filename>.ring for a new ring of the given sizes */
+	int create(const std::string &filename, off_t size, off_t sc_size);
+	/* open an existing <filename>.ring, fails if there is none */
+	int open(const std::string &filename, bool writable = false);
+	void close();
+	bool valid() const { return m_header != NULL; }
+
+	void get(State &state) const;
+	void setData(off_t begin, off_t end);
+	void setStructure(off_t begin, off_t end);
+
+private:
+	struct Header;
+	Header *m_header;
+	bool m_writable;
+
+	int map(int fd, bool writable);
+};
+#endif
+
+/*
+ * Turns rings which are no longer written, like a saved timeshift, into
+ * plain recordings starting with the oldest data, one after the other on
+ * a thread of its own. A file which can't be unrolled stays a ring with
+ * its .ring file, which can still be played.
+ */
+class eRingFileUnroller: private eThread
+{
+#ifndef SWIG
+	static eRingFileUnroller *instance;
+	eSingleLock m_lock; // protects m_queue and m_running
+	std::deque<std::string> m_queue;
+	bool m_running;
+	volatile bool m_abort;
+	void thread();
+	int unrollFile(const std::string &filename);
+public:
+	eRingFileUnroller();
+	~eRingFileUnroller();
+#endif
+public:
+	static eRingFileUnroller *getInstance() { return instance; }
+	/* queues filename, which may have been moved since it was saved */
+	void unroll(const std::string &filename);
+};
+
+#endif
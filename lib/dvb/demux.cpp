@@ -6,13 +6,18 @@
 #include <signal.h>
 #include <sys/sysinfo.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
 #include <linux/dvb/dmx.h>
 #include <lib/base/eerror.h>
 #include <lib/base/cfile.h>
+#include <lib/base/nconfig.h>
 #include <lib/dvb/idvb.h>
 #include <lib/dvb/demux.h>
 #include <lib/dvb/esection.h>
 #include <lib/dvb/decoder.h>
+#include <lib/python/python_helpers.h>
 
 #include "crc32.h"
 
@@ -150,6 +155,17 @@ RESULT eDVBDemux::createTSRecorder(ePtr<iDVBTSRecorder> &recorder, unsigned int
 	return 0;
 }
 
+RESULT eDVBDemux::createTSRecorder(ePtr<iDVBTSRecorder> &recorder, eDVBRecordFileThread *thread, unsigned int packetsize)
+{
+	if (m_dvr_busy)
+	{
+		delete thread;
+		return -EBUSY;
+	}
+	recorder = new eDVBTSRecorder(this, thread, packetsize);
+	return 0;
+}
+
 RESULT eDVBDemux::getMPEGDecoder(ePtr<iTSMPEGDecoder> &decoder, int index)
 {
 	decoder = new eTSMPEGDecoder(this, index);
@@ -442,7 +458,8 @@ eDVBRecordFileThread::eDVBRecordFileThread(int packetsize, int bufferCount, int
 	 m_sync_mode(sync_mode),
 	 m_aio(bufferCount),
 	 m_current_buffer(m_aio.begin()),
-	 m_buffer_use_histogram(bufferCount+1, 0)
+	 m_buffer_use_histogram(bufferCount+1, 0),
+	 m_ring_size(0)
 {
 	if (m_buffer == MAP_FAILED)
 		eFatal("[eDVBRecordFileThread] Failed to allocate filepush buffer, contact MiLo\n");
@@ -471,12 +488,36 @@ void eDVBRecordFileThread::setTimingPID(int pid, iDVBTSRecorder::timing_pid_type
 
 void eDVBRecordFileThread::startSaveMetaInformation(const std::string &filename)
 {
+	if (m_ring_size && m_sync_mode)
+	{
+		eWarning("[eDVBRecordFileThread] no ring buffer in sync mode");
+		m_ring_size = 0;
+	}
+	if (m_ring_size)
+	{
+		/* the structure entries of a ring take far less than 1/256 of its data, */
+		/* and their ring is made of whole pages */
+		off_t sc_size = (m_ring_size / 256) & ~(off_t)4095;
+		if (sc_size < 16 * 4096)
+			sc_size = 16 * 4096;
+		if (m_ringfile.create(filename, m_ring_size, sc_size) < 0)
+		{
+			eWarning("[eDVBRecordFileThread] failed to create ring buffer state for %s", filename.c_str());
+			m_ring_size = 0;
+		}
+		else
+		{
+			eDebug("[eDVBRecordFileThread] ring buffer of %lld MB", (long long)(m_ring_size >> 20));
+			m_ts_parser.setRingBuffer(sc_size);
+		}
+	}
 	m_ts_parser.startSave(filename);
 }
 
 void eDVBRecordFileThread::stopSaveMetaInformation()
 {
 	m_ts_parser.stopSave();
+	m_ringfile.close();
 }
 
 int eDVBRecordFileThread::getLastPTS(pts_t &pts)
@@ -489,8 +530,62 @@ int eDVBRecordFileThread::getFirstPTS(pts_t &pts)
 	return m_ts_parser.getFirstPTS(pts);
 }
 
+bool eDVBRecordFileThread::enableIOUring()
+{
+#ifdef HAVE_LIBURING
+	if (m_ring.valid())
+		return true;
+	/* every buffer can be in flight, plus a few structure writes */
+	if (!m_ring.init(m_aio.size() + 16))
+		return false;
+	if (m_ring.registerBuffer(m_allocated_buffer, m_aio.size() * m_buffersize))
+		eDebug("[eDVBRecordFileThread] io_uring with %zu fixed buffers", m_aio.size());
+	for (AsyncIOvector::iterator it = m_aio.begin(); it != m_aio.end(); ++it)
+		it->ring = &m_ring;
+	m_ts_parser.setIOUring(&m_ring);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void eDVBRecordFileThread::getBufferStatistics(ePyObject &dict)
+{
+	std::vector<int> histogram;
+	{
+		eSingleLocker l(m_histogram_lock);
+		histogram = m_buffer_use_histogram;
+	}
+	PutToDict(dict, "buffers", m_aio.size());
+	PutToDict(dict, "buffer_size", m_buffersize);
+#ifdef HAVE_LIBURING
+	PutToDict(dict, "backend", m_ring.valid() ? "io_uring" : "aio");
+#else
+	PutToDict(dict, "backend", "aio");
+#endif
+	PutToDict(dict, "overflows", m_overflow_count);
+	/* how often n buffers were still busy when a new block was written */
+	ePyObject busy = PyList_New(histogram.size());
+	for (unsigned int i = 0; i < histogram.size(); ++i)
+		PyList_SET_ITEM(busy, i, PyInt_FromLong(histogram[i]));
+	PutToDict(dict, "busy_histogram", busy);
+}
+
 int eDVBRecordFileThread::AsyncIO::wait()
 {
+#ifdef HAVE_LIBURING
+	if (ring)
+	{
+		int r = ring->wait(request);
+		request.result = 0; // report an error only once
+		if (r < 0)
+		{
+			eWarning("[eDVBRecordFileThread] wait: io_uring write failed: %s", strerror(-r));
+			return -1;
+		}
+		return 0;
+	}
+#endif
 	if (aio.aio_buf != NULL) // Only if we had a request outstanding
 	{
 		while (aio_error(&aio) == EINPROGRESS)
@@ -526,6 +621,22 @@ int eDVBRecordFileThread::AsyncIO::cancel(int fd)
 
 int eDVBRecordFileThread::AsyncIO::poll()
 {
+#ifdef HAVE_LIBURING
+	if (ring)
+	{
+		ring->reap();
+		if (request.busy)
+			return 1;
+		int r = request.result;
+		request.result = 0;
+		if (r < 0)
+		{
+			eWarning("[eDVBRecordFileThread] poll: io_uring write failed: %s", strerror(-r));
+			return -1;
+		}
+		return 0;
+	}
+#endif
 	if (aio.aio_buf == NULL)
 		return 0;
 	if (aio_error(&aio) == EINPROGRESS)
@@ -542,8 +653,22 @@ int eDVBRecordFileThread::AsyncIO::poll()
 	return 0;
 }
 
+bool eDVBRecordFileThread::AsyncIO::pending() const
+{
+#ifdef HAVE_LIBURING
+	if (ring)
+		return request.busy;
+#endif
+	return aio.aio_buf != NULL;
+}
+
 int eDVBRecordFileThread::AsyncIO::start(int fd, off_t offset, size_t nbytes, void* buffer)
 {
+#ifdef HAVE_LIBURING
+	/* only queued, asyncWrite submits */
+	if (ring)
+		return ring->write(request, fd, buffer, nbytes, offset);
+#endif
 	memset(&aio, 0, sizeof(aiocb)); // Documentation says "zero it before call".
 	aio.aio_fildes = fd;
 	aio.aio_nbytes = nbytes;
@@ -577,12 +702,44 @@ int eDVBRecordFileThread::asyncWrite(int len)
 	gettimeofday(&starttime, NULL);
 #endif
 
-	int r = m_current_buffer->start(m_fd_dest, m_current_offset, len, m_buffer);
+	off_t where = m_current_offset;
+	int head = 0;
+	if (m_ring_size)
+	{
+		/* the oldest data is overwritten now, so readers must leave it first */
+		publishRing(m_current_offset + len + m_buffersize - m_ring_size);
+		where = m_current_offset % m_ring_size;
+		if (where + len > m_ring_size)
+		{
+			/* wraps around, the part up to the end of the file is written right here */
+			head = m_ring_size - where;
+			if (::pwrite(m_fd_dest, m_buffer, head, where) != head)
+			{
+				eWarning("[eDVBRecordFileThread] pwrite failed: %m");
+				return -1;
+			}
+			where = 0;
+		}
+	}
+	m_current_buffer->position = m_current_offset;
+	int r = m_current_buffer->start(m_fd_dest, where, len - head, m_buffer + head);
 	if (r < 0)
 	{
 		eWarning("[eDVBRecordFileThread] aio_write failed: %m");
 		return r;
 	}
+#ifdef HAVE_LIBURING
+	/* one system call for this block and the structure writes queued while parsing it */
+	if (m_ring.valid())
+	{
+		r = m_ring.submit();
+		if (r < 0)
+		{
+			errno = -r;
+			return -1;
+		}
+	}
+#endif
 	m_current_offset += len;
 
 #ifdef SHOW_WRITE_TIME
@@ -613,7 +770,12 @@ int eDVBRecordFileThread::asyncWrite(int len)
 			return r;
 		}
 	}
-	++m_buffer_use_histogram[busy_count];
+	{
+		eSingleLocker l(m_histogram_lock);
+		++m_buffer_use_histogram[busy_count];
+	}
+	if (m_ring_size)
+		publishRing(m_current_offset - m_ring_size);
 
 	++m_current_buffer;
 	if (m_current_buffer == m_aio.end())
@@ -622,6 +784,20 @@ int eDVBRecordFileThread::asyncWrite(int len)
 	return len;
 }
 
+void eDVBRecordFileThread::publishRing(off_t begin)
+{
+	/* everything up to the oldest write in flight can be read */
+	off_t end = m_current_offset;
+	for (AsyncIOvector::const_iterator it = m_aio.begin(); it != m_aio.end(); ++it)
+	{
+		if (it->pending() && it->position < end)
+			end = it->position;
+	}
+	if (begin < 0)
+		begin = 0;
+	m_ringfile.setData(begin, std::max(begin, end));
+}
+
 int eDVBRecordFileThread::writeData(int len)
 {
 	if(m_sync_mode)
@@ -672,6 +848,8 @@ void eDVBRecordFileThread::flush()
 	{
 		it->wait();
 	}
+	if (m_ring_size)
+		publishRing(m_current_offset - m_ring_size);
 	int bufferCount = m_aio.size();
 	eDebug("[eDVBRecordFileThread] buffer usage histogram (%d buffers of %lu kB)", bufferCount, m_buffersize>>10);
 	for (int i=0; i <= bufferCount; ++i)
@@ -689,15 +867,130 @@ void eDVBRecordFileThread::flush()
 	}
 }
 
-eDVBRecordStreamThread::eDVBRecordStreamThread(int packetsize, int buffersize, bool sync_mode) :
-	eDVBRecordFileThread(packetsize, recordingBufferCount, buffersize, sync_mode)
+eDVBRecordStreamThread::eDVBRecordStreamThread(int packetsize, int buffersize, bool sync_mode, bool splice) :
+	eDVBRecordFileThread(packetsize, recordingBufferCount, buffersize, sync_mode),
+	m_splice(splice),
+	m_in_pipe(false),
+	m_nonblocking_fd(-1)
 {
+	m_pipe[0] = m_pipe[1] = -1;
+	if (m_splice)
+	{
+		if (::pipe2(m_pipe, O_CLOEXEC) < 0)
+		{
+			eWarning("[eDVBRecordStreamThread] pipe failed, not using splice: %m");
+			m_splice = false;
+		}
+		else
+		{
+			/* let one buffer fit in the pipe, the default is only 64 kB */
+			int size = ::fcntl(m_pipe[1], F_SETPIPE_SZ, (int)m_buffersize);
+			eDebug("[eDVBRecordStreamThread] splice through a pipe of %d kB", (size < 0 ? ::fcntl(m_pipe[1], F_GETPIPE_SZ) : size) >> 10);
+		}
+	}
 	eDebug("[eDVBRecordStreamThread] allocated %zu buffers of %zu kB", m_aio.size(), m_buffersize>>10);
 }
 
+eDVBRecordStreamThread::~eDVBRecordStreamThread()
+{
+	if (m_pipe[0] >= 0)
+		::close(m_pipe[0]);
+	if (m_pipe[1] >= 0)
+		::close(m_pipe[1]);
+}
+
+ssize_t eDVBRecordStreamThread::readData()
+{
+	/* rtsp needs the data in m_buffer to frame it */
+	if (m_splice && !getProtocol())
+	{
+		ssize_t bytes = ::splice(m_fd_source, NULL, m_pipe[1], NULL, m_buffersize, SPLICE_F_MOVE);
+		if (bytes >= 0 || errno != EINVAL)
+		{
+			m_in_pipe = bytes > 0;
+			return bytes;
+		}
+		eDebug("[eDVBRecordStreamThread] source does not support splice, falling back to read");
+		m_splice = false;
+	}
+	return eDVBRecordFileThread::readData();
+}
+
+int eDVBRecordStreamThread::spliceWrite(int len)
+{
+	/*
+	 * like the aio path, a stream is not held up by a slow client, what does
+	 * not fit is dropped. SPLICE_F_NONBLOCK only covers the pipe side, so the
+	 * socket has to be non-blocking as well.
+	 */
+	if (!m_sync_mode && m_nonblocking_fd != m_fd_dest)
+	{
+		int flags = ::fcntl(m_fd_dest, F_GETFL);
+		if (flags >= 0 && ::fcntl(m_fd_dest, F_SETFL, flags | O_NONBLOCK) >= 0)
+			m_nonblocking_fd = m_fd_dest;
+	}
+	int left = len;
+	while (left > 0)
+	{
+		ssize_t w = ::splice(m_pipe[0], NULL, m_fd_dest, NULL, left, SPLICE_F_MOVE | SPLICE_F_MORE | (m_sync_mode ? 0 : SPLICE_F_NONBLOCK));
+		if (w < 0)
+		{
+			if (errno == EINVAL && left == len)
+			{
+				eDebug("[eDVBRecordStreamThread] target does not support splice, falling back to write");
+				m_splice = false;
+				/* move the data back to m_buffer, the pipe is never filled by more than one read */
+				int pos = 0;
+				while (pos < len)
+				{
+					int r = ::read(m_pipe[0], m_buffer + pos, len - pos);
+					if (r <= 0)
+						return -1;
+					pos += r;
+				}
+				return len;
+			}
+			if (errno == EAGAIN && !m_sync_mode)
+				return spliceDrop(len, left);
+			eWarning("[eDVBRecordStreamThread] splice write error: %m");
+			return -1;
+		}
+		if (w == 0)
+		{
+			eWarning("[eDVBRecordStreamThread] splice write eof");
+			return 0;
+		}
+		left -= w;
+	}
+	return len;
+}
+
+int eDVBRecordStreamThread::spliceDrop(int len, int left)
+{
+	/* empty the pipe for the next read, m_buffer is unused while splicing */
+	while (left > 0)
+	{
+		int r = ::read(m_pipe[0], m_buffer, left);
+		if (r <= 0)
+			return -1;
+		left -= r;
+	}
+	return len;
+}
 
 int eDVBRecordStreamThread::writeData(int len)
 {
+	if (m_in_pipe)
+	{
+		m_in_pipe = false;
+		int r = spliceWrite(len);
+		/* with splice disabled, the data was moved back to m_buffer */
+		if (m_splice)
+			return r;
+		if (r < 0)
+			return r;
+	}
+
 	if(m_sync_mode)
 	{
 		struct pollfd pfd = {};
@@ -787,14 +1080,298 @@ void eDVBRecordStreamThread::flush()
 	eDVBRecordFileThread::flush();
 }
 
+/* client throughput is measured over windows of this many seconds */
+#define FANOUT_RATE_WINDOW 5
+/* maximum number of queued segments handed to one sendmsg */
+#define FANOUT_MAX_IOV 16
+/* unused chunks kept for reuse, the others are freed */
+#define FANOUT_SPARE_CHUNKS 2
+
+eDVBRecordFanoutThread::eDVBRecordFanoutThread(int packetsize, size_t backlog_limit) :
+	eDVBRecordFileThread(packetsize, 1),
+	m_backlog_limit(backlog_limit)
+{
+	m_chunk = new Chunk;
+	m_chunk->data = m_buffer;
+	m_chunk->refs = 1; // our own while it is being filled
+	eDebug("[eDVBRecordFanoutThread] chunks of %zu kB, backlog limit %zu kB", m_buffersize>>10, m_backlog_limit>>10);
+}
+
+eDVBRecordFanoutThread::~eDVBRecordFanoutThread()
+{
+	for (std::list<Client>::iterator it(m_clients.begin()); it != m_clients.end(); ++it)
+		releaseQueue(*it);
+	m_free.push_back(m_chunk);
+	for (std::vector<Chunk*>::iterator it(m_free.begin()); it != m_free.end(); ++it)
+	{
+		/* the first chunk uses the buffer allocated by eDVBRecordFileThread */
+		if ((*it)->data != m_allocated_buffer)
+			free((*it)->data);
+		delete *it;
+	}
+}
+
+void eDVBRecordFanoutThread::addClient(int fd)
+{
+	eSingleLocker l(m_lock);
+	for (std::list<Client>::iterator it(m_clients.begin()); it != m_clients.end(); ++it)
+	{
+		if (it->fd == fd)
+			return;
+	}
+	Client client;
+	client.fd = fd;
+	client.offset = 0;
+	client.statistics.bytes_sent = 0;
+	client.statistics.backlog = client.statistics.backlog_max = 0;
+	client.statistics.rate = 0;
+	client.window_start = 0;
+	client.window_bytes = 0;
+	m_clients.push_back(client);
+}
+
+void eDVBRecordFanoutThread::removeClient(int fd)
+{
+	eSingleLocker l(m_lock);
+	for (std::list<Client>::iterator it(m_clients.begin()); it != m_clients.end(); ++it)
+	{
+		if (it->fd == fd)
+		{
+			releaseQueue(*it);
+			m_clients.erase(it);
+			return;
+		}
+	}
+}
+
+bool eDVBRecordFanoutThread::getClientStatistics(int fd, ClientStatistics &stats)
+{
+	eSingleLocker l(m_lock);
+	for (std::list<Client>::iterator it(m_clients.begin()); it != m_clients.end(); ++it)
+	{
+		if (it->fd == fd)
+		{
+			stats = it->statistics;
+			return true;
+		}
+	}
+	return false;
+}
+
+void eDVBRecordFanoutThread::takeDroppedClients(std::vector<int> &fds)
+{
+	eSingleLocker l(m_lock);
+	fds.swap(m_dropped);
+	m_dropped.clear();
+}
+
+eDVBRecordFanoutThread::Chunk *eDVBRecordFanoutThread::getChunk()
+{
+	if (!m_free.empty())
+	{
+		Chunk *chunk = m_free.back();
+		m_free.pop_back();
+		return chunk;
+	}
+	unsigned char *data = (unsigned char*)malloc(m_buffersize);
+	if (!data)
+		return NULL;
+	Chunk *chunk = new Chunk;
+	chunk->data = data;
+	chunk->refs = 0;
+	return chunk;
+}
+
+void eDVBRecordFanoutThread::release(Chunk *chunk)
+{
+	if (--chunk->refs)
+		return;
+	/* the chunk in the buffer of eDVBRecordFileThread is always kept */
+	if (m_free.size() < FANOUT_SPARE_CHUNKS || chunk->data == m_allocated_buffer)
+		m_free.push_back(chunk);
+	else
+	{
+		free(chunk->data);
+		delete chunk;
+	}
+}
+
+void eDVBRecordFanoutThread::releaseQueue(Client &client)
+{
+	for (std::deque<Segment>::iterator it(client.queue.begin()); it != client.queue.end(); ++it)
+		release(it->chunk);
+	client.queue.clear();
+	client.offset = 0;
+	client.statistics.backlog = 0;
+}
+
+bool eDVBRecordFanoutThread::send(Client &client)
+{
+	while (!client.queue.empty())
+	{
+		struct iovec iov[FANOUT_MAX_IOV];
+		struct msghdr msg = {};
+		size_t total = 0;
+		int count = 0;
+		for (std::deque<Segment>::iterator it(client.queue.begin()); it != client.queue.end() && count < FANOUT_MAX_IOV; ++it, ++count)
+		{
+			size_t skip = count ? 0 : client.offset;
+			iov[count].iov_base = it->chunk->data + it->begin + skip;
+			iov[count].iov_len = it->end - it->begin - skip;
+			total += iov[count].iov_len;
+		}
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+		ssize_t sent = ::sendmsg(client.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				break;
+			eDebug("[eDVBRecordFanoutThread] send to client %d failed: %m", client.fd);
+			return false;
+		}
+		client.statistics.bytes_sent += sent;
+		client.statistics.backlog -= sent;
+		client.window_bytes += sent;
+		client.offset += sent;
+		while (!client.queue.empty() && client.offset >= (size_t)(client.queue.front().end - client.queue.front().begin))
+		{
+			client.offset -= client.queue.front().end - client.queue.front().begin;
+			release(client.queue.front().chunk);
+			client.queue.pop_front();
+		}
+		if ((size_t)sent < total)
+			break;
+	}
+	return true;
+}
+
+ssize_t eDVBRecordFanoutThread::readData()
+{
+	/* continue in the unused part of the current chunk */
+	return ::read(m_fd_source, m_buffer, m_chunk->data + m_buffersize - m_buffer);
+}
+
+int eDVBRecordFanoutThread::writeData(int len)
+{
+#if SIGCXX_MAJOR_VERSION == 3
+	m_ts_parser.parseData(m_current_offset, m_buffer, len);
+#else
+	if(!getProtocol())
+		m_ts_parser.parseData(m_current_offset, m_buffer, len);
+	if (m_ts_parser.broken())
+		sendEvent(evtRetune);
+#endif
+	m_current_offset += len;
+
+	bool dropped = false;
+	{
+		eSingleLocker l(m_lock);
+		if (m_clients.empty())
+			return len; // the next read overwrites the data
+		Segment segment;
+		segment.chunk = m_chunk;
+		segment.begin = m_buffer - m_chunk->data;
+		segment.end = segment.begin + len;
+		/*
+		 * small reads are packed into the same chunk, so a slow stream does
+		 * not pin a whole chunk per read. A new chunk is started when less
+		 * than a quarter of the current one is left.
+		 */
+		Chunk *next = NULL;
+		if (m_buffersize - segment.end < m_buffersize / 4)
+		{
+			next = getChunk();
+			if (!next)
+			{
+				eWarning("[eDVBRecordFanoutThread] out of memory, dropping %d bytes", len);
+				return len;
+			}
+		}
+
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		for (std::list<Client>::iterator it(m_clients.begin()); it != m_clients.end(); )
+		{
+			Client &client = *it;
+			if (!client.queue.empty() && client.queue.back().chunk == segment.chunk && client.queue.back().end == segment.begin)
+				client.queue.back().end = segment.end;
+			else
+			{
+				++segment.chunk->refs;
+				client.queue.push_back(segment);
+			}
+			client.statistics.backlog += len;
+			if (client.statistics.backlog > client.statistics.backlog_max)
+				client.statistics.backlog_max = client.statistics.backlog;
+			bool ok = send(client);
+			if (!ok || client.statistics.backlog > m_backlog_limit)
+			{
+				if (ok)
+					eDebug("[eDVBRecordFanoutThread] client %d too slow, backlog %zu kB, dropping", client.fd, client.statistics.backlog>>10);
+				m_dropped.push_back(client.fd);
+				releaseQueue(client);
+				it = m_clients.erase(it);
+				dropped = true;
+				continue;
+			}
+			if (ts.tv_sec - client.window_start >= FANOUT_RATE_WINDOW)
+			{
+				if (client.window_start)
+					client.statistics.rate = client.window_bytes / (ts.tv_sec - client.window_start);
+				client.window_start = ts.tv_sec;
+				client.window_bytes = 0;
+			}
+			++it;
+		}
+		if (next)
+		{
+			/* continue reading into the next chunk */
+			next->refs = 1;
+			release(m_chunk);
+			m_chunk = next;
+			m_buffer = next->data;
+		}
+		else
+			m_buffer += len;
+	}
+	if (dropped)
+		sendEvent(evtClientDropped);
+	return len;
+}
+
+void eDVBRecordFanoutThread::flush()
+{
+	if (m_overflow_count)
+	{
+		eDebug("[eDVBRecordFanoutThread] Demux buffer overflows: %d", m_overflow_count);
+	}
+}
+
 DEFINE_REF(eDVBTSRecorder);
 
 eDVBTSRecorder::eDVBTSRecorder(eDVBDemux *demux, int packetsize, bool streaming):
 	m_demux(demux),
 	m_running(0),
 	m_target_fd(-1),
-	m_thread(streaming ? new eDVBRecordStreamThread(packetsize) : new eDVBRecordFileThread(packetsize, recordingBufferCount)),
-	m_packetsize(packetsize)
+	m_thread(streaming ?
+		new eDVBRecordStreamThread(packetsize, -1, false, eConfigManager::getConfigBoolValue("config.streaming.splice")) :
+		new eDVBRecordFileThread(packetsize, recordingBufferCount)),
+	m_packetsize(packetsize),
+	m_needs_target(true)
+{
+	if (!streaming)
+		m_thread->enableIOUring();
+	CONNECT(m_thread->m_event, eDVBTSRecorder::filepushEvent);
+}
+
+eDVBTSRecorder::eDVBTSRecorder(eDVBDemux *demux, eDVBRecordFileThread *thread, int packetsize):
+	m_demux(demux),
+	m_running(0),
+	m_target_fd(-1),
+	m_thread(thread),
+	m_packetsize(packetsize),
+	m_needs_target(false)
 {
 	CONNECT(m_thread->m_event, eDVBTSRecorder::filepushEvent);
 }
@@ -812,7 +1389,7 @@ RESULT eDVBTSRecorder::start()
 	if (m_running)
 		return -1;
 
-	if (m_target_fd == -1)
+	if (m_needs_target && m_target_fd == -1)
 		return -2;
 
 	if (i == m_pids.end())
@@ -926,6 +1503,12 @@ RESULT eDVBTSRecorder::setBoundary(off_t max)
 	return -1; // not yet implemented
 }
 
+RESULT eDVBTSRecorder::setRingBuffer(off_t size)
+{
+	m_thread->setRingBuffer(size);
+	return 0;
+}
+
 RESULT eDVBTSRecorder::stop()
 {
 	int state=3;
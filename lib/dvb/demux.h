@@ -2,11 +2,17 @@
 #define __dvb_demux_h
 
 #include <aio.h>
+#include <deque>
+#include <list>
+#include <lib/base/elock.h>
 #include <lib/dvb/idvb.h>
 #include <lib/dvb/idemux.h>
 #include <lib/dvb/pvrparse.h>
+#include <lib/python/python.h>
 #include "filepush.h"
 
+class eDVBRecordFileThread;
+
 class eDVBDemux: public iDVBDemux
 {
 	DECLARE_REF(eDVBDemux);
@@ -25,6 +31,8 @@ public:
 	RESULT createSectionReader(eMainloop *context, ePtr<iDVBSectionReader> &reader);
 	RESULT createPESReader(eMainloop *context, ePtr<iDVBPESReader> &reader);
 	RESULT createTSRecorder(ePtr<iDVBTSRecorder> &recorder, unsigned int packetsize = 188, bool streaming=false);
+	/* recorder around a thread which writes to its own targets, takes ownership of thread */
+	RESULT createTSRecorder(ePtr<iDVBTSRecorder> &recorder, eDVBRecordFileThread *thread, unsigned int packetsize = 188);
 	RESULT getMPEGDecoder(ePtr<iTSMPEGDecoder> &reader, int index);
 	RESULT getSTC(pts_t &pts, int num);
 	RESULT getCADemuxID(uint8_t &id) { id = demux; return 0; }
@@ -126,8 +134,15 @@ public:
 	int getFirstPTS(pts_t &pts);
 	void setTargetFD(int fd) { m_fd_dest = fd; }
 	void enableAccessPoints(bool enable) { m_ts_parser.enableAccessPoints(enable); }
+	/* write the target as a ring buffer of size bytes, call before startSaveMetaInformation */
+	void setRingBuffer(off_t size) { m_ring_size = size; }
+	/* write with io_uring instead of POSIX AIO, call before start */
+	bool enableIOUring();
+	void getBufferStatistics(ePyObject &dict);
 protected:
 	int asyncWrite(int len);
+	/* tell readers of a ring buffer which range they can use */
+	void publishRing(off_t begin);
 	/* override */ int writeData(int len);
 	/* override */ void flush();
 
@@ -135,16 +150,30 @@ protected:
 	{
 		struct aiocb aio;
 		unsigned char* buffer;
+		off_t position; // of the data in the recording
+#ifdef HAVE_LIBURING
+		eIOUring *ring;
+		eIOUring::Request request;
+#endif
 		AsyncIO()
 		{
 			memset(&aio, 0, sizeof(aiocb));
 			buffer = NULL;
+			position = 0;
+#ifdef HAVE_LIBURING
+			ring = NULL;
+#endif
 		}
 		int wait();
 		int start(int fd, off_t offset, size_t nbytes, void* buffer);
 		int poll(); // returns 1 if busy, 0 if ready, <0 on error return
 		int cancel(int fd); // returns <0 on error, 0 cancelled, >0 bytes written?
+		bool pending() const; // not known to be written yet, does not reap
 	};
+#ifdef HAVE_LIBURING
+	/* before m_ts_parser, which may still have writes pending on it when destroyed */
+	eIOUring m_ring;
+#endif
 	eMPEGStreamParserTS m_ts_parser;
 	off_t m_current_offset;
 	int m_fd_dest;
@@ -153,17 +182,107 @@ protected:
 	unsigned char* m_allocated_buffer;
 	AsyncIOvector m_aio;
 	AsyncIOvector::iterator m_current_buffer;
+	eSingleLock m_histogram_lock;
 	std::vector<int> m_buffer_use_histogram;
+	off_t m_ring_size; // 0 unless the target is a ring buffer
+	eRingFile m_ringfile;
 };
 
+/*
+ * With splice enabled, data is moved from the source to the target through
+ * a pipe without being copied to user space. The TS parser does not see the
+ * data then. When the source or the target does not support splice, the
+ * thread falls back to reading and writing m_buffer.
+ */
 class eDVBRecordStreamThread: public eDVBRecordFileThread
 {
 public:
-	eDVBRecordStreamThread(int packetsize, int buffersize = -1, bool sync_mode = false);
+	eDVBRecordStreamThread(int packetsize, int buffersize = -1, bool sync_mode = false, bool splice = false);
+	~eDVBRecordStreamThread();
 
 protected:
+	ssize_t readData();
 	int writeData(int len);
 	void flush();
+
+private:
+	bool m_splice;
+	bool m_in_pipe; // the data of the last readData is in the pipe, not in m_buffer
+	int m_pipe[2];
+	int m_nonblocking_fd; // target made non-blocking for spliceWrite
+	int spliceWrite(int len);
+	/* discards the left bytes still in the pipe */
+	int spliceDrop(int len, int left);
+};
+
+/*
+ * Stream thread feeding any number of socket clients from one demux.
+ * Read data is not copied: consecutive reads fill a reference counted
+ * chunk, each read is queued as a segment of it on every client and
+ * written out with non-blocking sends, so a slow client never stalls the
+ * others. A client falling more than backlog_limit bytes behind, or
+ * failing to send, is dropped and reported with evtClientDropped.
+ */
+class eDVBRecordFanoutThread: public eDVBRecordFileThread
+{
+public:
+	eDVBRecordFanoutThread(int packetsize, size_t backlog_limit);
+	~eDVBRecordFanoutThread();
+
+	enum { evtClientDropped = evtUser };
+
+	struct ClientStatistics
+	{
+		unsigned long long bytes_sent;
+		size_t backlog, backlog_max;
+		unsigned int rate; // bytes per second over the last complete window
+	};
+
+	/* the fds stay owned by the caller, removeClient them before closing */
+	void addClient(int fd);
+	void removeClient(int fd);
+	bool getClientStatistics(int fd, ClientStatistics &stats);
+	/* fds of the clients dropped by the thread since the last call */
+	void takeDroppedClients(std::vector<int> &fds);
+
+protected:
+	ssize_t readData();
+	int writeData(int len);
+	void flush();
+
+private:
+	struct Chunk
+	{
+		unsigned char *data;
+		int refs;
+	};
+	struct Segment
+	{
+		Chunk *chunk;
+		int begin, end;
+	};
+	struct Client
+	{
+		int fd;
+		std::deque<Segment> queue;
+		size_t offset; // bytes of the first queued segment already sent
+		ClientStatistics statistics;
+		time_t window_start;
+		unsigned long long window_bytes;
+	};
+
+	size_t m_backlog_limit;
+	eSingleLock m_lock;
+	std::list<Client> m_clients;
+	std::vector<int> m_dropped;
+	std::vector<Chunk*> m_free;
+	Chunk *m_chunk; // being filled, m_buffer points to its unused part
+
+	Chunk *getChunk();
+	void release(Chunk *chunk);
+	void releaseQueue(Client &client);
+	/* returns false when the client has to be dropped */
+	bool send(Client &client);
 };
 
 class eDVBTSRecorder: public iDVBTSRecorder, public sigc::trackable
@@ -171,6 +290,7 @@ class eDVBTSRecorder: public iDVBTSRecorder, public sigc::trackable
 	DECLARE_REF(eDVBTSRecorder);
 public:
 	eDVBTSRecorder(eDVBDemux *demux, int packetsize, bool streaming);
+	eDVBTSRecorder(eDVBDemux *demux, eDVBRecordFileThread *thread, int packetsize);
 	~eDVBTSRecorder();
 
 	RESULT setBufferSize(int size);
@@ -183,12 +303,14 @@ public:
 	RESULT setTargetFD(int fd);
 	RESULT setTargetFilename(const std::string& filename);
 	RESULT setBoundary(off_t max);
+	RESULT setRingBuffer(off_t size);
 	RESULT enableAccessPoints(bool enable);
 
 	RESULT stop();
 
 	RESULT getCurrentPCR(pts_t &pcr);
 	RESULT getFirstPTS(pts_t &pts);
+	void getBufferStatistics(ePyObject &dict) { m_thread->getBufferStatistics(dict); }
 
 #if SIGCXX_MAJOR_VERSION == 3
 	RESULT connectEvent(const sigc::slot<void(int)> &event, ePtr<eConnection> &conn);
@@ -216,6 +338,7 @@ private:
 	eDVBRecordFileThread *m_thread;
 	std::string m_target_filename;
 	int m_packetsize;
+	bool m_needs_target;
 	friend class eRTSPStreamClient;
 };
 
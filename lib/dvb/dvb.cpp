@@ -3,11 +3,13 @@
 #include <linux/dvb/dmx.h>
 #include <linux/dvb/version.h>
 #include <lib/python/python.h>
+#include <lib/python/python_helpers.h>
 #include <lib/base/cfile.h>
 #include <lib/base/eerror.h>
 #include <lib/base/estring.h>
 #include <lib/base/wrappers.h>
 #include <lib/base/httpstream.h>
+#include <lib/base/nconfig.h>
 #include <lib/dvb/cahandler.h>
 #include <lib/dvb/idvb.h>
 #include <lib/dvb/dvb.h>
@@ -1662,6 +1664,9 @@ bool eDVBResourceManager::canMeasureFrontendInputPower()
 	return false;
 }
 
+/* blocks of 512 packets the playback reads ahead */
+#define PVR_PREFETCH_BLOCKS 8
+
 class eDVBChannelFilePush: public eFilePushThread
 {
 public:
@@ -1725,6 +1730,10 @@ eDVBChannel::eDVBChannel(eDVBResourceManager *mgr, eDVBAllocatedFrontend *fronte
 	m_pvr_fd_dst = -1;
 
 	m_skipmode_n = m_skipmode_m = m_skipmode_frames = 0;
+	m_skipmode_pts_step = 0;
+	m_trickplay_target = -1;
+	m_trickplay_frames = 0;
+	m_trickplay_fps = 0;
 
 	if (m_frontend)
 		m_frontend->get().connectStateChange(sigc::mem_fun(*this, &eDVBChannel::frontendStateChanged), m_conn_frontendStateChanged);
@@ -1857,6 +1866,9 @@ void eDVBChannel::cueSheetEvent(int event)
 				m_skipmode_frames = m_cue->m_skipmode_ratio / 90000;
 				m_skipmode_m = (bitrate / 8) * (m_skipmode_frames / 8);
 				m_skipmode_frames_remainder = 0;
+				/* show this many I-frames per second, at any speed */
+				int fps = eConfigManager::getConfigIntValue("config.seek.trickplay_fps", 10);
+				m_skipmode_pts_step = fps > 0 ? m_cue->m_skipmode_ratio / fps : 0;
 
 				if (m_cue->m_skipmode_ratio < 0)
 					m_skipmode_m -= m_skipmode_n;
@@ -1867,12 +1879,17 @@ void eDVBChannel::cueSheetEvent(int event)
 				{
 					eWarning("[eDVBChannel] something is wrong with this cueSheetEvent calculation");
 					m_skipmode_frames = m_skipmode_n = m_skipmode_m = 0;
+					m_skipmode_pts_step = 0;
 				}
 			} else
 			{
 				eDebug("[eDVBChannel] skipmode ratio is 0, normal play");
 				m_skipmode_frames = m_skipmode_n = m_skipmode_m = 0;
+				m_skipmode_pts_step = 0;
 			}
+			m_trickplay_target = -1;
+			m_trickplay_frames = 0;
+			m_trickplay_fps = 0;
 		}
 		m_pvr_thread->setIFrameSearch(m_skipmode_n != 0);
 		if (m_cue->m_skipmode_ratio != 0)
@@ -1950,7 +1967,24 @@ void eDVBChannel::getNextSourceSpan(off_t current_offset, size_t bytes_read, off
 	//eDebug("[eDVBChannel] getNextSourceSpan, current offset is %08llx, m_skipmode_m = %d!", current_offset, m_skipmode_m);
 	int frame_skip_success = 0;
 
-	if (m_skipmode_m)
+	if (m_skipmode_m && m_skipmode_pts_step)
+	{
+		size_t iframe_len;
+		off_t iframe_start = current_offset;
+		m_tstools_lock.lock();
+		int r = m_tstools.findTrickFrame(iframe_start, iframe_len, m_trickplay_target, m_skipmode_pts_step);
+		m_tstools_lock.unlock();
+		if (!r)
+		{
+			current_offset = align(iframe_start, blocksize);
+			max = align(iframe_len + 187, blocksize);
+			frame_skip_success = 1;
+		}
+		else
+			m_trickplay_target = -1;
+	}
+
+	if (m_skipmode_m && !frame_skip_success)
 	{
 		int frames_to_skip = m_skipmode_frames + m_skipmode_frames_remainder;
 		//eDebug("[eDVBChannel] we are at %llu, and we try to skip %d+%d frames from here", current_offset, m_skipmode_frames, m_skipmode_frames_remainder);
@@ -1974,7 +2008,9 @@ void eDVBChannel::getNextSourceSpan(off_t current_offset, size_t bytes_read, off
 		}
 	}
 
-	if (!frame_skip_success)
+	if (frame_skip_success)
+		countTrickplayFrame();
+	else
 	{
 		current_offset += align(m_skipmode_m, blocksize);
 
@@ -2091,6 +2127,7 @@ void eDVBChannel::getNextSourceSpan(off_t current_offset, size_t bytes_read, off
 
 		eDebug("[eDVBChannel] ok, resolved skip (rel: %d, diff %lld), now at %16jx", relative, pts, (intmax_t)offset);
 		current_offset = align(offset, blocksize); /* in case tstools return non-aligned offset */
+		m_trickplay_target = -1;
 	}
 
 	m_cue->m_lock.Unlock();
@@ -2158,6 +2195,46 @@ void eDVBChannel::getNextSourceSpan(off_t current_offset, size_t bytes_read, off
 	return;
 }
 
+void eDVBChannel::getPlaybackStatistics(ePyObject &dict)
+{
+	unsigned int seeks, probes, hits, misses, prefetched;
+	{
+		eSingleLocker l(m_tstools_lock);
+		m_tstools.getSeekStatistics(seeks, probes);
+		m_tstools.getCacheStatistics(hits, misses, prefetched);
+	}
+	/* seeks done by sampling the file because there is no .ap entry */
+	PutToDict(dict, "seeks", (long)seeks);
+	PutToDict(dict, "probes", (long)probes);
+	PutToDict(dict, "cache_hits", (long)hits);
+	PutToDict(dict, "cache_misses", (long)misses);
+	PutToDict(dict, "cache_prefetched", (long)prefetched);
+	/* in tenths */
+	PutToDict(dict, "trickplay_fps", (long)m_trickplay_fps);
+	if (m_pvr_thread)
+		PutToDict(dict, "prefetch_underruns", (long)m_pvr_thread->getPrefetchUnderruns());
+}
+
+void eDVBChannel::countTrickplayFrame()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!m_trickplay_frames++)
+	{
+		m_trickplay_start = now;
+		return;
+	}
+	long long ms = (now.tv_sec - m_trickplay_start.tv_sec) * 1000LL + (now.tv_nsec - m_trickplay_start.tv_nsec) / 1000000;
+	if (ms >= 5000)
+	{
+		int frames = m_trickplay_frames - 1;
+		m_trickplay_fps = frames * 10000LL / ms;
+		eDebug("[eDVBChannel] trick play delivered %d frames in %lld ms, %lld.%lld fps", frames, ms, frames * 1000LL / ms, frames * 10000LL / ms % 10);
+		m_trickplay_frames = 1;
+		m_trickplay_start = now;
+	}
+}
+
 void eDVBChannel::AddUse()
 {
 	if (++m_use_count > 1 && m_state == state_last_instance)
@@ -2407,6 +2484,8 @@ RESULT eDVBChannel::playSource(ePtr<iTsSource> &source, const char *streaminfo_f
 	m_pvr_thread->enablePVRCommit(1);
 	m_pvr_thread->setStreamMode(m_source->isStream());
 	m_pvr_thread->setScatterGather(this);
+	/* read ahead, so disk or network latency does not starve the decoder */
+	m_pvr_thread->setPrefetch(PVR_PREFETCH_BLOCKS);
 
 	m_event(this, evtPreStart);
 
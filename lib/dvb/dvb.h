@@ -13,6 +13,7 @@
 #include <lib/dvb/esection.h>
 #include "filepush.h"
 #include <connection.h>
+#include <atomic>
 
 #include <dvbsi++/service_description_section.h>
 
@@ -317,6 +318,8 @@ public:
 	RESULT getLength(pts_t &len);
 	RESULT getCurrentPosition(iDVBDemux *decoding_demux, pts_t &pos, int mode);
 
+	void getPlaybackStatistics(ePyObject &dict);
+
 	int getUseCount() { return m_use_count; }
 
 	RESULT requestTsidOnid();
@@ -358,6 +361,13 @@ private:
 	void cueSheetEvent(int event);
 	ePtr<eConnection> m_conn_cueSheetEvent;
 	int m_skipmode_m, m_skipmode_n, m_skipmode_frames, m_skipmode_frames_remainder;
+		/* trick play from the I-frame table: pts to advance per shown frame, and where we should be by now */
+	pts_t m_skipmode_pts_step, m_trickplay_target;
+	int m_trickplay_frames;
+	struct timespec m_trickplay_start;
+	/* frames per second delivered in the last measuring interval, in tenths, 0 when not in trick play */
+	std::atomic<int> m_trickplay_fps;
+	void countTrickplayFrame();
 
 	std::list<std::pair<off_t, off_t> > m_source_span;
 	void getNextSourceSpan(off_t current_offset, size_t bytes_read, off_t &start, size_t &size, int blocksize, int &sof);
@@ -6,12 +6,21 @@
 #include <fcntl.h>
 #include <fstream>
 #include <regex>
+#include <algorithm>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/vfs.h> // for statfs
+#include <unistd.h>
 #include <lib/base/encoding.h>
 #include <lib/base/estring.h>
 #include <lib/dvb/db.h>
 #include <lib/dvb/dvb.h>
 #include <lib/dvb/epgchanneldata.h>
+#include <lib/dvb/epgingest.h>
+#include <lib/dvb/epgsearchindex.h>
+#include <lib/dvb/epgsnapshot.h>
+#include <lib/dvb/epgtextcache.h>
 #include <lib/dvb/epgtransponderdatareader.h>
 #include <lib/dvb/lowlevel/eit.h>
 #include <lib/base/nconfig.h>
@@ -19,11 +28,15 @@
 #include <dvbsi++/descriptor_tag.h>
 #include <unordered_set>
 #include <lib/python/python.h>
+#include <lib/python/python_helpers.h>
 #include <Python.h>
 
 /* Interval between "garbage collect" cycles */
 #define CLEAN_INTERVAL 60000    //  1 min
 
+/* Memory the service snapshots kept for lookups may use, the descriptors are shared with the cache */
+#define MAX_SNAPSHOT_BYTES (2 * 1024 * 1024)
+
 struct DescriptorPair
 {
 	int reference_count;
@@ -35,6 +48,75 @@ struct DescriptorPair
 
 typedef std::tr1::unordered_map<uint32_t, DescriptorPair> DescriptorMap;
 
+/*
+ * eventData objects and their crc lists are carved out of big chunks
+ * instead of being allocated one by one, that saves the malloc overhead of
+ * two allocations per cached event. Freed blocks are kept in a free list
+ * per size class for the next event, the chunks are returned when the
+ * cache is empty. Only used with the cache_lock held.
+ */
+class eEventDataArena
+{
+	enum { CHUNK_SIZE = 64 * 1024, ALIGN = sizeof(void*) };
+	std::vector<void*> m_freeList; // indexed by size / ALIGN
+	std::vector<uint8_t*> m_chunks;
+	uint8_t *m_chunkPos;
+	size_t m_chunkLeft;
+	size_t m_used;
+public:
+	eEventDataArena()
+		:m_chunkPos(NULL), m_chunkLeft(0), m_used(0)
+	{
+	}
+	void *alloc(size_t size)
+	{
+		size = (size + ALIGN - 1) & ~(ALIGN - 1);
+		size_t cls = size / ALIGN;
+		m_used += size;
+		if (cls < m_freeList.size() && m_freeList[cls])
+		{
+			void *p = m_freeList[cls];
+			m_freeList[cls] = *(void**)p;
+			return p;
+		}
+		if (m_chunkLeft < size)
+		{
+			m_chunkPos = new uint8_t[CHUNK_SIZE];
+			m_chunkLeft = CHUNK_SIZE;
+			m_chunks.push_back(m_chunkPos);
+		}
+		void *p = m_chunkPos;
+		m_chunkPos += size;
+		m_chunkLeft -= size;
+		return p;
+	}
+	void free(void *p, size_t size)
+	{
+		if (!p)
+			return;
+		size = (size + ALIGN - 1) & ~(ALIGN - 1);
+		size_t cls = size / ALIGN;
+		if (cls >= m_freeList.size())
+			m_freeList.resize(cls + 1);
+		*(void**)p = m_freeList[cls];
+		m_freeList[cls] = p;
+		m_used -= size;
+		if (!m_used)
+			release();
+	}
+	void release()
+	{
+		for (std::vector<uint8_t*>::iterator it(m_chunks.begin()); it != m_chunks.end(); ++it)
+			delete [] *it;
+		m_chunks.clear();
+		m_freeList.clear();
+		m_chunkPos = NULL;
+		m_chunkLeft = 0;
+	}
+	size_t usedBytes() const { return m_used; }
+	size_t chunkBytes() const { return m_chunks.size() * CHUNK_SIZE; }
+};
+
 struct eventData
 {
 	uint8_t rawEITdata[10];
@@ -42,15 +124,29 @@ struct eventData
 	uint16_t type;
 	uint32_t *crc_list;
 	static DescriptorMap descriptors;
+	static eEPGSearchIndex searchIndex;
+	static eEventDataArena arena;
 	static uint8_t data[];
 	static unsigned int CacheSize;
 	static bool isCacheCorrupt;
 	eventData(const eit_event_struct* e = NULL, int size = 0, int type = 0, int tsidonid = 0);
+	eventData(const eEPGParsedSection &section, const eEPGParsedEvent &event, int type);
 	~eventData();
+	static bool parse(const eit_event_struct* e, int size, int tsidonid, eEPGParsedSection &section, eEPGParsedEvent &event);
+	void init(const eEPGParsedSection &section, const eEPGParsedEvent &event);
 	static void load(FILE *);
-	static void save(FILE *);
 	static void cacheCorrupt(const char* context);
-	const eit_event_struct* get() const;
+	static void *operator new(size_t size) { return arena.alloc(size); }
+	static void operator delete(void *p) { arena.free(p, sizeof(eventData)); }
+	static uint32_t *allocCrcList(int n) { return n ? (uint32_t*)arena.alloc(n * sizeof(uint32_t)) : NULL; }
+	static void freeCrcList(uint32_t *list, int n) { arena.free(list, n * sizeof(uint32_t)); }
+	/* crcs optionally receives the crcs of the returned descriptors */
+	const eit_event_struct* get(std::vector<uint32_t> *crcs = NULL) const;
+	bool equals(const eventData &e) const
+	{
+		return type == e.type && n_crc == e.n_crc && !memcmp(rawEITdata, e.rawEITdata, 10) &&
+			(!n_crc || !memcmp(crc_list, e.crc_list, n_crc * sizeof(uint32_t)));
+	}
 	int getEventID() const
 	{
 		return (rawEITdata[0] << 8) | rawEITdata[1];
@@ -68,6 +164,13 @@ struct eventData
 unsigned int eventData::CacheSize = 0;
 bool eventData::isCacheCorrupt = 0;
 DescriptorMap eventData::descriptors;
+static const uint8_t *lookupDescriptor(uint32_t crc)
+{
+	DescriptorMap::const_iterator it = eventData::descriptors.find(crc);
+	return it != eventData::descriptors.end() ? it->second.data : NULL;
+}
+eEPGSearchIndex eventData::searchIndex(lookupDescriptor);
+eEventDataArena eventData::arena;
 uint8_t eventData::data[2 * 4096 + 12];
 extern const uint32_t crc32_table[256];
 
@@ -108,13 +211,40 @@ eventData::eventData(const eit_event_struct* e, int size, int _type, int tsidoni
 	if (!e)
 		return; /* Used when loading from file */
 
-	uint32_t descr[65];
-	uint32_t *pdescr=descr;
+	eEPGParsedSection section;
+	eEPGParsedEvent event;
+	parse(e, size, tsidonid, section, event);
+	init(section, event);
+}
+
+eventData::eventData(const eEPGParsedSection &section, const eEPGParsedEvent &event, int _type)
+	:n_crc(0), type(_type & 0xFFFF), crc_list(NULL)
+{
+	init(section, event);
+}
+
+static void addParsedDescriptor(eEPGParsedSection &section, const uint8_t *descr, int descr_len)
+{
+	uint32_t offset = section.descriptorData.size();
+	section.descriptorData.insert(section.descriptorData.end(), descr, descr + descr_len);
+	section.crcs.push_back(std::make_pair(calculate_crc_hash(descr, descr_len), offset));
+}
 
+/*
+ * Extract the cached descriptors of an EIT event and calculate their crcs.
+ * This does not touch the cache, so it can run without the cache_lock.
+ * Returns false, with the descriptors of the event dropped again, when the
+ * event carries more descriptors than an eventData can hold.
+ */
+bool eventData::parse(const eit_event_struct* e, int size, int tsidonid, eEPGParsedSection &section, eEPGParsedEvent &event)
+{
 	uint8_t *data = (uint8_t*)e;
 	int ptr=12;
 	size -= 12;
 
+	event.first_crc = section.crcs.size();
+	memcpy(event.rawEITdata, (uint8_t*)e, 10);
+
 	while(size > 1)
 	{
 		uint8_t *descr = data + ptr;
@@ -132,18 +262,7 @@ eventData::eventData(const eit_event_struct* e, int size, int _type, int tsidoni
 				case PARENTAL_RATING_DESCRIPTOR:
 				case PDC_DESCRIPTOR:
 				{
-					uint32_t crc = calculate_crc_hash(descr, descr_len);
-					DescriptorMap::iterator it = descriptors.find(crc);
-					if ( it == descriptors.end() )
-					{
-						CacheSize+=descr_len;
-						uint8_t *d = new uint8_t[descr_len];
-						memcpy(d, descr, descr_len);
-						descriptors[crc] = DescriptorPair(1, d);
-					}
-					else
-						++it->second.reference_count;
-					*pdescr++ = crc;
+					addParsedDescriptor(section, descr, descr_len);
 					break;
 				}
 				case SHORT_EVENT_DESCRIPTOR:
@@ -176,6 +295,7 @@ eventData::eventData(const eit_event_struct* e, int size, int _type, int tsidoni
  					unsigned int eventTextlen = eventText.length();
 
 					//Rebuild the short event descriptor with UTF-8 strings
+					uint8_t rebuilt[2 + 255];
 
 					//Save the title first
 					if( eventNameUTF8len > 0 ) //only store the data if there is something to store
@@ -186,7 +306,7 @@ eventData::eventData(const eit_event_struct* e, int size, int _type, int tsidoni
 						*/
 						eventNameUTF8len = truncateUTF8(eventNameUTF8, 255 - 6);
 						int title_len = 6 + eventNameUTF8len;
-						uint8_t *title_data = new uint8_t[title_len + 2];
+						uint8_t *title_data = rebuilt;
 						title_data[0] = SHORT_EVENT_DESCRIPTOR;
 						title_data[1] = title_len;
 						title_data[2] = descr[2];
@@ -199,20 +319,7 @@ eventData::eventData(const eit_event_struct* e, int size, int _type, int tsidoni
 
 						//Calculate the CRC, based on our new data
 						title_len += 2; //add 2 the length to include the 2 bytes in the header
-						uint32_t title_crc = calculate_crc_hash(title_data, title_len);
-
-						DescriptorMap::iterator it = descriptors.find(title_crc);
-						if ( it == descriptors.end() )
-						{
-							CacheSize += title_len;
-							descriptors[title_crc] = DescriptorPair(1, title_data);
-						}
-						else
-						{
-							++it->second.reference_count;
-							delete [] title_data;
-						}
-						*pdescr++ = title_crc;
+						addParsedDescriptor(section, title_data, title_len);
 					}
 
 					//save text with UTF-8/original encoding
@@ -220,9 +327,11 @@ eventData::eventData(const eit_event_struct* e, int size, int _type, int tsidoni
 					{
 						if (!isCyrillic)
 							eventTextlen = truncateUTF8(eventText, 255 - 6);
+						else if (eventTextlen > 255 - 6)
+							eventTextlen = 255 - 6;
 
 						int text_len = 6 + eventTextlen;
-						uint8_t *text_data = new uint8_t[text_len + 2];
+						uint8_t *text_data = rebuilt;
 						text_data[0] = SHORT_EVENT_DESCRIPTOR;
 						text_data[1] = text_len;
 						text_data[2] = descr[2];
@@ -244,20 +353,7 @@ eventData::eventData(const eit_event_struct* e, int size, int _type, int tsidoni
 						}
 
 						text_len += 2; //add 2 the length to include the 2 bytes in the header
-						uint32_t text_crc = calculate_crc_hash(text_data, text_len);
-
-						DescriptorMap::iterator it = descriptors.find(text_crc);
-						if ( it == descriptors.end() )
-						{
-							CacheSize += text_len;
-							descriptors[text_crc] = DescriptorPair(1, text_data);
-						}
-						else
-						{
-							++it->second.reference_count;
-							delete [] text_data;
-						}
-						*pdescr++ = text_crc;
+						addParsedDescriptor(section, text_data, text_len);
 					}
 					break;
 				}
@@ -270,21 +366,52 @@ eventData::eventData(const eit_event_struct* e, int size, int _type, int tsidoni
 		else
 			break;
 	}
-	memcpy(rawEITdata, (uint8_t*)e, 10);
-	ASSERT(pdescr <= &descr[65]);
-	n_crc = pdescr - descr;
+	if (section.crcs.size() - event.first_crc > 65)
+	{
+		eDebug("[eEPGCache] skip event %04x with %d descriptors", (data[0] << 8) | data[1], (int)(section.crcs.size() - event.first_crc));
+		section.descriptorData.resize(section.crcs[event.first_crc].second);
+		section.crcs.resize(event.first_crc);
+		event.n_crc = 0;
+		return false;
+	}
+	event.n_crc = section.crcs.size() - event.first_crc;
+	return true;
+}
+
+/* add the parsed descriptors to the descriptor map, cache_lock needs to be set in calling procedure! */
+void eventData::init(const eEPGParsedSection &section, const eEPGParsedEvent &event)
+{
+	memcpy(rawEITdata, event.rawEITdata, 10);
+	n_crc = event.n_crc;
 	if (n_crc)
+		crc_list = allocCrcList(n_crc);
+	for (int i = 0; i < n_crc; ++i)
 	{
-		crc_list = new uint32_t[n_crc];
-		memcpy(crc_list, descr, n_crc * sizeof(uint32_t));
+		const std::pair<uint32_t, uint32_t> &entry = section.crcs[event.first_crc + i];
+		DescriptorMap::iterator it = descriptors.find(entry.first);
+		if ( it == descriptors.end() )
+		{
+			const uint8_t *descr = &section.descriptorData[entry.second];
+			int descr_len = descr[1] + 2;
+			CacheSize += descr_len;
+			uint8_t *d = eEPGDescriptorData::create(descr_len, entry.first);
+			memcpy(d, descr, descr_len);
+			descriptors[entry.first] = DescriptorPair(1, d);
+			searchIndex.add(entry.first, d);
+		}
+		else
+			++it->second.reference_count;
+		crc_list[i] = entry.first;
 	}
 	CacheSize += sizeof(*this) + n_crc * sizeof(uint32_t);
 }
 
-const eit_event_struct* eventData::get() const
+const eit_event_struct* eventData::get(std::vector<uint32_t> *crcs) const
 {
 	unsigned int pos = 12;
 	memcpy(data, rawEITdata, 10);
+	if (crcs)
+		crcs->clear();
 	unsigned int descriptors_length = 0;
 	for (uint8_t i = 0; i < n_crc; ++i)
 	{
@@ -297,6 +424,8 @@ const eit_event_struct* eventData::get() const
 				memcpy(data + pos, it->second.data, b);
 				pos += b;
 				descriptors_length += b;
+				if (crcs)
+					crcs->push_back(crc_list[i]);
 			}
 		}
 		else
@@ -321,9 +450,12 @@ eventData::~eventData()
 			}
 			if (!--p.reference_count) // no more used descriptor
 			{
-				CacheSize -= it->second.data[1];
-				delete [] it->second.data;  	// free descriptor memory
+				uint8_t *data = it->second.data;
+				uint32_t crc = it->first;
+				CacheSize -= data[1];
 				descriptors.erase(it);	// remove entry from descriptor map
+				searchIndex.remove(crc, data);
+				eEPGDescriptorData::release(data);  	// free descriptor memory, unless a snapshot still uses it
 			}
 		}
 		else
@@ -331,7 +463,7 @@ eventData::~eventData()
 			cacheCorrupt("eventData::~eventData");
 		}
 	}
-	delete [] crc_list;
+	freeCrcList(crc_list, n_crc);
 	CacheSize -= sizeof(*this) + n_crc * sizeof(uint32_t);
 }
 
@@ -345,13 +477,14 @@ void eventData::load(FILE *f)
 	ret = fread(&size, sizeof(int), 1, f);
 	descriptors.clear();
 	descriptors.rehash(size);
+	searchIndex.clear();
 	while(size)
 	{
 		ret = fread(&id, sizeof(uint32_t), 1, f);
 		ret = fread(&p.reference_count, sizeof(int), 1, f);
 		ret = fread(header, 2, 1, f);
 		int bytes = header[1]+2;
-		p.data = new uint8_t[bytes];
+		p.data = eEPGDescriptorData::create(bytes, id);
 		p.data[0] = header[0];
 		p.data[1] = header[1];
 		ret = fread(p.data+2, bytes-2, 1, f);
@@ -359,26 +492,10 @@ void eventData::load(FILE *f)
 		DescriptorMap::iterator it = descriptors.find(id);
 		if (it != descriptors.end())
 		{
-			delete [] it->second.data; // free descriptor memory
+			eEPGDescriptorData::release(it->second.data); // free descriptor memory
 		}
 		descriptors[id] = p;
-		--size;
-	}
-}
-
-void eventData::save(FILE *f)
-{
-	if (isCacheCorrupt)
-		return;
-	int size=descriptors.size();
-	DescriptorMap::iterator it(descriptors.begin());
-	fwrite(&size, sizeof(int), 1, f);
-	while(size)
-	{
-		fwrite(&it->first, sizeof(uint32_t), 1, f);
-		fwrite(&it->second.reference_count, sizeof(int), 1, f);
-		fwrite(it->second.data, it->second.data[1]+2, 1, f);
-		++it;
+		searchIndex.add(id, p.data);
 		--size;
 	}
 }
@@ -407,7 +524,9 @@ static pthread_mutex_t cache_lock =
 DEFINE_REF(eEPGCache)
 
 eEPGCache::eEPGCache()
-	:messages(this,1,"eEPGCache"), m_running(false), m_enabledEpgSources(0), cleanTimer(eTimer::create(this)), m_debug(false), m_timeQueryRef(nullptr)
+	:messages(this,1,"eEPGCache"), m_running(false), m_enabledEpgSources(0), cleanTimer(eTimer::create(this)), m_debug(false),
+	m_image(NULL), m_imageSize(0), m_imageInode(0),
+	m_snapshotBytes(0), m_snapshotHits(0), m_snapshotStaleHits(0), m_snapshotBuilds(0), m_timeQueryRef(nullptr), m_timeQueryPos(0), m_timeQueryEnd(0)
 {
 	eDebug("[eEPGCache] Initialized EPGCache (wait for setCacheFile call now)");
 
@@ -429,6 +548,16 @@ eEPGCache::eEPGCache()
 	onid_file.close();
 
 	m_debug = eConfigManager::getConfigBoolValue("config.crash.debugEPG");
+	eventData::searchIndex.setEnabled(eConfigManager::getConfigBoolValue("config.epg.searchindex", true));
+	m_snapshotsEnabled = eConfigManager::getConfigBoolValue("config.epg.snapshots", true);
+	eEPGTextCache::getInstance().setCapacity(eConfigManager::getConfigIntValue("config.epg.textcache", 256));
+
+	// EIT sections are parsed on this many worker threads, 0 parses them in the reader thread
+	int ingest_threads = eConfigManager::getConfigIntValue("config.epg.ingestthreads", 2);
+	int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ingest_threads > cpus)
+		ingest_threads = cpus;
+	m_ingest = new eEPGIngestPipeline(this, ingest_threads < 0 ? 0 : ingest_threads);
 
 	instance = this;
 }
@@ -509,7 +638,10 @@ bool eEPGCache::FixOverlapping(EventCacheItem &servicemap, time_t TM, int durati
 		}
 	}
 
-	tmp = tm_it;
+	// erasing in front of tm_it moved it, but its start time is still TM
+	tmp = servicemap.byTime.find(TM);
+	if (tmp == servicemap.byTime.end())
+		return ret;
 	while(tmp->first < (TM + duration - 60))
 	{
 		if (tmp->first != TM && tmp->second->type != PRIVATE)
@@ -529,7 +661,7 @@ bool eEPGCache::FixOverlapping(EventCacheItem &servicemap, time_t TM, int durati
 			}
 #endif
 			delete tmp->second;
-			servicemap.byTime.erase(tmp++);
+			tmp = servicemap.byTime.erase(tmp);
 			ret = true;
 		}
 		else
@@ -541,7 +673,11 @@ bool eEPGCache::FixOverlapping(EventCacheItem &servicemap, time_t TM, int durati
 }
 
 /**
- * @brief Parse EIT section data and update the EPG cache timeMap and eventMap
+ * @brief Queue EIT section data for the EPG cache
+ *
+ * Sections read from a channel are parsed by the ingest pipeline worker
+ * threads, sections submitted without a channel (imports) are parsed and
+ * committed before this returns.
  *
  * @param data EIT section data
  * @param source The type of EIT source
@@ -592,22 +728,47 @@ void eEPGCache::sectionRead(const uint8_t *data, int source, eEPGChannelData *ch
 	}
 	uniqueEPGKey service( eit->getServiceID(), onid, tsid);
 
-	eit_event_struct* eit_event = (eit_event_struct*) (data+ptr);
-	int eit_event_size;
-	int duration;
-
+	const eit_event_struct* eit_event = (const eit_event_struct*) (data+ptr);
 	time_t TM = parseDVBtime((const uint8_t*)eit_event + 2);
-	time_t now = ::time(0);
 
 	if ( TM != 3599 && TM > -1 && channel)
 		channel->haveData |= source;
 
-	singleLock s(cache_lock);
-	// hier wird immer eine eventMap zurck gegeben.. entweder eine vorhandene..
-	// oder eine durch [] erzeugte
-	EventCacheItem &servicemap = eventDB[service];
-	eventMap::iterator prevEventIt = servicemap.byEvent.end();
-	timeMap::iterator prevTimeIt = servicemap.byTime.end();
+	m_ingest->submit(data, source, service, (tsid<<16)|onid, !channel);
+}
+
+/**
+ * @brief Parse the events of an EIT section
+ *
+ * Runs without the cache_lock, the descriptors are converted and hashed
+ * here but only added to the cache by commitSection.
+ *
+ * @param data EIT section data
+ * @param source The type of EIT source
+ * @param service The service the section belongs to
+ * @param tsidonid Transport stream and original network id, for the text encoding
+ * @param section Receives the parsed events
+ * @return void
+ */
+void eEPGCache::parseSection(const uint8_t *data, int source, const uniqueEPGKey &service, int tsidonid, eEPGParsedSection &section)
+{
+	const eit_t *eit = (const eit_t*) data;
+
+	int len = eit->getSectionLength() - 1;
+	int ptr = EIT_SIZE;
+	int onid = service.onid;
+
+	/* onid_blacklist is only filled in the constructor, before the ingest workers are started */
+	if (find(onid_blacklist.begin(), onid_blacklist.end(), onid) != onid_blacklist.end())
+		return;
+
+	unsigned int days = maxdays.load(std::memory_order_relaxed);
+
+	const eit_event_struct* eit_event = (const eit_event_struct*) (data+ptr);
+	int eit_event_size;
+	int duration;
+	time_t TM;
+	time_t now = ::time(0);
 
 	while (ptr<len)
 	{
@@ -617,29 +778,81 @@ void eEPGCache::sectionRead(const uint8_t *data, int source, eEPGChannelData *ch
 		duration = fromBCD(eit_event->duration_1)*3600+fromBCD(eit_event->duration_2)*60+fromBCD(eit_event->duration_3);
 		TM = parseDVBtime((const uint8_t*)eit_event + 2, &event_hash);
 
-		std::vector<int>::iterator m_it=find(onid_blacklist.begin(),onid_blacklist.end(),onid);
-		if (m_it != onid_blacklist.end())
-			goto next;
-
 		if ( (TM != 3599) &&		// NVOD Service
 		     (now <= (TM+duration)) &&	// skip old events
-		     (TM < (now+4*maxdays*24*60*60)) &&	// maxdays for EPG - no more than 4 weeks in future
+		     (TM < (now+4*days*24*60*60)) &&	// maxdays for EPG - no more than 4 weeks in future
 		     ( (onid != 1714) || (duration != (24*3600-1)) )	// PlatformaHD invalid event
 		   )
 		{
-			uint16_t event_id = eit_event->getEventId();
+			eEPGParsedEvent event;
+			if (eventData::parse(eit_event, eit_event_size, tsidonid, section, event))
+			{
+				event.event_id = eit_event->getEventId();
+				event.start = TM;
+				event.duration = duration;
+				if (event.event_id == 0) {
+					// hack for some polsat services on 13.0E..... but this also replaces other valid event_ids with value 0..
+					// but we do not care about it...
+					event.event_id = event_hash;
+					event.rawEITdata[0] = event_hash >> 8;
+					event.rawEITdata[1] = event_hash & 0xFF;
+				}
+				section.events.push_back(event);
+			}
+		}
+		ptr += eit_event_size;
+		eit_event = (const eit_event_struct*)(((const uint8_t*)eit_event) + eit_event_size);
+	}
+}
+
+/* commit the parsed sections of the ingest pipeline with one cache_lock */
+void eEPGCache::commitSections(const std::vector<eEPGIngestJob*> &jobs)
+{
+	struct timespec start, end;
+	singleLock s(cache_lock);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (std::vector<eEPGIngestJob*>::const_iterator it(jobs.begin()); it != jobs.end(); ++it)
+	{
+		commitSection((*it)->parsed, (*it)->source, (*it)->service);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		(*it)->commit_us = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+		start = end;
+	}
+}
+
+/**
+ * @brief Update the EPG cache timeMap and eventMap with a parsed section
+ *
+ * cache_lock needs to be set in calling procedure!
+ *
+ * @param section The parsed events
+ * @param source The type of EIT source
+ * @param service The service the section belongs to
+ * @return void
+ */
+void eEPGCache::commitSection(const eEPGParsedSection &section, int source, const uniqueEPGKey &service)
+{
+	if (section.events.empty())
+		return;
+
+	materialize(service);
+	// hier wird immer eine eventMap zurck gegeben.. entweder eine vorhandene..
+	// oder eine durch [] erzeugte
+	EventCacheItem &servicemap = eventDB[service];
+	// dirty tells whether this section changed anything, the snapshot is only invalidated then
+	bool was_dirty = servicemap.dirty;
+	servicemap.dirty = false;
+
+	for (std::vector<eEPGParsedEvent>::const_iterator event(section.events.begin()); event != section.events.end(); ++event)
+	{
+		{
+			uint16_t event_id = event->event_id;
+			time_t TM = event->start;
+			int duration = event->duration;
 			eventData *evt = 0;
 			int ev_erase_count = 0;
 			int tm_erase_count = 0;
 
-			if (event_id == 0) {
-				// hack for some polsat services on 13.0E..... but this also replaces other valid event_ids with value 0..
-				// but we do not care about it...
-				event_id = event_hash;
-				eit_event->event_id_hi = event_hash >> 8;
-				eit_event->event_id_lo = event_hash & 0xFF;
-			}
-
 			// search in eventmap
 			eventMap::iterator ev_it =
 				servicemap.byEvent.find(event_id);
@@ -663,12 +876,11 @@ void eEPGCache::sectionRead(const uint8_t *data, int source, eEPGChannelData *ch
 						// exempt memory
 						eventData *tmp = ev_it->second;
 						ev_it->second = tm_it_tmp->second =
-							new eventData(eit_event, eit_event_size, source, (tsid<<16)|onid);
+							new eventData(section, *event, source);
+						if (!tmp->equals(*ev_it->second))
+							servicemap.dirty = true;
 						if (FixOverlapping(servicemap, TM, duration, tm_it_tmp, service))
-						{
-							prevEventIt = servicemap.byEvent.end();
-							prevTimeIt = servicemap.byTime.end();
-						}
+							servicemap.dirty = true;
 						delete tmp;
 						goto next;
 					}
@@ -677,7 +889,6 @@ void eEPGCache::sectionRead(const uint8_t *data, int source, eEPGChannelData *ch
 						tm_erase_count++;
 						// delete the found record from timemap
 						servicemap.byTime.erase(tm_it_tmp);
-						prevTimeIt = servicemap.byTime.end();
 					}
 				}
 			}
@@ -703,10 +914,12 @@ void eEPGCache::sectionRead(const uint8_t *data, int source, eEPGChannelData *ch
 					ev_erase_count++;
 					// delete the found record from eventmap
 					servicemap.byEvent.erase(ev_it_tmp);
-					prevEventIt = servicemap.byEvent.end();
+					// erase moved the entries behind it
+					ev_it = servicemap.byEvent.find(event_id);
 				}
 			}
-			evt = new eventData(eit_event, eit_event_size, source, (tsid<<16)|onid);
+			evt = new eventData(section, *event, source);
+			servicemap.dirty = true;
 #ifdef EPG_DEBUG
 			if(m_debug) {
 				bool consistencyCheck=true;
@@ -724,14 +937,14 @@ void eEPGCache::sectionRead(const uint8_t *data, int source, eEPGChannelData *ch
 			{
 				// exempt memory
 				delete ev_it->second;
-				tm_it = prevTimeIt = servicemap.byTime.insert( prevTimeIt, std::pair<const time_t, eventData*>( TM, evt ) );
+				tm_it = servicemap.byTime.insert( timeMap::value_type( TM, evt ) ).first;
 				ev_it->second = evt;
 			}
 			else if (ev_erase_count > 0 && tm_erase_count == 0)
 			{
 				// exempt memory
 				delete tm_it->second;
-				ev_it = prevEventIt = servicemap.byEvent.insert( prevEventIt, std::pair<const uint16_t, eventData*>( event_id, evt) );
+				ev_it = servicemap.byEvent.insert( eventMap::value_type( event_id, evt) ).first;
 				tm_it->second = evt;
 			}
 			else // added new eventData
@@ -741,8 +954,8 @@ void eEPGCache::sectionRead(const uint8_t *data, int source, eEPGChannelData *ch
 					consistencyCheck=false;
 				}
 #endif
-				ev_it = prevEventIt = servicemap.byEvent.insert( prevEventIt, std::pair<const uint16_t, eventData*>( event_id, evt) );
-				tm_it = prevTimeIt = servicemap.byTime.insert( prevTimeIt, std::pair<const time_t, eventData*>( TM, evt ) );
+				ev_it = servicemap.byEvent.insert( eventMap::value_type( event_id, evt) ).first;
+				tm_it = servicemap.byTime.insert( timeMap::value_type( TM, evt ) ).first;
 			}
 
 #ifdef EPG_DEBUG
@@ -766,11 +979,7 @@ void eEPGCache::sectionRead(const uint8_t *data, int source, eEPGChannelData *ch
 				}
 			}
 #endif
-			if (FixOverlapping(servicemap, TM, duration, tm_it, service))
-			{
-				prevEventIt = servicemap.byEvent.end();
-				prevTimeIt = servicemap.byTime.end();
-			}
+			FixOverlapping(servicemap, TM, duration, tm_it, service);
 		}
 next:
 #ifdef EPG_DEBUG
@@ -801,9 +1010,11 @@ next:
 			}
 		}
 #endif
-		ptr += eit_event_size;
-		eit_event = (eit_event_struct*)(((uint8_t*)eit_event) + eit_event_size);
+		;
 	}
+	if (servicemap.dirty)
+		invalidateSnapshot(service);
+	servicemap.dirty |= was_dirty;
 }
 
 void eEPGCache::flushEPG(int sid, int onid, int tsid)
@@ -825,6 +1036,8 @@ void eEPGCache::clearCompleteEPGCache()
 		tmMap.clear();
 	}
 	eventDB.clear();
+	m_imageServices.clear();
+	invalidateSnapshots();
 #ifdef ENABLE_PRIVATE_EPG
 	content_time_tables.clear();
 #endif
@@ -837,6 +1050,8 @@ void eEPGCache::flushEPG(const uniqueEPGKey & s, bool lock) // lock only affects
 	if (s)  // clear only this service
 	{
 		singleLock l(cache_lock);
+		m_imageServices.erase(s);
+		invalidateSnapshot(s);
 		eventCache::iterator it = eventDB.find(s);
 		if ( it != eventDB.end() )
 		{
@@ -926,13 +1141,16 @@ void eEPGCache::cleanLoop()
 					// remove entry from timeMap
 //					eDebug("[eEPGCache] release heap mem");
 					delete It->second;
-					DBIt->second.byTime.erase(It++);
+					It = DBIt->second.byTime.erase(It);
 //					eDebug("[eEPGCache] delete old event (timeMap)");
 					updated = true;
+					DBIt->second.dirty = true;
 				}
 				else
 					++It;
 			}
+			if ( updated )
+				invalidateSnapshot(DBIt->first);
 #ifdef ENABLE_PRIVATE_EPG
 			if ( updated )
 			{
@@ -969,10 +1187,12 @@ eEPGCache::~eEPGCache()
 	m_running = false;
 	messages.send(Message::quit);
 	kill(); // waiting for thread shutdown
+	delete m_ingest;
 	singleLock s(cache_lock);
 	for (eventCache::iterator evIt = eventDB.begin(); evIt != eventDB.end(); evIt++)
 		for (eventMap::iterator It = evIt->second.byEvent.begin(); It != evIt->second.byEvent.end(); It++)
 			delete It->second;
+	unmapImage();
 }
 
 void eEPGCache::gotMessage( const Message &msg )
@@ -1017,6 +1237,214 @@ void eEPGCache::clear()
 
 const static unsigned int EPG_MAGIC = 0x98765432;
 
+/*
+ * Sort the bulk loaded byTime entries of a service and build byEvent from
+ * them. Events with a duplicate start time or event id are dropped.
+ */
+static void sortEventCacheItem(EventCacheItem &item)
+{
+	std::vector<timeMap::value_type> dropped_time;
+	item.byTime.sort(&dropped_time);
+	for (std::vector<timeMap::value_type>::iterator it(dropped_time.begin()); it != dropped_time.end(); ++it)
+		delete it->second;
+	item.byEvent.clear();
+	item.byEvent.reserve(item.byTime.size());
+	for (timeMap::iterator it(item.byTime.begin()); it != item.byTime.end(); ++it)
+		item.byEvent.append(eventMap::value_type(it->second->getEventID(), it->second));
+	std::vector<eventMap::value_type> dropped_id;
+	item.byEvent.sort(&dropped_id);
+	for (std::vector<eventMap::value_type>::iterator it(dropped_id.begin()); it != dropped_id.end(); ++it)
+	{
+		item.byTime.erase(it->second->getStartTime());
+		delete it->second;
+	}
+}
+
+/*
+ * ENIGMA_EPG_V9 image, native byte order like the V8 format:
+ *
+ *   epgImageHeader
+ *   one event block per service: epgImageEvent records, each followed by
+ *     its descriptor crcs
+ *   descriptor data (tag, length, payload)
+ *   trailer: epgImageTrailer, service table, descriptor table sorted by
+ *     crc, private epg tables
+ *
+ * The trailer offset in the header is written last, an image without
+ * trailer is unfinished. The image is mapped at startup and a service is
+ * only turned into eventData when it is accessed. Saving appends the blocks
+ * of changed services and a new trailer to the mapped image, the file is
+ * rewritten when more than half of it became garbage: event blocks of
+ * services which changed since, older trailers and descriptors no event
+ * refers to anymore.
+ */
+static const char EPG_IMAGE_VERSION[] = "ENIGMA_EPG_V9";
+
+struct epgImageHeader
+{
+	uint32_t magic;
+	char version[13];
+	uint8_t reserved[3];
+	uint32_t trailer_offset;
+	uint32_t trailer_size;
+	uint32_t reserved2[2];
+};
+
+struct epgImageTrailer
+{
+	uint32_t services;
+	uint32_t descriptors;
+	uint32_t private_size;
+	uint32_t reserved;
+};
+
+struct epgImageService
+{
+	int32_t sid, onid, tsid;
+	uint32_t offset, size;
+	uint32_t reserved;
+};
+
+struct epgImageEvent
+{
+	uint16_t type;
+	uint8_t rawEITdata[10];
+	uint8_t n_crc;
+	uint8_t reserved[3];
+};
+
+struct epgImageDescriptor
+{
+	uint32_t crc, offset;
+	bool operator<(const epgImageDescriptor &a) const { return crc < a.crc; }
+};
+
+#ifdef ENABLE_PRIVATE_EPG
+struct epgImagePrivateEvent
+{
+	int64_t begin, start;
+	uint16_t event_id;
+	uint8_t reserved[6];
+};
+#endif
+
+static const epgImageTrailer *imageTrailer(const uint8_t *image)
+{
+	return (const epgImageTrailer*)(image + ((const epgImageHeader*)image)->trailer_offset);
+}
+
+template <class T>
+static void appendRaw(std::vector<uint8_t> &out, const T &value)
+{
+	const uint8_t *p = (const uint8_t*)&value;
+	out.insert(out.end(), p, p + sizeof(T));
+}
+
+static void collectImageCrcs(const uint8_t *block, uint32_t size, std::vector<uint32_t> &crcs)
+{
+	const uint8_t *end = block + size;
+	while (block + sizeof(epgImageEvent) <= end)
+	{
+		const epgImageEvent *rec = (const epgImageEvent*)block;
+		const uint32_t *crc = (const uint32_t*)(rec + 1);
+		block += sizeof(epgImageEvent) + rec->n_crc * sizeof(uint32_t);
+		if (block > end)
+			break;
+		crcs.insert(crcs.end(), crc, crc + rec->n_crc);
+	}
+}
+
+static void buildImageBlock(const timeMap &events, std::vector<uint8_t> &block, std::vector<uint32_t> &crcs)
+{
+	block.clear();
+	for (timeMap::const_iterator it(events.begin()); it != events.end(); ++it)
+	{
+		const eventData *evt = it->second;
+		epgImageEvent rec = {};
+		rec.type = evt->type;
+		memcpy(rec.rawEITdata, evt->rawEITdata, 10);
+		rec.n_crc = evt->n_crc;
+		appendRaw(block, rec);
+		for (uint8_t i = 0; i < evt->n_crc; ++i)
+			appendRaw(block, evt->crc_list[i]);
+		crcs.insert(crcs.end(), evt->crc_list, evt->crc_list + evt->n_crc);
+	}
+}
+
+static void buildImageTrailer(std::vector<uint8_t> &out, const std::vector<epgImageService> &services,
+	const std::vector<epgImageDescriptor> &descriptors, const std::vector<uint8_t> &private_tables)
+{
+	epgImageTrailer trailer = {};
+	trailer.services = services.size();
+	trailer.descriptors = descriptors.size();
+	trailer.private_size = private_tables.size();
+	out.clear();
+	appendRaw(out, trailer);
+	if (!services.empty())
+		out.insert(out.end(), (const uint8_t*)&services[0], (const uint8_t*)(&services[0] + services.size()));
+	if (!descriptors.empty())
+		out.insert(out.end(), (const uint8_t*)&descriptors[0], (const uint8_t*)(&descriptors[0] + descriptors.size()));
+	out.insert(out.end(), private_tables.begin(), private_tables.end());
+}
+
+#ifdef ENABLE_PRIVATE_EPG
+static void buildImagePrivateTables(std::vector<uint8_t> &out, const contentMaps &tables)
+{
+	out.clear();
+	appendRaw(out, (uint32_t)tables.size());
+	for (contentMaps::const_iterator a = tables.begin(); a != tables.end(); ++a)
+	{
+		appendRaw(out, a->first);
+		appendRaw(out, (uint32_t)a->second.size());
+		for (contentMap::const_iterator i = a->second.begin(); i != a->second.end(); ++i)
+		{
+			appendRaw(out, (int32_t)i->first);
+			appendRaw(out, (uint32_t)i->second.size());
+			for (contentTimeMap::const_iterator it(i->second.begin()); it != i->second.end(); ++it)
+			{
+				epgImagePrivateEvent ev = {};
+				ev.begin = it->first;
+				ev.start = it->second.first;
+				ev.event_id = it->second.second;
+				appendRaw(out, ev);
+			}
+		}
+	}
+}
+
+static void loadImagePrivateTables(const uint8_t *data, uint32_t size, contentMaps &tables)
+{
+	const uint8_t *end = data + size;
+#define IMAGE_READ(var) \
+	if (data + sizeof(var) > end) return; \
+	memcpy(&var, data, sizeof(var)); \
+	data += sizeof(var);
+	uint32_t services = 0;
+	IMAGE_READ(services);
+	while (services--)
+	{
+		uniqueEPGKey key;
+		uint32_t contents = 0;
+		IMAGE_READ(key);
+		IMAGE_READ(contents);
+		while (contents--)
+		{
+			int32_t content_id = 0;
+			uint32_t count = 0;
+			IMAGE_READ(content_id);
+			IMAGE_READ(count);
+			while (count--)
+			{
+				epgImagePrivateEvent ev;
+				IMAGE_READ(ev);
+				tables[key][content_id][ev.begin] = std::pair<time_t, uint16_t>(ev.start, ev.event_id);
+			}
+		}
+	}
+#undef IMAGE_READ
+}
+#endif
+
 void eEPGCache::load()
 {
 	if(m_debug) {
@@ -1064,9 +1492,31 @@ void eEPGCache::load()
 		}
 		char text1[13];
 		ret = fread( text1, 13, 1, f);
-		if ( !memcmp( text1, "ENIGMA_EPG_V8", 13) )
+		if ( !memcmp( text1, EPG_IMAGE_VERSION, 13) )
 		{
 			singleLock s(cache_lock);
+			invalidateSnapshots();
+			if (eventDB.size() > 0)
+			{
+				clearCompleteEPGCache();
+			}
+			/* events are read when a service is accessed for the first time */
+			if (mapImage(fileno(f), EPGDAT))
+			{
+#ifdef ENABLE_PRIVATE_EPG
+				const epgImageTrailer *trailer = imageTrailer(m_image);
+				const uint8_t *private_tables = (const uint8_t*)(trailer + 1) +
+					trailer->services * sizeof(epgImageService) + trailer->descriptors * sizeof(epgImageDescriptor);
+				loadImagePrivateTables(private_tables, trailer->private_size, content_time_tables);
+#endif
+				eDebug("[eEPGCache] %zu services mapped from %s", m_imageServices.size(), EPGDAT);
+			}
+		}
+		else if ( !memcmp( text1, "ENIGMA_EPG_V8", 13) )
+		{
+			/* old format, converted to an epg image by the next save() */
+			singleLock s(cache_lock);
+			invalidateSnapshots();
 			if (eventDB.size() > 0)
 			{
 				clearCompleteEPGCache();
@@ -1093,14 +1543,14 @@ void eEPGCache::load()
 					ret = fread( event->rawEITdata, 10, 1, f);
 					if (event->n_crc)
 					{
-						event->crc_list = new uint32_t[event->n_crc];
+						event->crc_list = eventData::allocCrcList(event->n_crc);
 						ret = fread( event->crc_list, sizeof(uint32_t), event->n_crc, f);
 					}
 					eventData::CacheSize += sizeof(eventData) + event->n_crc * sizeof(uint32_t);
-					item.byEvent[event->getEventID()] = event;
-					item.byTime[event->getStartTime()] = event;
+					item.byTime.append(timeMap::value_type(event->getStartTime(), event));
 					++cnt;
 				}
+				sortEventCacheItem(item);
 			}
 			eventData::load(f);
 			eDebug("[eEPGCache] %d events read from %s", cnt, EPGDAT);
@@ -1143,19 +1593,410 @@ void eEPGCache::load()
 #endif // ENABLE_PRIVATE_EPG
 		}
 		else
-			eDebug("[eEPGCache] don't read old epg database");
-		posix_fadvise(fileno(f), 0, 0, POSIX_FADV_DONTNEED);
-		fclose(f);
-		// We got this far, so the EPG file is okay.
-		if (renameResult == 0)
+			eDebug("[eEPGCache] don't read old epg database");
+		posix_fadvise(fileno(f), 0, 0, POSIX_FADV_DONTNEED);
+		fclose(f);
+		// We got this far, so the EPG file is okay.
+		if (renameResult == 0)
+		{
+			renameResult = rename(EPGDATX, EPGDAT);
+			if (renameResult) eDebug("[eEPGCache] failed to rename epg.dat back");
+		}
+	}
+	if(m_debug) {
+		eDebug("[eEPGCache] load() - finished");
+	}
+}
+
+bool eEPGCache::mapImage(int fd, const char *filename)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(epgImageHeader))
+		return false;
+	size_t size = st.st_size;
+	void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+	{
+		eDebug("[eEPGCache] failed to map '%s' (%m)", filename);
+		return false;
+	}
+	const uint8_t *image = (const uint8_t*)p;
+	const epgImageHeader *header = (const epgImageHeader*)image;
+	const epgImageTrailer *trailer = imageTrailer(image);
+	if (header->magic != EPG_MAGIC || memcmp(header->version, EPG_IMAGE_VERSION, 13) ||
+		!header->trailer_offset || header->trailer_size < sizeof(epgImageTrailer) ||
+		(uint64_t)header->trailer_offset + header->trailer_size > size ||
+		sizeof(epgImageTrailer) + (uint64_t)trailer->services * sizeof(epgImageService) +
+			(uint64_t)trailer->descriptors * sizeof(epgImageDescriptor) + trailer->private_size > header->trailer_size)
+	{
+		eDebug("[eEPGCache] '%s' is no valid epg image", filename);
+		munmap(p, size);
+		return false;
+	}
+
+	unmapImage();
+	m_image = image;
+	m_imageSize = size;
+	m_imageFile = filename;
+	m_imageInode = st.st_ino;
+
+	const epgImageService *services = (const epgImageService*)(trailer + 1);
+	for (uint32_t i = 0; i < trailer->services; ++i)
+	{
+		const epgImageService &s = services[i];
+		if ((uint64_t)s.offset + s.size > header->trailer_offset)
+			continue;
+		uniqueEPGKey key(s.sid, s.onid, s.tsid);
+		eventCache::iterator it = eventDB.find(key);
+		if (it != eventDB.end())
+		{
+			/* just written by save() */
+			it->second.dirty = false;
+			it->second.imageOffset = s.offset;
+			it->second.imageSize = s.size;
+		}
+		else
+		{
+			EventImageItem &item = m_imageServices[key];
+			item.offset = s.offset;
+			item.size = s.size;
+		}
+	}
+	const epgImageDescriptor *descriptors = (const epgImageDescriptor*)(services + trailer->services);
+	m_imageDescriptors.resize(trailer->descriptors);
+	for (uint32_t i = 0; i < trailer->descriptors; ++i)
+		m_imageDescriptors[i] = std::make_pair(descriptors[i].crc, descriptors[i].offset);
+	return true;
+}
+
+void eEPGCache::unmapImage()
+{
+	if (m_image)
+		munmap((void*)m_image, m_imageSize);
+	m_image = NULL;
+	m_imageSize = 0;
+	m_imageInode = 0;
+	m_imageFile.clear();
+	m_imageServices.clear();
+	m_imageDescriptors.clear();
+}
+
+const uint8_t *eEPGCache::imageDescriptor(uint32_t crc) const
+{
+	std::vector<std::pair<uint32_t, uint32_t> >::const_iterator it =
+		std::lower_bound(m_imageDescriptors.begin(), m_imageDescriptors.end(), std::make_pair(crc, (uint32_t)0));
+	if (it == m_imageDescriptors.end() || it->first != crc)
+		return NULL;
+	uint64_t offset = it->second;
+	if (offset + 2 > m_imageSize || offset + 2 + m_image[offset + 1] > m_imageSize)
+		return NULL;
+	return m_image + offset;
+}
+
+// cache_lock needs to be set in calling procedure!
+void eEPGCache::materialize(const uniqueEPGKey &service)
+{
+	if (m_imageServices.empty())
+		return;
+	eventImageMap::iterator image_it = m_imageServices.find(service);
+	if (image_it == m_imageServices.end())
+		return;
+	EventImageItem item = image_it->second;
+	m_imageServices.erase(image_it);
+
+	EventCacheItem &servicemap = eventDB[service];
+	servicemap.dirty = false;
+	servicemap.imageOffset = item.offset;
+	servicemap.imageSize = item.size;
+
+	time_t now = ::time(0) - historySeconds;
+	const uint8_t *p = m_image + item.offset;
+	const uint8_t *end = p + item.size;
+	while (p + sizeof(epgImageEvent) <= end)
+	{
+		const epgImageEvent *rec = (const epgImageEvent*)p;
+		const uint32_t *crcs = (const uint32_t*)(rec + 1);
+		p += sizeof(epgImageEvent) + rec->n_crc * sizeof(uint32_t);
+		if (p > end)
+			break;
+		time_t start_time = parseDVBtime(&rec->rawEITdata[2]);
+		int duration = fromBCD(rec->rawEITdata[7])*3600+fromBCD(rec->rawEITdata[8])*60+fromBCD(rec->rawEITdata[9]);
+		if (now > start_time + duration)
+			continue; /* outdated, cleanLoop would remove it anyway */
+
+		uint32_t crc_list[255];
+		uint8_t n_crc = 0;
+		for (uint8_t i = 0; i < rec->n_crc; ++i)
+		{
+			DescriptorMap::iterator it = eventData::descriptors.find(crcs[i]);
+			if (it != eventData::descriptors.end())
+				++it->second.reference_count;
+			else
+			{
+				const uint8_t *descr = imageDescriptor(crcs[i]);
+				if (!descr)
+				{
+					eDebug("[eEPGCache] descriptor %08x missing in epg image", crcs[i]);
+					continue;
+				}
+				int descr_len = descr[1] + 2;
+				uint8_t *d = eEPGDescriptorData::create(descr_len, crcs[i]);
+				memcpy(d, descr, descr_len);
+				eventData::CacheSize += descr_len;
+				eventData::descriptors[crcs[i]] = DescriptorPair(1, d);
+				eventData::searchIndex.add(crcs[i], d);
+			}
+			crc_list[n_crc++] = crcs[i];
+		}
+		eventData *event = new eventData(0, 0, rec->type);
+		memcpy(event->rawEITdata, rec->rawEITdata, 10);
+		event->n_crc = n_crc;
+		event->crc_list = eventData::allocCrcList(n_crc);
+		memcpy(event->crc_list, crc_list, n_crc * sizeof(uint32_t));
+		eventData::CacheSize += sizeof(eventData) + n_crc * sizeof(uint32_t);
+		servicemap.byTime.append(timeMap::value_type(start_time, event));
+	}
+	sortEventCacheItem(servicemap);
+}
+
+// cache_lock needs to be set in calling procedure!
+void eEPGCache::materializeAll()
+{
+	if (m_imageServices.empty())
+		return;
+	eventDB.rehash(eventDB.size() + m_imageServices.size());
+	while (!m_imageServices.empty())
+	{
+		uniqueEPGKey key = m_imageServices.begin()->first;
+		materialize(key);
+	}
+}
+
+/* write a complete image, cache_lock needs to be set in calling procedure! */
+bool eEPGCache::writeImage(FILE *f)
+{
+	epgImageHeader header = {};
+	header.magic = EPG_MAGIC;
+	memcpy(header.version, EPG_IMAGE_VERSION, 13);
+	fwrite(&header, sizeof(header), 1, f);
+	uint32_t pos = sizeof(header);
+
+	int cnt = 0;
+	std::vector<epgImageService> services;
+	std::vector<uint32_t> crcs;
+	std::vector<uint8_t> block;
+	services.reserve(eventDB.size() + m_imageServices.size());
+	for (eventCache::iterator service_it(eventDB.begin()); service_it != eventDB.end(); ++service_it)
+	{
+		buildImageBlock(service_it->second.byTime, block, crcs);
+		epgImageService s = { service_it->first.sid, service_it->first.onid, service_it->first.tsid, pos, (uint32_t)block.size(), 0 };
+		if (!block.empty())
+			fwrite(&block[0], block.size(), 1, f);
+		services.push_back(s);
+		pos += block.size();
+		cnt += service_it->second.byTime.size();
+	}
+	for (eventImageMap::iterator image_it(m_imageServices.begin()); image_it != m_imageServices.end(); ++image_it)
+	{
+		const uint8_t *data = m_image + image_it->second.offset;
+		epgImageService s = { image_it->first.sid, image_it->first.onid, image_it->first.tsid, pos, image_it->second.size, 0 };
+		fwrite(data, image_it->second.size, 1, f);
+		collectImageCrcs(data, image_it->second.size, crcs);
+		services.push_back(s);
+		pos += image_it->second.size;
+	}
+
+	std::sort(crcs.begin(), crcs.end());
+	crcs.erase(std::unique(crcs.begin(), crcs.end()), crcs.end());
+	std::vector<epgImageDescriptor> descriptors;
+	descriptors.reserve(crcs.size());
+	for (std::vector<uint32_t>::iterator it(crcs.begin()); it != crcs.end(); ++it)
+	{
+		DescriptorMap::iterator d = eventData::descriptors.find(*it);
+		const uint8_t *data = d != eventData::descriptors.end() ? d->second.data : imageDescriptor(*it);
+		if (!data)
+			continue;
+		epgImageDescriptor descr = { *it, pos };
+		fwrite(data, data[1] + 2, 1, f);
+		descriptors.push_back(descr);
+		pos += data[1] + 2;
+	}
+	static const uint8_t padding[4] = {};
+	fwrite(padding, (4 - (pos & 3)) & 3, 1, f);
+	pos = (pos + 3) & ~3;
+
+	std::vector<uint8_t> private_tables, trailer;
+#ifdef ENABLE_PRIVATE_EPG
+	buildImagePrivateTables(private_tables, content_time_tables);
+#endif
+	buildImageTrailer(trailer, services, descriptors, private_tables);
+	fwrite(&trailer[0], trailer.size(), 1, f);
+
+	// write trailer offset after binary data
+	// has been written to disk.
+	fflush(f);
+	fsync(fileno(f));
+	header.trailer_offset = pos;
+	header.trailer_size = trailer.size();
+	fseek(f, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, f);
+	fflush(f);
+	if(m_debug) {
+		eDebug("[eEPGCache] %d events, %zu services, %zu descriptors written", cnt, services.size(), descriptors.size());
+	}
+	return !ferror(f);
+}
+
+/* adds the descriptor crcs of the events in an image block to crcs */
+static void imageBlockCrcs(const uint8_t *p, uint32_t size, std::vector<uint32_t> &crcs)
+{
+	const uint8_t *end = p + size;
+	while (p + sizeof(epgImageEvent) <= end)
+	{
+		const epgImageEvent *rec = (const epgImageEvent*)p;
+		const uint32_t *rec_crcs = (const uint32_t*)(rec + 1);
+		p += sizeof(epgImageEvent) + rec->n_crc * sizeof(uint32_t);
+		if (p > end)
+			break;
+		crcs.insert(crcs.end(), rec_crcs, rec_crcs + rec->n_crc);
+	}
+}
+
+/* append the changed services to the mapped image, cache_lock needs to be set in calling procedure! */
+bool eEPGCache::appendImage(const char *filename)
+{
+	struct stat st;
+	if (!m_image || m_imageFile != filename || stat(filename, &st) < 0 ||
+		st.st_ino != m_imageInode || (size_t)st.st_size != m_imageSize)
+		return false;
+
+	/* everything a rewrite wouldn't copy is garbage */
+	uint64_t live = sizeof(epgImageHeader) + ((const epgImageHeader*)m_image)->trailer_size;
+	std::vector<uint32_t> referenced;
+	for (eventImageMap::iterator image_it(m_imageServices.begin()); image_it != m_imageServices.end(); ++image_it)
+	{
+		live += image_it->second.size;
+		imageBlockCrcs(m_image + image_it->second.offset, image_it->second.size, referenced);
+	}
+	for (eventCache::iterator service_it(eventDB.begin()); service_it != eventDB.end(); ++service_it)
+	{
+		EventCacheItem &item = service_it->second;
+		if (!item.dirty)
+		{
+			live += item.imageSize;
+			imageBlockCrcs(m_image + item.imageOffset, item.imageSize, referenced);
+		}
+		else
 		{
-			renameResult = rename(EPGDATX, EPGDAT);
-			if (renameResult) eDebug("[eEPGCache] failed to rename epg.dat back");
+			/* the new block of the service may still use descriptors of the image */
+			for (timeMap::iterator it(item.byTime.begin()); it != item.byTime.end(); ++it)
+				referenced.insert(referenced.end(), it->second->crc_list, it->second->crc_list + it->second->n_crc);
+		}
+	}
+	std::sort(referenced.begin(), referenced.end());
+	referenced.erase(std::unique(referenced.begin(), referenced.end()), referenced.end());
+	for (std::vector<uint32_t>::iterator it(referenced.begin()); it != referenced.end(); ++it)
+	{
+		const uint8_t *descr = imageDescriptor(*it);
+		if (descr)
+			live += descr[1] + 2;
+	}
+	if (live < m_imageSize && (m_imageSize - live) * 2 > m_imageSize)
+		return false; /* mostly garbage, rewrite it */
+
+	FILE *f = fopen(filename, "r+b");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	static const uint8_t padding[4] = {};
+	uint32_t pos = m_imageSize;
+	fwrite(padding, (4 - (pos & 3)) & 3, 1, f);
+	pos = (pos + 3) & ~3;
+
+	int cnt = 0;
+	std::vector<epgImageService> services;
+	std::vector<uint32_t> crcs;
+	std::vector<uint8_t> block;
+	services.reserve(eventDB.size() + m_imageServices.size());
+	for (eventCache::iterator service_it(eventDB.begin()); service_it != eventDB.end(); ++service_it)
+	{
+		EventCacheItem &item = service_it->second;
+		epgImageService s = { service_it->first.sid, service_it->first.onid, service_it->first.tsid, item.imageOffset, item.imageSize, 0 };
+		if (item.dirty)
+		{
+			buildImageBlock(item.byTime, block, crcs);
+			if (!block.empty())
+				fwrite(&block[0], block.size(), 1, f);
+			s.offset = pos;
+			s.size = block.size();
+			pos += block.size();
+			++cnt;
 		}
+		services.push_back(s);
+	}
+	for (eventImageMap::iterator image_it(m_imageServices.begin()); image_it != m_imageServices.end(); ++image_it)
+	{
+		epgImageService s = { image_it->first.sid, image_it->first.onid, image_it->first.tsid, image_it->second.offset, image_it->second.size, 0 };
+		services.push_back(s);
+	}
+
+	/* only descriptors which are not in the image yet */
+	std::sort(crcs.begin(), crcs.end());
+	crcs.erase(std::unique(crcs.begin(), crcs.end()), crcs.end());
+	std::vector<epgImageDescriptor> descriptors;
+	descriptors.reserve(m_imageDescriptors.size() + crcs.size());
+	for (std::vector<std::pair<uint32_t, uint32_t> >::iterator it(m_imageDescriptors.begin()); it != m_imageDescriptors.end(); ++it)
+	{
+		epgImageDescriptor descr = { it->first, it->second };
+		descriptors.push_back(descr);
+	}
+	size_t old_descriptors = descriptors.size();
+	for (std::vector<uint32_t>::iterator it(crcs.begin()); it != crcs.end(); ++it)
+	{
+		if (imageDescriptor(*it))
+			continue;
+		DescriptorMap::iterator d = eventData::descriptors.find(*it);
+		if (d == eventData::descriptors.end())
+			continue;
+		epgImageDescriptor descr = { *it, pos };
+		fwrite(d->second.data, d->second.data[1] + 2, 1, f);
+		descriptors.push_back(descr);
+		pos += d->second.data[1] + 2;
 	}
+	std::inplace_merge(descriptors.begin(), descriptors.begin() + old_descriptors, descriptors.end());
+	fwrite(padding, (4 - (pos & 3)) & 3, 1, f);
+	pos = (pos + 3) & ~3;
+
+	std::vector<uint8_t> private_tables, trailer;
+#ifdef ENABLE_PRIVATE_EPG
+	buildImagePrivateTables(private_tables, content_time_tables);
+#endif
+	buildImageTrailer(trailer, services, descriptors, private_tables);
+	fwrite(&trailer[0], trailer.size(), 1, f);
+	fflush(f);
+	fsync(fileno(f));
+
+	// switch to the new trailer only after it has been written to disk
+	uint32_t trailer_pos[2] = { pos, (uint32_t)trailer.size() };
+	fseek(f, offsetof(epgImageHeader, trailer_offset), SEEK_SET);
+	fwrite(trailer_pos, sizeof(trailer_pos), 1, f);
+	fflush(f);
+	bool ok = !ferror(f);
+	fsync(fileno(f));
+	fclose(f);
+	if (!ok)
+		return false;
+
 	if(m_debug) {
-		eDebug("[eEPGCache] load() - finished");
+		eDebug("[eEPGCache] %d changed services appended to %s", cnt, filename);
+	}
+	int fd = ::open(filename, O_RDONLY);
+	if (fd >= 0)
+	{
+		mapImage(fd, filename);
+		::close(fd);
 	}
+	return true;
 }
 
 void eEPGCache::save()
@@ -1169,7 +2010,7 @@ void eEPGCache::save()
 		if (eventData::isCacheCorrupt)
 			return;
 		// only save epg.dat if it is not empty
-		if (eventData::CacheSize < 1)
+		if (eventData::CacheSize < 1 && m_imageServices.empty())
 			return;
 
 		std::vector<char> vEPGDAT(m_filename.begin(), m_filename.end());
@@ -1177,25 +2018,32 @@ void eEPGCache::save()
 		const char* EPGDAT = &vEPGDAT[0];
 
 		singleLock s(cache_lock);
+		/* unchanged services are already on disk */
+		if (appendImage(EPGDAT))
+			return;
+
+		std::string tmpname = std::string(EPGDAT) + ".saving";
 		/* create empty file */
-		FILE *f = fopen(EPGDAT, "wb");
+		FILE *f = fopen(tmpname.c_str(), "wb");
 		if (!f)
 		{
-			eDebug("[eEPGCache] Failed to open %s: %m", EPGDAT);
+			eDebug("[eEPGCache] Failed to open %s: %m", tmpname.c_str());
 			EPGDAT = EPGDAT_IN_FLASH;
-			f = fopen(EPGDAT, "wb");
+			tmpname = std::string(EPGDAT) + ".saving";
+			f = fopen(tmpname.c_str(), "wb");
 			if (!f)
 			{
-				eDebug("[eEPGCache] Failed to open '%s' (%m)", EPGDAT);
+				eDebug("[eEPGCache] Failed to open '%s' (%m)", tmpname.c_str());
 				return;
 			}
 		}
 
-		char* buf = realpath(EPGDAT, NULL);
+		char* buf = realpath(tmpname.c_str(), NULL);
 		if (!buf)
 		{
-			eDebug("[eEPGCache] realpath to '%s' failed in save (%m)", EPGDAT);
+			eDebug("[eEPGCache] realpath to '%s' failed in save (%m)", tmpname.c_str());
 			fclose(f);
+			unlink(tmpname.c_str());
 			return;
 		}
 		if(m_debug) {
@@ -1206,83 +2054,169 @@ void eEPGCache::save()
 		if (statfs(buf, &st) < 0) {
 			eDebug("[eEPGCache] statfs '%s' failed in save (%m)", buf);
 			fclose(f);
+			unlink(tmpname.c_str());
 			free(buf);
 			return;
 		}
 
 		// check for enough free space on storage
+		uint64_t needed = ((uint64_t)eventData::CacheSize*12)/10; // 20% overhead
+		for (eventImageMap::iterator image_it(m_imageServices.begin()); image_it != m_imageServices.end(); ++image_it)
+			needed += image_it->second.size;
 		tmp=st.f_bfree;
 		tmp*=st.f_bsize;
-		if ( tmp < (eventData::CacheSize*12)/10 ) // 20% overhead
+		if ( (uint64_t)tmp < needed )
 		{
-			eDebug("[eEPGCache] not enough free space at '%s' %jd bytes available but %u needed", buf, (intmax_t)tmp, (eventData::CacheSize*12)/10);
+			eDebug("[eEPGCache] not enough free space at '%s' %jd bytes available but %ju needed", buf, (intmax_t)tmp, (uintmax_t)needed);
 			fclose(f);
+			unlink(tmpname.c_str());
 			free(buf);
 			return;
 		}
 
 		free(buf);
 
-		int cnt=0;
-		unsigned int magic = EPG_MAGIC;
-		fwrite(&magic, sizeof(int), 1, f);
-		const char *text = "UNFINISHED_V8";
-		fwrite( text, 13, 1, f );
-		int size = eventDB.size();
-		fwrite( &size, sizeof(int), 1, f );
-		for (eventCache::iterator service_it(eventDB.begin()); service_it != eventDB.end(); ++service_it)
-		{
-			timeMap &timemap = service_it->second.byTime;
-			fwrite( &service_it->first, sizeof(uniqueEPGKey), 1, f);
-			size = timemap.size();
-			fwrite( &size, sizeof(int), 1, f);
-			for (timeMap::iterator time_it(timemap.begin()); time_it != timemap.end(); ++time_it)
+		bool ok = writeImage(f);
+		fclose(f);
+		if (!ok || rename(tmpname.c_str(), EPGDAT))
+		{
+			eDebug("[eEPGCache] failed to write '%s' (%m)", EPGDAT);
+			unlink(tmpname.c_str());
+			return;
+		}
+		/* continue with the new image, the old mapping stays valid until then */
+		int fd = ::open(EPGDAT, O_RDONLY);
+		if (fd >= 0)
+		{
+			mapImage(fd, EPGDAT);
+			::close(fd);
+		}
+	}
+}
+
+// cache_lock needs to be set in calling procedure!
+void eEPGCache::invalidateSnapshot(const uniqueEPGKey &service)
+{
+	eSingleLocker l(m_snapshotLock);
+	snapshotMap::iterator it = m_snapshots.find(service);
+	if (it != m_snapshots.end())
+		it->second.stale = true;
+}
+
+// cache_lock needs to be set in calling procedure!
+void eEPGCache::invalidateSnapshots()
+{
+	eSingleLocker l(m_snapshotLock);
+	for (snapshotMap::iterator it(m_snapshots.begin()); it != m_snapshots.end(); ++it)
+		it->second.stale = true;
+}
+
+/**
+ * @brief Return the immutable snapshot of the events of a service
+ *
+ * A valid snapshot is returned without taking the cache_lock. Writers only
+ * mark the snapshot of a changed service as stale, the next reader builds a
+ * new one. When the cache is locked by a writer at that moment, the stale
+ * snapshot is returned instead of waiting for the writer.
+ *
+ * @param service The service
+ * @return the snapshot, never NULL
+ */
+eEPGSnapshotPtr eEPGCache::getSnapshot(const uniqueEPGKey &service)
+{
+	eEPGSnapshotPtr stale;
+	{
+		eSingleLocker l(m_snapshotLock);
+		snapshotMap::iterator it = m_snapshots.find(service);
+		if (it != m_snapshots.end())
+		{
+			m_snapshotLru.splice(m_snapshotLru.begin(), m_snapshotLru, it->second.lru);
+			if (!it->second.stale)
 			{
-				uint8_t len = time_it->second->n_crc * sizeof(uint32_t) + 10;
-				fwrite( &time_it->second->type, sizeof(uint16_t), 1, f );
-				fwrite( &len, sizeof(uint8_t), 1, f);
-				fwrite( time_it->second->rawEITdata, 10, 1, f);
-				fwrite( time_it->second->crc_list, sizeof(uint32_t), time_it->second->n_crc, f);
-				++cnt;
+				++m_snapshotHits;
+				return it->second.snapshot;
 			}
+			stale = it->second.snapshot;
 		}
-		if(m_debug) {
-			eDebug("[eEPGCache] %d events written to %s", cnt, EPGDAT);
-		}
-		eventData::save(f);
-#ifdef ENABLE_PRIVATE_EPG
-		const char* text3 = "PRIVATE_EPG";
-		fwrite( text3, 11, 1, f );
-		size = content_time_tables.size();
-		fwrite( &size, sizeof(int), 1, f);
-		for (contentMaps::iterator a = content_time_tables.begin(); a != content_time_tables.end(); ++a)
-		{
-			contentMap &content_time_table = a->second;
-			fwrite( &a->first, sizeof(uniqueEPGKey), 1, f);
-			int size = content_time_table.size();
-			fwrite( &size, sizeof(int), 1, f);
-			for (contentMap::iterator i = content_time_table.begin(); i != content_time_table.end(); ++i )
+	}
+	if (!stale)
+		pthread_mutex_lock(&cache_lock);
+	else if (pthread_mutex_trylock(&cache_lock))
+	{
+		eSingleLocker l(m_snapshotLock);
+		++m_snapshotStaleHits;
+		return stale;
+	}
+
+	/* build it with the cache_lock held, so no writer can invalidate it before it is stored */
+	eEPGServiceSnapshot *snapshot = new eEPGServiceSnapshot;
+	materialize(service);
+	eventCache::iterator It = eventDB.find(service);
+	if (It != eventDB.end())
+	{
+		for (timeMap::iterator i = It->second.byTime.begin(); i != It->second.byTime.end(); ++i)
+		{
+			const eventData *event = i->second;
+			const uint8_t *descriptors[255];
+			int n = 0;
+			for (int c = 0; c < event->n_crc; ++c)
 			{
-				int size = i->second.size();
-				fwrite( &i->first, sizeof(int), 1, f);
-				fwrite( &size, sizeof(int), 1, f);
-				for ( contentTimeMap::iterator it(i->second.begin());
-					it != i->second.end(); ++it )
-				{
-					fwrite( &it->first, sizeof(time_t), 1, f);
-					fwrite( &it->second.first, sizeof(time_t), 1, f);
-					fwrite( &it->second.second, sizeof(uint16_t), 1, f);
-				}
+				DescriptorMap::iterator d = eventData::descriptors.find(event->crc_list[c]);
+				if (d != eventData::descriptors.end())
+					descriptors[n++] = d->second.data;
 			}
+			snapshot->add(i->first, event->getDuration(), event->rawEITdata, descriptors, n);
+		}
+	}
+	snapshot->finish();
+	eEPGSnapshotPtr result(snapshot);
+	{
+		eSingleLocker l(m_snapshotLock);
+		std::pair<snapshotMap::iterator, bool> inserted = m_snapshots.insert(snapshotMap::value_type(service, SnapshotItem()));
+		SnapshotItem &item = inserted.first->second;
+		if (inserted.second)
+		{
+			m_snapshotLru.push_front(service);
+			item.lru = m_snapshotLru.begin();
+		}
+		else
+		{
+			m_snapshotLru.splice(m_snapshotLru.begin(), m_snapshotLru, item.lru);
+			m_snapshotBytes -= item.bytes;
+		}
+		item.snapshot = result;
+		item.stale = false;
+		item.bytes = snapshot->memoryUsage();
+		m_snapshotBytes += item.bytes;
+		++m_snapshotBuilds;
+		/* drop the least recently used ones, readers still holding them keep them alive */
+		while (m_snapshotBytes > MAX_SNAPSHOT_BYTES && m_snapshots.size() > 1)
+		{
+			snapshotMap::iterator oldest = m_snapshots.find(m_snapshotLru.back());
+			m_snapshotBytes -= oldest->second.bytes;
+			m_snapshots.erase(oldest);
+			m_snapshotLru.pop_back();
 		}
-#endif
-		// write version string after binary data
-		// has been written to disk.
-		fsync(fileno(f));
-		fseek(f, sizeof(int), SEEK_SET);
-		fwrite("ENIGMA_EPG_V8", 13, 1, f);
-		fclose(f);
 	}
+	pthread_mutex_unlock(&cache_lock);
+	return result;
+}
+
+/**
+ * @brief Look up an event in the snapshot of a service
+ *
+ * @param service The service
+ * @param type 2 to look up the event id @p value, otherwise the direction
+ * for a lookup of the time @p value as in lookupEventTime
+ * @param snapshot Receives the snapshot holding the event
+ * @return the index of the event in @p snapshot or -1
+ */
+int eEPGCache::lookupSnapshot(const eServiceReference &service, int type, time_t value, eEPGSnapshotPtr &snapshot)
+{
+	snapshot = getSnapshot(uniqueEPGKey(handleGroup(service)));
+	if (type == 2)
+		return snapshot->lookupId(value);
+	return snapshot->lookupTime(value, type);
 }
 
 /** @copydoc eEPGCache::lookupEventTime
@@ -1290,6 +2224,7 @@ void eEPGCache::save()
 RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, const eventData *&result, int direction)
 {
 	uniqueEPGKey key(handleGroup(service));
+	materialize(key);
 
 	// check whether EPG for this service is ready...
 	eventCache::iterator It = eventDB.find( key );
@@ -1358,6 +2293,17 @@ RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, co
  */
 RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, Event *& result, int direction)
 {
+	eLatencyHistogram::Timer timer(m_lookupLatency);
+	if (m_snapshotsEnabled)
+	{
+		eEPGSnapshotPtr snapshot;
+		uint8_t buffer[eEPGServiceSnapshot::MAX_EVENT_SIZE];
+		int i = lookupSnapshot(service, direction, t, snapshot);
+		if (i < 0)
+			return -1;
+		result = new Event((uint8_t*)snapshot->event(i, buffer));
+		return 0;
+	}
 	singleLock s(cache_lock);
 	const eventData *data = nullptr;
 	RESULT ret = lookupEventTime(service, t, data, direction);
@@ -1370,16 +2316,31 @@ RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, Ev
  */
 RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, ePtr<eServiceEvent> &result, int direction)
 {
+	eLatencyHistogram::Timer timer(m_lookupLatency);
+	result = NULL;
+	if (m_snapshotsEnabled)
+	{
+		eEPGSnapshotPtr snapshot;
+		uint8_t buffer[eEPGServiceSnapshot::MAX_EVENT_SIZE];
+		int i = lookupSnapshot(service, direction, t, snapshot);
+		if (i < 0)
+			return -1;
+		std::vector<uint32_t> crcs;
+		Event ev((uint8_t*)snapshot->event(i, buffer, &crcs));
+		result = new eServiceEvent();
+		const eServiceReferenceDVB &ref = (const eServiceReferenceDVB&)service;
+		return result->parseFrom(&ev, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get(), ref.getServiceID().get(), crcs);
+	}
 	singleLock s(cache_lock);
 	const eventData *data = nullptr;
 	RESULT ret = lookupEventTime(service, t, data, direction);
-	result = NULL;
 	if ( !ret && data )
 	{
-		Event *ev = new Event((uint8_t*)data->get());
+		std::vector<uint32_t> crcs;
+		Event *ev = new Event((uint8_t*)data->get(&crcs));
 		result = new eServiceEvent();
 		const eServiceReferenceDVB &ref = (const eServiceReferenceDVB&)service;
-		ret = result->parseFrom(ev, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get(), ref.getServiceID().get());
+		ret = result->parseFrom(ev, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get(), ref.getServiceID().get(), crcs);
 		delete ev;
 	}
 	return ret;
@@ -1388,6 +2349,7 @@ RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, eP
 RESULT eEPGCache::lookupEventId(const eServiceReference &service, int event_id, const eventData *&result )
 {
 	uniqueEPGKey key(handleGroup(service));
+	materialize(key);
 
 	eventCache::iterator It = eventDB.find(key);
 	if (It != eventDB.end())
@@ -1451,6 +2413,17 @@ RESULT eEPGCache::saveEventToFile(const char* filename, const eServiceReference
 
 RESULT eEPGCache::lookupEventId(const eServiceReference &service, int event_id, Event *& result)
 {
+	eLatencyHistogram::Timer timer(m_lookupLatency);
+	if (m_snapshotsEnabled)
+	{
+		eEPGSnapshotPtr snapshot;
+		uint8_t buffer[eEPGServiceSnapshot::MAX_EVENT_SIZE];
+		int i = lookupSnapshot(service, 2, event_id, snapshot);
+		if (i < 0)
+			return -1;
+		result = new Event((uint8_t*)snapshot->event(i, buffer));
+		return 0;
+	}
 	singleLock s(cache_lock);
 	const eventData *data=0;
 	RESULT ret = lookupEventId(service, event_id, data);
@@ -1461,22 +2434,56 @@ RESULT eEPGCache::lookupEventId(const eServiceReference &service, int event_id,
 
 RESULT eEPGCache::lookupEventId(const eServiceReference &service, int event_id, ePtr<eServiceEvent> &result)
 {
+	eLatencyHistogram::Timer timer(m_lookupLatency);
+	result = NULL;
+	if (m_snapshotsEnabled)
+	{
+		eEPGSnapshotPtr snapshot;
+		uint8_t buffer[eEPGServiceSnapshot::MAX_EVENT_SIZE];
+		int i = lookupSnapshot(service, 2, event_id, snapshot);
+		if (i < 0)
+			return -1;
+		std::vector<uint32_t> crcs;
+		Event ev((uint8_t*)snapshot->event(i, buffer, &crcs));
+		result = new eServiceEvent();
+		const eServiceReferenceDVB &ref = (const eServiceReferenceDVB&)service;
+		return result->parseFrom(&ev, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get(), ref.getServiceID().get(), crcs);
+	}
 	singleLock s(cache_lock);
 	const eventData *data=0;
 	RESULT ret = lookupEventId(service, event_id, data);
-	result = NULL;
 	if ( !ret && data )
 	{
-		Event ev((uint8_t*)data->get());
+		std::vector<uint32_t> crcs;
+		Event ev((uint8_t*)data->get(&crcs));
 		result = new eServiceEvent();
 		const eServiceReferenceDVB &ref = (const eServiceReferenceDVB&)service;
-		ret = result->parseFrom(&ev, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get(), ref.getServiceID().get());
+		ret = result->parseFrom(&ev, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get(), ref.getServiceID().get(), crcs);
 	}
 	return ret;
 }
 
 RESULT eEPGCache::startTimeQuery(const eServiceReference &service, time_t begin, int minutes)
 {
+	eLatencyHistogram::Timer timer(m_lookupLatency);
+	if (m_snapshotsEnabled)
+	{
+		if (m_timeQueryRef)
+			delete m_timeQueryRef;
+		m_timeQueryRef = (eServiceReferenceDVB*)new eServiceReference(handleGroup(service));
+
+		if (begin == -1)
+			begin = ::time(0);
+
+		m_timeQueryBegin = begin;
+		m_timeQueryMinutes = minutes;
+		m_timeQueryCount = 0;
+		m_timeQuerySnapshot = getSnapshot(*m_timeQueryRef);
+
+		m_timeQueryPos = m_timeQuerySnapshot->timeRange(begin, minutes, m_timeQueryEnd);
+		return m_timeQueryPos < m_timeQueryEnd ? 0 : -1;
+	}
+
 	singleLock s(cache_lock);
 
 	if (m_timeQueryRef)
@@ -1489,7 +2496,9 @@ RESULT eEPGCache::startTimeQuery(const eServiceReference &service, time_t begin,
 	m_timeQueryBegin = begin;
 	m_timeQueryMinutes = minutes;
 	m_timeQueryCount = 0;
+	m_timeQuerySnapshot.reset();
 
+	materialize(*m_timeQueryRef);
 	eventCache::iterator It = eventDB.find(*m_timeQueryRef);
 	if ( It != eventDB.end() && !It->second.byTime.empty() )
 	{
@@ -1498,10 +2507,10 @@ RESULT eEPGCache::startTimeQuery(const eServiceReference &service, time_t begin,
 		{
 			if ( timemap_it->first != m_timeQueryBegin )
 			{
-				timeMap::iterator x = timemap_it;
-				--x;
-				if ( x != It->second.byTime.end() )
+				if ( timemap_it != It->second.byTime.begin() )
 				{
+					timeMap::iterator x = timemap_it;
+					--x;
 					time_t start_time = x->first;
 					if ( m_timeQueryBegin > start_time && m_timeQueryBegin < (start_time+x->second->getDuration()))
 						timemap_it = x;
@@ -1522,6 +2531,16 @@ RESULT eEPGCache::startTimeQuery(const eServiceReference &service, time_t begin,
 
 RESULT eEPGCache::getNextTimeEntry(Event *&result)
 {
+	if (m_timeQuerySnapshot)
+	{
+		int i = m_timeQueryPos + m_timeQueryCount;
+		if (i >= m_timeQueryEnd)
+			return -1;
+		uint8_t buffer[eEPGServiceSnapshot::MAX_EVENT_SIZE];
+		result = new Event((uint8_t*)m_timeQuerySnapshot->event(i, buffer));
+		m_timeQueryCount++;
+		return 0;
+	}
 	singleLock s(cache_lock);
 	eventCache::iterator It = eventDB.find(*m_timeQueryRef);
 	if ( It != eventDB.end() && !It->second.byTime.empty() )
@@ -1531,10 +2550,10 @@ RESULT eEPGCache::getNextTimeEntry(Event *&result)
 		{
 			if ( timemap_it->first != m_timeQueryBegin )
 			{
-				timeMap::iterator x = timemap_it;
-				--x;
-				if ( x != It->second.byTime.end() )
+				if ( timemap_it != It->second.byTime.begin() )
 				{
+					timeMap::iterator x = timemap_it;
+					--x;
 					time_t start_time = x->first;
 					if ( m_timeQueryBegin > start_time && m_timeQueryBegin < (start_time+x->second->getDuration()))
 						timemap_it = x;
@@ -1567,6 +2586,20 @@ RESULT eEPGCache::getNextTimeEntry(Event *&result)
 
 RESULT eEPGCache::getNextTimeEntry(ePtr<eServiceEvent> &result)
 {
+	if (m_timeQuerySnapshot)
+	{
+		int i = m_timeQueryPos + m_timeQueryCount;
+		if (i >= m_timeQueryEnd)
+			return -1;
+		uint8_t buffer[eEPGServiceSnapshot::MAX_EVENT_SIZE];
+		std::vector<uint32_t> crcs;
+		Event ev((uint8_t*)m_timeQuerySnapshot->event(i, buffer, &crcs));
+		result = new eServiceEvent();
+		int currentQueryTsidOnid = (m_timeQueryRef->getTransportStreamID().get()<<16) | m_timeQueryRef->getOriginalNetworkID().get();
+		int currentQuerySid = m_timeQueryRef->getServiceID().get();
+		m_timeQueryCount++;
+		return result->parseFrom(&ev, currentQueryTsidOnid, currentQuerySid, crcs);
+	}
 	singleLock s(cache_lock);
 	eventCache::iterator It = eventDB.find(*m_timeQueryRef);
 	if ( It != eventDB.end() && !It->second.byTime.empty() )
@@ -1576,10 +2609,10 @@ RESULT eEPGCache::getNextTimeEntry(ePtr<eServiceEvent> &result)
 		{
 			if ( timemap_it->first != m_timeQueryBegin )
 			{
-				timeMap::iterator x = timemap_it;
-				--x;
-				if ( x != It->second.byTime.end() )
+				if ( timemap_it != It->second.byTime.begin() )
 				{
+					timeMap::iterator x = timemap_it;
+					--x;
 					time_t start_time = x->first;
 					if ( m_timeQueryBegin > start_time && m_timeQueryBegin < (start_time+x->second->getDuration()))
 						timemap_it = x;
@@ -1602,12 +2635,13 @@ RESULT eEPGCache::getNextTimeEntry(ePtr<eServiceEvent> &result)
 		}
 		if ( timemap_it != timemap_end )
 		{
-			Event ev((uint8_t*)timemap_it->second->get());
+			std::vector<uint32_t> crcs;
+			Event ev((uint8_t*)timemap_it->second->get(&crcs));
 			result = new eServiceEvent();
 			int currentQueryTsidOnid = (m_timeQueryRef->getTransportStreamID().get()<<16) | m_timeQueryRef->getOriginalNetworkID().get();
 			int currentQuerySid = m_timeQueryRef->getServiceID().get();
 			m_timeQueryCount++;
-			return result->parseFrom(&ev, currentQueryTsidOnid, currentQuerySid);
+			return result->parseFrom(&ev, currentQueryTsidOnid, currentQuerySid, crcs);
 		}
 	}
 	return -1;
@@ -1933,22 +2967,42 @@ PyObject *eEPGCache::lookupEvent(ePyObject list, ePyObject convertFunc)
 			else
 			{
 				eServiceEvent evt;
-				const eventData *ev_data=0;
+				bool found = false;
 				if (stime)
 				{
-					singleLock s(cache_lock);
-					if (type == 2)
-						lookupEventId(ref, event_id, ev_data);
+					eLatencyHistogram::Timer timer(m_lookupLatency);
+					const eServiceReferenceDVB &dref = (const eServiceReferenceDVB&)ref;
+					if (m_snapshotsEnabled)
+					{
+						eEPGSnapshotPtr snapshot;
+						uint8_t buffer[eEPGServiceSnapshot::MAX_EVENT_SIZE];
+						int i = lookupSnapshot(ref, type, type == 2 ? event_id : stime, snapshot);
+						if (i >= 0)
+						{
+							std::vector<uint32_t> crcs;
+							Event ev((uint8_t*)snapshot->event(i, buffer, &crcs));
+							evt.parseFrom(&ev, (dref.getTransportStreamID().get()<<16)|dref.getOriginalNetworkID().get(), dref.getServiceID().get(), crcs);
+							found = true;
+						}
+					}
 					else
-						lookupEventTime(ref, stime, ev_data, type);
-					if (ev_data)
 					{
-						const eServiceReferenceDVB &dref = (const eServiceReferenceDVB&)ref;
-						Event ev((uint8_t*)ev_data->get());
-						evt.parseFrom(&ev, (dref.getTransportStreamID().get()<<16)|dref.getOriginalNetworkID().get(), dref.getServiceID().get());
+						const eventData *ev_data=0;
+						singleLock s(cache_lock);
+						if (type == 2)
+							lookupEventId(ref, event_id, ev_data);
+						else
+							lookupEventTime(ref, stime, ev_data, type);
+						if (ev_data)
+						{
+							std::vector<uint32_t> crcs;
+							Event ev((uint8_t*)ev_data->get(&crcs));
+							evt.parseFrom(&ev, (dref.getTransportStreamID().get()<<16)|dref.getOriginalNetworkID().get(), dref.getServiceID().get(), crcs);
+							found = true;
+						}
 					}
 				}
-				if (ev_data)
+				if (found)
 				{
 					if (handleEvent(&evt, dest_list, argstring, argcount, service, nowTime, service_name, convertFunc, convertFuncArgs))
 						return 0; // error
@@ -1971,6 +3025,171 @@ skip_entry:
 	return dest_list;
 }
 
+/*
+ * Title of a cached event without building an eServiceEvent. The cache
+ * stores the event name as its own UTF-8 short event descriptor, so this
+ * is a copy in the common case. Events with names in several languages
+ * take the eServiceEvent path, which selects the configured language.
+ */
+static ePyObject eventTitle(const eit_event_struct *event, const eServiceReferenceDVB &ref)
+{
+	const uint8_t *data = (const uint8_t*)event;
+	int len = event->getDescriptorsLoopLength();
+	const uint8_t *name = NULL;
+	const uint8_t *language = NULL;
+	bool simple = true;
+	for (int ptr = EIT_LOOP_SIZE; ptr + 1 < EIT_LOOP_SIZE + len; ptr += data[ptr + 1] + 2)
+	{
+		const uint8_t *descr = data + ptr;
+		if (descr[0] != SHORT_EVENT_DESCRIPTOR)
+			continue;
+		if (language && memcmp(language, descr + 2, 3))
+			simple = false;
+		language = descr + 2;
+		if (descr[5])
+		{
+			if (name)
+				simple = false;
+			name = descr;
+		}
+	}
+	if (!name)
+		return PyString_FromString("");
+	if (!simple || name[6] != 0x15)
+	{
+		Event ev(data);
+		eServiceEvent evt;
+		evt.parseFrom(&ev, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get(), ref.getServiceID().get());
+		std::string title = evt.getEventName();
+		return PyUnicode_DecodeUTF8(title.data(), title.length(), "replace");
+	}
+	char title[256];
+	int title_len = name[5] - 1;
+	memcpy(title, name + 7, title_len);
+	for (int i = 0; i < title_len; ++i)
+	{
+		if (title[i] == '\n' || title[i] == '\t')
+			title[i] = ' ';
+	}
+	return PyUnicode_DecodeUTF8(title, title_len, "replace");
+}
+
+/**
+ * @brief Look up the events of many services in a time window with one call
+ *
+ * Each service is resolved once and its events are read in time order, from
+ * the service snapshot or, with config.epg.snapshots off, the cache itself. The result is columnar, a dict of parallel lists:
+ * "service" (index into @p services), "start", "duration", "event_id" and,
+ * when @p titles is set, "title".
+ *
+ * @param services list of service reference strings
+ * @param begin start of the window, -1 for now
+ * @param minutes length of the window, -1 for all following events
+ * @param titles also return the event titles
+ * @return the dict or NULL with a python exception set
+ */
+PyObject *eEPGCache::lookupEventsInWindow(ePyObject services, time_t begin, int minutes, bool titles)
+{
+	if (!PyList_Check(services))
+	{
+		PyErr_SetString(PyExc_TypeError, "[eEPGCache] arg 0 is not a list");
+		return NULL;
+	}
+	if (begin == -1)
+		begin = ::time(0);
+
+	std::vector<int> service_column;
+	std::vector<time_t> start_column;
+	std::vector<int> duration_column;
+	std::vector<int> id_column;
+	std::vector<ePyObject> title_column;
+	uint8_t buffer[eEPGServiceSnapshot::MAX_EVENT_SIZE];
+
+	int count = PyList_Size(services);
+	for (int i = 0; i < count; ++i)
+	{
+		ePyObject item = PyList_GET_ITEM(services, i); // borrowed reference!
+		if (!PyString_Check(item))
+			continue;
+		eLatencyHistogram::Timer timer(m_lookupLatency);
+		eServiceReference ref(handleGroup(eServiceReference(PyString_AS_STRING(item))));
+		// redirect subservice querys to parent service
+		eServiceReferenceDVB &dvb_ref = (eServiceReferenceDVB&)ref;
+		if (dvb_ref.getParentTransportStreamID().get())
+		{
+			dvb_ref.setTransportStreamID(dvb_ref.getParentTransportStreamID());
+			dvb_ref.setServiceID(dvb_ref.getParentServiceID());
+		}
+		if (m_snapshotsEnabled)
+		{
+			eEPGSnapshotPtr snapshot = getSnapshot(uniqueEPGKey(ref));
+			int end;
+			for (int pos = snapshot->timeRange(begin, minutes, end); pos < end; ++pos)
+			{
+				const eEPGServiceSnapshot::Entry &entry = (*snapshot)[pos];
+				service_column.push_back(i);
+				start_column.push_back(entry.start);
+				duration_column.push_back(entry.duration);
+				id_column.push_back(entry.event_id);
+				if (titles)
+					title_column.push_back(eventTitle(snapshot->event(pos, buffer), dvb_ref));
+			}
+			continue;
+		}
+
+		singleLock s(cache_lock);
+		materialize(uniqueEPGKey(ref));
+		eventCache::iterator It = eventDB.find(uniqueEPGKey(ref));
+		if (It == eventDB.end())
+			continue;
+		timeMap &byTime = It->second.byTime;
+		timeMap::iterator pos = byTime.lower_bound(begin);
+		if (pos != byTime.end() && pos->first != begin && pos != byTime.begin())
+		{
+			timeMap::iterator x = pos;
+			--x;
+			if (begin > x->first && begin < x->first + x->second->getDuration())
+				pos = x;
+		}
+		timeMap::iterator end = minutes != -1 ? byTime.lower_bound(begin + minutes * 60) : byTime.end();
+		for (; pos != end; ++pos)
+		{
+			service_column.push_back(i);
+			start_column.push_back(pos->first);
+			duration_column.push_back(pos->second->getDuration());
+			id_column.push_back(pos->second->getEventID());
+			if (titles)
+				title_column.push_back(eventTitle(pos->second->get(), dvb_ref));
+		}
+	}
+
+	int events = service_column.size();
+	ePyObject service_list = PyList_New(events);
+	ePyObject start_list = PyList_New(events);
+	ePyObject duration_list = PyList_New(events);
+	ePyObject id_list = PyList_New(events);
+	for (int i = 0; i < events; ++i)
+	{
+		PyList_SET_ITEM(service_list, i, PyInt_FromLong(service_column[i]));
+		PyList_SET_ITEM(start_list, i, PyInt_FromLong(start_column[i]));
+		PyList_SET_ITEM(duration_list, i, PyInt_FromLong(duration_column[i]));
+		PyList_SET_ITEM(id_list, i, PyInt_FromLong(id_column[i]));
+	}
+	ePyObject dict = PyDict_New();
+	PutToDict(dict, "service", service_list);
+	PutToDict(dict, "start", start_list);
+	PutToDict(dict, "duration", duration_list);
+	PutToDict(dict, "event_id", id_list);
+	if (titles)
+	{
+		ePyObject title_list = PyList_New(events);
+		for (int i = 0; i < events; ++i)
+			PyList_SET_ITEM(title_list, i, title_column[i]);
+		PutToDict(dict, "title", title_list);
+	}
+	return dict;
+}
+
 static void fill_eit_start(eit_event_struct *evt, time_t t)
 {
     tm time;
@@ -2652,99 +3871,116 @@ PyObject *eEPGCache::search(ePyObject arg)
 						/* new block to release epgcache lock before Py_END_ALLOW_THREADS is called
 						   otherwise there might be a deadlock with other python thread waiting for the epgcache lock */
 						singleLock s(cache_lock);
-						std::string text;
-						for (DescriptorMap::iterator it(eventData::descriptors.begin());
-							it != eventData::descriptors.end(); ++it)
+						materializeAll();
+						/* title and description searches are answered from the text index, if it can */
+						if (!eventData::searchIndex.isEnabled() || !eventData::searchIndex.search(querytype, str, strlen, casetype, descr))
 						{
-							uint8_t *data = it->second.data;
-							int textlen = 0;
-							const char *textptr = NULL;
-							if ( data[0] == SHORT_EVENT_DESCRIPTOR && querytype > 0 && querytype < 5 )
+							std::string text;
+							for (DescriptorMap::iterator it(eventData::descriptors.begin());
+								it != eventData::descriptors.end(); ++it)
 							{
-								textptr = (const char*)&data[6];
-								textlen = data[5];
-								if (data[6] < 0x20)
+								uint8_t *data = it->second.data;
+								int textlen = 0;
+								const char *textptr = NULL;
+								if ( data[0] == SHORT_EVENT_DESCRIPTOR && querytype > 0 && querytype < 5 )
 								{
-									/* custom encoding */
-									text = convertDVBUTF8((unsigned char*)textptr, textlen, 0x40, 0);
-									textptr = text.data();
-									textlen = text.length();
+									textptr = (const char*)&data[6];
+									textlen = data[5];
+									if (eventData::searchIndex.isEnabled())
+									{
+										/* the index has the text decoded already */
+										if (!eventData::searchIndex.getText(it->first, data, textptr, textlen))
+											textlen = 0;
+									}
+									else if (data[6] < 0x20)
+									{
+										/* custom encoding */
+										text = convertDVBUTF8((unsigned char*)textptr, textlen, 0x40, 0);
+										textptr = text.data();
+										textlen = text.length();
+									}
 								}
-							}
-							else if ( data[0] == EXTENDED_EVENT_DESCRIPTOR && querytype == 5 )
-							{
-								textptr = (const char*)&data[8];
-								textlen = data[7];
-								if (data[8] < 0x20)
+								else if ( data[0] == EXTENDED_EVENT_DESCRIPTOR && querytype == 5 )
 								{
-									/* custom encoding */
-									text = convertDVBUTF8((unsigned char*)textptr, textlen, 0x40, 0);
-									textptr = text.data();
-									textlen = text.length();
+									textptr = (const char*)&data[8];
+									textlen = data[7];
+									if (eventData::searchIndex.isEnabled())
+									{
+										/* the index has the text decoded already */
+										if (!eventData::searchIndex.getText(it->first, data, textptr, textlen))
+											textlen = 0;
+									}
+									else if (data[8] < 0x20)
+									{
+										/* custom encoding */
+										text = convertDVBUTF8((unsigned char*)textptr, textlen, 0x40, 0);
+										textptr = text.data();
+										textlen = text.length();
+									}
 								}
-							}
-							else if ( data[0] == CONTENT_IDENTIFIER_DESCRIPTOR && querytype == 6 )
-							{
-								auto cid = ContentIdentifierDescriptor(data);
-								auto cril = cid.getIdentifier();
-								for (auto crid = cril->begin(); crid != cril->end(); ++crid)
+								else if ( data[0] == CONTENT_IDENTIFIER_DESCRIPTOR && querytype == 6 )
 								{
-									// UK broadcasters set the two top bits of crid_type, i.e. 0x31 and 0x32 rather than
-									// the specification's 1 and 2 for episode and series respectively
-									if (((*crid)->getType() & 0xf) == casetype && (*crid)->getBytes()->data() != NULL)
+									auto cid = ContentIdentifierDescriptor(data);
+									auto cril = cid.getIdentifier();
+									for (auto crid = cril->begin(); crid != cril->end(); ++crid)
 									{
-										// Exact match required for CRID data
-										if ((*crid)->getLength() == strlen && memcmp((*crid)->getBytes()->data(), str, strlen) == 0)
+										// UK broadcasters set the two top bits of crid_type, i.e. 0x31 and 0x32 rather than
+										// the specification's 1 and 2 for episode and series respectively
+										if (((*crid)->getType() & 0xf) == casetype && (*crid)->getBytes()->data() != NULL)
 										{
-											descr.push_back(it->first);
+											// Exact match required for CRID data
+											if ((*crid)->getLength() == strlen && memcmp((*crid)->getBytes()->data(), str, strlen) == 0)
+											{
+												descr.push_back(it->first);
+											}
 										}
 									}
 								}
-							}
-							/* if we have a descriptor, the argument may not be bigger */
-							if (textlen > 0 && strlen <= textlen )
-							{
-								if (querytype == 1)
-								{
-									/* require exact text match */
-									if (textlen != strlen)
-										continue;
-								}
-								else if (querytype == 3)
-								{
-									/* Do a "startswith" match by pretending the text isn't that long */
-									textlen = strlen;
-								}
-								else if (querytype == 4)
-								{
-									/* Offset to adjust the pointer based on the text length difference */
-									textptr = textptr + textlen - strlen;
-									textlen = strlen;
-								}
-								if (casetype)
+								/* if we have a descriptor, the argument may not be bigger */
+								if (textlen > 0 && strlen <= textlen )
 								{
-									while (textlen >= strlen)
+									if (querytype == 1)
+									{
+										/* require exact text match */
+										if (textlen != strlen)
+											continue;
+									}
+									else if (querytype == 3)
+									{
+										/* Do a "startswith" match by pretending the text isn't that long */
+										textlen = strlen;
+									}
+									else if (querytype == 4)
+									{
+										/* Offset to adjust the pointer based on the text length difference */
+										textptr = textptr + textlen - strlen;
+										textlen = strlen;
+									}
+									if (casetype)
 									{
-										if (!strncasecmp(textptr, str, strlen))
+										while (textlen >= strlen)
 										{
-											descr.push_back(it->first);
-											break;
+											if (!strncasecmp(textptr, str, strlen))
+											{
+												descr.push_back(it->first);
+												break;
+											}
+											textlen--;
+											textptr++;
 										}
-										textlen--;
-										textptr++;
 									}
-								}
-								else
-								{
-									while (textlen >= strlen)
+									else
 									{
-										if (!memcmp(textptr, str, strlen))
+										while (textlen >= strlen)
 										{
-											descr.push_back(it->first);
-											break;
+											if (!memcmp(textptr, str, strlen))
+											{
+												descr.push_back(it->first);
+												break;
+											}
+											textlen--;
+											textptr++;
 										}
-										textlen--;
-										textptr++;
 									}
 								}
 							}
@@ -2789,7 +4025,12 @@ PyObject *eEPGCache::search(ePyObject arg)
 		// ref is only valid in SIMILAR_BROADCASTING_SEARCH
 		// in this case we start searching with the base service
 		bool first = ref.valid() ? true : false;
+		/* a text search can match thousands of descriptors, don't scan them linearly per event */
+		std::unordered_set<uint32_t> descr_set;
+		if (querytype)
+			descr_set.insert(descr.begin(), descr.end());
 		singleLock s(cache_lock);
+		materializeAll();
 		eventCache::iterator cit(ref.valid() ? eventDB.find(ref) : eventDB.begin());
 		while(cit != eventDB.end() && maxcount)
 		{
@@ -2811,21 +4052,22 @@ PyObject *eEPGCache::search(ePyObject arg)
 				}
 				// check if any of our descriptor used by this event
 				unsigned int cnt = 0;
-				for (uint8_t i = 0; i < evit->second->n_crc; ++i)
+				if (querytype)
+				{
+					/* we need only one match, when we're not looking for similar broadcasting events */
+					for (uint8_t i = 0; i < evit->second->n_crc && !cnt; ++i)
+						cnt = descr_set.count(evit->second->crc_list[i]);
+				}
+				else
 				{
-					uint32_t crc32 = evit->second->crc_list[i];
-					for (std::deque<uint32_t>::const_iterator it = descr.begin();
-						it != descr.end(); ++it)
+					for (uint8_t i = 0; i < evit->second->n_crc; ++i)
 					{
-						if (*it == crc32)  // found...
+						uint32_t crc32 = evit->second->crc_list[i];
+						for (std::deque<uint32_t>::const_iterator it = descr.begin();
+							it != descr.end(); ++it)
 						{
-							++cnt;
-							if (querytype)
-							{
-								/* we need only one match, when we're not looking for similar broadcasting events */
-								i = evit->second->n_crc;
-								break;
-							}
+							if (*it == crc32)  // found...
+								++cnt;
 						}
 					}
 				}
@@ -2852,8 +4094,9 @@ PyObject *eEPGCache::search(ePyObject arg)
 								else
 								{
 									const eServiceReferenceDVB &dref = (const eServiceReferenceDVB&)ref;
-									Event ev((uint8_t*)ev_data->get());
-									ptr.parseFrom(&ev, (dref.getTransportStreamID().get()<<16)|dref.getOriginalNetworkID().get(), dref.getServiceID().get());
+									std::vector<uint32_t> crcs;
+									Event ev((uint8_t*)ev_data->get(&crcs));
+									ptr.parseFrom(&ev, (dref.getTransportStreamID().get()<<16)|dref.getOriginalNetworkID().get(), dref.getServiceID().get(), crcs);
 								}
 							}
 						// create service name
@@ -2928,6 +4171,88 @@ PyObject *eEPGCache::search(ePyObject arg)
 	return ret;
 }
 
+/* size of a glibc malloc chunk for a request of n bytes */
+static size_t mallocChunkSize(size_t n)
+{
+	size_t chunk = (n + sizeof(size_t) + 2 * sizeof(size_t) - 1) & ~(2 * sizeof(size_t) - 1);
+	return chunk < 4 * sizeof(size_t) ? 4 * sizeof(size_t) : chunk;
+}
+
+/**
+ * @brief Return the memory usage of the EPG cache as dict
+ *
+ * event_bytes and index_bytes are used by the flat event storage,
+ * map_layout_bytes is what the same events would need with one heap
+ * eventData, one heap crc list and a std::map node in byEvent and byTime
+ * per event, saved_bytes is the difference.
+ */
+PyObject *eEPGCache::getCacheStatistics()
+{
+	size_t events = 0, index_bytes = 0, map_layout_bytes = 0, descriptor_bytes = 0;
+	const size_t node_size = 4 * sizeof(void*) + sizeof(timeMap::value_type);
+	singleLock s(cache_lock);
+	for (eventCache::iterator it(eventDB.begin()); it != eventDB.end(); ++it)
+	{
+		timeMap &tmMap = it->second.byTime;
+		events += tmMap.size();
+		index_bytes += tmMap.capacity() * sizeof(timeMap::value_type) + it->second.byEvent.capacity() * sizeof(eventMap::value_type);
+		for (timeMap::iterator i = tmMap.begin(); i != tmMap.end(); ++i)
+		{
+			map_layout_bytes += 2 * mallocChunkSize(node_size) + mallocChunkSize(sizeof(eventData));
+			if (i->second->n_crc)
+				map_layout_bytes += mallocChunkSize(i->second->n_crc * sizeof(uint32_t));
+		}
+	}
+	for (DescriptorMap::iterator it(eventData::descriptors.begin()); it != eventData::descriptors.end(); ++it)
+		descriptor_bytes += it->second.data[1] + 2;
+	size_t used_bytes = eventData::arena.chunkBytes() + index_bytes;
+
+	ePyObject dict = PyDict_New();
+	PutToDict(dict, "services", eventDB.size());
+	PutToDict(dict, "mapped_services", m_imageServices.size());
+	PutToDict(dict, "events", events);
+	PutToDict(dict, "descriptors", eventData::descriptors.size());
+	PutToDict(dict, "descriptor_bytes", descriptor_bytes);
+	PutToDict(dict, "event_bytes", eventData::arena.usedBytes());
+	PutToDict(dict, "arena_bytes", eventData::arena.chunkBytes());
+	PutToDict(dict, "index_bytes", index_bytes);
+	PutToDict(dict, "search_index_bytes", eventData::searchIndex.memoryUsage());
+	PutToDict(dict, "map_layout_bytes", map_layout_bytes);
+	PutToDict(dict, "saved_bytes", (long)map_layout_bytes - (long)used_bytes);
+	eEPGTextCache::getInstance().getStatistics(dict);
+	return dict;
+}
+
+PyObject *eEPGCache::getIngestStatistics()
+{
+	ePyObject dict = PyDict_New();
+	m_ingest->getStatistics(dict);
+	return dict;
+}
+
+PyObject *eEPGCache::getLookupStatistics(bool reset)
+{
+	ePyObject dict = PyDict_New();
+	PutToDict(dict, "lookups", m_lookupLatency.count());
+	PutToDict(dict, "p50_us", m_lookupLatency.percentile(50));
+	PutToDict(dict, "p90_us", m_lookupLatency.percentile(90));
+	PutToDict(dict, "p99_us", m_lookupLatency.percentile(99));
+	PutToDict(dict, "max_us", m_lookupLatency.max());
+	{
+		eSingleLocker l(m_snapshotLock);
+		PutToDict(dict, "snapshots", m_snapshots.size());
+		PutToDict(dict, "snapshot_bytes", m_snapshotBytes);
+		PutToDict(dict, "snapshot_hits", m_snapshotHits);
+		PutToDict(dict, "snapshot_stale_hits", m_snapshotStaleHits);
+		PutToDict(dict, "snapshot_builds", m_snapshotBuilds);
+		if (reset)
+			m_snapshotHits = m_snapshotStaleHits = m_snapshotBuilds = 0;
+	}
+	if (reset)
+		m_lookupLatency.reset();
+	return dict;
+}
+
 #ifdef ENABLE_PRIVATE_EPG
 struct date_time
 {
@@ -2965,7 +4290,10 @@ void eEPGCache::privateSectionRead(const uniqueEPGKey &current_service, const ui
 	contentMap &content_time_table = content_time_tables[current_service];
 	singleLock s(cache_lock);
 	std::map< date_time, std::list<uniqueEPGKey>, less_datetime > start_times;
+	materialize(current_service);
+	invalidateSnapshots();
 	EventCacheItem &eventDBitem = eventDB[current_service];
+	eventDBitem.dirty = true;
 	eventMap &evMap = eventDBitem.byEvent;
 	timeMap &tmMap = eventDBitem.byTime;
 	int ptr = 8;
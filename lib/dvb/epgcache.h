@@ -11,12 +11,17 @@
 
 #ifndef SWIG
 
+#include <atomic>
+#include <list>
 #include <vector>
 #include <tr1/unordered_map>
+#include <sys/types.h>
 
 #include <lib/dvb/idvb.h>
 #include <lib/dvb/dvbtime.h>
+#include <lib/dvb/epgsnapshot.h>
 #include <lib/base/ebase.h>
+#include <lib/base/flatmap.h>
 #include <lib/base/thread.h>
 #include <lib/base/message.h>
 #include <lib/service/event.h>
@@ -26,6 +31,8 @@ struct eventData;
 class eServiceReferenceDVB;
 class eEPGChannelData;
 class eEPGTransponderDataReader;
+class eEPGIngestPipeline;
+struct eEPGIngestJob;
 
 struct uniqueEPGKey
 {
@@ -74,9 +81,9 @@ struct uniqueEPGKey
 };
 
 //eventMap is sorted by event_id
-typedef std::map<uint16_t, eventData*> eventMap;
+typedef eFlatMap<uint16_t, eventData*> eventMap;
 //timeMap is sorted by beginTime
-typedef std::map<time_t, eventData*> timeMap;
+typedef eFlatMap<time_t, eventData*> timeMap;
 
 struct hash_uniqueEPGKey
 {
@@ -89,8 +96,20 @@ struct hash_uniqueEPGKey
 struct EventCacheItem {
 	eventMap byEvent;
 	timeMap byTime;
+	// false when the events are unchanged since they were read from / written to the epg.dat image
+	bool dirty;
+	// event block of this service in the mapped epg.dat image (valid when !dirty)
+	uint32_t imageOffset, imageSize;
+	EventCacheItem()
+		:dirty(true), imageOffset(0), imageSize(0) {}
 };
 
+// service whose events are still in the mapped epg.dat image only
+struct EventImageItem {
+	uint32_t offset, size, count;
+};
+typedef std::tr1::unordered_map<uniqueEPGKey, EventImageItem, hash_uniqueEPGKey, uniqueEPGKey::equal> eventImageMap;
+
 typedef std::tr1::unordered_map<uniqueEPGKey, EventCacheItem, hash_uniqueEPGKey, uniqueEPGKey::equal> eventCache;
 #ifdef ENABLE_PRIVATE_EPG
 	typedef std::tr1::unordered_map<time_t, std::pair<time_t, uint16_t> > contentTimeMap;
@@ -98,6 +117,26 @@ typedef std::tr1::unordered_map<uniqueEPGKey, EventCacheItem, hash_uniqueEPGKey,
 	typedef std::tr1::unordered_map<uniqueEPGKey, contentMap, hash_uniqueEPGKey, uniqueEPGKey::equal > contentMaps;
 #endif
 
+// an EIT event parsed from a section, before it is added to the cache
+struct eEPGParsedEvent
+{
+	uint16_t event_id;
+	time_t start;
+	int duration;
+	uint8_t rawEITdata[10];
+	uint8_t n_crc;
+	uint32_t first_crc; // index into eEPGParsedSection::crcs
+};
+
+// the cacheable events of one EIT section, parsed and hashed without holding the cache_lock
+struct eEPGParsedSection
+{
+	std::vector<eEPGParsedEvent> events;
+	// crc and offset of the descriptor in descriptorData
+	std::vector<std::pair<uint32_t, uint32_t> > crcs;
+	std::vector<uint8_t> descriptorData;
+};
+
 struct eit_parental_rating {
         u_char  country_code[3];
         u_char  rating;
@@ -136,10 +175,11 @@ private:
 	friend struct eventData;
 	friend class eEPGChannelData;
 	friend class eEPGTransponderDataReader;
+	friend class eEPGIngestPipeline;
 	static eEPGCache *instance;
 
 	unsigned int historySeconds;
-	unsigned int maxdays;
+	std::atomic<unsigned int> maxdays; // read by the ingest workers
 
 	std::vector<int> onid_blacklist;
 	eventCache eventDB;
@@ -155,12 +195,52 @@ private:
 	contentMaps content_time_tables;
 #endif
 
+	// mmap'ed epg.dat (ENIGMA_EPG_V9), services are materialized on first access
+	const uint8_t *m_image;
+	size_t m_imageSize;
+	std::string m_imageFile;
+	ino_t m_imageInode;
+	eventImageMap m_imageServices;
+	std::vector<std::pair<uint32_t, uint32_t> > m_imageDescriptors; // sorted crc -> file offset
+	bool mapImage(int fd, const char *filename);
+	void unmapImage();
+	const uint8_t *imageDescriptor(uint32_t crc) const;
+	void materialize(const uniqueEPGKey &service);
+	void materializeAll();
+	bool writeImage(FILE *f);
+	bool appendImage(const char *filename);
+
 	void thread();  // thread function
 
 #ifdef ENABLE_PRIVATE_EPG
 	void privateSectionRead(const uniqueEPGKey &, const uint8_t *);
 #endif
 	void sectionRead(const uint8_t *data, int source, eEPGChannelData *channel);
+	eEPGIngestPipeline *m_ingest;
+	void parseSection(const uint8_t *data, int source, const uniqueEPGKey &service, int tsidonid, eEPGParsedSection &section);
+	void commitSection(const eEPGParsedSection &section, int source, const uniqueEPGKey &service);
+	void commitSections(const std::vector<eEPGIngestJob*> &jobs);
+
+	// read-mostly lookups on immutable per service snapshots, see getSnapshot
+	struct SnapshotItem
+	{
+		eEPGSnapshotPtr snapshot;
+		bool stale;
+		size_t bytes;
+		std::list<uniqueEPGKey>::iterator lru; // position in m_snapshotLru
+	};
+	typedef std::tr1::unordered_map<uniqueEPGKey, SnapshotItem, hash_uniqueEPGKey, uniqueEPGKey::equal> snapshotMap;
+	bool m_snapshotsEnabled;
+	eSingleLock m_snapshotLock; // never held while waiting for the cache_lock
+	snapshotMap m_snapshots;
+	std::list<uniqueEPGKey> m_snapshotLru; // most recently used first
+	size_t m_snapshotBytes;
+	unsigned int m_snapshotHits, m_snapshotStaleHits, m_snapshotBuilds;
+	eLatencyHistogram m_lookupLatency;
+	eEPGSnapshotPtr getSnapshot(const uniqueEPGKey &service);
+	int lookupSnapshot(const eServiceReference &service, int type, time_t value, eEPGSnapshotPtr &snapshot);
+	void invalidateSnapshot(const uniqueEPGKey &service);
+	void invalidateSnapshots();
 
 	void gotMessage(const Message &message);
 	void cleanLoop();
@@ -172,6 +252,8 @@ private:
 	time_t m_timeQueryBegin;
 	int m_timeQueryMinutes;
 	int m_timeQueryCount;  // counts the returned events; getNextTimeEntry returns always the m_timeQueryCount'th event
+	eEPGSnapshotPtr m_timeQuerySnapshot;
+	int m_timeQueryPos, m_timeQueryEnd; // range of the query in m_timeQuerySnapshot
 #else
 	eEPGCache();
 	~eEPGCache();
@@ -231,7 +313,15 @@ public:
 		NO_CASE_CHECK
 	};
 	PyObject *lookupEvent(SWIG_PYOBJECT(ePyObject) list, SWIG_PYOBJECT(ePyObject) convertFunc=(PyObject*)0);
+	// columnar events of a list of services in a time window, for EPG grids
+	PyObject *lookupEventsInWindow(SWIG_PYOBJECT(ePyObject) services, time_t begin, int minutes, bool titles=true);
 	PyObject *search(SWIG_PYOBJECT(ePyObject));
+	// memory usage of the cached events, see eEPGCache::getCacheStatistics
+	PyObject *getCacheStatistics();
+	// worker threads, queue and per source throughput of the EIT section ingestion
+	PyObject *getIngestStatistics();
+	// latency percentiles of the event lookups and snapshot usage, optionally restarting the measurement
+	PyObject *getLookupStatistics(bool reset=false);
 
 	// eServiceEvent are parsed epg events.. it's safe to use them after cache unlock
 	// for use from python ( members: m_start_time, m_duration, m_short_description, m_extended_description )
@@ -0,0 +1,239 @@
+#include <lib/dvb/epgingest.h>
+
+#include <unistd.h>
+#include <lib/base/eerror.h>
+#include <lib/dvb/lowlevel/eit.h>
+#include <lib/python/python_helpers.h>
+
+/* sections per second are measured over windows of this many seconds */
+#define RATE_WINDOW 10
+
+static inline void now(struct timespec &ts)
+{
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+}
+
+static inline int elapsed_us(const struct timespec &from, const struct timespec &to)
+{
+	return (to.tv_sec - from.tv_sec) * 1000000 + (to.tv_nsec - from.tv_nsec) / 1000;
+}
+
+void eEPGIngestPipeline::Worker::thread()
+{
+	hasStarted();
+	/* same priority as the EPG thread */
+	if (nice(4) == -1)
+	{
+		eDebug("[eEPGIngestPipeline] worker failed to modify scheduling priority (%m)");
+	}
+	m_pipeline.process();
+}
+
+eEPGIngestPipeline::eEPGIngestPipeline(eEPGCache *cache, int threads)
+	:m_cache(cache), m_taken(0), m_committing(false), m_stop(false), m_batches(0), m_batch_max_us(0)
+{
+	for (int i = 0; i < threads; ++i)
+	{
+		Worker *worker = new Worker(*this);
+		worker->run();
+		m_workers.push_back(worker);
+	}
+	eDebug("[eEPGIngestPipeline] %d worker thread(s)", threads);
+}
+
+eEPGIngestPipeline::~eEPGIngestPipeline()
+{
+	{
+		eSingleLocker l(m_lock);
+		m_stop = true;
+		m_work.broadcast();
+		m_space.broadcast();
+	}
+	for (std::vector<Worker*>::iterator it(m_workers.begin()); it != m_workers.end(); ++it)
+	{
+		(*it)->kill();
+		delete *it;
+	}
+	/* sections not committed yet are dropped, they will be broadcast again */
+	for (std::deque<eEPGIngestJob*>::iterator it(m_jobs.begin()); it != m_jobs.end(); ++it)
+		delete *it;
+}
+
+void eEPGIngestPipeline::submit(const uint8_t *data, int source, const uniqueEPGKey &service, int tsidonid, bool synchronous)
+{
+	const eit_t *eit = (const eit_t*)data;
+	eEPGIngestJob *job = new eEPGIngestJob;
+	job->section.assign(data, data + eit->getSectionLength() + 3);
+	job->source = source;
+	job->tsidonid = tsidonid;
+	job->service = service;
+	job->parse_us = job->commit_us = 0;
+	job->done = false;
+	now(job->queued);
+
+	if (synchronous || m_workers.empty())
+	{
+		std::vector<eEPGIngestJob*> jobs(1, job);
+		parse(job);
+		commit(jobs);
+		return;
+	}
+
+	eSingleLocker l(m_lock);
+	while (!m_stop && m_jobs.size() >= MAX_QUEUED)
+		m_space.wait(m_lock);
+	if (m_stop)
+	{
+		delete job;
+		return;
+	}
+	m_jobs.push_back(job);
+	m_work.signal();
+}
+
+void eEPGIngestPipeline::flush()
+{
+	eSingleLocker l(m_lock);
+	while (!m_stop && (!m_jobs.empty() || m_committing))
+		m_space.wait(m_lock);
+}
+
+void eEPGIngestPipeline::process()
+{
+	while (true)
+	{
+		eEPGIngestJob *job;
+		{
+			eSingleLocker l(m_lock);
+			while (!m_stop && m_taken == m_jobs.size())
+				m_work.wait(m_lock);
+			if (m_stop)
+				return;
+			job = m_jobs[m_taken++];
+		}
+		parse(job);
+		{
+			eSingleLocker l(m_lock);
+			job->done = true;
+		}
+		commitReady();
+	}
+}
+
+void eEPGIngestPipeline::parse(eEPGIngestJob *job)
+{
+	struct timespec start, end;
+	now(start);
+	m_cache->parseSection(&job->section[0], job->source, job->service, job->tsidonid, job->parsed);
+	now(end);
+	job->parse_us = elapsed_us(start, end);
+	/* the raw section is not needed anymore */
+	std::vector<uint8_t>().swap(job->section);
+}
+
+/*
+ * Commit the parsed jobs at the front of the queue. Only one thread commits
+ * at a time, so sections are applied in the order they were received, even
+ * when a later section was parsed first.
+ */
+void eEPGIngestPipeline::commitReady()
+{
+	std::vector<eEPGIngestJob*> ready;
+	{
+		eSingleLocker l(m_lock);
+		if (m_committing)
+			return;
+		m_committing = true;
+	}
+	while (true)
+	{
+		{
+			eSingleLocker l(m_lock);
+			while (!m_jobs.empty() && m_jobs.front()->done && ready.size() < MAX_COMMIT_BATCH)
+			{
+				ready.push_back(m_jobs.front());
+				m_jobs.pop_front();
+				--m_taken;
+			}
+			if (ready.empty() || m_stop)
+			{
+				m_committing = false;
+				m_space.broadcast();
+				break;
+			}
+		}
+		commit(ready);
+		ready.clear();
+		m_space.broadcast();
+	}
+	for (std::vector<eEPGIngestJob*>::iterator it(ready.begin()); it != ready.end(); ++it)
+		delete *it;
+}
+
+void eEPGIngestPipeline::commit(std::vector<eEPGIngestJob*> &jobs)
+{
+	struct timespec start, end;
+	now(start);
+	m_cache->commitSections(jobs);
+	now(end);
+	account(jobs, elapsed_us(start, end));
+	for (std::vector<eEPGIngestJob*>::iterator it(jobs.begin()); it != jobs.end(); ++it)
+		delete *it;
+}
+
+void eEPGIngestPipeline::account(const std::vector<eEPGIngestJob*> &jobs, int batch_us)
+{
+	struct timespec ts;
+	now(ts);
+	eSingleLocker l(m_lock);
+	++m_batches;
+	if ((unsigned int)batch_us > m_batch_max_us)
+		m_batch_max_us = batch_us;
+	for (std::vector<eEPGIngestJob*>::const_iterator it(jobs.begin()); it != jobs.end(); ++it)
+	{
+		const eEPGIngestJob *job = *it;
+		SourceStatistics &s = m_statistics[job->source];
+		++s.sections;
+		s.events += job->parsed.events.size();
+		s.parse_us += job->parse_us;
+		s.queue_us += elapsed_us(job->queued, ts);
+		s.commit_us += job->commit_us;
+		if ((unsigned int)job->commit_us > s.commit_max_us)
+			s.commit_max_us = job->commit_us;
+		if (ts.tv_sec - s.window_start >= RATE_WINDOW)
+		{
+			if (s.window_start)
+				s.rate = (double)s.window_sections / (ts.tv_sec - s.window_start);
+			s.window_start = ts.tv_sec;
+			s.window_sections = 0;
+		}
+		++s.window_sections;
+	}
+}
+
+void eEPGIngestPipeline::getStatistics(ePyObject &dict)
+{
+	eSingleLocker l(m_lock);
+	PutToDict(dict, "threads", m_workers.size());
+	PutToDict(dict, "queued", m_jobs.size());
+	PutToDict(dict, "batches", m_batches);
+	PutToDict(dict, "batch_max_us", m_batch_max_us);
+	ePyObject sources = PyDict_New();
+	for (std::map<int, SourceStatistics>::const_iterator it(m_statistics.begin()); it != m_statistics.end(); ++it)
+	{
+		const SourceStatistics &s = it->second;
+		ePyObject entry = PyDict_New();
+		PutToDict(entry, "sections", s.sections);
+		PutToDict(entry, "events", s.events);
+		PutToDict(entry, "sections_per_second", PyFloat_FromDouble(s.rate));
+		PutToDict(entry, "parse_avg_us", s.parse_us / s.sections);
+		PutToDict(entry, "queue_avg_us", s.queue_us / s.sections);
+		PutToDict(entry, "commit_avg_us", s.commit_us / s.sections);
+		PutToDict(entry, "commit_max_us", s.commit_max_us);
+		ePyObject source = PyInt_FromLong(it->first);
+		PyDict_SetItem(sources, source, entry);
+		Py_DECREF(source);
+		Py_DECREF(entry);
+	}
+	PutToDict(dict, "sources", sources);
+}
@@ -0,0 +1,103 @@
+#ifndef __epgingest_h_
+#define __epgingest_h_
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <time.h>
+#include <lib/base/elock.h>
+#include <lib/base/thread.h>
+#include <lib/dvb/epgcache.h>
+
+/* a section on its way through eEPGIngestPipeline */
+struct eEPGIngestJob
+{
+	std::vector<uint8_t> section;
+	int source;
+	int tsidonid;
+	uniqueEPGKey service;
+	struct timespec queued;
+	int parse_us;
+	int commit_us; // set by eEPGCache::commitSections
+	bool done;
+	eEPGParsedSection parsed;
+};
+
+/*
+ * Worker pool between the EIT section readers and the EPG cache.
+ *
+ * Sections are copied into a job and parsed by the workers into an
+ * eEPGParsedSection (descriptor UTF-8 conversion and crc hashing happen
+ * here, without cache_lock). Parsed jobs are committed in submission
+ * order, in batches of up to MAX_COMMIT_BATCH sections per cache_lock
+ * acquisition, so the lock is only held for the map updates.
+ *
+ * With zero worker threads, sections are parsed and committed in the
+ * calling thread, like before.
+ */
+class eEPGIngestPipeline
+{
+public:
+	eEPGIngestPipeline(eEPGCache *cache, int threads);
+	~eEPGIngestPipeline();
+
+	/* data must hold the complete section, it is copied when queued */
+	void submit(const uint8_t *data, int source, const uniqueEPGKey &service, int tsidonid, bool synchronous = false);
+	/* wait until all queued sections are committed */
+	void flush();
+
+	int threadCount() const { return m_workers.size(); }
+	void getStatistics(ePyObject &dict);
+
+private:
+	enum {
+		MAX_QUEUED = 512,
+		MAX_COMMIT_BATCH = 32
+	};
+
+	struct SourceStatistics
+	{
+		unsigned long long sections, events;
+		unsigned long long parse_us, queue_us, commit_us;
+		unsigned int commit_max_us;
+		/* sections per second over the last complete window */
+		time_t window_start;
+		unsigned int window_sections;
+		double rate;
+		SourceStatistics()
+			:sections(0), events(0), parse_us(0), queue_us(0), commit_us(0), commit_max_us(0),
+			window_start(0), window_sections(0), rate(0) {}
+	};
+
+	class Worker: public eThread
+	{
+		eEPGIngestPipeline &m_pipeline;
+	public:
+		Worker(eEPGIngestPipeline &pipeline): m_pipeline(pipeline) {}
+		void thread();
+	};
+
+	eEPGCache *m_cache;
+	std::vector<Worker*> m_workers;
+
+	eSingleLock m_lock;
+	eCondition m_work, m_space;
+	/* all jobs not committed yet, in submission order */
+	std::deque<eEPGIngestJob*> m_jobs;
+	/* number of jobs at the front of m_jobs already taken by a worker */
+	size_t m_taken;
+	bool m_committing;
+	bool m_stop;
+
+	std::map<int, SourceStatistics> m_statistics;
+	unsigned long long m_batches;
+	unsigned int m_batch_max_us;
+
+	void process();
+	void parse(eEPGIngestJob *job);
+	void commitReady();
+	void commit(std::vector<eEPGIngestJob*> &jobs);
+	void account(const std::vector<eEPGIngestJob*> &jobs, int batch_us);
+};
+
+#endif
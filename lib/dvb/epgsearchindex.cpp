@@ -0,0 +1,241 @@
+#include <lib/dvb/epgsearchindex.h>
+
+#include <algorithm>
+#include <string.h>
+#include <strings.h>
+#include <lib/base/estring.h>
+#include <dvbsi++/descriptor_tag.h>
+
+/* don't bother compacting the posting lists for only a few removed descriptors */
+#define MIN_STALE_FOR_COMPACT 4096
+
+static inline uint8_t foldASCII(uint8_t c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline uint32_t makeTrigram(const uint8_t *p)
+{
+	return (foldASCII(p[0]) << 16) | (foldASCII(p[1]) << 8) | foldASCII(p[2]);
+}
+
+eEPGSearchIndex::eEPGSearchIndex(DescriptorLookup lookup)
+	:m_lookup(lookup), m_enabled(false), m_indexed(0), m_stale(0)
+{
+}
+
+void eEPGSearchIndex::setEnabled(bool enabled)
+{
+	if (!enabled)
+		clear();
+	m_enabled = enabled;
+}
+
+/*
+ * The text fields of a title or description descriptor, as the old
+ * descriptor scan in eEPGCache::search used them. Text with a custom
+ * encoding starts with a control character and still has to be decoded.
+ */
+bool eEPGSearchIndex::rawText(const uint8_t *data, uint8_t &kind, const char *&text, int &textlen)
+{
+	textlen = 0;
+	if (data[0] == SHORT_EVENT_DESCRIPTOR)
+	{
+		kind = TITLE;
+		text = (const char*)&data[6];
+		textlen = data[5];
+	}
+	else if (data[0] == EXTENDED_EVENT_DESCRIPTOR)
+	{
+		kind = DESCRIPTION;
+		text = (const char*)&data[8];
+		textlen = data[7];
+	}
+	return textlen > 0;
+}
+
+bool eEPGSearchIndex::getText(uint32_t crc, const uint8_t *descriptor, const char *&text, int &textlen) const
+{
+	uint8_t kind;
+	if (!rawText(descriptor, kind, text, textlen))
+		return false;
+	if ((uint8_t)text[0] >= 0x20)
+		return true;
+	/* custom encoding, decoded by add() */
+	TextMap::const_iterator it = m_texts.find(crc);
+	if (it == m_texts.end())
+		return false;
+	text = it->second.data();
+	textlen = it->second.length();
+	return true;
+}
+
+void eEPGSearchIndex::trigrams(const char *text, int textlen, std::vector<uint32_t> &result)
+{
+	result.clear();
+	if (textlen < 3)
+		return;
+	const uint8_t *p = (const uint8_t*)text;
+	const uint8_t *end = p + textlen - 2;
+	result.reserve(textlen - 2);
+	for (; p < end; ++p)
+		result.push_back(makeTrigram(p));
+	std::sort(result.begin(), result.end());
+	result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+void eEPGSearchIndex::add(uint32_t crc, const uint8_t *descriptor)
+{
+	if (!m_enabled)
+		return;
+	uint8_t kind;
+	const char *text;
+	int textlen;
+	if (!rawText(descriptor, kind, text, textlen))
+		return;
+	if ((uint8_t)text[0] < 0x20)
+	{
+		/* custom encoding */
+		std::string &decoded = m_texts[crc];
+		decoded = convertDVBUTF8((const unsigned char*)text, textlen, 0x40, 0);
+		if (decoded.empty())
+		{
+			m_texts.erase(crc);
+			return;
+		}
+		text = decoded.data();
+		textlen = decoded.length();
+	}
+	std::vector<uint32_t> grams;
+	trigrams(text, textlen, grams);
+	for (std::vector<uint32_t>::const_iterator it(grams.begin()); it != grams.end(); ++it)
+		m_postings[*it].push_back(crc);
+	++m_indexed;
+}
+
+void eEPGSearchIndex::remove(uint32_t crc, const uint8_t *descriptor)
+{
+	if (!m_enabled || (descriptor[0] != SHORT_EVENT_DESCRIPTOR && descriptor[0] != EXTENDED_EVENT_DESCRIPTOR))
+		return;
+	m_texts.erase(crc);
+	/*
+	 * The posting lists are not touched here, removing a crc from the lists
+	 * of common trigrams would make every cleanLoop quadratic. Stale crcs are
+	 * skipped at query time and dropped by the next compact().
+	 */
+	if (m_indexed)
+		--m_indexed;
+	if (++m_stale > MIN_STALE_FOR_COMPACT && m_stale > m_indexed)
+		compact();
+}
+
+void eEPGSearchIndex::clear()
+{
+	m_postings.clear();
+	m_texts.clear();
+	m_indexed = 0;
+	m_stale = 0;
+}
+
+void eEPGSearchIndex::compact()
+{
+	for (PostingMap::iterator it(m_postings.begin()); it != m_postings.end(); )
+	{
+		std::vector<uint32_t> &list = it->second;
+		std::vector<uint32_t>::iterator end = list.begin();
+		for (std::vector<uint32_t>::const_iterator c(list.begin()); c != list.end(); ++c)
+			if (m_lookup(*c))
+				*end++ = *c;
+		list.erase(end, list.end());
+		/* a crc removed and added again is listed twice */
+		std::sort(list.begin(), list.end());
+		list.erase(std::unique(list.begin(), list.end()), list.end());
+		if (list.empty())
+			it = m_postings.erase(it);
+		else
+		{
+			std::vector<uint32_t>(list).swap(list);
+			++it;
+		}
+	}
+	m_stale = 0;
+}
+
+bool eEPGSearchIndex::matches(int querytype, const char *textptr, int textlen, const char *str, int strlen, bool nocase)
+{
+	/* the argument may not be bigger than the text */
+	if (strlen > textlen)
+		return false;
+	switch (querytype)
+	{
+	case 1:
+		/* require exact text match */
+		if (textlen != strlen)
+			return false;
+		break;
+	case 3:
+		/* Do a "startswith" match by pretending the text isn't that long */
+		textlen = strlen;
+		break;
+	case 4:
+		/* Offset to adjust the pointer based on the text length difference */
+		textptr = textptr + textlen - strlen;
+		textlen = strlen;
+		break;
+	default:
+		break;
+	}
+	for (; textlen >= strlen; --textlen, ++textptr)
+	{
+		if (nocase ? !strncasecmp(textptr, str, strlen) : !memcmp(textptr, str, strlen))
+			return true;
+	}
+	return false;
+}
+
+bool eEPGSearchIndex::search(int querytype, const char *str, int strlen, bool nocase, std::deque<uint32_t> &result) const
+{
+	if (querytype < 1 || querytype > 5 || strlen < 3)
+		return false;
+	uint8_t kind = querytype == 5 ? DESCRIPTION : TITLE;
+
+	/* every match contains all trigrams of the search string, so use the rarest one */
+	const std::vector<uint32_t> *candidates = NULL;
+	for (int i = 0; i + 2 < strlen; ++i)
+	{
+		PostingMap::const_iterator it = m_postings.find(makeTrigram((const uint8_t*)str + i));
+		if (it == m_postings.end())
+			return true;
+		if (!candidates || it->second.size() < candidates->size())
+			candidates = &it->second;
+	}
+
+	std::vector<uint32_t> found;
+	for (std::vector<uint32_t>::const_iterator c(candidates->begin()); c != candidates->end(); ++c)
+	{
+		const uint8_t *descriptor = m_lookup(*c);
+		const char *text;
+		int textlen;
+		if (descriptor && descriptor[0] == (kind == TITLE ? SHORT_EVENT_DESCRIPTOR : EXTENDED_EVENT_DESCRIPTOR) &&
+			getText(*c, descriptor, text, textlen) && matches(querytype, text, textlen, str, strlen, nocase))
+			found.push_back(*c);
+	}
+	/* a crc removed and added again before compact() can be listed twice */
+	if (m_stale)
+	{
+		std::sort(found.begin(), found.end());
+		found.erase(std::unique(found.begin(), found.end()), found.end());
+	}
+	result.insert(result.end(), found.begin(), found.end());
+	return true;
+}
+
+size_t eEPGSearchIndex::memoryUsage() const
+{
+	size_t usage = 0;
+	for (PostingMap::const_iterator it(m_postings.begin()); it != m_postings.end(); ++it)
+		usage += sizeof(*it) + it->second.capacity() * sizeof(uint32_t);
+	for (TextMap::const_iterator it(m_texts.begin()); it != m_texts.end(); ++it)
+		usage += sizeof(*it) + it->second.capacity();
+	return usage;
+}
@@ -0,0 +1,76 @@
+#ifndef __epgsearchindex_h_
+#define __epgsearchindex_h_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <tr1/unordered_map>
+
+/*
+ * Text index over the cached short (title) and extended (description)
+ * event descriptors of the EPG cache.
+ *
+ * Every descriptor is decoded to UTF-8 once, when it enters the descriptor
+ * map, and its ASCII case folded trigrams are recorded in a posting list.
+ * The decoded text is kept only for descriptors with a custom encoding,
+ * the others are used from the descriptor map as they are. eEPGCache::search
+ * looks up the candidates of the rarest trigram of the search string and
+ * verifies those against the stored text, so no text is decoded at query
+ * time.
+ *
+ * The index is not thread safe, the cache_lock of the EPG cache must be
+ * held when calling any of these functions.
+ */
+class eEPGSearchIndex
+{
+public:
+	enum { TITLE, DESCRIPTION };
+
+	/* the cached descriptor with this crc, NULL when it is gone */
+	typedef const uint8_t *(*DescriptorLookup)(uint32_t crc);
+
+	eEPGSearchIndex(DescriptorLookup lookup);
+
+	void setEnabled(bool enabled);
+	bool isEnabled() const { return m_enabled; }
+
+	/* called when a descriptor is added to eventData::descriptors */
+	void add(uint32_t crc, const uint8_t *descriptor);
+	/* called after a descriptor was removed from eventData::descriptors, before it is freed */
+	void remove(uint32_t crc, const uint8_t *descriptor);
+	void clear();
+
+	/*
+	 * querytype as used by eEPGCache::search:
+	 * 1 = exact title, 2 = partial title, 3 = title starts with,
+	 * 4 = title ends with, 5 = partial description
+	 * Returns false when the index can't answer the query, search strings
+	 * shorter than a trigram have to be looked up by scanning the cache.
+	 */
+	bool search(int querytype, const char *str, int strlen, bool nocase, std::deque<uint32_t> &result) const;
+	/* the UTF-8 text of an indexed title or description descriptor, without decoding it */
+	bool getText(uint32_t crc, const uint8_t *descriptor, const char *&text, int &textlen) const;
+
+	size_t memoryUsage() const;
+
+private:
+	typedef std::tr1::unordered_map<uint32_t, std::vector<uint32_t> > PostingMap;
+	typedef std::tr1::unordered_map<uint32_t, std::string> TextMap;
+
+	DescriptorLookup m_lookup;
+	bool m_enabled;
+	PostingMap m_postings;
+	/* decoded texts of the descriptors that are not plain text */
+	TextMap m_texts;
+	size_t m_indexed;
+	/* crcs removed from the cache but still referenced by m_postings */
+	size_t m_stale;
+
+	static bool rawText(const uint8_t *descriptor, uint8_t &kind, const char *&text, int &textlen);
+	static void trigrams(const char *text, int textlen, std::vector<uint32_t> &result);
+	static bool matches(int querytype, const char *textptr, int textlen, const char *str, int strlen, bool nocase);
+	void compact();
+};
+
+#endif
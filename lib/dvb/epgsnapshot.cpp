@@ -0,0 +1,226 @@
+#include <lib/dvb/epgsnapshot.h>
+
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+struct entryStartLess
+{
+	bool operator()(const eEPGServiceSnapshot::Entry &a, time_t b) const { return a.start < b; }
+	bool operator()(time_t a, const eEPGServiceSnapshot::Entry &b) const { return a < b.start; }
+};
+
+struct eventIdLess
+{
+	bool operator()(const std::pair<uint16_t, uint32_t> &a, const std::pair<uint16_t, uint32_t> &b) const { return a.first < b.first; }
+	bool operator()(const std::pair<uint16_t, uint32_t> &a, uint16_t b) const { return a.first < b; }
+};
+
+/* the holder count and the crc are kept in front of the descriptor data */
+enum { DESCRIPTOR_HEADER = 8 };
+
+uint8_t *eEPGDescriptorData::create(int len, uint32_t crc)
+{
+	uint8_t *p = new uint8_t[DESCRIPTOR_HEADER + len];
+	new (p) std::atomic<int>(1);
+	*(uint32_t*)(p + 4) = crc;
+	return p + DESCRIPTOR_HEADER;
+}
+
+uint32_t eEPGDescriptorData::crc(const uint8_t *data)
+{
+	return *(const uint32_t*)(data - DESCRIPTOR_HEADER + 4);
+}
+
+void eEPGDescriptorData::retain(const uint8_t *data)
+{
+	((std::atomic<int>*)(data - DESCRIPTOR_HEADER))->fetch_add(1, std::memory_order_relaxed);
+}
+
+void eEPGDescriptorData::release(const uint8_t *data)
+{
+	uint8_t *p = const_cast<uint8_t*>(data - DESCRIPTOR_HEADER);
+	std::atomic<int> *holders = (std::atomic<int>*)p;
+	if (holders->fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		holders->~atomic();
+		delete [] p;
+	}
+}
+
+eEPGServiceSnapshot::~eEPGServiceSnapshot()
+{
+	for (std::vector<const uint8_t*>::const_iterator it(m_descriptors.begin()); it != m_descriptors.end(); ++it)
+		eEPGDescriptorData::release(*it);
+}
+
+void eEPGServiceSnapshot::add(time_t start, int duration, const uint8_t *rawEITdata, const uint8_t * const *descriptors, int n_descriptors)
+{
+	Entry entry;
+	entry.start = start;
+	entry.duration = duration;
+	entry.event_id = (rawEITdata[0] << 8) | rawEITdata[1];
+	memcpy(entry.rawEITdata, rawEITdata, 10);
+	entry.n_descriptors = n_descriptors;
+	entry.first_descriptor = m_descriptors.size();
+	for (int i = 0; i < n_descriptors; ++i)
+	{
+		eEPGDescriptorData::retain(descriptors[i]);
+		m_descriptors.push_back(descriptors[i]);
+	}
+	m_byTime.push_back(entry);
+}
+
+void eEPGServiceSnapshot::finish()
+{
+	m_byEvent.reserve(m_byTime.size());
+	for (unsigned int i = 0; i < m_byTime.size(); ++i)
+		m_byEvent.push_back(std::make_pair(m_byTime[i].event_id, i));
+	std::sort(m_byEvent.begin(), m_byEvent.end(), eventIdLess());
+	std::vector<Entry>(m_byTime).swap(m_byTime);
+	std::vector<const uint8_t*>(m_descriptors).swap(m_descriptors);
+}
+
+const eit_event_struct *eEPGServiceSnapshot::event(int i, uint8_t *buffer, std::vector<uint32_t> *crcs) const
+{
+	const Entry &entry = m_byTime[i];
+	unsigned int pos = 12;
+	memcpy(buffer, entry.rawEITdata, 10);
+	if (crcs)
+		crcs->clear();
+	for (int d = 0; d < entry.n_descriptors; ++d)
+	{
+		const uint8_t *descr = m_descriptors[entry.first_descriptor + d];
+		unsigned int len = descr[1] + 2;
+		if (pos + len < MAX_EVENT_SIZE)
+		{
+			memcpy(buffer + pos, descr, len);
+			pos += len;
+			if (crcs)
+				crcs->push_back(eEPGDescriptorData::crc(descr));
+		}
+	}
+	unsigned int descriptors_length = pos - 12;
+	buffer[10] = (descriptors_length >> 8) & 0x0F;
+	buffer[11] = descriptors_length & 0xFF;
+	return (const eit_event_struct*)buffer;
+}
+
+int eEPGServiceSnapshot::lowerBound(time_t t) const
+{
+	return std::lower_bound(m_byTime.begin(), m_byTime.end(), t, entryStartLess()) - m_byTime.begin();
+}
+
+int eEPGServiceSnapshot::timeRange(time_t begin, int minutes, int &end) const
+{
+	int pos = lowerBound(begin);
+	if (pos < (int)m_byTime.size() && m_byTime[pos].start != begin && pos > 0)
+	{
+		const Entry &x = m_byTime[pos - 1];
+		if (begin > x.start && begin < x.start + x.duration)
+			--pos;
+	}
+	end = minutes != -1 ? lowerBound(begin + minutes * 60) : m_byTime.size();
+	return pos;
+}
+
+int eEPGServiceSnapshot::lookupTime(time_t t, int direction) const
+{
+	if (m_byTime.empty())
+		return -1;
+	if (t == -1)
+		t = ::time(0);
+	int i = std::upper_bound(m_byTime.begin(), m_byTime.end(), t, entryStartLess()) - m_byTime.begin(); // first > t
+	if (direction > 0)
+		return i < (int)m_byTime.size() ? i : -1;
+
+	// direction <= 0
+	if (i == 0)
+		return -1;
+	--i;
+	time_t end_time = m_byTime[i].start + m_byTime[i].duration;
+	if (direction == 0)
+		return t < end_time ? i : -1;
+
+	// direction < 0
+	if (t >= end_time)
+		return i;
+	return i > 0 ? i - 1 : -1;
+}
+
+int eEPGServiceSnapshot::lookupId(int event_id) const
+{
+	std::vector<std::pair<uint16_t, uint32_t> >::const_iterator it =
+		std::lower_bound(m_byEvent.begin(), m_byEvent.end(), (uint16_t)event_id, eventIdLess());
+	if (it == m_byEvent.end() || it->first != event_id)
+		return -1;
+	return it->second;
+}
+
+size_t eEPGServiceSnapshot::memoryUsage() const
+{
+	return sizeof(*this) + m_byTime.capacity() * sizeof(Entry) +
+		m_byEvent.capacity() * sizeof(m_byEvent[0]) + m_descriptors.capacity() * sizeof(const uint8_t*);
+}
+
+static inline int latencyBucket(unsigned int us)
+{
+	if (us < 4)
+		return us;
+	int msb = 31 - __builtin_clz(us);
+	return (msb - 1) * 4 + ((us >> (msb - 2)) & 3);
+}
+
+static inline unsigned int latencyBucketLimit(int bucket)
+{
+	if (bucket < 4)
+		return bucket;
+	int shift = bucket / 4 - 1;
+	return ((4u + bucket % 4) << shift) + (1u << shift) - 1;
+}
+
+void eLatencyHistogram::add(unsigned int us)
+{
+	++m_buckets[latencyBucket(us)];
+	++m_count;
+	unsigned int max = m_max;
+	while (us > max && !m_max.compare_exchange_weak(max, us))
+		;
+}
+
+void eLatencyHistogram::reset()
+{
+	for (int i = 0; i < BUCKETS; ++i)
+		m_buckets[i] = 0;
+	m_count = 0;
+	m_max = 0;
+}
+
+unsigned int eLatencyHistogram::percentile(int percent) const
+{
+	unsigned int count = m_count;
+	if (!count)
+		return 0;
+	unsigned int wanted = ((unsigned long long)count * percent + 99) / 100;
+	unsigned int seen = 0;
+	for (int i = 0; i < BUCKETS; ++i)
+	{
+		seen += m_buckets[i];
+		if (seen >= wanted)
+			return std::min(latencyBucketLimit(i), (unsigned int)m_max);
+	}
+	return m_max;
+}
+
+eLatencyHistogram::Timer::Timer(eLatencyHistogram &histogram)
+	:m_histogram(histogram)
+{
+	clock_gettime(CLOCK_MONOTONIC, &m_start);
+}
+
+eLatencyHistogram::Timer::~Timer()
+{
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	m_histogram.add((end.tv_sec - m_start.tv_sec) * 1000000 + (end.tv_nsec - m_start.tv_nsec) / 1000);
+}
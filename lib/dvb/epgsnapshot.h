@@ -0,0 +1,123 @@
+#ifndef __epgsnapshot_h_
+#define __epgsnapshot_h_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+#include <lib/dvb/lowlevel/eit.h>
+
+/*
+ * Descriptor data shared by the descriptor map of the EPG cache and the
+ * snapshots. The holder count in front of the data is changed atomically,
+ * so a snapshot can drop its references without the cache_lock.
+ */
+class eEPGDescriptorData
+{
+public:
+	/* uninitialised data of len bytes with one holder */
+	static uint8_t *create(int len, uint32_t crc);
+	static void retain(const uint8_t *data);
+	static void release(const uint8_t *data);
+	/* the crc hash the descriptor is cached under */
+	static uint32_t crc(const uint8_t *data);
+};
+
+/*
+ * Immutable view of the cached events of one service.
+ *
+ * Snapshots are built by eEPGCache::getSnapshot with the cache_lock held
+ * and are never modified afterwards, so lookups on a snapshot need no
+ * lock at all. A snapshot stays valid for as long as a reader holds a
+ * reference to it, even when the writer has replaced it in the meantime.
+ * The descriptors are not copied, the snapshot holds a reference to the
+ * cached ones instead.
+ */
+class eEPGServiceSnapshot
+{
+public:
+	struct Entry
+	{
+		time_t start;
+		int duration;
+		uint16_t event_id;
+		uint8_t rawEITdata[10];
+		uint8_t n_descriptors;
+		uint32_t first_descriptor; // index into m_descriptors
+	};
+	enum { MAX_EVENT_SIZE = 2 * 4096 + 12 };
+
+	eEPGServiceSnapshot() {}
+	~eEPGServiceSnapshot();
+
+	/* events have to be added in start time order, the descriptors are retained */
+	void add(time_t start, int duration, const uint8_t *rawEITdata, const uint8_t * const *descriptors, int n_descriptors);
+	void finish();
+
+	bool empty() const { return m_byTime.empty(); }
+	int size() const { return m_byTime.size(); }
+	const Entry &operator[](int i) const { return m_byTime[i]; }
+	/*
+	 * assembles event i in buffer, which has to hold MAX_EVENT_SIZE bytes,
+	 * crcs optionally receives the crc hashes of the descriptors
+	 */
+	const eit_event_struct *event(int i, uint8_t *buffer, std::vector<uint32_t> *crcs = NULL) const;
+
+	/* same semantics as eEPGCache::lookupEventTime, returns the index or -1 */
+	int lookupTime(time_t t, int direction) const;
+	int lookupId(int event_id) const;
+	/* index of the first event starting at or after t */
+	int lowerBound(time_t t) const;
+	/*
+	 * events of a time window as used by eEPGCache::startTimeQuery: from the
+	 * event running at begin up to the last one starting before begin + minutes
+	 * (minutes == -1 for all), returns the first index, end receives the end
+	 */
+	int timeRange(time_t begin, int minutes, int &end) const;
+
+	/* without the shared descriptors */
+	size_t memoryUsage() const;
+
+private:
+	eEPGServiceSnapshot(const eEPGServiceSnapshot &);
+	eEPGServiceSnapshot &operator=(const eEPGServiceSnapshot &);
+
+	std::vector<Entry> m_byTime;
+	std::vector<std::pair<uint16_t, uint32_t> > m_byEvent; // event id -> index in m_byTime
+	std::vector<const uint8_t*> m_descriptors;
+};
+
+typedef std::shared_ptr<const eEPGServiceSnapshot> eEPGSnapshotPtr;
+
+/*
+ * Lock free latency histogram with four buckets per power of two, so the
+ * reported percentiles are accurate to about 25%.
+ */
+class eLatencyHistogram
+{
+public:
+	eLatencyHistogram() { reset(); }
+	void add(unsigned int us);
+	void reset();
+	unsigned int count() const { return m_count; }
+	unsigned int max() const { return m_max; }
+	/* upper bound of the bucket holding the given percentile, in us */
+	unsigned int percentile(int percent) const;
+
+	class Timer
+	{
+		eLatencyHistogram &m_histogram;
+		struct timespec m_start;
+	public:
+		Timer(eLatencyHistogram &histogram);
+		~Timer();
+	};
+
+private:
+	enum { BUCKETS = 124 };
+	std::atomic<unsigned int> m_buckets[BUCKETS];
+	std::atomic<unsigned int> m_count, m_max;
+};
+
+#endif
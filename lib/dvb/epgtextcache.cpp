@@ -0,0 +1,81 @@
+#include <lib/dvb/epgtextcache.h>
+
+#include <lib/base/estring.h>
+#include <lib/python/python_helpers.h>
+
+eEPGTextCache &eEPGTextCache::getInstance()
+{
+	static eEPGTextCache instance;
+	return instance;
+}
+
+eEPGTextCache::eEPGTextCache()
+	:m_capacity(256), m_hits(0), m_misses(0)
+{
+}
+
+void eEPGTextCache::setCapacity(unsigned int capacity)
+{
+	eSingleLocker l(m_lock);
+	m_capacity = capacity;
+	while (m_entries.size() > m_capacity)
+	{
+		m_index.erase(m_entries.back().key);
+		m_entries.pop_back();
+	}
+}
+
+void eEPGTextCache::convert(std::string &output, const std::string &raw, int table, int tsidonid, uint32_t crc, int part)
+{
+	uint64_t key = ((uint64_t)crc << 8) | (part & 0xFF);
+	{
+		eSingleLocker l(m_lock);
+		EntryMap::iterator it = m_index.find(key);
+		if (it != m_index.end())
+		{
+			const Entry &entry = *it->second;
+			if (entry.table == table && entry.tsidonid == tsidonid && entry.raw == raw)
+			{
+				m_entries.splice(m_entries.begin(), m_entries, it->second);
+				output = entry.text;
+				++m_hits;
+				return;
+			}
+		}
+		++m_misses;
+	}
+
+	/* convert without the lock, another thread may insert the same text meanwhile */
+	convertDVBUTF8Into(output, (const unsigned char*)raw.data(), raw.size(), table, tsidonid);
+
+	eSingleLocker l(m_lock);
+	if (!m_capacity)
+		return;
+	EntryMap::iterator it = m_index.find(key);
+	if (it != m_index.end())
+	{
+		m_entries.erase(it->second);
+		m_index.erase(it);
+	}
+	Entry entry;
+	entry.key = key;
+	entry.table = table;
+	entry.tsidonid = tsidonid;
+	entry.raw = raw;
+	entry.text = output;
+	m_entries.push_front(entry);
+	m_index[key] = m_entries.begin();
+	if (m_entries.size() > m_capacity)
+	{
+		m_index.erase(m_entries.back().key);
+		m_entries.pop_back();
+	}
+}
+
+void eEPGTextCache::getStatistics(ePyObject &dict)
+{
+	eSingleLocker l(m_lock);
+	PutToDict(dict, "text_cache_entries", m_entries.size());
+	PutToDict(dict, "text_cache_hits", m_hits);
+	PutToDict(dict, "text_cache_misses", m_misses);
+}
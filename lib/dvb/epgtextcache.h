@@ -0,0 +1,58 @@
+#ifndef __epgtextcache_h_
+#define __epgtextcache_h_
+
+#include <list>
+#include <string>
+#include <stdint.h>
+#include <tr1/unordered_map>
+#include <lib/base/elock.h>
+#include <lib/python/python.h>
+
+/*
+ * Small LRU of descriptor texts converted to UTF-8.
+ *
+ * EPG screens convert the same description descriptors again on every
+ * redraw. Converted texts are kept by the crc the EPG cache stores the
+ * descriptor under, so no hash has to be calculated here. The encoding
+ * table, the transponder and the raw text are compared on a hit, so a crc
+ * collision is just a miss.
+ *
+ * The cache is thread safe. A capacity of 0 disables it.
+ */
+class eEPGTextCache
+{
+public:
+	static eEPGTextCache &getInstance();
+
+	void setCapacity(unsigned int capacity);
+	/*
+	 * same as convertDVBUTF8Into, served from the cache when possible,
+	 * crc is the one of the descriptor, part tells its texts apart
+	 */
+	void convert(std::string &output, const std::string &raw, int table, int tsidonid, uint32_t crc, int part);
+
+	void getStatistics(ePyObject &dict);
+
+private:
+	eEPGTextCache();
+
+	struct Entry
+	{
+		uint64_t key;
+		int table;
+		int tsidonid;
+		std::string raw;
+		std::string text;
+	};
+	typedef std::list<Entry> EntryList;
+	typedef std::tr1::unordered_map<uint64_t, EntryList::iterator> EntryMap;
+
+	eSingleLock m_lock;
+	unsigned int m_capacity;
+	/* most recently used first */
+	EntryList m_entries;
+	EntryMap m_index;
+	unsigned long long m_hits, m_misses;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <sys/ioctl.h>
 #include <poll.h>
 #include <time.h>
+#include <algorithm>
 
 // this allows filesystem tasks to be prioritised
 #include <sys/vfs.h>
@@ -27,6 +28,8 @@ eFilePushThread::eFilePushThread(int blocksize, size_t buffersize):
 	 m_blocksize(blocksize),
 	 m_buffersize(buffersize),
 	 m_buffer((unsigned char *)malloc(buffersize)),
+	 m_prefetch_blocks(0),
+	 m_prefetch(NULL),
 	 m_messagepump(eApp, 0, "eFilePushThread"),
 	 m_run_state(0)
 {
@@ -48,6 +51,242 @@ static void signal_handler(int x)
 	eDebug("[eFilePush] SIGUSR1 received");
 }
 
+eFilePushPrefetcher::eFilePushPrefetcher(int blocks, size_t blocksize, int alignment):
+	m_blocks(blocks),
+	m_blocksize(blocksize),
+	m_alignment(alignment),
+	m_head(0),
+	m_filled(0),
+	m_next(0),
+	m_end(0),
+	m_reading(false),
+	m_discard(false),
+	m_hold(false),
+	m_cold(true),
+	m_interrupted(false),
+	m_stop(1),
+	m_stopped(true),
+	m_serial(0),
+	m_underruns(0)
+{
+	for (std::vector<Block>::iterator it(m_blocks.begin()); it != m_blocks.end(); ++it)
+	{
+		it->data = (unsigned char *)malloc(blocksize);
+		if (it->data == NULL)
+			eFatal("[eFilePushPrefetcher] Failed to allocate %zu bytes", blocksize);
+	}
+}
+
+eFilePushPrefetcher::~eFilePushPrefetcher()
+{
+	stop();
+	for (std::vector<Block>::iterator it(m_blocks.begin()); it != m_blocks.end(); ++it)
+		free(it->data);
+}
+
+void eFilePushPrefetcher::start(ePtr<iTsSource> &source)
+{
+	m_source = source;
+	m_stop = 0;
+	m_stopped = false;
+	reset(0, 0);
+	run();
+}
+
+void eFilePushPrefetcher::stop()
+{
+	static const struct timespec timespec_1 = { .tv_sec =  0, .tv_nsec = 1000000000 / 10 };
+	int safeguard;
+
+	if (m_stop == 1)
+		return;
+	{
+		eSingleLocker lock(m_lock);
+		m_stop = 1;
+		m_cond.broadcast();
+	}
+	/* interrupt a blocking read */
+	for (safeguard = 100; safeguard > 0 && !m_stopped; safeguard--)
+	{
+		sendSignal(SIGUSR1);
+		nanosleep(&timespec_1, nullptr);
+	}
+	if (safeguard > 0)
+		kill();
+	else
+		eWarning("[eFilePushPrefetcher] thread could not be stopped!");
+	m_source = NULL;
+}
+
+void eFilePushPrefetcher::thread()
+{
+	sigset_t sigmask;
+	setIoPrio(IOPRIO_CLASS_BE, 0);
+	/* like eFilePushThread, only SIGUSR1 may interrupt our reads */
+	sigfillset(&sigmask);
+	sigdelset(&sigmask, SIGUSR1);
+	pthread_sigmask(SIG_SETMASK, &sigmask, nullptr);
+
+	hasStarted();
+
+	eSingleLocker lock(m_lock);
+	while (true)
+	{
+		while (!m_stop && (m_filled == (int)m_blocks.size() || m_hold || (m_end && m_next >= m_end)))
+			m_cond.wait(m_lock);
+		if (m_stop)
+			break;
+
+		Block &block = m_blocks[(m_head + m_filled) % m_blocks.size()];
+		off_t offset = m_next;
+		size_t size = m_blocksize;
+		if (m_end && (off_t)size > m_end - offset)
+			size = m_end - offset;
+		m_reading = true;
+
+		m_lock.unlock();
+		ssize_t len = m_source->read(offset, block.data, size);
+		int error = errno;
+		/* like eFilePushThread, leave a partial packet for the next read */
+		if (len > 0)
+			len -= len % m_alignment;
+		m_lock.lock();
+
+		m_reading = false;
+		if (m_discard)
+		{
+			/* the span has changed meanwhile */
+			m_discard = false;
+			m_cond.broadcast();
+			continue;
+		}
+		block.offset = offset;
+		block.len = len;
+		block.error = error;
+		block.pos = 0;
+		block.serial = ++m_serial;
+		++m_filled;
+		if (len > 0)
+			m_next += len;
+		else
+			m_hold = true;
+		m_cond.broadcast();
+	}
+	m_stopped = true;
+}
+
+/* called with m_lock held */
+void eFilePushPrefetcher::reset(off_t offset, size_t size)
+{
+	m_discard = m_reading;
+	m_filled = 0;
+	m_next = offset;
+	m_end = size ? offset + size : 0;
+	m_hold = false;
+	m_cold = true;
+	m_cond.broadcast();
+}
+
+void eFilePushPrefetcher::setSpan(off_t offset, size_t size)
+{
+	{
+		eSingleLocker lock(m_lock);
+		off_t position = m_filled ? m_blocks[m_head].offset + m_blocks[m_head].pos : m_next;
+		if (position != offset)
+			reset(offset, size);
+		else
+		{
+			/* the span continues where the last one ended, keep what was read already */
+			m_end = size ? offset + size : 0;
+			m_cond.broadcast();
+		}
+	}
+	/* ask the kernel to start reading the span as well */
+	m_source->prefetch(offset, size ? size : m_blocksize * m_blocks.size());
+}
+
+ssize_t eFilePushPrefetcher::get(off_t offset, size_t count, const unsigned char *&data)
+{
+	eSingleLocker lock(m_lock);
+	bool waited = false;
+	unsigned int serial = m_serial;
+	while (true)
+	{
+		if (m_interrupted)
+		{
+			m_interrupted = false;
+			errno = EINTR;
+			return -1;
+		}
+		if (m_filled)
+		{
+			Block &block = m_blocks[m_head];
+			if (block.len > 0 && block.offset + (off_t)block.pos == offset)
+			{
+				if (waited && !m_cold)
+					++m_underruns;
+				m_cold = false;
+				data = block.data + block.pos;
+				return std::min(count, block.len - block.pos);
+			}
+			if (block.len <= 0 && block.offset == offset)
+			{
+				/* EOF or error, read again next time */
+				ssize_t len = block.len;
+				errno = block.error;
+				m_head = (m_head + 1) % m_blocks.size();
+				--m_filled;
+				m_hold = false;
+				m_cond.broadcast();
+				/* a growing file may have more data by now */
+				if (block.serial <= serial)
+					continue;
+				return len;
+			}
+			/* not where the push thread continues, start over */
+			reset(offset, 0);
+		}
+		else if (!m_reading && m_next != offset)
+			reset(offset, 0);
+		else if (!m_reading && m_end && m_next >= m_end)
+		{
+			/* reading on past the span */
+			m_end = 0;
+			m_cond.broadcast();
+		}
+		waited = true;
+		m_cond.wait(m_lock);
+	}
+}
+
+void eFilePushPrefetcher::release(size_t len)
+{
+	eSingleLocker lock(m_lock);
+	if (!m_filled)
+		return;
+	Block &block = m_blocks[m_head];
+	block.pos += len;
+	if ((ssize_t)block.pos >= block.len)
+	{
+		m_head = (m_head + 1) % m_blocks.size();
+		--m_filled;
+		m_cond.broadcast();
+	}
+}
+
+void eFilePushPrefetcher::interrupt()
+{
+	eSingleLocker lock(m_lock);
+	m_interrupted = true;
+	m_cond.broadcast();
+}
+
+unsigned int eFilePushPrefetcher::getUnderruns()
+{
+	eSingleLocker lock(m_lock);
+	return m_underruns;
+}
+
 void eFilePushThread::thread()
 {
 	sigset_t sigmask;
@@ -80,6 +319,10 @@ void eFilePushThread::thread()
 		int fd_video = open("/dev/dvb/adapter0/video0", O_RDONLY);
 // Fix to ensure that event evtEOF is called at end of playbackl part 1/3
 		bool already_empty = false;
+		const unsigned char *data = m_buffer;
+		off_t last_span_offset = -1;
+		if (m_prefetch && !m_sg)
+			m_prefetch->setSpan(m_current_position, 0);
 
 		while (!m_stop)
 		{
@@ -99,6 +342,18 @@ void eFilePushThread::thread()
 				}
 				m_sg->getNextSourceSpan(m_current_position, bytes_read, current_span_offset, current_span_remaining, m_blocksize, m_sof);
 				ASSERT(!(current_span_remaining % m_blocksize));
+				if (m_prefetch)
+				{
+					m_prefetch->setSpan(current_span_offset, current_span_remaining);
+					/* in trickmode, the next span is usually as far away again */
+					if (m_sg->getSkipMode() != 0 && last_span_offset >= 0 && current_span_remaining)
+					{
+						off_t next_span_offset = 2 * current_span_offset - last_span_offset;
+						if (next_span_offset >= 0)
+							m_source->prefetch(next_span_offset, current_span_remaining);
+					}
+					last_span_offset = current_span_offset;
+				}
 				m_current_position = current_span_offset;
 				bytes_read = 0;
 			}
@@ -112,6 +367,22 @@ void eFilePushThread::thread()
 			/* align to blocksize */
 			maxread -= maxread % m_blocksize;
 
+			/* a ring buffer has overwritten the data here already, go on with the oldest that is left */
+			off_t first = m_source->firstOffset();
+			if (maxread && first > m_current_position)
+			{
+				off_t skip = first - m_current_position;
+				skip += (m_blocksize - skip % m_blocksize) % m_blocksize;
+				eDebug("[eFilePushThread] %lld bytes at %lld are gone, skipping them", (long long)skip, (long long)m_current_position);
+				m_current_position += skip;
+				bytes_read += skip;
+				if (m_sg)
+					current_span_remaining -= std::min((off_t)current_span_remaining, skip);
+				if (m_prefetch)
+					m_prefetch->setSpan(m_current_position, m_sg ? current_span_remaining : 0);
+				continue;
+			}
+
 			if (maxread && !m_sof)
 			{
 #ifdef SHOW_WRITE_TIME
@@ -119,7 +390,13 @@ void eFilePushThread::thread()
 				struct timeval now = {};
 				gettimeofday(&starttime, NULL);
 #endif
-				buf_end = m_source->read(m_current_position, m_buffer, maxread);
+				if (m_prefetch)
+					buf_end = m_prefetch->get(m_current_position, maxread, data);
+				else
+				{
+					buf_end = m_source->read(m_current_position, m_buffer, maxread);
+					data = m_buffer;
+				}
 #ifdef SHOW_WRITE_TIME
 				gettimeofday(&now, NULL);
 				suseconds_t diff = (1000000 * (now.tv_sec - starttime.tv_sec)) + now.tv_usec - starttime.tv_usec;
@@ -142,6 +419,8 @@ void eFilePushThread::thread()
 					eWarning("[eFilePushThread] OVERFLOW while playback?");
 					continue;
 				}
+				if (errno == ENXIO) /* overwritten by a ring buffer meanwhile */
+					continue;
 				eDebug("[eFilePushThread] read error: %m");
 			}
 
@@ -213,10 +492,10 @@ void eFilePushThread::thread()
 			{
 				/* Write data to mux */
 				int buf_start = 0;
-				filterRecordData(m_buffer, buf_end);
+				filterRecordData(data, buf_end);
 				while ((buf_start != buf_end) && !m_stop)
 				{
-					int w = write(m_fd_dest, m_buffer + buf_start, buf_end - buf_start);
+					int w = write(m_fd_dest, data + buf_start, buf_end - buf_start);
 
 					if (w <= 0)
 					{
@@ -236,6 +515,8 @@ void eFilePushThread::thread()
 					}
 					buf_start += w;
 				}
+				if (m_prefetch)
+					m_prefetch->release(buf_end);
 
 				eofcount = 0;
 // Fix to ensure that event evtEOF is called at end of playbackl part 3/3
@@ -289,6 +570,12 @@ void eFilePushThread::start(ePtr<iTsSource> &source, int fd_dest)
 	act.sa_flags = 0;
 	sigaction(SIGUSR1, &act, nullptr);
 
+	if (m_prefetch_blocks && !m_source->isStream())
+	{
+		m_prefetch = new eFilePushPrefetcher(m_prefetch_blocks, m_buffersize, m_blocksize);
+		m_prefetch->start(m_source);
+	}
+
 	run();
 }
 
@@ -309,6 +596,8 @@ void eFilePushThread::stop()
 	for(safeguard = 100; safeguard > 0; safeguard--)
 	{
 		eDebug("[eFilePushThread] stopping thread: %d", safeguard);
+		if (m_prefetch)
+			m_prefetch->interrupt();
 		sendSignal(SIGUSR1);
 
 		nanosleep(&timespec_1, nullptr);
@@ -321,6 +610,13 @@ void eFilePushThread::stop()
 		kill();
 	else
 		eWarning("[eFilePushThread] thread could not be stopped!");
+
+	if (m_prefetch && safeguard > 0)
+	{
+		eDebug("[eFilePushThread] prefetch underruns: %u", m_prefetch->getUnderruns());
+		delete m_prefetch;
+		m_prefetch = NULL;
+	}
 }
 
 void eFilePushThread::pause()
@@ -334,6 +630,8 @@ void eFilePushThread::pause()
 	 * for the thread to acknowledge that */
 	eSingleLocker lock(m_run_mutex);
 	m_stop = 2;
+	if (m_prefetch)
+		m_prefetch->interrupt();
 	sendSignal(SIGUSR1);
 	m_run_cond.signal(); /* Trigger if in weird state */
 	while (m_run_state) {
@@ -371,6 +669,16 @@ void eFilePushThread::setScatterGather(iFilePushScatterGather *sg)
 	m_sg = sg;
 }
 
+void eFilePushThread::setPrefetch(int blocks)
+{
+	m_prefetch_blocks = blocks;
+}
+
+unsigned int eFilePushThread::getPrefetchUnderruns()
+{
+	return m_prefetch ? m_prefetch->getUnderruns() : 0;
+}
+
 void eFilePushThread::sendEvent(int evt)
 {
 	/* add a ref, to make sure the object is not destroyed while the messagepump contains unhandled messages */
@@ -576,7 +884,7 @@ void eFilePushThreadRecorder::thread()
 	/* m_stop must be evaluated after each syscall. */
 	while (!m_stop)
 	{
-		bytes = ::read(m_fd_source, m_buffer, m_buffersize);
+		bytes = readData();
 
 		if (bytes < 0)
 		{
@@ -680,6 +988,11 @@ void eFilePushThreadRecorder::thread()
 	m_stopped = true;
 }
 
+ssize_t eFilePushThreadRecorder::readData()
+{
+	return ::read(m_fd_source, m_buffer, m_buffersize);
+}
+
 void eFilePushThreadRecorder::start(int fd)
 {
 	m_fd_source = fd;
@@ -6,6 +6,7 @@
 #include <libsig_comp.h>
 #include <lib/base/message.h>
 #include <sys/types.h>
+#include <vector>
 #include <lib/base/rawfile.h>
 
 class iFilePushScatterGather
@@ -18,6 +19,69 @@ public:
 	virtual int getSkipMode() = 0;
 };
 
+/*
+ * Read-ahead stage of eFilePushThread.
+ *
+ * A thread of its own fills a ring of blocks from the span the push thread
+ * is going to read next, so a slow disk or network mount only stalls the
+ * decoder once the blocks read ahead are used up. The push thread takes
+ * the blocks in order with get() and hands them back with release().
+ */
+class eFilePushPrefetcher: public eThread
+{
+public:
+	eFilePushPrefetcher(int blocks, size_t blocksize, int alignment);
+	~eFilePushPrefetcher();
+	void start(ePtr<iTsSource> &source);
+	void stop();
+	void thread();
+
+	/* the next reads start at offset, and stop after size bytes (0: no end) */
+	void setSpan(off_t offset, size_t size);
+	/* like iTsSource::read, but data points into the block holding offset */
+	ssize_t get(off_t offset, size_t count, const unsigned char *&data);
+	/* len bytes of the data returned by get() were used */
+	void release(size_t len);
+	/* makes a waiting get() return EINTR */
+	void interrupt();
+
+	/* number of times get() had to wait for data */
+	unsigned int getUnderruns();
+
+private:
+	struct Block
+	{
+		unsigned char *data;
+		off_t offset;
+		ssize_t len; // 0 on EOF, < 0 on error
+		int error;
+		size_t pos; // bytes released already
+		unsigned int serial; // order of the reads
+	};
+	std::vector<Block> m_blocks;
+	size_t m_blocksize;
+	int m_alignment;
+	ePtr<iTsSource> m_source;
+
+	eSingleLock m_lock;
+	eCondition m_cond;
+	/* the filled blocks start at m_head, the next one is read from m_next */
+	int m_head, m_filled;
+	off_t m_next, m_end;
+	bool m_reading, m_discard;
+	/* don't read on after EOF or an error until get() returned it */
+	bool m_hold;
+	/* the first wait after a new span is not an underrun */
+	bool m_cold;
+	bool m_interrupted;
+	int m_stop;
+	bool m_stopped;
+	unsigned int m_serial;
+	unsigned int m_underruns;
+
+	void reset(off_t offset, size_t size);
+};
+
 class eFilePushThread: public eThread, public sigc::trackable, public iObject
 {
 	DECLARE_REF(eFilePushThread);
@@ -37,6 +101,10 @@ public:
 	/* stream mode will wait on EOF until more data is available. */
 	void setStreamMode(int);
 	void setScatterGather(iFilePushScatterGather *);
+	/* read ahead this many blocks of buffersize in a separate thread, 0 to disable */
+	void setPrefetch(int blocks);
+	/* times the decoder had to wait for the prefetch thread */
+	unsigned int getPrefetchUnderruns();
 
 #if SIGCXX_MAJOR_VERSION == 3
 	enum { evtEOF, evtReadError, evtWriteError, evtUser, evtStopped };
@@ -62,6 +130,8 @@ private:
 	size_t m_buffersize;
 	unsigned char* m_buffer;
 	off_t m_current_position;
+	int m_prefetch_blocks;
+	eFilePushPrefetcher *m_prefetch;
 
 	ePtr<iTsSource> m_source;
 
@@ -102,6 +172,10 @@ protected:
 	// If result <0, set 'errno'. The simplest implementation is just "::write(m_buffer, ...)"
 	// The method may freely modify m_buffer and m_buffersize
 	virtual int writeData(int len) = 0;
+	// Reads the next block from m_fd_source and returns its size, like read() does.
+	// The data is normally read into m_buffer, an override may keep it elsewhere
+	// as long as its writeData knows where to find it.
+	virtual ssize_t readData();
 	// Called when terminating the recording thread. Allows to clean up memory and
 	// flush buffers, terminate outstanding IO requests.
 	virtual void flush() = 0;
@@ -48,6 +48,9 @@ public:
 		/* for saving additional meta data. */
 	virtual RESULT setTargetFilename(const std::string& filename) = 0;
 	virtual RESULT setBoundary(off_t max) = 0;
+		/* write the FD as a ring buffer of size bytes, which must be allocated already. */
+		/* offsets keep growing, offset x is stored at x % size. before start(). */
+	virtual RESULT setRingBuffer(off_t size) = 0;
 	virtual RESULT enableAccessPoints(bool enable) = 0;
 
 	virtual RESULT stop() = 0;
@@ -0,0 +1,196 @@
+#include <lib/dvb/iouring.h>
+
+#ifdef HAVE_LIBURING
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <lib/base/eerror.h>
+
+eIOUring::eIOUring()
+	:m_valid(false), m_fixed(NULL), m_fixed_size(0), m_failed(false)
+{
+}
+
+eIOUring::~eIOUring()
+{
+	if (m_valid)
+		io_uring_queue_exit(&m_ring);
+}
+
+bool eIOUring::init(unsigned int entries)
+{
+	int r = io_uring_queue_init(entries, &m_ring, 0);
+	if (r < 0)
+	{
+		eDebug("[eIOUring] io_uring not available: %s", strerror(-r));
+		return false;
+	}
+	m_valid = true;
+	return true;
+}
+
+bool eIOUring::registerBuffer(void *buffer, size_t size)
+{
+	struct iovec iov;
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+	int r = io_uring_register_buffers(&m_ring, &iov, 1);
+	if (r < 0)
+	{
+		eDebug("[eIOUring] cannot register %zu kB buffer: %s", size >> 10, strerror(-r));
+		return false;
+	}
+	m_fixed = (const unsigned char*)buffer;
+	m_fixed_size = size;
+	return true;
+}
+
+int eIOUring::queue(Request &request)
+{
+	request.busy = true;
+	if (!m_failed)
+	{
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&m_ring);
+		if (!sqe)
+		{
+			/* submission queue full, make room */
+			submit();
+			if (!m_failed)
+				sqe = io_uring_get_sqe(&m_ring);
+		}
+		if (sqe)
+		{
+			if (m_fixed && request.buffer >= m_fixed && request.buffer + request.size <= m_fixed + m_fixed_size)
+				io_uring_prep_write_fixed(sqe, request.fd, request.buffer, request.size, request.offset, 0);
+			else
+				io_uring_prep_write(sqe, request.fd, request.buffer, request.size, request.offset);
+			io_uring_sqe_set_data(sqe, &request);
+			m_queued.push_back(&request);
+			return 0;
+		}
+	}
+	writeSync(request);
+	return 0;
+}
+
+void eIOUring::writeSync(Request &request)
+{
+	while (request.size)
+	{
+		ssize_t r = ::pwrite(request.fd, request.buffer, request.size, request.offset);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+		{
+			request.result = r < 0 ? -errno : -EIO;
+			break;
+		}
+		request.result += r;
+		request.buffer += r;
+		request.size -= r;
+		request.offset += r;
+	}
+	request.busy = false;
+}
+
+int eIOUring::write(Request &request, int fd, const void *buffer, size_t size, off_t offset)
+{
+	request.fd = fd;
+	request.buffer = (const unsigned char*)buffer;
+	request.size = size;
+	request.offset = offset;
+	request.result = 0;
+	request.stalled = false;
+	return queue(request);
+}
+
+int eIOUring::submit()
+{
+	if (m_queued.empty())
+		return 0;
+	int r = io_uring_submit(&m_ring);
+	if (r < 0)
+	{
+		/*
+		 * The queued entries stay in the submission queue, so the ring
+		 * must never submit again, or the kernel would write them after
+		 * they were written here and their requests were reused.
+		 */
+		eWarning("[eIOUring] submit failed: %s, writing synchronously from now on", strerror(-r));
+		m_failed = true;
+		std::vector<Request*> queued;
+		queued.swap(m_queued);
+		for (std::vector<Request*>::iterator it = queued.begin(); it != queued.end(); ++it)
+			writeSync(**it);
+		return 0;
+	}
+	/* the kernel takes entries in order, the rest goes with the next submit */
+	m_queued.erase(m_queued.begin(), m_queued.begin() + std::min((size_t)r, m_queued.size()));
+	return r;
+}
+
+void eIOUring::complete(struct io_uring_cqe *cqe)
+{
+	Request *request = (Request*)io_uring_cqe_get_data(cqe);
+	int res = cqe->res;
+	io_uring_cqe_seen(&m_ring, cqe);
+	if (res >= 0 && (size_t)res < request->size)
+	{
+		/* short write, continue with the rest */
+		if (res == 0 && request->stalled)
+			res = -EIO;
+		else
+		{
+			request->stalled = res == 0;
+			request->result += res;
+			request->buffer += res;
+			request->size -= res;
+			request->offset += res;
+			if (queue(*request) == 0 && submit() >= 0)
+				return;
+			res = -EIO;
+		}
+	}
+	if (res < 0)
+		request->result = res;
+	else
+		request->result += res;
+	request->busy = false;
+}
+
+void eIOUring::reap()
+{
+	struct io_uring_cqe *cqe;
+	while (io_uring_peek_cqe(&m_ring, &cqe) == 0)
+		complete(cqe);
+}
+
+int eIOUring::wait(Request &request)
+{
+	while (request.busy)
+	{
+		/* nothing to wait for when the request did not reach the kernel */
+		submit();
+		if (!request.busy)
+			break;
+		struct io_uring_cqe *cqe;
+		int r = io_uring_wait_cqe(&m_ring, &cqe);
+		if (r < 0)
+		{
+			/* the kernel still owns the buffer, so keep waiting for it */
+			if (r != -EINTR)
+			{
+				eWarning("[eIOUring] wait failed: %s", strerror(-r));
+				usleep(10000);
+			}
+			continue;
+		}
+		complete(cqe);
+	}
+	return request.result;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef __iouring_h_
+#define __iouring_h_
+
+#ifdef HAVE_LIBURING
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <vector>
+#include <liburing.h>
+
+/*
+ * Write-only io_uring for the recording threads.
+ *
+ * write() only queues a request; submit() hands everything queued to the
+ * kernel with one system call, so the .ts and .sc writes of a block go out
+ * together. Writes inside the registered buffer use it as a fixed buffer.
+ * Each write is tracked by a Request owned by the caller, which has to
+ * stay where it is until the write completed. Short writes are continued
+ * transparently, a write that makes no progress twice in a row fails with
+ * EIO.
+ *
+ * When submitting fails, the ring is not used again: the requests that did
+ * not reach the kernel are written synchronously, and so is everything
+ * written afterwards. Requests the kernel already has stay busy until they
+ * completed.
+ *
+ * Not thread safe, a ring belongs to one thread at a time.
+ */
+class eIOUring
+{
+public:
+	struct Request
+	{
+		int fd;
+		const unsigned char *buffer;
+		size_t size;
+		off_t offset;
+		int result; // bytes written or -errno, valid when not busy
+		bool busy;
+		bool stalled; // the last completion wrote nothing
+		Request(): fd(-1), buffer(NULL), size(0), offset(0), result(0), busy(false), stalled(false) {}
+	};
+
+	eIOUring();
+	~eIOUring();
+
+	/* returns false when the kernel does not support io_uring */
+	bool init(unsigned int entries);
+	bool valid() const { return m_valid; }
+	/* submitting failed, writes are synchronous now */
+	bool failed() const { return m_failed; }
+	bool registerBuffer(void *buffer, size_t size);
+
+	int write(Request &request, int fd, const void *buffer, size_t size, off_t offset);
+	int submit();
+	/* collects completions without blocking */
+	void reap();
+	/* returns the result of the request once it completed */
+	int wait(Request &request);
+
+private:
+	struct io_uring m_ring;
+	bool m_valid;
+	const unsigned char *m_fixed;
+	size_t m_fixed_size;
+	bool m_failed;
+	std::vector<Request*> m_queued; // not submitted yet, in queue order
+
+	int queue(Request &request);
+	void writeSync(Request &request);
+	void complete(struct io_uring_cqe *cqe);
+};
+
+#endif
+
+#endif
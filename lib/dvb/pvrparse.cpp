@@ -7,6 +7,7 @@
 #include <fcntl.h>
 #include <byteswap.h>
 #include <sys/mman.h>
+#include <algorithm>
 
 #ifndef BYTE_ORDER
 #	error no byte order defined!
@@ -19,13 +20,21 @@
 #define MAPSIZE (PAGESIZE*8)
 
 eMPEGStreamInformation::eMPEGStreamInformation():
+	m_access_points(NULL),
+	m_ap_count(0),
+	m_ap_mapsize(0),
+	m_ap_prepared(false),
 	m_structure_read_fd(-1),
 	m_cache_index(-1),
 	m_current_entry(-1),
 	m_structure_cache_entries(0),
 	m_structure_file_entries(0),
 	m_structure_cache(NULL),
-	m_streamtime_accesspoints(false)
+	m_streamtime_accesspoints(false),
+	m_iframe_entry(0),
+	m_iframe_scanner(*this),
+	m_iframe_scanning(false),
+	m_structure_ring_size(0)
 {
 }
 
@@ -36,13 +45,25 @@ eMPEGStreamInformation::~eMPEGStreamInformation()
 
 void eMPEGStreamInformation::close()
 {
+	/* the scanner uses the structure file and the access points */
+	m_iframe_scanner.kill();
+	m_iframe_scanning = false;
+	if (m_ap_mapsize)
+		::munmap((void*)m_access_points, m_ap_mapsize);
+	m_access_points = NULL;
+	m_ap_count = 0;
+	m_ap_mapsize = 0;
+	m_ap_prepared = false;
+	std::vector<unsigned long long>().swap(m_ap_sorted);
+	m_timestamp_deltas.clear();
+	std::vector<IFrame>().swap(m_iframes);
+	m_iframe_entry = 0;
 	if (m_structure_read_fd >= 0)
 	{
 		if (m_structure_cache != NULL)
 		{
 			//eDebug("[eMPEGStreamInformation] {%d} close - unmap %p size %d", gettid(), m_structure_cache, m_structure_cache_entries * 16);
-			::munmap(m_structure_cache, m_structure_cache_entries * 16);
-			m_structure_cache = NULL;
+			freeCache();
 		}
 		::close(m_structure_read_fd);
 		m_structure_cache_entries = 0;
@@ -50,73 +71,157 @@ void eMPEGStreamInformation::close()
 		m_structure_read_fd = -1;
 		m_structure_file_entries = 0;
 	}
+	m_ringfile.close();
+	m_structure_ring_size = 0;
 }
 
+struct accessPointOffsetLess
+{
+	bool operator()(const std::pair<off_t, pts_t> &a, const std::pair<off_t, pts_t> &b) const { return a.first < b.first; }
+};
+
 int eMPEGStreamInformation::load(const char *filename)
 {
 	//eDebug("[eMPEGStreamInformation] {%d} load(%s)", gettid(), filename);
 	close();
 	std::string s_filename(filename);
 	m_structure_read_fd = ::open((s_filename + ".sc").c_str(), O_RDONLY | O_CLOEXEC);
-	m_access_points.clear();
-	m_pts_to_offset.clear();
-	m_timestamp_deltas.clear();
-	CFile f((s_filename + ".ap").c_str(), "rb");
-	if (!f)
+	if (m_ringfile.open(s_filename) == 0)
+	{
+		eRingFile::State state;
+		m_ringfile.get(state);
+		m_structure_ring_size = state.sc_size;
+	}
+	int fd = ::open((s_filename + ".ap").c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
 		return -1;
-	while (1)
+	/*
+	 * The .ap file is mapped and used as it is, so opening a long recording
+	 * costs neither memory nor reading all of it. The writer replaces the
+	 * file instead of truncating it, so the mapping stays valid.
+	 */
+	struct stat st;
+	size_t count = 0;
+	if (::fstat(fd, &st) == 0)
+		count = st.st_size / 16;
+	if (count)
+	{
+		void *map = ::mmap(NULL, count * 16, PROT_READ, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			m_access_points = (const unsigned long long*)map;
+			m_ap_count = count;
+			m_ap_mapsize = count * 16;
+		}
+		else
+			eDebug("[eMPEGStreamInformation] failed to map %s.ap: %m", filename);
+	}
+	::close(fd);
+	return 0;
+}
+
+void eMPEGStreamInformation::prepareAccessPoints()
+{
+	if (m_ap_prepared)
+		return;
+	m_ap_prepared = true;
+	/* files written by older versions may not be in order, sort a copy of those */
+	for (size_t i = 1; i < m_ap_count; ++i)
 	{
-		unsigned long long d[2];
-		if (fread(d, sizeof(d), 1, f) < 1)
+		if (apOffset(i) <= apOffset(i - 1))
+		{
+			std::vector<std::pair<off_t, pts_t> > aps(m_ap_count);
+			for (size_t j = 0; j < m_ap_count; ++j)
+				aps[j] = std::make_pair(apOffset(j), apPts(j));
+			std::stable_sort(aps.begin(), aps.end(), accessPointOffsetLess());
+			/* the last access point at an offset wins */
+			m_ap_sorted.reserve(aps.size() * 2);
+			for (size_t j = 0; j < aps.size(); ++j)
+			{
+				if (j + 1 < aps.size() && aps[j + 1].first == aps[j].first)
+					continue;
+				m_ap_sorted.push_back(htobe64(aps[j].first));
+				m_ap_sorted.push_back(htobe64(aps[j].second));
+			}
+			::munmap((void*)m_access_points, m_ap_mapsize);
+			m_access_points = &m_ap_sorted[0];
+			m_ap_count = m_ap_sorted.size() / 2;
+			m_ap_mapsize = 0;
 			break;
-		d[0] = be64toh(d[0]);
-		d[1] = be64toh(d[1]);
-		m_access_points[d[0]] = d[1];
-		m_pts_to_offset.insert(std::pair<pts_t,off_t>(d[1], d[0]));
+		}
 	}
 	/* assume the accesspoints are in streamtime, if they start with a 0 timestamp */
-	m_streamtime_accesspoints = (!m_access_points.empty() && m_access_points.begin()->second == 0);
+	m_streamtime_accesspoints = (m_ap_count && apPts(0) == 0);
 	fixupDiscontinuties();
-	return 0;
+}
+
+off_t eMPEGStreamInformation::apOffset(size_t i) const
+{
+	return be64toh(m_access_points[i * 2]);
+}
+
+pts_t eMPEGStreamInformation::apPts(size_t i) const
+{
+	return be64toh(m_access_points[i * 2 + 1]);
+}
+
+pts_t eMPEGStreamInformation::apFixedPts(size_t i)
+{
+	off_t offset = apOffset(i);
+	return apPts(i) - getDelta(offset);
+}
+
+size_t eMPEGStreamInformation::apLowerBound(off_t offset) const
+{
+	size_t first = 0, last = m_ap_count;
+	while (first < last)
+	{
+		size_t mid = (first + last) / 2;
+		if (apOffset(mid) < offset)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+	return first;
 }
 
 void eMPEGStreamInformation::fixupDiscontinuties()
 {
-	if (m_access_points.empty())
+	if (!m_ap_count)
 		return;
 		/* if we have no delta at the beginning, extrapolate it */
-	if ((m_access_points.find(0) == m_access_points.end()) && (m_access_points.size() > 1))
+	if ((apOffset(0) != 0) && (m_ap_count > 1))
 	{
-		std::map<off_t,pts_t>::const_iterator second = m_access_points.begin();
-		std::map<off_t,pts_t>::const_iterator first  = second++;
-		if (first->first < second->first) /* i.e., not equal or broken */
+		off_t first = apOffset(0), second = apOffset(1);
+		if (first < second) /* i.e., not equal or broken */
 		{
-			off_t diff = second->first - first->first;
-			pts_t tdiff = second->second - first->second;
-			tdiff *= first->first;
+			off_t diff = second - first;
+			pts_t tdiff = apPts(1) - apPts(0);
+			tdiff *= first;
 			tdiff /= diff;
-			m_timestamp_deltas[0] = first->second - tdiff;
-//			eDebug("[eMPEGStreamInformation] first delta is %08llx", first->second - tdiff);
+			m_timestamp_deltas[0] = apPts(0) - tdiff;
+//			eDebug("[eMPEGStreamInformation] first delta is %08llx", apPts(0) - tdiff);
 		}
 	}
 
 	if (m_timestamp_deltas.empty())
-		m_timestamp_deltas[m_access_points.begin()->first] = m_access_points.begin()->second;
+		m_timestamp_deltas[apOffset(0)] = apPts(0);
 
 	pts_t currentDelta = m_timestamp_deltas.begin()->second, lastpts = -1;
-	for (std::map<off_t,pts_t>::const_iterator i(m_access_points.begin()); i != m_access_points.end(); ++i)
+	for (size_t i = 0; i < m_ap_count; ++i)
 	{
-		pts_t current = i->second - currentDelta;
+		pts_t pts = apPts(i);
+		pts_t current = pts - currentDelta;
 		pts_t diff = current - lastpts;
 
 		if (diff <= 0 || diff > (90000*10)) // 10sec diff
 		{
-//			eDebug("[eMPEGStreamInformation] %llx < %llx, have discont. new timestamp is %llx (diff is %llx)!", current, lastpts, i->second, diff);
-			currentDelta = i->second - lastpts - (90000/25);
-//			eDebug("[eMPEGStreamInformation] current delta now %llx, making current to %llx", currentDelta, i->second - currentDelta);
-			m_timestamp_deltas[i->first] = currentDelta;
+//			eDebug("[eMPEGStreamInformation] %llx < %llx, have discont. new timestamp is %llx (diff is %llx)!", current, lastpts, pts, diff);
+			currentDelta = pts - lastpts - (90000/25);
+//			eDebug("[eMPEGStreamInformation] current delta now %llx, making current to %llx", currentDelta, pts - currentDelta);
+			m_timestamp_deltas[apOffset(i)] = currentDelta;
 		}
-		lastpts = i->second - currentDelta;
+		lastpts = pts - currentDelta;
 	}
 }
 
@@ -134,6 +239,7 @@ pts_t eMPEGStreamInformation::getDelta(off_t offset)
 // fixupPTS is apparently called to get UI time information and such
 int eMPEGStreamInformation::fixupPTS(const off_t &offset, pts_t &ts)
 {
+	prepareAccessPoints();
 	//eDebug("[eMPEGStreamInformation::fixupPTS] offset=%llu pts=%llu", offset, ts);
 	if (m_streamtime_accesspoints)
 	{
@@ -148,21 +254,45 @@ int eMPEGStreamInformation::fixupPTS(const off_t &offset, pts_t &ts)
 	if (m_timestamp_deltas.empty())
 		return -1;
 
-	std::multimap<pts_t, off_t>::const_iterator
-		l = m_pts_to_offset.upper_bound(ts - 60 * 90000),
-		u = m_pts_to_offset.upper_bound(ts + 60 * 90000),
-		nearest = m_pts_to_offset.end();
-
-	while (l != u)
+	/*
+	 * Look for the access point with the pts nearest to ts, at most a minute
+	 * away. Between two deltas the pts increase, so each of those ranges is
+	 * searched with a binary search.
+	 */
+	size_t nearest = m_ap_count;
+	pts_t nearest_distance = 0;
+	for (std::map<off_t,pts_t>::const_iterator d(m_timestamp_deltas.begin()); d != m_timestamp_deltas.end(); )
 	{
-		if ((nearest == m_pts_to_offset.end()) || (llabs(l->first - ts) < llabs(nearest->first - ts)))
-			nearest = l;
-		++l;
+		size_t first = apLowerBound(d->first);
+		++d;
+		size_t end = d == m_timestamp_deltas.end() ? m_ap_count : apLowerBound(d->first);
+		size_t last = end;
+		while (first < last)
+		{
+			size_t mid = (first + last) / 2;
+			if (apPts(mid) < ts)
+				first = mid + 1;
+			else
+				last = mid;
+		}
+		for (size_t i = first ? first - 1 : 0; i <= first && i < end; ++i)
+		{
+			pts_t pts = apPts(i);
+			if (pts <= ts - 60 * 90000 || pts > ts + 60 * 90000)
+				continue;
+			/* on a tie, the lower pts wins */
+			if ((nearest == m_ap_count) || (llabs(pts - ts) < nearest_distance) ||
+				(llabs(pts - ts) == nearest_distance && pts < apPts(nearest)))
+			{
+				nearest = i;
+				nearest_distance = llabs(pts - ts);
+			}
+		}
 	}
-	if (nearest == m_pts_to_offset.end())
+	if (nearest == m_ap_count)
 		return 1;
 
-	ts -= getDelta(nearest->second);
+	ts -= getDelta(apOffset(nearest));
 
 	return 0;
 }
@@ -170,21 +300,22 @@ int eMPEGStreamInformation::fixupPTS(const off_t &offset, pts_t &ts)
 // getPTS is typically called when you "jump" in a file.
 int eMPEGStreamInformation::getPTS(off_t &offset, pts_t &pts)
 {
+	prepareAccessPoints();
 	//eDebug("[eMPEGStreamInformation] {%d} getPTS(offset=%llu, pts=%llu)", gettid(), offset, pts);
-	std::map<off_t,pts_t>::iterator before = m_access_points.lower_bound(offset);
-
-		/* usually, we prefer the AP before the given offset. however if there is none, we take any. */
-	if (before != m_access_points.begin())
-		--before;
-
-	if (before == m_access_points.end())
+	if (!m_ap_count)
 	{
 		pts = 0;
 		return -1;
 	}
 
-	offset = before->first;
-	pts = before->second - getDelta(offset);
+	size_t before = apLowerBound(offset);
+
+		/* usually, we prefer the AP before the given offset. however if there is none, we take any. */
+	if (before)
+		--before;
+
+	offset = apOffset(before);
+	pts = apPts(before) - getDelta(offset);
 
 	return 0;
 }
@@ -192,58 +323,56 @@ int eMPEGStreamInformation::getPTS(off_t &offset, pts_t &pts)
 pts_t eMPEGStreamInformation::getInterpolated(off_t offset)
 {
 		/* get the PTS values before and after the offset. */
-	std::map<off_t,pts_t>::iterator before, after;
-	after = m_access_points.upper_bound(offset);
-	before = after;
-
-	if (before != m_access_points.begin())
-		--before;
-	else	/* we query before the first known timestamp ... FIXME */
-		return 0;
+	size_t after = apLowerBound(offset + 1);
 
-		/* empty... */
-	if (before == m_access_points.end())
+		/* empty, or we query before the first known timestamp ... FIXME */
+	if (!after)
 		return 0;
+	size_t before = after - 1;
 
 		/* if after == end, then we need to extrapolate ... FIXME */
-	if ((before->first == offset) || (after == m_access_points.end()))
-		return before->second - getDelta(offset);
+	if ((apOffset(before) == offset) || (after == m_ap_count))
+		return apPts(before) - getDelta(offset);
 
-	pts_t before_ts = before->second - getDelta(before->first);
-	pts_t after_ts = after->second - getDelta(after->first);
+	pts_t before_ts = apFixedPts(before);
+	pts_t after_ts = apFixedPts(after);
 
 //	eDebug("[eMPEGStreamInformation] %08llx .. ? .. %08llx", before_ts, after_ts);
-//	eDebug("[eMPEGStreamInformation] %08llx .. %08llx .. %08llx", before->first, offset, after->first);
+//	eDebug("[eMPEGStreamInformation] %08llx .. %08llx .. %08llx", apOffset(before), offset, apOffset(after));
 
 	pts_t diff = after_ts - before_ts;
-	off_t diff_off = after->first - before->first;
+	off_t diff_off = apOffset(after) - apOffset(before);
 
-	diff = (offset - before->first) * diff / diff_off;
+	diff = (offset - apOffset(before)) * diff / diff_off;
 //	eDebug("[eMPEGStreamInformation] %08llx .. %08llx .. %08llx", before_ts, before_ts + diff, after_ts);
 	return before_ts + diff;
 }
 
 off_t eMPEGStreamInformation::getAccessPoint(pts_t ts, int marg)
 {
+	prepareAccessPoints();
 	//eDebug("[eMPEGStreamInformation::getAccessPoint] ts=%llu, marg=%d", ts, marg);
-		/* FIXME: more efficient implementation */
-	off_t last = 0;
-	off_t last2 = 0;
 	ts += 1; // Add rounding error margin
-	for (std::map<off_t, pts_t>::const_iterator i(m_access_points.begin()); i != m_access_points.end(); ++i)
+	/* the fixed up pts increase with the offset, find the first access point after ts */
+	size_t first = 0, end = m_ap_count;
+	while (first < end)
 	{
-		pts_t delta = getDelta(i->first);
-		pts_t c = i->second - delta;
-		if (c > ts) {
-			if (marg > 0)
-				return (last + i->first)/376*188;
-			else if (marg < 0)
-				return (last + last2)/376*188;
-			else
-				return last;
-		}
-		last2 = last;
-		last = i->first;
+		size_t mid = (first + end) / 2;
+		if (apFixedPts(mid) > ts)
+			end = mid;
+		else
+			first = mid + 1;
+	}
+	off_t last = first > 0 ? apOffset(first - 1) : 0;
+	off_t last2 = first > 1 ? apOffset(first - 2) : 0;
+	if (first < m_ap_count)
+	{
+		if (marg > 0)
+			return (last + apOffset(first))/376*188;
+		else if (marg < 0)
+			return (last + last2)/376*188;
+		else
+			return last;
 	}
 	if (marg < 0)
 		return (last + last2)/376*188;
@@ -253,53 +382,54 @@ off_t eMPEGStreamInformation::getAccessPoint(pts_t ts, int marg)
 
 int eMPEGStreamInformation::getNextAccessPoint(pts_t &ts, const pts_t &start, int direction)
 {
-	if (m_access_points.empty())
+	prepareAccessPoints();
+	if (!m_ap_count)
 	{
 		eDebug("[eMPEGStreamInformation] can't get next access point without streaminfo (yet)");
 		return -1;
 	}
 	off_t offset = getAccessPoint(start);
-	std::map<off_t, pts_t>::const_iterator i = m_access_points.find(offset);
-	if (i == m_access_points.end())
+	size_t i = apLowerBound(offset);
+	if (i == m_ap_count || apOffset(i) != offset)
 	{
 		eDebug("[eMPEGStreamInformation] getNextAccessPoint: initial AP not found");
 		return -1;
 	}
-	pts_t c1 = i->second - getDelta(i->first);
+	pts_t c1 = apFixedPts(i);
 	while (direction)
 	{
 		while (direction > 0)
 		{
-			if (i == m_access_points.end())
+			if (i + 1 >= m_ap_count)
 				return -1;
 			++i;
-			pts_t c2 = i->second - getDelta(i->first);
-			if (c1 == c2) { // Discontinuity
+			pts_t c2 = apFixedPts(i);
+			if (c1 == c2 && i + 1 < m_ap_count) { // Discontinuity
 				++i;
-				c2 = i->second - getDelta(i->first);
+				c2 = apFixedPts(i);
 			}
 			c1 = c2;
 			direction--;
 		}
 		while (direction < 0)
 		{
-			if (i == m_access_points.begin())
+			if (i == 0)
 			{
 				eDebug("[eMPEGStreamInformation] getNextAccessPoint at start");
 				return -1;
 			}
 			--i;
-			pts_t c2 = i->second - getDelta(i->first);
-			if (c1 == c2) { // Discontinuity
+			pts_t c2 = apFixedPts(i);
+			if (c1 == c2 && i > 0) { // Discontinuity
 				--i;
-				c2 = i->second - getDelta(i->first);
+				c2 = apFixedPts(i);
 			}
 			c1 = c2;
 			direction++;
 		}
 	}
-	ts = i->second - getDelta(i->first);
-	eDebug("[eMPEGStreamInformation] getNextAccessPoint fine, at %lld - %lld = %lld", ts, i->second, getDelta(i->first));
+	ts = apFixedPts(i);
+	eDebug("[eMPEGStreamInformation] getNextAccessPoint fine, at %lld - %lld = %lld", ts, apPts(i), getDelta(apOffset(i)));
 	return 0;
 }
 
@@ -308,18 +438,59 @@ int eMPEGStreamInformation::getNextAccessPoint(pts_t &ts, const pts_t &start, in
 
 static const int entry_size = 16;
 
+int eMPEGStreamInformation::structureEntries(int &first)
+{
+	if (m_structure_ring_size)
+	{
+		eRingFile::State state;
+		m_ringfile.get(state);
+		first = state.sc_begin / entry_size;
+		return state.sc_end / entry_size;
+	}
+	first = 0;
+	return ::lseek(m_structure_read_fd, 0, SEEK_END) / entry_size;
+}
+
+ssize_t eMPEGStreamInformation::readStructure(void *buffer, size_t bytes, off_t where)
+{
+	if (!m_structure_ring_size)
+		return ::pread(m_structure_read_fd, buffer, bytes, where);
+	/* in a ring, the part after the end of the file is at its start */
+	size_t done = 0;
+	while (done < bytes)
+	{
+		off_t position = (where + done) % m_structure_ring_size;
+		size_t count = std::min((off_t)(bytes - done), m_structure_ring_size - position);
+		ssize_t r = ::pread(m_structure_read_fd, (char*)buffer + done, count, position);
+		if (r <= 0)
+			return done ? (ssize_t)done : r;
+		done += r;
+	}
+	return done;
+}
+
+void eMPEGStreamInformation::freeCache()
+{
+	if (m_structure_ring_size)
+		free(m_structure_cache);
+	else
+		::munmap(m_structure_cache, m_structure_cache_entries * entry_size);
+	m_structure_cache = NULL;
+}
+
 int eMPEGStreamInformation::moveCache(int index)
 {
 	//eDebug("[eMPEGStreamInformation::moveCache] index=%d m_cache_index=%d m_structure_cache_entries=%d", index, m_cache_index, m_structure_cache_entries);
 	// Check if index falls inside current range.
 	if ((m_structure_cache_entries != 0) && (index >= m_cache_index) && (index < m_cache_index + m_structure_cache_entries))
 	{
-		// Request for the same data. If the request is at the end of the stream,
+		// Request for the same data. If the cache ended at the end of the stream,
 		// check if the file has become larger.
-		if (index + m_structure_cache_entries >= m_structure_file_entries)
+		if (m_structure_cache_entries < (int)(MAPSIZE / entry_size))
 		{
-			int l = ::lseek(m_structure_read_fd, 0, SEEK_END) / entry_size;
-			if (l == m_structure_file_entries)
+			int first;
+			int l = structureEntries(first);
+			if (m_cache_index + m_structure_cache_entries >= l)
 			{
 				// No change to file, just return
 				return m_structure_cache_entries;
@@ -344,13 +515,16 @@ int eMPEGStreamInformation::loadCache(int index)
 	if (m_structure_cache != NULL)
 	{
 		//eDebug("[eMPEGStreamInformation] munmap %p size %d index %d", m_structure_cache, m_structure_cache_entries * entry_size, m_cache_index);
-		::munmap(m_structure_cache, m_structure_cache_entries * entry_size);
-		m_structure_cache = NULL;
+		freeCache();
 		m_structure_cache_entries = 0;
 		m_cache_index = -1;
 	}
+	int first;
+	off_t until = (off_t)structureEntries(first) * entry_size;
 	off_t where = ROUND_TO_PAGESIZE(index * entry_size);
-	off_t until = ::lseek(m_structure_read_fd, 0, SEEK_END);
+	/* the start of a ring is page aligned */
+	if (where < (off_t)first * entry_size)
+		where = (off_t)first * entry_size;
 	size_t bytes;
 	if (where + MAPSIZE <= until)
 	{
@@ -371,7 +545,18 @@ int eMPEGStreamInformation::loadCache(int index)
 		}
 	}
 	//eDebug("[eMPEGStreamInformation] mmap offset=%lld size %d", where, bytes);
-	m_structure_cache = (unsigned long long*) ::mmap(NULL, bytes, PROT_READ, MAP_SHARED, m_structure_read_fd, where);
+	if (m_structure_ring_size)
+	{
+		/* a ring may wrap within the window, so it is copied instead of mapped */
+		m_structure_cache = (unsigned long long*)malloc(bytes);
+		if (m_structure_cache && readStructure(m_structure_cache, bytes, where) != (ssize_t)bytes)
+		{
+			free(m_structure_cache);
+			m_structure_cache = NULL;
+		}
+	}
+	else
+		m_structure_cache = (unsigned long long*) ::mmap(NULL, bytes, PROT_READ, MAP_SHARED, m_structure_read_fd, where);
 	if (m_structure_cache == NULL)
 	{
 		eDebug("[eMPEGStreamInformation] failed to mmap cache: %m");
@@ -399,8 +584,9 @@ int eMPEGStreamInformation::getStructureEntryFirst(off_t &offset, unsigned long
 	    (structureCacheOffset(0) > offset) ||
 	    (structureCacheOffset(m_structure_cache_entries - 1) <= offset))
 	{
-		int l = ::lseek(m_structure_read_fd, 0, SEEK_END) / entry_size;
-		if (l == 0)
+		int first;
+		int l = structureEntries(first);
+		if (l <= first)
 		{
 			eDebug("[eMPEGStreamInformation] getStructureEntryFirst failed because file size is zero");
 			return -1;
@@ -408,16 +594,15 @@ int eMPEGStreamInformation::getStructureEntryFirst(off_t &offset, unsigned long
 		m_structure_file_entries = l;
 
 		/* do a binary search */
-		int count = l;
-		int i = 0;
+		int count = l - first;
+		int i = first;
 		const int structure_cache_size = MAPSIZE / entry_size;
 		while (count > (structure_cache_size/4))
 		{
 			int step = count >> 1;
 			// Read entry at top end of current range (== i+step-1)
-			::lseek(m_structure_read_fd, (i + step - 1) * entry_size, SEEK_SET);
 			unsigned long long d;
-			if (::read(m_structure_read_fd, &d, sizeof(d)) < (ssize_t)sizeof(d))
+			if (readStructure(&d, sizeof(d), (off_t)(i + step - 1) * entry_size) < (ssize_t)sizeof(d))
 			{
 				eDebug("[eMPEGStreamInformation] getStructureEntryFirst read error at entry %d", i+step);
 				return -1;
@@ -439,8 +624,8 @@ int eMPEGStreamInformation::getStructureEntryFirst(off_t &offset, unsigned long
 		{
 			i = l - structure_cache_size; // Near end of file, just fetch the last
 		}
-		if (i < 0)
-			i = 0;
+		if (i < first)
+			i = first;
 		int num = moveCache(i);
 		if ((num < structure_cache_size) && (structureCacheOffset(num - 1) <= offset))
 		{
@@ -508,6 +693,12 @@ int eMPEGStreamInformation::getStructureEntryNext(off_t &offset, unsigned long l
 			return -1;
 		}
 		index = next - m_cache_index;
+		if ((index < 0) || (index >= num))
+		{
+			/* before the start of a ring */
+			eDebug("[eMPEGStreamInformation] getStructureEntryNext failed, entry %d is gone", next);
+			return -1;
+		}
 		//eDebug("[eMPEGStreamInformation] getStructureEntryNext Moved outside cache, next=%d delta=%d cache=%d index=+%d", next, delta, m_cache_index, index);
 	}
 	offset = structureCacheOffset(index);
@@ -520,18 +711,20 @@ int eMPEGStreamInformation::getStructureEntryNext(off_t &offset, unsigned long l
 // Get first or last PTS value and offset.
 int eMPEGStreamInformation::getFirstFrame(off_t &offset, pts_t& pts)
 {
+	prepareAccessPoints();
 	//eDebug("[eMPEGStreamInformation] {processid %d} getFirstFrame", gettid());
-	std::map<off_t,pts_t>::const_iterator entry = m_access_points.begin();
-	if (entry != m_access_points.end())
+	if (m_ap_count)
 	{
-		offset = entry->first;
-		pts = entry->second;
+		offset = apOffset(0);
+		pts = apPts(0);
 		return 0;
 	}
 	// No access points (yet?) use the .sc data instead
 	if (m_structure_read_fd >= 0)
 	{
-		int num = moveCache(0);
+		int first;
+		structureEntries(first);
+		int num = moveCache(first);
 		if (num <= 0)
 		{
 			eDebug("[eMPEGStreamInformation::getFirstFrame] - no data (yet?)");
@@ -555,19 +748,20 @@ int eMPEGStreamInformation::getFirstFrame(off_t &offset, pts_t& pts)
 }
 int eMPEGStreamInformation::getLastFrame(off_t &offset, pts_t& pts)
 {
+	prepareAccessPoints();
 	//eDebug("[eMPEGStreamInformation::getLastFrame]", gettid());
-	std::map<off_t,pts_t>::const_reverse_iterator entry = m_access_points.rbegin();
-	if (entry != m_access_points.rend())
+	if (m_ap_count)
 	{
-		offset = entry->first;
-		pts = entry->second;
+		offset = apOffset(m_ap_count - 1);
+		pts = apPts(m_ap_count - 1);
 		return 0;
 	}
 	// No access points (yet?) use the .sc data instead
 	if (m_structure_read_fd >= 0)
 	{
-		int l = ::lseek(m_structure_read_fd, 0, SEEK_END) / entry_size;
-		if (l <= 0)
+		int oldest;
+		int l = structureEntries(oldest);
+		if (l <= oldest)
 		{
 			eDebug("[eMPEGStreamInformation::getLastFrame] - no data (yet?)");
 			offset = 0;
@@ -619,11 +813,117 @@ int eMPEGStreamInformation::getLastFrame(off_t &offset, pts_t& pts)
 	return -1;
 }
 
+void eMPEGStreamInformation::IFrameScanner::thread()
+{
+	hasStarted();
+	m_info.updateIFrames();
+}
+
+void eMPEGStreamInformation::scanIFrames()
+{
+	prepareAccessPoints();
+	if (m_iframe_scanning || m_structure_read_fd < 0)
+		return;
+	m_iframe_scanning = true;
+	/* the last scan has released the lock for good, join it */
+	m_iframe_scanner.kill();
+	if (m_iframe_scanner.run())
+		m_iframe_scanning = false;
+}
+
+void eMPEGStreamInformation::updateIFrames()
+{
+	int first;
+	int entries = structureEntries(first);
+	std::vector<IFrame> added;
+	int index = std::max(m_iframe_entry, first);
+	/* the I-frame whose end has not been seen yet, and the last sequence header */
+	int frame_entry = -1, header_entry = -1;
+	off_t frame_offset = 0, header_offset = 0;
+	pts_t frame_pts = 0;
+	unsigned long long buffer[2 * 1024];
+	while (index < entries)
+	{
+		int count = std::min(entries - index, 1024);
+		ssize_t r = readStructure(buffer, count * entry_size, (off_t)index * entry_size);
+		if (r < entry_size)
+			break;
+		count = r / entry_size;
+		for (int i = 0; i < count; ++i, ++index)
+		{
+			off_t offset = be64toh(buffer[i * 2]);
+			unsigned long long longdata = be64toh(buffer[i * 2 + 1]);
+			unsigned int data = (unsigned int)longdata;
+			if (offset == 0x7fffFFFFffffFFFFll)
+			{
+				entries = index;
+				break;
+			}
+			/* same start codes as in eDVBTSTools::findFrame */
+			if (((data & 0xFF) == 0x0009) || ((data & 0xFF) == 0x00) || ((data & 0x7E) == 0x0046))
+			{
+				if (frame_entry != -1)
+				{
+					IFrame frame;
+					frame.offset = frame_offset;
+					frame.len = offset - frame_offset;
+					frame.pts = frame_pts;
+					added.push_back(frame);
+					frame_entry = -1;
+				}
+				if (((data & 0xE0FF) == 0x0009) || ((data & 0xE07E) == 0x0046) || ((data & 0x3800FF) == 0x080000))
+				{
+					frame_entry = header_entry != -1 ? header_entry : index;
+					frame_offset = header_entry != -1 ? header_offset : offset;
+					if ((longdata & 0x1000000) && !m_streamtime_accesspoints)
+						frame_pts = (pts_t)(longdata >> 31) - getDelta(frame_offset);
+					else
+						frame_pts = getInterpolated(frame_offset);
+				}
+				header_entry = -1;
+			}
+			else if ((data & 0xFF) == 0xB3) /* MPEG2 sequence header */
+			{
+				header_entry = index;
+				header_offset = offset;
+			}
+		}
+	}
+	/* continue with the unfinished frame next time */
+	if (frame_entry != -1)
+		m_iframe_entry = frame_entry;
+	else if (header_entry != -1)
+		m_iframe_entry = header_entry;
+	else
+		m_iframe_entry = index;
+
+	eSingleLocker lock(m_iframe_lock);
+	m_iframes.insert(m_iframes.end(), added.begin(), added.end());
+	if (m_structure_ring_size)
+	{
+		/* forget the frames a ring has overwritten, once they are the bigger part */
+		eRingFile::State state;
+		m_ringfile.get(state);
+		std::vector<IFrame>::iterator gone = m_iframes.begin();
+		while (gone != m_iframes.end() && gone->offset < state.begin)
+			++gone;
+		if ((size_t)(gone - m_iframes.begin()) > m_iframes.size() / 2)
+			m_iframes.erase(m_iframes.begin(), gone);
+	}
+	m_iframe_scanning = false;
+}
+
 eMPEGStreamInformationWriter::eMPEGStreamInformationWriter():
 	m_structure_write_fd(-1),
 	m_structure_pos(0),
 	m_write_buffer(NULL),
-	m_buffer_filled(0)
+	m_buffer_filled(0),
+	m_range_begin(0),
+	m_range_end(-1),
+	m_structure_ring_size(0)
+#ifdef HAVE_LIBURING
+	,m_ring(NULL)
+#endif
 {}
 
 eMPEGStreamInformationWriter::~eMPEGStreamInformationWriter()
@@ -635,6 +935,12 @@ int eMPEGStreamInformationWriter::startSave(const std::string& filename)
 {
 	m_filename = filename;
 	m_structure_write_fd = ::open((m_filename + ".sc").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	m_structure_pos = 0;
+	if (m_structure_ring_size && m_ringfile.open(m_filename, true) < 0)
+	{
+		eWarning("[eMPEGStreamInformationWriter] no ring buffer state for %s, writing a linear structure file", m_filename.c_str());
+		m_structure_ring_size = 0;
+	}
 	m_buffer_filled = 0;
 	m_write_buffer = NULL;
 	return 0;
@@ -652,8 +958,10 @@ int eMPEGStreamInformationWriter::stopSave(void)
 		return 1;
 	std::string ap_filename(m_filename);
 	ap_filename += ".ap";
+	/* readers map the .ap file, so replace it instead of truncating it under their feet */
+	std::string tmp_filename(ap_filename + ".tmp");
 	{
-		CFile f(ap_filename.c_str(), "wb");
+		CFile f(tmp_filename.c_str(), "wb");
 		if (!f)
 			return -1;
 		for (std::deque<AccessPoint>::const_iterator i(m_streamtime_access_points.begin()); i != m_streamtime_access_points.end(); ++i)
@@ -673,17 +981,22 @@ int eMPEGStreamInformationWriter::stopSave(void)
 				goto write_ap_error;
 		}
 	}
+	if (::rename(tmp_filename.c_str(), ap_filename.c_str()) < 0)
+		goto write_ap_error;
 	return 0;
 write_ap_error:
 	/* Writing half an AP file is worse than no file at all, so unlink
 	 * it if writing it fails */
 	eDebug("[eMPEGStreamInformationWriter] Failed to write %s, removing it", ap_filename.c_str());
+	::unlink(tmp_filename.c_str());
 	::unlink(ap_filename.c_str());
 	return -1;
 }
 
 void eMPEGStreamInformationWriter::addAccessPoint(off_t offset, pts_t pts, bool streamtime)
 {
+	if (!inRange(offset))
+		return;
 	if (streamtime)
 	{
 		m_streamtime_access_points.push_back(AccessPoint(offset, pts));
@@ -701,7 +1014,7 @@ void eMPEGStreamInformationWriter::addAccessPoint(off_t offset, pts_t pts, bool
 
 void eMPEGStreamInformationWriter::writeStructureEntry(off_t offset, unsigned long long data)
 {
-	if (m_structure_write_fd >= 0)
+	if (m_structure_write_fd >= 0 && inRange(offset))
 	{
 		if (m_write_buffer == NULL)
 		{
@@ -717,19 +1030,29 @@ void eMPEGStreamInformationWriter::writeStructureEntry(off_t offset, unsigned lo
 		d[0] = htobe64(offset);
 		d[1] = htobe64(data);
 		m_buffer_filled += 16;
-		if (m_buffer_filled == PAGESIZE)
+		/* a write must not cross the end of a ring */
+		if ((m_buffer_filled == PAGESIZE) ||
+			(m_structure_ring_size && ((m_structure_pos + m_buffer_filled) % m_structure_ring_size) == 0))
 			commit();
 	}
 }
 
 eMPEGStreamInformationWriter::PendingWrite::PendingWrite():
-	m_buffer(NULL) // empty constructor because deque will make a COPY first.
+	m_buffer(NULL), // empty constructor because deque will make a COPY first.
+	m_pos(0)
+#ifdef HAVE_LIBURING
+	,m_ring(NULL)
+#endif
 {
 }
 
 int eMPEGStreamInformationWriter::PendingWrite::start(int fd, off_t where, void* buffer, size_t buffer_size)
 {
 	m_buffer = buffer; // Note: We take ownership of the buffer!
+#ifdef HAVE_LIBURING
+	if (m_ring)
+		return m_ring->write(m_request, fd, buffer, buffer_size, where);
+#endif
 	memset(&m_aio, 0, sizeof(m_aio));
 	m_aio.aio_fildes = fd;
 	m_aio.aio_nbytes = buffer_size;
@@ -754,6 +1077,15 @@ eMPEGStreamInformationWriter::PendingWrite::~PendingWrite()
 
 int eMPEGStreamInformationWriter::PendingWrite::wait()
 {
+#ifdef HAVE_LIBURING
+	if (m_ring)
+	{
+		int r = m_ring->wait(m_request);
+		if (r < 0)
+			eDebug("[eMPEGStreamInformationWriter] io_uring write failed: %s", strerror(-r));
+		return r;
+	}
+#endif
 	//eDebug("[eMPEGStreamInformationWriter] PendingWrite waiting for IO completion");
 	struct aiocb* aio = &m_aio;
 	while (aio_error(aio) == EINPROGRESS)
@@ -778,14 +1110,27 @@ bool eMPEGStreamInformationWriter::PendingWrite::poll()
 {
 	if (m_buffer == NULL)
 		return true; // Nothing pending
-	if (aio_error(&m_aio) == EINPROGRESS)
+#ifdef HAVE_LIBURING
+	if (m_ring)
 	{
-		return false; // still busy
+		m_ring->reap();
+		if (m_request.busy)
+			return false; // still busy
+		if (m_request.result < 0)
+			eDebug("[eMPEGStreamInformationWriter] io_uring write failed: %s", strerror(-m_request.result));
 	}
-	int r = aio_return(&m_aio);
-	if (r < 0)
+	else
+#endif
 	{
-		eDebug("[eMPEGStreamInformationWriter] aio_return returned failure: %m");
+		if (aio_error(&m_aio) == EINPROGRESS)
+		{
+			return false; // still busy
+		}
+		int r = aio_return(&m_aio);
+		if (r < 0)
+		{
+			eDebug("[eMPEGStreamInformationWriter] aio_return returned failure: %m");
+		}
 	}
 	free(m_buffer);
 	m_buffer = NULL;
@@ -812,11 +1157,32 @@ void eMPEGStreamInformationWriter::commit()
 	if (m_write_buffer != NULL)
 	{
 		m_pending_writes.push_back(PendingWrite()); // calls copy constructor, so don't initialize it
-		m_pending_writes.back().start(m_structure_write_fd, m_structure_pos, m_write_buffer, m_buffer_filled);
+#ifdef HAVE_LIBURING
+		/* the deque never moves its elements on push_back and pop_front, so the request stays put */
+		m_pending_writes.back().m_ring = m_ring;
+#endif
+		m_pending_writes.back().m_pos = m_structure_pos;
+		off_t where = m_structure_ring_size ? m_structure_pos % m_structure_ring_size : m_structure_pos;
+		m_pending_writes.back().start(m_structure_write_fd, where, m_write_buffer, m_buffer_filled);
 		m_structure_pos += m_buffer_filled;
 		m_write_buffer = NULL;
 		m_buffer_filled = 0;
 	}
+	if (m_structure_ring_size)
+		publishStructure();
+}
+
+void eMPEGStreamInformationWriter::publishStructure()
+{
+	/* readers may use what has been written, up to the oldest write in flight, */
+	/* and keep a window of MAPSIZE away from the page being overwritten next */
+	off_t end = m_pending_writes.empty() ? m_structure_pos : m_pending_writes.front().m_pos;
+	off_t begin = m_structure_pos + MAPSIZE - m_structure_ring_size;
+	if (begin < 0)
+		begin = 0;
+	else
+		begin = (begin + PAGESIZE - 1) & ~((off_t)PAGESIZE - 1);
+	m_ringfile.setStructure(begin, std::max(begin, end));
 }
 
 
@@ -826,6 +1192,11 @@ void eMPEGStreamInformationWriter::close()
 	{
 		commit();
 		m_pending_writes.clear(); // this waits for all IO to complete
+		if (m_structure_ring_size)
+		{
+			publishStructure();
+			m_ringfile.close();
+		}
 		::close(m_structure_write_fd);
 		m_structure_write_fd = -1;
 		if ((m_structure_pos == 0) && !m_filename.empty())
@@ -6,7 +6,12 @@
 #include <map>
 #include <set>
 #include <deque>
+#include <vector>
 #include <aio.h>
+#include <lib/dvb/iouring.h>
+#include <lib/base/elock.h>
+#include <lib/base/thread.h>
+#include <lib/base/ringfile.h>
 
 	/* This module parses TS data and collects valuable information  */
 	/* about it, like PTS<->offset correlations and sequence starts. */
@@ -30,7 +35,7 @@ public:
 
 	int getNextAccessPoint(pts_t &ts, const pts_t &start, int direction);
 
-	bool hasAccessPoints() { return !m_access_points.empty(); }
+	bool hasAccessPoints() { return m_ap_count != 0; }
 	bool hasStructure() { return m_structure_read_fd >= 0; }
 
 		/* get a structure entry at given offset (or previous one, if no exact match was found).
@@ -43,25 +48,66 @@ public:
 	int getFirstFrame(off_t &offset, pts_t& pts);
 	int getLastFrame(off_t &offset, pts_t& pts);
 
+	struct IFrame
+	{
+		off_t offset; // of the sequence header, if there is one right before it
+		unsigned int len;
+		pts_t pts; // zero-based
+	};
+		/* I-frames found in the structure file, in offset order. they are */
+		/* collected by a background thread, which only scans the part of a */
+		/* growing file it has not seen yet. scanIFrames starts it unless it */
+		/* is still busy. both must be called with getIFrameLock() held. */
+	void scanIFrames();
+	eSingleLock &getIFrameLock() { return m_iframe_lock; }
+	const std::vector<IFrame> &getIFrames() const { return m_iframes; }
+
 private:
+	class IFrameScanner: public eThread
+	{
+		eMPEGStreamInformation &m_info;
+	public:
+		IFrameScanner(eMPEGStreamInformation &info): m_info(info) {}
+		void thread();
+	};
+	/* runs on the scanner thread */
+	void updateIFrames();
 	void close();
 	int loadCache(int index);
 	int moveCache(int index);
+	void freeCache();
+	/* number of structure entries, first is the oldest one left in a ring */
+	int structureEntries(int &first);
+	/* pread at a logical position of the structure file */
+	ssize_t readStructure(void *buffer, size_t bytes, off_t where);
 	/* inter/extrapolate timestamp from offset */
 	pts_t getInterpolated(off_t offset);
 	/* get delta at specific offset */
 	pts_t getDelta(off_t offset);
 	/* recalculates timestampDeltas */
 	void fixupDiscontinuties();
-	/* we order by off_t here, since the timestamp may */
+	/* sorts and fixes up the access points on their first use, not in load */
+	void prepareAccessPoints();
+	/* access point i, its offset, pts and pts minus delta */
+	off_t apOffset(size_t i) const;
+	pts_t apPts(size_t i) const;
+	pts_t apFixedPts(size_t i);
+	/* index of the first access point at or after offset */
+	size_t apLowerBound(off_t offset) const;
+	/* the access points are the mapped .ap file, an array of big endian */
+	/* offset/pts pairs. we order by off_t here, since the timestamp may */
 	/* wrap around. */
 	/* we only record sequence start's pts values here. */
-	std::map<off_t, pts_t> m_access_points;
+	const unsigned long long *m_access_points;
+	size_t m_ap_count;
+	size_t m_ap_mapsize; // 0 if m_access_points is m_ap_sorted
+	bool m_ap_prepared;
+	/* sorted copy of an .ap file which is not in offset order */
+	std::vector<unsigned long long> m_ap_sorted;
 	/* timestampDelta is in fact the difference between */
 	/* the PTS in the stream and a real PTS from 0..max */
+	/* within the access points between two deltas, pts increase. */
 	std::map<off_t, pts_t> m_timestamp_deltas;
-	/* these are non-fixed up pts value (like m_access_points), just used to accelerate stuff. */
-	std::multimap<pts_t, off_t> m_pts_to_offset;
 
 	int m_structure_read_fd;
 	int m_cache_index;   // Location of cache
@@ -70,6 +116,14 @@ private:
 	int m_structure_file_entries; // Also to detect changes to file
 	unsigned long long* m_structure_cache;
 	bool m_streamtime_accesspoints;
+	std::vector<IFrame> m_iframes;
+	int m_iframe_entry; // first structure entry updateIFrames has to look at
+	IFrameScanner m_iframe_scanner;
+	eSingleLock m_iframe_lock; // protects m_iframes and m_iframe_scanning
+	bool m_iframe_scanning;
+	/* set if the structure file is written as a ring buffer */
+	eRingFile m_ringfile;
+	off_t m_structure_ring_size;
 };
 
 class eMPEGStreamInformationWriter
@@ -83,6 +137,14 @@ public:
 	virtual void addAccessPoint(off_t offset, pts_t pts, bool streamtime);
 	void writeStructureEntry(off_t offset, unsigned long long data);
 	void commit();
+	/* only keep the entries of offsets in [begin, end), end -1 is unlimited */
+	void setRange(off_t begin, off_t end) { m_range_begin = begin; m_range_end = end; }
+	/* write the structure file as a ring of size bytes, before startSave */
+	void setRingBuffer(off_t size) { m_structure_ring_size = size; }
+#ifdef HAVE_LIBURING
+	/* queue structure writes on ring, they are submitted by its owner */
+	void setIOUring(eIOUring *ring) { m_ring = ring; }
+#endif
 private:
 	void close();
 	struct AccessPoint
@@ -100,7 +162,12 @@ private:
 		bool poll(); // releases resources when ready, returns true if released
 		int wait();
 		void* m_buffer;
+		off_t m_pos; // logical position in the structure file
 		struct aiocb m_aio;
+#ifdef HAVE_LIBURING
+		eIOUring *m_ring;
+		eIOUring::Request m_request;
+#endif
 	};
 	std::deque<PendingWrite> m_pending_writes;
 	std::string m_filename;
@@ -108,6 +175,14 @@ private:
 	off_t m_structure_pos;
 	void* m_write_buffer;
 	size_t m_buffer_filled;
+	off_t m_range_begin, m_range_end;
+	off_t m_structure_ring_size;
+	eRingFile m_ringfile;
+#ifdef HAVE_LIBURING
+	eIOUring *m_ring;
+#endif
+	void publishStructure();
+	bool inRange(off_t offset) const { return offset >= m_range_begin && (m_range_end < 0 || offset < m_range_end); }
 };
 
 
@@ -0,0 +1,481 @@
+#include <lib/dvb/reindex.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <lib/base/cfile.h>
+#include <lib/base/eerror.h>
+#include <lib/base/rawfile.h>
+#include <lib/dvb/decoder.h>
+#include <lib/dvb/pvrparse.h>
+
+/* how far into the recording to look for the packet size and the PMT */
+#define PROBE_SIZE (16 * 1024 * 1024)
+/* packets that need to be in sync to accept a packet size */
+#define SYNC_PACKETS 64
+
+void eDVBReindexer::Worker::thread()
+{
+	hasStarted();
+	/* this is background work, leave the cpu to playback and recordings */
+	if (nice(4) == -1)
+	{
+		eDebug("[eDVBReindexer] worker failed to modify scheduling priority (%m)");
+	}
+	m_reindexer.process();
+}
+
+eDVBReindexer::eDVBReindexer(const std::string &filename)
+	:m_filename(filename), m_pid(-1), m_streamtype(eDVBVideo::UNKNOWN),
+	m_pidtype(iDVBTSRecorder::video_pid), m_packetsize(188),
+	m_start(0), m_length(0), m_chunksize(0), m_overlap(0), m_chunks(0),
+	m_next(0), m_parsed(0), m_stop(false), m_error(0)
+{
+}
+
+int eDVBReindexer::run(int threads)
+{
+	int err = probe();
+	if (err < 0)
+		return err;
+	loadState();
+
+	int todo = std::count(m_done.begin(), m_done.end(), false);
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	threads = std::max(1, std::min(threads, todo));
+	eDebug("[eDVBReindexer] %s: %d byte packets, %s pid 0x%x, %d of %d chunks to do, %d thread(s)",
+		m_filename.c_str(), m_packetsize, m_pidtype == iDVBTSRecorder::video_pid ? "video" : "audio",
+		m_pid, todo, m_chunks, threads);
+
+	if (threads == 1)
+		process();
+	else
+	{
+		std::vector<Worker*> workers;
+		for (int i = 0; i < threads; ++i)
+		{
+			Worker *worker = new Worker(*this);
+			worker->run();
+			workers.push_back(worker);
+		}
+		for (std::vector<Worker*>::iterator it(workers.begin()); it != workers.end(); ++it)
+		{
+			(*it)->kill();
+			delete *it;
+		}
+	}
+
+	if (m_error)
+		return m_error;
+	if (m_stop)
+	{
+		eDebug("[eDVBReindexer] %s: stopped, %d of %d chunks done", m_filename.c_str(),
+			(int)std::count(m_done.begin(), m_done.end(), true), m_chunks);
+		return -EINTR;
+	}
+	err = join();
+	if (err < 0)
+		return err;
+	cleanup();
+	return 0;
+}
+
+void eDVBReindexer::stop()
+{
+	eSingleLocker l(m_lock);
+	m_stop = true;
+}
+
+int eDVBReindexer::probe()
+{
+	eRawFile f;
+	int err = f.open(m_filename.c_str());
+	if (err < 0)
+		return err;
+	m_length = f.length();
+	err = detectPacketSize(f);
+	if (err < 0)
+	{
+		eDebug("[eDVBReindexer] %s: no transport stream sync found", m_filename.c_str());
+		return err;
+	}
+	if (m_pid == -1)
+	{
+		err = findTimingPid(f);
+		if (err < 0)
+		{
+			eDebug("[eDVBReindexer] %s: no video or audio stream found", m_filename.c_str());
+			return err;
+		}
+	}
+	m_chunksize = CHUNK_SIZE / m_packetsize * m_packetsize;
+	m_overlap = OVERLAP / m_packetsize * m_packetsize;
+	m_chunks = (m_length - m_start + m_chunksize - 1) / m_chunksize;
+	if (!m_chunks)
+		return -ENODATA;
+	m_done.assign(m_chunks, false);
+	m_next = 0;
+	m_parsed = 0;
+	m_error = 0;
+	return 0;
+}
+
+/*
+ * 188 byte packets, or 192 byte packets with a 4 byte timestamp in front
+ * as written by some receivers. 204 byte packets with parity would need a
+ * header offset of zero, which eMPEGStreamParserTS does not support.
+ */
+int eDVBReindexer::detectPacketSize(eRawFile &f)
+{
+	static const int sizes[] = { 188, 192 };
+	std::vector<unsigned char> buffer(192 * (SYNC_PACKETS + 1));
+	ssize_t len = f.read(0, &buffer[0], buffer.size());
+	if (len < 0)
+		return len;
+	for (int start = 0; start < 192; ++start)
+	{
+		for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+		{
+			int size = sizes[i];
+			int packets = 0;
+			for (ssize_t pos = start + size - 188; pos < len && buffer[pos] == 0x47; pos += size)
+				++packets;
+			/* a short recording has to be in sync up to its end */
+			if (packets >= SYNC_PACKETS || (packets && start + packets * size >= len))
+			{
+				m_packetsize = size;
+				m_start = start;
+				return 0;
+			}
+		}
+	}
+	return -EINVAL;
+}
+
+/* the first video stream of the first program in the PAT, or its first audio stream for radio */
+int eDVBReindexer::findTimingPid(eRawFile &f)
+{
+	int pmt_pid = -1;
+	std::vector<unsigned char> buffer(m_packetsize * 1024);
+	for (off_t offset = m_start; offset < m_start + PROBE_SIZE; offset += buffer.size())
+	{
+		ssize_t len = f.read(offset, &buffer[0], buffer.size());
+		if (len <= 0)
+			break;
+		for (ssize_t pos = 0; pos + m_packetsize <= len; pos += m_packetsize)
+		{
+			const unsigned char *pkt = &buffer[pos + m_packetsize - 188];
+			int pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+			if (pkt[0] != 0x47 || !(pkt[1] & 0x40) || (pid != 0 && pid != pmt_pid))
+				continue;
+			const unsigned char *end = pkt + 188;
+			const unsigned char *payload = pkt + 4;
+			if (!(pkt[3] & 0x10))
+				continue;
+			if (pkt[3] & 0x20)
+				payload += 1 + payload[0];
+			if (payload >= end)
+				continue;
+			const unsigned char *section = payload + 1 + payload[0];
+			if (section + 12 > end)
+				continue;
+			int section_length = ((section[1] & 0x0f) << 8) | section[2];
+			/* without the crc */
+			const unsigned char *section_end = std::min(section + 3 + section_length - 4, end);
+			if (pid == 0 && section[0] == 0x00)
+			{
+				for (const unsigned char *p = section + 8; p + 4 <= section_end; p += 4)
+				{
+					int program = (p[0] << 8) | p[1];
+					if (program)
+					{
+						pmt_pid = ((p[2] & 0x1f) << 8) | p[3];
+						break;
+					}
+				}
+			}
+			else if (pid == pmt_pid && section[0] == 0x02)
+			{
+				int program_info_length = ((section[10] & 0x0f) << 8) | section[11];
+				int audio_pid = -1, audio_type = eDVBAudio::aMPEG;
+				for (const unsigned char *p = section + 12 + program_info_length; p + 5 <= section_end;
+					p += 5 + (((p[3] & 0x0f) << 8) | p[4]))
+				{
+					int streamtype;
+					switch (p[0])
+					{
+					case 0x01:
+					case 0x02:
+						streamtype = eDVBVideo::MPEG2;
+						break;
+					case 0x1b:
+						streamtype = eDVBVideo::MPEG4_H264;
+						break;
+					case 0x24:
+						streamtype = eDVBVideo::H265_HEVC;
+						break;
+					case 0x03:
+					case 0x04:
+					case 0x0f:
+					case 0x11:
+					case 0x81:
+						if (audio_pid == -1)
+						{
+							audio_pid = ((p[1] & 0x1f) << 8) | p[2];
+							audio_type = p[0] == 0x81 ? eDVBAudio::aAC3 :
+								p[0] == 0x0f ? eDVBAudio::aAAC :
+								p[0] == 0x11 ? eDVBAudio::aAACHE : eDVBAudio::aMPEG;
+						}
+						continue;
+					default:
+						continue;
+					}
+					setPid(((p[1] & 0x1f) << 8) | p[2], streamtype);
+					return 0;
+				}
+				if (audio_pid == -1)
+					return -ENOENT;
+				/* a radio recording, the parser does not index audio so this only clears the old index */
+				setPid(audio_pid, audio_type, iDVBTSRecorder::audio_pid);
+				return 0;
+			}
+		}
+	}
+	return -ENOENT;
+}
+
+std::string eDVBReindexer::partName(int chunk) const
+{
+	char buf[16];
+	snprintf(buf, sizeof(buf), ".reindex.%d", chunk);
+	return m_filename + buf;
+}
+
+/*
+ * The state file starts with the parameters the chunks were parsed with,
+ * followed by one line per finished chunk. A state file of a different
+ * run (the recording has grown, or another pid was given) is discarded.
+ */
+void eDVBReindexer::loadState()
+{
+	std::string filename = m_filename + ".reindex";
+	char header[128];
+	snprintf(header, sizeof(header), "%d %lld %lld %d %d\n", m_packetsize,
+		(long long)m_length, (long long)m_chunksize, m_pid, m_streamtype);
+	{
+		CFile f(filename, "r");
+		char line[128];
+		if (f && fgets(line, sizeof(line), f) && !strcmp(line, header))
+		{
+			int chunk;
+			int resumed = 0;
+			while (fscanf(f, "%d", &chunk) == 1)
+			{
+				if (chunk >= 0 && chunk < m_chunks && !m_done[chunk])
+				{
+					m_done[chunk] = true;
+					m_parsed += std::min(m_chunksize, m_length - m_start - chunk * m_chunksize);
+					++resumed;
+				}
+			}
+			eDebug("[eDVBReindexer] %s: resuming, %d chunks already done", m_filename.c_str(), resumed);
+			return;
+		}
+	}
+	CFile f(filename, "w");
+	if (!f || fputs(header, f) < 0)
+		eDebug("[eDVBReindexer] failed to write %s, reindexing cannot be resumed", filename.c_str());
+}
+
+void eDVBReindexer::markDone(int chunk)
+{
+	CFile f(m_filename + ".reindex", "a");
+	if (f)
+	{
+		fprintf(f, "%d\n", chunk);
+		fflush(f);
+		f.sync();
+	}
+}
+
+void eDVBReindexer::process()
+{
+	while (true)
+	{
+		int chunk;
+		{
+			eSingleLocker l(m_lock);
+			while (m_next < m_chunks && m_done[m_next])
+				++m_next;
+			if (m_stop || m_next == m_chunks)
+				return;
+			chunk = m_next++;
+		}
+		int err = parseChunk(chunk);
+		eSingleLocker l(m_lock);
+		if (err < 0)
+		{
+			if (err != -EINTR)
+			{
+				eDebug("[eDVBReindexer] %s: chunk %d failed: %s", m_filename.c_str(), chunk, strerror(-err));
+				m_error = err;
+				m_stop = true;
+			}
+			return;
+		}
+		m_done[chunk] = true;
+		markDone(chunk);
+	}
+}
+
+int eDVBReindexer::parseChunk(int chunk)
+{
+	eRawFile f(m_packetsize);
+	int err = f.open(m_filename.c_str());
+	if (err < 0)
+		return err;
+
+	off_t begin = m_start + chunk * m_chunksize;
+	off_t end = std::min(begin + m_chunksize, m_length);
+	bool last = chunk == m_chunks - 1;
+	std::string part = partName(chunk);
+	::unlink((part + ".ap").c_str());
+
+	eMPEGStreamParserTS parser(m_packetsize);
+	parser.setPid(m_pid, m_pidtype, m_streamtype);
+	/* the first and last chunk also keep what comes before and after them */
+	parser.setRange(chunk ? begin : 0, last ? -1 : end);
+	parser.startSave(part);
+
+	std::vector<unsigned char> buffer(m_packetsize * 1024);
+	/* read on a bit, a start code may continue in the next chunk */
+	off_t stop = last ? m_length : std::min(end + (off_t)buffer.size(), m_length);
+	off_t offset = std::max(m_start, begin - m_overlap);
+	while (offset < stop)
+	{
+		{
+			eSingleLocker l(m_lock);
+			if (m_stop)
+			{
+				parser.stopSave();
+				return -EINTR;
+			}
+		}
+		ssize_t len = f.read(offset, &buffer[0], std::min((off_t)buffer.size(), stop - offset));
+		if (len < 0)
+		{
+			parser.stopSave();
+			return len;
+		}
+		if (!len)
+			break;
+		parser.parseData(offset, &buffer[0], len);
+
+		off_t parsed = std::min(offset + len, end) - std::max(offset, begin);
+		offset += len;
+		if (parsed > 0)
+		{
+			off_t done;
+			{
+				eSingleLocker l(m_lock);
+				done = m_parsed += parsed;
+			}
+			progress(done, m_length - m_start);
+		}
+	}
+	return parser.stopSave() < 0 ? -EIO : 0;
+}
+
+static int appendFile(const std::string &filename, FILE *to)
+{
+	CFile f(filename, "rb");
+	if (!f)
+		return errno == ENOENT ? 0 : -errno;
+	char buffer[65536];
+	size_t len;
+	while ((len = fread(buffer, 1, sizeof(buffer), f)) > 0)
+	{
+		if (fwrite(buffer, 1, len, to) != len)
+			return -EIO;
+	}
+	return ferror(f) ? -EIO : 0;
+}
+
+/* replaces target by tmp, or removes it when tmp turned out empty */
+static int replaceFile(const std::string &tmp, const std::string &target, bool empty)
+{
+	if (empty)
+	{
+		::unlink(tmp.c_str());
+		::unlink(target.c_str());
+		return 0;
+	}
+	if (::rename(tmp.c_str(), target.c_str()) < 0)
+		return -errno;
+	return 0;
+}
+
+int eDVBReindexer::join()
+{
+	std::string ap = m_filename + ".ap", sc = m_filename + ".sc";
+	long ap_size, sc_size;
+	{
+		CFile ap_out(ap + ".tmp", "wb");
+		CFile sc_out(sc + ".tmp", "wb");
+		if (!ap_out || !sc_out)
+		{
+			int err = -errno;
+			::unlink((ap + ".tmp").c_str());
+			::unlink((sc + ".tmp").c_str());
+			return err;
+		}
+		for (int i = 0; i < m_chunks; ++i)
+		{
+			std::string part = partName(i);
+			int err = appendFile(part + ".ap", ap_out);
+			if (!err)
+				err = appendFile(part + ".sc", sc_out);
+			if (err < 0)
+			{
+				eDebug("[eDVBReindexer] failed to join %s: %s", part.c_str(), strerror(-err));
+				::unlink((ap + ".tmp").c_str());
+				::unlink((sc + ".tmp").c_str());
+				return err;
+			}
+		}
+		int err = 0;
+		if (fflush(ap_out) || fflush(sc_out) || ap_out.sync() < 0 || sc_out.sync() < 0)
+			err = -errno;
+		if (err < 0)
+		{
+			eDebug("[eDVBReindexer] failed to write the index of %s: %s", m_filename.c_str(), strerror(-err));
+			::unlink((ap + ".tmp").c_str());
+			::unlink((sc + ".tmp").c_str());
+			return err;
+		}
+		ap_size = ftell(ap_out);
+		sc_size = ftell(sc_out);
+	}
+	int err = replaceFile(sc + ".tmp", sc, !sc_size);
+	if (!err)
+		err = replaceFile(ap + ".tmp", ap, !ap_size);
+	if (err < 0)
+		eDebug("[eDVBReindexer] failed to replace the index of %s: %s", m_filename.c_str(), strerror(-err));
+	else
+		eDebug("[eDVBReindexer] %s: %ld access points, %ld structure entries", m_filename.c_str(), ap_size / 16, sc_size / 16);
+	return err;
+}
+
+void eDVBReindexer::cleanup()
+{
+	for (int i = 0; i < m_chunks; ++i)
+	{
+		std::string part = partName(i);
+		::unlink((part + ".ap").c_str());
+		::unlink((part + ".sc").c_str());
+	}
+	::unlink((m_filename + ".reindex").c_str());
+}
@@ -0,0 +1,89 @@
+#ifndef __lib_dvb_reindex_h
+#define __lib_dvb_reindex_h
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <lib/base/elock.h>
+#include <lib/base/thread.h>
+#include <lib/dvb/idemux.h>
+
+class eRawFile;
+
+/*
+ * Rebuilds the .ap and .sc files of a recording.
+ *
+ * The recording is split into chunks which are parsed in parallel, each
+ * by its own eMPEGStreamParserTS. A parser starts OVERLAP bytes before its
+ * chunk, so it has seen a pts and the last start codes when the chunk
+ * begins, and only keeps the entries within its chunk. Finished chunks
+ * are written to part files and listed in <recording>.reindex, so an
+ * interrupted run continues where it stopped. When all chunks are done,
+ * the parts are joined and renamed over the .ap and .sc files.
+ */
+class eDVBReindexer
+{
+public:
+	eDVBReindexer(const std::string &filename);
+	virtual ~eDVBReindexer() {}
+
+	/* use this pid instead of the first video (or, for radio, audio) stream in the PMT */
+	void setPid(int pid, int streamtype, iDVBTSRecorder::timing_pid_type pidtype = iDVBTSRecorder::video_pid)
+	{
+		m_pid = pid;
+		m_streamtype = streamtype;
+		m_pidtype = pidtype;
+	}
+	/* threads <= 0 runs one worker per cpu, returns 0 or -errno */
+	int run(int threads = 0);
+	/* may be called from any thread, run() then returns -EINTR and can be resumed later */
+	void stop();
+
+	int packetSize() const { return m_packetsize; }
+
+protected:
+	/* called from the worker threads whenever a block has been parsed */
+	virtual void progress(off_t done, off_t total) {}
+
+private:
+	enum {
+		CHUNK_SIZE = 64 * 1024 * 1024,
+		OVERLAP = 4 * 1024 * 1024
+	};
+
+	class Worker: public eThread
+	{
+		eDVBReindexer &m_reindexer;
+	public:
+		Worker(eDVBReindexer &reindexer): m_reindexer(reindexer) {}
+		void thread();
+	};
+
+	std::string m_filename;
+	int m_pid, m_streamtype;
+	iDVBTSRecorder::timing_pid_type m_pidtype;
+	int m_packetsize;
+	/* offset of the first packet */
+	off_t m_start, m_length, m_chunksize, m_overlap;
+	int m_chunks;
+
+	eSingleLock m_lock;
+	std::vector<bool> m_done;
+	int m_next;
+	off_t m_parsed;
+	bool m_stop;
+	int m_error;
+
+	int probe();
+	int detectPacketSize(eRawFile &f);
+	int findTimingPid(eRawFile &f);
+	std::string partName(int chunk) const;
+	void loadState();
+	void markDone(int chunk);
+	void process();
+	int parseChunk(int chunk);
+	int join();
+	void cleanup();
+};
+
+#endif
@@ -17,9 +17,89 @@
 #include <lib/base/cfile.h>
 #include <lib/base/e2avahi.h>
 #include <lib/python/python.h>
+#include <lib/python/python_helpers.h>
 #include <lib/dvb/streamserver.h>
 #include <lib/dvb/encoder.h>
 
+eStreamSource::eStreamSource(eStreamServer *handler, const std::string &serviceref)
+ : parent(handler), m_serviceref(serviceref), m_fanout(NULL), m_failed(false)
+{
+}
+
+eStreamSource::~eStreamSource()
+{
+	m_fanout = NULL;
+	stop();
+}
+
+int eStreamSource::start()
+{
+	eDebug("[eStreamSource] shared stream ref: %s", m_serviceref.c_str());
+	return eDVBServiceStream::start(m_serviceref.c_str(), -1);
+}
+
+void eStreamSource::createRecorder(ePtr<iDVBDemux> &demux)
+{
+	size_t backlog = eConfigManager::getConfigIntValue("config.streaming.shared_backlog", 4) * 1024 * 1024;
+	eDVBRecordFanoutThread *fanout = new eDVBRecordFanoutThread(188, backlog);
+	((eDVBDemux*)(iDVBDemux*)demux)->createTSRecorder(m_record, fanout, 188);
+	if (!m_record)
+		return;
+	m_fanout = fanout;
+	CONNECT(m_fanout->m_event, eStreamSource::fanoutEvent);
+	for (std::map<int, eStreamClient*>::iterator it(m_clients.begin()); it != m_clients.end(); ++it)
+		m_fanout->addClient(it->first);
+}
+
+void eStreamSource::addClient(eStreamClient *client, int fd)
+{
+	m_clients[fd] = client;
+	if (m_fanout)
+		m_fanout->addClient(fd);
+	eDebug("[eStreamSource] %s: %zu client(s)", m_serviceref.c_str(), m_clients.size());
+}
+
+void eStreamSource::removeClient(int fd)
+{
+	if (m_fanout)
+		m_fanout->removeClient(fd);
+	m_clients.erase(fd);
+	eDebug("[eStreamSource] %s: %zu client(s)", m_serviceref.c_str(), m_clients.size());
+	if (m_clients.empty())
+		parent->releaseSource(this);
+}
+
+bool eStreamSource::getClientStatistics(int fd, eDVBRecordFanoutThread::ClientStatistics &stats)
+{
+	return m_fanout && m_fanout->getClientStatistics(fd, stats);
+}
+
+void eStreamSource::fanoutEvent(int event)
+{
+	if (event != eDVBRecordFanoutThread::evtClientDropped || !m_fanout)
+		return;
+	ePtr<eStreamSource> ref = this;
+	std::vector<int> fds;
+	m_fanout->takeDroppedClients(fds);
+	for (std::vector<int>::iterator it(fds.begin()); it != fds.end(); ++it)
+	{
+		std::map<int, eStreamClient*>::iterator client = m_clients.find(*it);
+		if (client != m_clients.end())
+			client->second->stopStream();
+	}
+}
+
+void eStreamSource::stopClients()
+{
+	ePtr<eStreamSource> ref = this;
+	m_failed = true;
+	std::vector<ePtr<eStreamClient> > clients;
+	for (std::map<int, eStreamClient*>::iterator it(m_clients.begin()); it != m_clients.end(); ++it)
+		clients.push_back(it->second);
+	for (std::vector<ePtr<eStreamClient> >::iterator it(clients.begin()); it != clients.end(); ++it)
+		(*it)->stopStream();
+}
+
 eStreamClient::eStreamClient(eStreamServer *handler, int socket, const std::string remotehost)
  : parent(handler), encoderFd(-1), streamFd(socket), streamThread(NULL), m_remotehost(remotehost), m_timeout(eTimer::create(eApp))
 {
@@ -30,6 +110,11 @@ eStreamClient::~eStreamClient()
 {
 	rsn->stop();
 	stop();
+	if (m_source)
+	{
+		m_source->removeClient(streamFd);
+		m_source = 0;
+	}
 	if (streamThread)
 	{
 		streamThread->stop();
@@ -173,12 +258,28 @@ void eStreamClient::notifier(int what)
 				pos = serviceref.find('?');
 				if (pos == std::string::npos)
 				{
-					eDebug("[eDVBServiceStream] stream ref: %s", serviceref.c_str());
-					if (eDVBServiceStream::start(serviceref.c_str(), streamFd) >= 0)
+					/* only live services are shared, recordings and files are streamed per client */
+					eServiceReference ref(serviceref);
+					if (ref.type == eServiceReference::idDVB && ref.path.empty() &&
+						eConfigManager::getConfigBoolValue("config.streaming.shared", true))
+					{
+						if (!parent->getSource(serviceref, m_source))
+						{
+							m_source->addClient(this, streamFd);
+							running = true;
+							m_serviceref = serviceref;
+							m_useencoder = false;
+						}
+					}
+					else
 					{
-						running = true;
-						m_serviceref = serviceref;
-						m_useencoder = false;
+						eDebug("[eDVBServiceStream] stream ref: %s", serviceref.c_str());
+						if (eDVBServiceStream::start(serviceref.c_str(), streamFd) >= 0)
+						{
+							running = true;
+							m_serviceref = serviceref;
+							m_useencoder = false;
+						}
 					}
 				}
 				else
@@ -316,6 +417,11 @@ bool eStreamClient::isUsingEncoder()
 	return m_useencoder;
 }
 
+bool eStreamClient::getStatistics(eDVBRecordFanoutThread::ClientStatistics &stats)
+{
+	return m_source && m_source->getClientStatistics(streamFd, stats);
+}
+
 DEFINE_REF(eStreamServer);
 
 eStreamServer *eStreamServer::m_instance = NULL;
@@ -356,6 +462,38 @@ void eStreamServer::connectionLost(eStreamClient *client)
 	}
 }
 
+RESULT eStreamServer::getSource(const std::string &serviceref, ePtr<eStreamSource> &source)
+{
+	std::map<std::string, ePtr<eStreamSource> >::iterator it = m_sources.find(serviceref);
+	if (it != m_sources.end())
+	{
+		if (!it->second->failed())
+		{
+			source = it->second;
+			return 0;
+		}
+		m_sources.erase(it);
+	}
+	ePtr<eStreamSource> s = new eStreamSource(this, serviceref);
+	if (s->start() < 0 || s->failed())
+		return -1;
+	m_sources[serviceref] = s;
+	source = s;
+	return 0;
+}
+
+void eStreamServer::releaseSource(eStreamSource *source)
+{
+	for (std::map<std::string, ePtr<eStreamSource> >::iterator it = m_sources.begin(); it != m_sources.end(); ++it)
+	{
+		if (it->second == source)
+		{
+			m_sources.erase(it);
+			break;
+		}
+	}
+}
+
 void eStreamServer::stopStream()
 {
 	eSmartPtrList<eStreamClient>::iterator it = clients.begin();
@@ -395,4 +533,27 @@ PyObject *eStreamServer::getConnectedClients()
 	return ret;
 }
 
+PyObject *eStreamServer::getClientStatistics()
+{
+	ePyObject ret = PyList_New(0);
+	for (eSmartPtrList<eStreamClient>::iterator it = clients.begin(); it != clients.end(); ++it)
+	{
+		ePyObject dict = PyDict_New();
+		PutToDict(dict, "host", it->getRemoteHost().c_str());
+		PutToDict(dict, "serviceref", it->getServiceref().c_str());
+		PutToDict(dict, "shared", (long)it->isShared());
+		eDVBRecordFanoutThread::ClientStatistics stats;
+		if (it->getStatistics(stats))
+		{
+			PutToDict(dict, "bytes_sent", PyLong_FromUnsignedLongLong(stats.bytes_sent));
+			PutToDict(dict, "bytes_per_second", stats.rate);
+			PutToDict(dict, "backlog", stats.backlog);
+			PutToDict(dict, "backlog_max", stats.backlog_max);
+		}
+		PyList_Append(ret, dict);
+		Py_DECREF(dict);
+	}
+	return ret;
+}
+
 eAutoInitPtr<eStreamServer> init_eStreamServer(eAutoInitNumbers::service + 1, "Stream server");
@@ -1,12 +1,45 @@
 #ifndef __DVB_STREAMSERVER_H_
 #define __DVB_STREAMSERVER_H_
 
+#include <map>
 #include <lib/network/serversocket.h>
 #include <lib/service/servicedvbstream.h>
 #include <lib/nav/core.h>
+#include <lib/dvb/demux.h>
 
 #ifndef SWIG
 class eStreamServer;
+class eStreamClient;
+
+/*
+ * A service streamed to all plain (non transcoding) clients requesting it,
+ * using a single demux recorder whose buffers are fanned out to the clients.
+ */
+class eStreamSource: public eDVBServiceStream
+{
+	eStreamServer *parent;
+	std::string m_serviceref;
+	eDVBRecordFanoutThread *m_fanout; // owned by m_record
+	std::map<int, eStreamClient*> m_clients;
+	bool m_failed;
+
+	void createRecorder(ePtr<iDVBDemux> &demux);
+	void fanoutEvent(int event);
+	void stopClients();
+
+	void streamStopped() { stopClients(); }
+	void tuneFailed() { stopClients(); }
+
+public:
+	eStreamSource(eStreamServer *handler, const std::string &serviceref);
+	~eStreamSource();
+
+	int start();
+	bool failed() const { return m_failed; }
+	void addClient(eStreamClient *client, int fd);
+	void removeClient(int fd);
+	bool getClientStatistics(int fd, eDVBRecordFanoutThread::ClientStatistics &stats);
+};
 
 class eStreamClient: public eDVBServiceStream
 {
@@ -19,6 +52,7 @@ protected:
 	int encoderFd;
 	int streamFd;
 	eDVBRecordStreamThread *streamThread;
+	ePtr<eStreamSource> m_source;
 	std::string m_remotehost;
 	std::string m_serviceref;
 	bool m_useencoder;
@@ -44,6 +78,8 @@ public:
 	std::string getRemoteHost();
 	std::string getServiceref();
 	bool isUsingEncoder();
+	bool isShared() { return m_source; }
+	bool getStatistics(eDVBRecordFanoutThread::ClientStatistics &stats);
 };
 #endif
 
@@ -53,6 +89,9 @@ class eStreamServer: public eServerSocket
 	static eStreamServer *m_instance;
 
 	eSmartPtrList<eStreamClient> clients;
+#ifndef SWIG
+	std::map<std::string, ePtr<eStreamSource> > m_sources;
+#endif
 
 	void newConnection(int socket);
 
@@ -66,12 +105,15 @@ public:
 	~eStreamServer();
 
 	void connectionLost(eStreamClient *client);
+	RESULT getSource(const std::string &serviceref, ePtr<eStreamSource> &source);
+	void releaseSource(eStreamSource *source);
 #endif
 
 	static eStreamServer *getInstance();
 	void stopStream();
 	bool stopStreamClient(const std::string remotehost, const std::string serviceref);
 	PyObject *getConnectedClients();
+	PyObject *getClientStatistics();
 };
 
 #endif /* __DVB_STREAMSERVER_H_ */
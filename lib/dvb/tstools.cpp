@@ -1,7 +1,8 @@
 #include <lib/dvb/tstools.h>
 #include <lib/dvb/specs.h>
 #include <lib/base/eerror.h>
-#include <lib/base/cachedtssource.h>
+#include <lib/base/cfile.h>
+#include <lib/base/nconfig.h>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -62,6 +63,9 @@ eDVBTSTools::eDVBTSTools():
 	m_begin_valid (0),
 	m_end_valid(0),
 	m_samples_taken(0),
+	m_samples_dirty(false),
+	m_seeks(0),
+	m_probes(0),
 	m_last_filelength(0),
 	m_futile(0)
 {
@@ -69,6 +73,10 @@ eDVBTSTools::eDVBTSTools():
 
 void eDVBTSTools::closeSource()
 {
+	saveSamples();
+	if (m_seeks)
+		eDebug("[eDVBTSTools] %u seeks needed %u probes", m_seeks, m_probes);
+	m_cache = NULL;
 	m_source = NULL;
 	m_packet_size = 188;
 }
@@ -86,23 +94,45 @@ int eDVBTSTools::openFile(const char *filename, int nostreaminfo)
 	if (f->open(filename) < 0)
 		return -1;
 
-	src = new eCachedSource(src);
-
 	setSource(src, nostreaminfo ? NULL : filename);
 
 	return 0;
 }
 
+void eDVBTSTools::getCacheStatistics(unsigned int &hits, unsigned int &misses, unsigned int &prefetched)
+{
+	if (m_cache)
+		m_cache->getStatistics(hits, misses, prefetched);
+	else
+		hits = misses = prefetched = 0;
+}
+
 void eDVBTSTools::setSource(ePtr<iTsSource> &source, const char *stream_info_filename)
 {
 	closeSource();
 	m_source = source;
+	/* a stream returns the next data whatever offset is read, so it can't be cached */
+	if (m_source && !m_source->isStream())
+	{
+		eCachedSource *cache = new eCachedSource(source, eConfigManager::getConfigIntValue("config.usage.tstools_cache_blocks", eCachedSource::DEFAULT_BLOCKS));
+		m_cache = cache;
+		m_source = cache;
+	}
 	if (stream_info_filename)
 	{
 		eDebug("[eDVBTSTools] setSource loading streaminfo for %s", stream_info_filename);
 		m_streaminfo.load(stream_info_filename);
 	}
 	m_samples_taken = 0;
+	m_samples.clear();
+	m_samples_file.clear();
+	if (stream_info_filename && m_source && !m_source->isStream())
+		m_samples_file = std::string(stream_info_filename) + ".samples";
+	m_seeks = m_probes = 0;
+	/* begin and end belong to the previous source */
+	m_begin_valid = m_end_valid = 0;
+	m_futile = 0;
+	m_last_filelength = 0;
 	m_packet_size = m_source ? m_source->getPacketSize() : 188;
 }
 
@@ -377,6 +407,9 @@ int eDVBTSTools::getOffset(off_t &offset, pts_t &pts, int marg)
 		if (!m_samples_taken)
 			takeSamples();
 
+		++m_seeks;
+		unsigned int probes = m_probes;
+
 		if (!m_samples.empty())
 		{
 			int maxtries = 5;
@@ -413,6 +446,8 @@ int eDVBTSTools::getOffset(off_t &offset, pts_t &pts, int marg)
 				{
 					eDebug("[eDVBTSTools] getOffset something went wrong when taking samples.");
 					m_samples.clear();
+					if (!m_samples_file.empty())
+						::unlink(m_samples_file.c_str());
 					takeSamples();
 					continue;
 				}
@@ -467,7 +502,7 @@ int eDVBTSTools::getOffset(off_t &offset, pts_t &pts, int marg)
 			if (p != -1)
 			{
 				pts = p;
-				eDebug("[eDVBTSTools] getOffset aborting. Taking %ld as offset for %lld", (intmax_t)offset, pts);
+				eDebug("[eDVBTSTools] getOffset aborting. Taking %ld as offset for %lld (%u probes)", (intmax_t)offset, pts, m_probes - probes);
 				return 0;
 			}
 		}
@@ -490,6 +525,14 @@ void eDVBTSTools::calcBegin()
 	if (!m_source || !m_source->valid())
 		return;
 
+	/* the start of a ring buffer moves on, look for it again every MB */
+	if (m_begin_valid && m_source->firstOffset() > m_offset_begin + 1024 * 1024)
+	{
+		m_begin_valid = 0;
+		m_futile = 0;
+		m_samples_taken = 0;
+	}
+
 	if (!(m_begin_valid || m_futile))
 	{
 		// Just ask streaminfo
@@ -506,7 +549,7 @@ void eDVBTSTools::calcBegin()
 		}
 		else
 		{
-			m_offset_begin = 0;
+			m_offset_begin = m_source->firstOffset();
 			if (!getPTS(m_offset_begin, m_pts_begin))
 				m_begin_valid = 1;
 			else
@@ -658,6 +701,14 @@ void eDVBTSTools::takeSamples()
 
 	bytes_per_sample -= bytes_per_sample % m_packet_size;
 
+	if (!loadSamples())
+	{
+		eDebug("[eDVBTSTools] takeSamples reusing %zu samples from %s", m_samples.size(), m_samples_file.c_str());
+		m_samples[0] = m_offset_begin;
+		m_samples[m_pts_end - m_pts_begin] = m_offset_end;
+		return;
+	}
+
 	eDebug("[eDVBTSTools] takeSamples step %ld, pts begin %lld, pts end %lld, offs begin %ld, offs end %ld:",
 		(intmax_t)bytes_per_sample, m_pts_begin, m_pts_end, (intmax_t)m_offset_begin, (intmax_t)m_offset_end);
 
@@ -669,6 +720,7 @@ void eDVBTSTools::takeSamples()
 		retries = 2;
 		offset += bytes_per_sample;
 	}
+	saveSamples();
 	m_samples[0] = m_offset_begin;
 	m_samples[m_pts_end - m_pts_begin] = m_offset_end;
 }
@@ -678,6 +730,7 @@ int eDVBTSTools::takeSample(off_t off, pts_t &p)
 {
 	off_t offset_org = off;
 
+	++m_probes;
 	if (!eDVBTSTools::getPTS(off, p, 1))
 	{
 			/* as we are happily mixing PTS and PCR values (no comment, please), we might
@@ -704,11 +757,88 @@ int eDVBTSTools::takeSample(off_t off, pts_t &p)
 
 		eDebug("[eDVBTSTools] takeSample adding sample %ld: pts %lld -> pos %ld (diff %ld bytes)", (intmax_t)offset_org, p, (intmax_t)off, (intmax_t)(off-offset_org));
 		m_samples[p] = off;
+		m_samples_dirty = true;
 		return 0;
 	}
 	return -1;
 }
 
+/*
+ * Taking samples is slow, especially on network mounts, so they are kept
+ * in <recording>.samples. Like the .ap file, it holds big endian pairs:
+ * the offset and pts of the begin of the recording, followed by the
+ * zero based pts and the offset of each sample.
+ */
+#define MAX_SAVED_SAMPLES 1024
+
+int eDVBTSTools::loadSamples()
+{
+	if (m_samples_file.empty())
+		return -1;
+	CFile f(m_samples_file, "rb");
+	if (!f)
+		return -1;
+	unsigned long long d[2];
+	if (fread(d, sizeof(d), 1, f) < 1 || (off_t)be64toh(d[0]) != m_offset_begin || (pts_t)be64toh(d[1]) != m_pts_begin)
+	{
+		eDebug("[eDVBTSTools] %s belongs to another recording, ignoring it", m_samples_file.c_str());
+		return -1;
+	}
+	std::map<pts_t, off_t> samples;
+	while (fread(d, sizeof(d), 1, f) == 1)
+	{
+		pts_t pts = be64toh(d[0]);
+		off_t offset = be64toh(d[1]);
+		/* the recording has been cut since */
+		if (offset < m_offset_begin || offset > m_offset_end)
+			return -1;
+		samples[pts] = offset;
+	}
+	if (samples.empty())
+		return -1;
+	m_samples.swap(samples);
+	m_samples_dirty = false;
+	return 0;
+}
+
+void eDVBTSTools::saveSamples()
+{
+	if (!m_samples_dirty || m_samples_file.empty() || !m_begin_valid)
+		return;
+	m_samples_dirty = false;
+	std::string tmp_file(m_samples_file + ".tmp");
+	{
+		CFile f(tmp_file, "wb");
+		if (!f)
+		{
+			eDebug("[eDVBTSTools] failed to write %s: %m", tmp_file.c_str());
+			return;
+		}
+		unsigned long long d[2];
+		d[0] = htobe64(m_offset_begin);
+		d[1] = htobe64(m_pts_begin);
+		fwrite(d, sizeof(d), 1, f);
+		/* each seek adds samples, keep an even spread of them */
+		size_t step = m_samples.size() / MAX_SAVED_SAMPLES + 1, i = 0;
+		for (std::map<pts_t, off_t>::const_iterator it(m_samples.begin()); it != m_samples.end(); ++it, ++i)
+		{
+			if (i % step)
+				continue;
+			d[0] = htobe64(it->first);
+			d[1] = htobe64(it->second);
+			fwrite(d, sizeof(d), 1, f);
+		}
+		if (ferror(f))
+		{
+			eDebug("[eDVBTSTools] failed to write %s", tmp_file.c_str());
+			::unlink(tmp_file.c_str());
+			return;
+		}
+	}
+	if (::rename(tmp_file.c_str(), m_samples_file.c_str()) < 0)
+		::unlink(tmp_file.c_str());
+}
+
 int eDVBTSTools::findPMT(eDVBPMTParser::program &program)
 {
 	int pmtpid = -1;
@@ -1006,6 +1136,91 @@ int eDVBTSTools::findNextPicture(off_t &offset, size_t &len, int &distance, int
 	return 0;
 }
 
+int eDVBTSTools::findTrickFrame(off_t &offset, size_t &len, pts_t &target, pts_t step)
+{
+	if (!m_streaminfo.hasStructure() || !step)
+		return -1;
+
+	eSingleLocker lock(m_streaminfo.getIFrameLock());
+	const std::vector<eMPEGStreamInformation::IFrame> &frames = m_streaminfo.getIFrames();
+	if (frames.empty())
+	{
+		/* the caller uses findNextPicture until the table has been built */
+		m_streaminfo.scanIFrames();
+		return -1;
+	}
+
+	/* the frame shown last, i.e. the last one starting before offset */
+	int first = 0, last = frames.size();
+	while (first < last)
+	{
+		int mid = (first + last) / 2;
+		if (frames[mid].offset < offset)
+			first = mid + 1;
+		else
+			last = mid;
+	}
+	int current = first - 1;
+	if (current < 0)
+	{
+		if (step < 0)
+			return -1;
+		/* before the first I-frame, show that one */
+		target = frames[0].pts;
+		offset = frames[0].offset;
+		len = frames[0].len;
+		return 0;
+	}
+	if (target < 0)
+		target = frames[current].pts;
+	target += step;
+
+	int next = current;
+	if (step > 0)
+	{
+		while (1)
+		{
+			if (next + 1 >= (int)frames.size())
+			{
+				/* the recording may still be growing */
+				m_streaminfo.scanIFrames();
+				break;
+			}
+			if (frames[next + 1].pts > target)
+			{
+				/* take the later one if it is nearer, or if we have not moved yet */
+				if (next == current || frames[next + 1].pts - target < target - frames[next].pts)
+					++next;
+				break;
+			}
+			++next;
+		}
+	}
+	else
+	{
+		while (next > 0)
+		{
+			if (frames[next - 1].pts < target)
+			{
+				if (next == current || target - frames[next - 1].pts < frames[next].pts - target)
+					--next;
+				break;
+			}
+			--next;
+		}
+	}
+	if (next == current)
+		return -1;
+
+	/* after a gap in the timestamps, continue from the frame itself */
+	if (llabs(frames[next].pts - target) > 10 * 90000 + llabs(step))
+		target = frames[next].pts;
+
+	offset = frames[next].offset;
+	len = frames[next].len;
+	return 0;
+}
+
 void eDVBTSTools::PMTready(int error)
 {
 	if (!error)
@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <lib/dvb/pvrparse.h>
 #include <lib/base/rawfile.h>
+#include <lib/base/cachedtssource.h>
 #include <lib/base/elock.h>
 #include <lib/dvb/pmtparse.h>
 #include <lib/dvb/idemux.h>
@@ -78,10 +79,21 @@ public:
 	number of frames skipped. */
 	int findFrame(off_t &offset, size_t &len, int &direction, int frame_types = frametypeI);
 	int findNextPicture(off_t &offset, size_t &len, int &distance, int frame_types = frametypeAll);
+	/** findTrickFrame: picks the I-frame to show next in trick play, from the I-frame table of the
+	structure file. target is the zero-based pts the last shown frame should have had, or -1 to start
+	at the I-frame before offset. It is advanced by step (negative for rewind) and the I-frame nearest
+	to it, but at least one I-frame away from offset, is returned. The table is built in the background,
+	-1 is returned until it is ready. */
+	int findTrickFrame(off_t &offset, size_t &len, pts_t &target, pts_t step);
 
 	/* Retrieve PMT. Returns 0 on success. */
 	int findPMT(eDVBPMTParser::program &program);
 
+	/* seeks done by sampling the file, and the pts probes they needed */
+	void getSeekStatistics(unsigned int &seeks, unsigned int &probes) const { seeks = m_seeks; probes = m_probes; }
+	/* of the block cache in front of the source, all 0 without one */
+	void getCacheStatistics(unsigned int &hits, unsigned int &misses, unsigned int &prefetched);
+
 protected:
 	void closeSource();
 
@@ -95,12 +107,16 @@ protected:
 
 	void takeSamples();
 	int takeSample(off_t off, pts_t &p);
+	int loadSamples();
+	void saveSamples();
 
 private:
 	int m_pid;
 	int m_packet_size;
 
 	ePtr<iTsSource> m_source;
+	/* m_source again, unless the source is a stream */
+	ePtr<eCachedSource> m_cache;
 
 	int m_begin_valid, m_end_valid;
 	pts_t m_pts_begin, m_pts_end;
@@ -110,6 +126,10 @@ private:
 		/* for simple linear interpolation */
 	std::map<pts_t, off_t> m_samples;
 	int m_samples_taken;
+		/* the samples are kept in this file, if any */
+	std::string m_samples_file;
+	bool m_samples_dirty;
+	unsigned int m_seeks, m_probes;
 
 	eMPEGStreamInformation m_streaminfo;
 	off_t m_last_filelength;
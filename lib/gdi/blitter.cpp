@@ -0,0 +1,273 @@
+#include <cstring>
+#include <lib/gdi/blitter.h>
+#include <lib/gdi/gpixmap.h>
+#include <lib/base/eerror.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define BLIT_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && (BYTE_ORDER == LITTLE_ENDIAN)
+#define BLIT_NEON
+#include <arm_neon.h>
+#endif
+
+/* plain C, the reference for all others */
+
+static void blend_c(uint32_t *dst, const uint32_t *src, int width)
+{
+	gRGB *d = (gRGB*)dst;
+	const gRGB *s = (const gRGB*)src;
+	while (width--)
+		(d++)->alpha_blend(*s++);
+}
+
+static void alphatest_c(uint32_t *dst, const uint32_t *src, int width, uint32_t mask)
+{
+	while (width--)
+	{
+		if (*src & mask)
+			*dst = *src;
+		++src;
+		++dst;
+	}
+}
+
+static void expand_c(uint32_t *dst, const uint8_t *src, const uint32_t *pal, int width)
+{
+	for (; width >= 4; width -= 4, src += 4, dst += 4)
+	{
+		dst[0] = pal[src[0]];
+		dst[1] = pal[src[1]];
+		dst[2] = pal[src[2]];
+		dst[3] = pal[src[3]];
+	}
+	while (width--)
+		*dst++ = pal[*src++];
+}
+
+static void scale_c(uint32_t *dst, const uint32_t *src, const int *map, int width)
+{
+	for (; width >= 4; width -= 4, map += 4, dst += 4)
+	{
+		dst[0] = src[map[0]];
+		dst[1] = src[map[1]];
+		dst[2] = src[map[2]];
+		dst[3] = src[map[3]];
+	}
+	while (width--)
+		*dst++ = src[*map++];
+}
+
+static const gBlitKernels kernels_c = { "C", blend_c, alphatest_c, expand_c, scale_c };
+
+/*
+ * alpha_blend computes y + (((x - y) * a) >> 8) per channel, x = 0xFF for
+ * the alpha channel. That is (x * a + y * (256 - a)) >> 8, which does not
+ * exceed 16 bits, so the vector versions work on 16 bit lanes.
+ */
+
+#ifdef BLIT_X86
+
+static inline __m128i blend_sse2_half(__m128i s, __m128i d, __m128i a)
+{
+	const __m128i v256 = _mm_set1_epi16(256);
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(v256, a)));
+	return _mm_srli_epi16(sum, 8);
+}
+
+static void blend_sse2(uint32_t *dst, const uint32_t *src, int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	for (; width >= 4; width -= 4, src += 4, dst += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)src);
+		__m128i a = _mm_srli_epi32(s, 24);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xFFFF)
+			continue; /* fully transparent */
+		__m128i d = _mm_loadu_si128((const __m128i*)dst);
+		s = _mm_or_si128(s, alpha);
+		a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+		__m128i lo = blend_sse2_half(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(a, a));
+		__m128i hi = blend_sse2_half(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(a, a));
+		_mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+	}
+	blend_c(dst, src, width);
+}
+
+static void alphatest_sse2(uint32_t *dst, const uint32_t *src, int width, uint32_t mask)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i m = _mm_set1_epi32(mask);
+	for (; width >= 4; width -= 4, src += 4, dst += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)src);
+		__m128i keep = _mm_cmpeq_epi32(_mm_and_si128(s, m), zero);
+		__m128i d = _mm_loadu_si128((const __m128i*)dst);
+		_mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s)));
+	}
+	alphatest_c(dst, src, width, mask);
+}
+
+static const gBlitKernels kernels_sse2 = { "SSE2", blend_sse2, alphatest_sse2, expand_c, scale_c };
+
+__attribute__((target("avx2")))
+static inline __m256i blend_avx2_half(__m256i s, __m256i d, __m256i a)
+{
+	const __m256i v256 = _mm256_set1_epi16(256);
+	__m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, _mm256_sub_epi16(v256, a)));
+	return _mm256_srli_epi16(sum, 8);
+}
+
+__attribute__((target("avx2")))
+static void blend_avx2(uint32_t *dst, const uint32_t *src, int width)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+	/* the unpacks and the pack all work within 128 bit lanes, so the order is kept */
+	for (; width >= 8; width -= 8, src += 8, dst += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*)src);
+		__m256i a = _mm256_srli_epi32(s, 24);
+		if (_mm256_testz_si256(a, a))
+			continue; /* fully transparent */
+		__m256i d = _mm256_loadu_si256((const __m256i*)dst);
+		s = _mm256_or_si256(s, alpha);
+		a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+		__m256i lo = blend_avx2_half(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(a, a));
+		__m256i hi = blend_avx2_half(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(a, a));
+		_mm256_storeu_si256((__m256i*)dst, _mm256_packus_epi16(lo, hi));
+	}
+	blend_sse2(dst, src, width);
+}
+
+__attribute__((target("avx2")))
+static void alphatest_avx2(uint32_t *dst, const uint32_t *src, int width, uint32_t mask)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i m = _mm256_set1_epi32(mask);
+	for (; width >= 8; width -= 8, src += 8, dst += 8)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i*)src);
+		__m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(s, m), zero);
+		__m256i d = _mm256_loadu_si256((const __m256i*)dst);
+		_mm256_storeu_si256((__m256i*)dst, _mm256_blendv_epi8(s, d, keep));
+	}
+	alphatest_sse2(dst, src, width, mask);
+}
+
+__attribute__((target("avx2")))
+static void expand_avx2(uint32_t *dst, const uint8_t *src, const uint32_t *pal, int width)
+{
+	for (; width >= 8; width -= 8, src += 8, dst += 8)
+	{
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src));
+		_mm256_storeu_si256((__m256i*)dst, _mm256_i32gather_epi32((const int*)pal, index, 4));
+	}
+	expand_c(dst, src, pal, width);
+}
+
+__attribute__((target("avx2")))
+static void scale_avx2(uint32_t *dst, const uint32_t *src, const int *map, int width)
+{
+	for (; width >= 8; width -= 8, map += 8, dst += 8)
+	{
+		__m256i index = _mm256_loadu_si256((const __m256i*)map);
+		_mm256_storeu_si256((__m256i*)dst, _mm256_i32gather_epi32((const int*)src, index, 4));
+	}
+	scale_c(dst, src, map, width);
+}
+
+static const gBlitKernels kernels_avx2 = { "AVX2", blend_avx2, alphatest_avx2, expand_avx2, scale_avx2 };
+
+#endif
+
+#ifdef BLIT_NEON
+
+static inline uint8x8_t blend_neon_channel(uint8x8_t x, uint8x8_t y, uint8x8_t a)
+{
+	/* y * 256 + x * a - y * a, wraps in between but not in the end */
+	uint16x8_t sum = vsubq_u16(vaddq_u16(vshll_n_u8(y, 8), vmull_u8(x, a)), vmull_u8(y, a));
+	return vshrn_n_u16(sum, 8);
+}
+
+static void blend_neon(uint32_t *dst, const uint32_t *src, int width)
+{
+	const uint8x8_t opaque = vdup_n_u8(0xFF);
+	for (; width >= 8; width -= 8, src += 8, dst += 8)
+	{
+		/* deinterleaved into b, g, r, a */
+		uint8x8x4_t s = vld4_u8((const uint8_t*)src);
+		if (vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0) == 0)
+			continue; /* fully transparent */
+		uint8x8x4_t d = vld4_u8((const uint8_t*)dst);
+		d.val[0] = blend_neon_channel(s.val[0], d.val[0], s.val[3]);
+		d.val[1] = blend_neon_channel(s.val[1], d.val[1], s.val[3]);
+		d.val[2] = blend_neon_channel(s.val[2], d.val[2], s.val[3]);
+		d.val[3] = blend_neon_channel(opaque, d.val[3], s.val[3]);
+		vst4_u8((uint8_t*)dst, d);
+	}
+	blend_c(dst, src, width);
+}
+
+static void alphatest_neon(uint32_t *dst, const uint32_t *src, int width, uint32_t mask)
+{
+	const uint32x4_t m = vdupq_n_u32(mask);
+	for (; width >= 4; width -= 4, src += 4, dst += 4)
+	{
+		uint32x4_t s = vld1q_u32(src);
+		uint32x4_t d = vld1q_u32(dst);
+		vst1q_u32(dst, vbslq_u32(vtstq_u32(s, m), s, d));
+	}
+	alphatest_c(dst, src, width, mask);
+}
+
+static const gBlitKernels kernels_neon = { "NEON", blend_neon, alphatest_neon, expand_c, scale_c };
+
+#endif
+
+static const gBlitKernels &select()
+{
+#ifdef BLIT_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return kernels_avx2;
+	return kernels_sse2;
+#elif defined(BLIT_NEON)
+	return kernels_neon;
+#else
+	return kernels_c;
+#endif
+}
+
+const gBlitKernels &gBlitKernels::get()
+{
+	static const gBlitKernels &kernels = select();
+	static bool logged = false;
+	if (!logged)
+	{
+		logged = true;
+		eDebug("[gBlitKernels] using %s blitters", kernels.name);
+	}
+	return kernels;
+}
+
+const gBlitKernels &gBlitKernels::reference()
+{
+	return kernels_c;
+}
+
+void gBlitKernels::buildScaleMap(int *map, int width, int src_width)
+{
+	int index = 0, rest = 0;
+	for (int x = 0; x < width; ++x)
+	{
+		map[x] = index;
+		rest += src_width;
+		while (rest >= width)
+		{
+			rest -= width;
+			++index;
+		}
+	}
+}
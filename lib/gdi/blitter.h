@@ -0,0 +1,33 @@
+#ifndef __lib_gdi_blitter_h
+#define __lib_gdi_blitter_h
+
+#include <stdint.h>
+
+/*
+ * The pixel loops of the blits gPixmap does on the CPU, for one row each.
+ * Every kernel has a plain C version, and SSE2/AVX2 or NEON versions
+ * where the CPU has them. get() picks the best set once, at runtime on
+ * x86, so one binary runs everywhere. All versions give the same result
+ * to the bit.
+ */
+
+struct gBlitKernels
+{
+	const char *name;
+	/* dst blended with src, like gRGB::alpha_blend */
+	void (*blend)(uint32_t *dst, const uint32_t *src, int width);
+	/* copy the pixels of src which have any bit of mask set */
+	void (*alphatest)(uint32_t *dst, const uint32_t *src, int width, uint32_t mask);
+	/* dst = pal[src], palette expansion */
+	void (*expand)(uint32_t *dst, const uint8_t *src, const uint32_t *pal, int width);
+	/* dst[x] = src[map[x]], a row scaled to the nearest pixel */
+	void (*scale)(uint32_t *dst, const uint32_t *src, const int *map, int width);
+
+	static const gBlitKernels &get();
+	/* the plain C set */
+	static const gBlitKernels &reference();
+	/* map[x] = x * src_width / width, without a division per pixel */
+	static void buildScaleMap(int *map, int width, int src_width);
+};
+
+#endif
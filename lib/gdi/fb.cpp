@@ -5,9 +5,11 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <memory.h>
+#include <algorithm>
 #include <linux/kd.h>
 
 #include <lib/gdi/fb.h>
+#include <lib/gdi/erect.h>
 #include <linux/stmfb.h>
 
 #ifndef FBIO_WAITFORVSYNC
@@ -119,7 +121,43 @@ int fbClass::waitVSync()
 
 void fbClass::blit()
 {
-	if (fbFd < 0) return;
+	eRect all(0, 0, xRes, yRes);
+	blit(&all, 1);
+}
+
+/* the blitter filters when it scales, it reads this many source pixels around each one */
+#define SCALE_FILTER_MARGIN 2
+
+/*
+ * Grows [first, last) on a surface axis of len pixels, which is scaled to
+ * dst_len pixels, so that it can be scaled on its own without a seam: by
+ * the filter margin, and then outwards to whole steps of the ratio, where
+ * a source and a destination pixel edge meet. An area blitted like that is
+ * sampled at the same phase as when the whole surface is blitted.
+ */
+static void alignToScale(int &first, int &last, int len, int dst_len)
+{
+	if (len == dst_len)
+	{
+		first = std::max(first, 0);
+		last = std::min(last, len);
+		return;
+	}
+	int a = len, b = dst_len;
+	while (b)
+	{
+		int r = a % b;
+		a = b;
+		b = r;
+	}
+	int step = len / a;
+	first = std::max(first - SCALE_FILTER_MARGIN, 0) / step * step;
+	last = std::min((last + SCALE_FILTER_MARGIN + step - 1) / step * step, len);
+}
+
+int fbClass::blit(const eRect *areas, int count)
+{
+	if (fbFd < 0) return 0;
 	int modefd=open("/proc/stb/video/3d_mode", O_RDWR);
 	char buf[16] = "off";
 	if (modefd > 0)
@@ -129,6 +167,24 @@ void fbClass::blit()
 		close(modefd);
 	}
 
+	/* where the whole surface goes on the screen, twice in the 3d modes */
+	eRect targets[2];
+	int num_targets = 1;
+	if (strncmp(buf,"sbs",3)==0)
+	{
+		targets[0] = eRect(ePoint(0 + leftDiff/2, 0 + topDiff), ePoint(xResSc/2 + rightDiff/2, yResSc + bottomDiff));
+		targets[1] = eRect(ePoint(xResSc/2 + leftDiff/2, 0 + topDiff), ePoint(xResSc + rightDiff/2, yResSc + bottomDiff));
+		num_targets = 2;
+	}
+	else if (strncmp(buf,"tab",3)==0)
+	{
+		targets[0] = eRect(ePoint(0 + leftDiff, 0 + topDiff/2), ePoint(xResSc + rightDiff, yResSc/2 + bottomDiff/2));
+		targets[1] = eRect(ePoint(0 + leftDiff, yResSc/2 + topDiff/2), ePoint(xResSc + rightDiff, yResSc + bottomDiff/2));
+		num_targets = 2;
+	}
+	else
+		targets[0] = eRect(ePoint(0 + leftDiff, 0 + topDiff), ePoint(xResSc + rightDiff, yResSc + bottomDiff));
+
 	STMFBIO_BLT_DATA    bltData;
 	memset(&bltData, 0, sizeof(STMFBIO_BLT_DATA));
 	bltData.operation  = BLT_OP_COPY;
@@ -136,70 +192,47 @@ void fbClass::blit()
 	bltData.srcPitch   = xRes * 4;
 	bltData.dstOffset  = 0;
 	bltData.dstPitch   = xResSc*4;
-	bltData.src_top    = 0;
-	bltData.src_left   = 0;
-	bltData.src_right  = xRes;
-	bltData.src_bottom = yRes;
 	bltData.srcFormat  = SURF_BGRA8888;
 	bltData.dstFormat  = SURF_BGRA8888;
 	bltData.srcMemBase = STMFBGP_FRAMEBUFFER;
 	bltData.dstMemBase = STMFBGP_FRAMEBUFFER;
 
-	if (strncmp(buf,"sbs",3)==0)
-	{
-		bltData.dst_top    = 0 + topDiff;
-		bltData.dst_left   = 0 + leftDiff/2;
-		bltData.dst_right  = xResSc/2 + rightDiff/2;
-		bltData.dst_bottom = yResSc + bottomDiff;
-		if (ioctl(fbFd, STMFBIO_BLT, &bltData ) < 0)
-		{
-			perror("STMFBIO_BLT");
-		}
-		bltData.dst_top    = 0 + topDiff;
-		bltData.dst_left   = xResSc/2 + leftDiff/2;
-		bltData.dst_right  = xResSc + rightDiff/2;
-		bltData.dst_bottom = yResSc + bottomDiff;
-		if (ioctl(fbFd, STMFBIO_BLT, &bltData ) < 0)
-		{
-			perror("STMFBIO_BLT");
-		}
-	}
-	else if (strncmp(buf,"tab",3)==0)
-	{
-		bltData.dst_top    = 0 + topDiff/2;
-		bltData.dst_left   = 0 + leftDiff;
-		bltData.dst_right  = xResSc + rightDiff;
-		bltData.dst_bottom = yResSc/2 + bottomDiff/2;
-		if (ioctl(fbFd, STMFBIO_BLT, &bltData ) < 0)
-		{
-			perror("STMFBIO_BLT");
-		}
-		bltData.dst_top    = yResSc/2 + topDiff/2;
-		bltData.dst_left   = 0 + leftDiff;
-		bltData.dst_right  = xResSc + rightDiff;
-		bltData.dst_bottom = yResSc + bottomDiff/2;
-		if (ioctl(fbFd, STMFBIO_BLT, &bltData ) < 0)
-		{
-			perror("STMFBIO_BLT");
-		}
-	}
-	else
+	eRect all(0, 0, xRes, yRes);
+	int pixels = 0;
+	for (int i = 0; i < count; ++i)
 	{
-		bltData.dst_top    = 0 + topDiff;
-		bltData.dst_left   = 0 + leftDiff;
-		bltData.dst_right  = xResSc + rightDiff;
-		bltData.dst_bottom = yResSc + bottomDiff;
-		if (ioctl(fbFd, STMFBIO_BLT, &bltData ) < 0)
+		if ((areas[i] & all).empty())
+			continue;
+		for (int t = 0; t < num_targets; ++t)
 		{
-			perror("STMFBIO_BLT");
+			const eRect &dst = targets[t];
+			int left = areas[i].left(), right = areas[i].right();
+			int top = areas[i].top(), bottom = areas[i].bottom();
+			alignToScale(left, right, xRes, dst.width());
+			alignToScale(top, bottom, yRes, dst.height());
+			bltData.src_top    = top;
+			bltData.src_left   = left;
+			bltData.src_right  = right;
+			bltData.src_bottom = bottom;
+			/* exact, the edges are on whole steps */
+			bltData.dst_top    = dst.top() + top * dst.height() / yRes;
+			bltData.dst_left   = dst.left() + left * dst.width() / xRes;
+			bltData.dst_right  = dst.left() + right * dst.width() / xRes;
+			bltData.dst_bottom = dst.top() + bottom * dst.height() / yRes;
+			if (ioctl(fbFd, STMFBIO_BLT, &bltData ) < 0)
+			{
+				perror("STMFBIO_BLT");
+			}
+			if (!t)
+				pixels += (right - left) * (bottom - top);
 		}
-	
 	}
 
 	if (ioctl(fbFd, STMFBIO_SYNC_BLITTER) < 0)
 	{
 		perror("STMFBIO_SYNC_BLITTER");
 	}
+	return pixels;
 }
 
 fbClass::~fbClass()
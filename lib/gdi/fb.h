@@ -9,6 +9,8 @@
 # define FB_DEV "/dev/fb0"
 #endif
 
+class eRect;
+
 class fbClass
 {
 	int fbFd;
@@ -48,6 +50,10 @@ public:
 	int setOffset(int off);
 	int waitVSync();
 	void blit();
+		/* only these areas of the surface, the blitter is synced once after all of them.
+		   on scaled output they are grown to whole steps of the ratio.
+		   returns the number of surface pixels copied */
+	int blit(const eRect *areas, int count);
 	unsigned int Stride() { return stride; }
 	fb_cmap *CMAP() { return &cmap; }
 
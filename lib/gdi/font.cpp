@@ -1,5 +1,6 @@
 #include <lib/gdi/font.h>
 
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
@@ -22,6 +23,8 @@
 #include <lib/base/eerror.h>
 #include <lib/gdi/lcd.h>
 #include <lib/gdi/grc.h>
+#include <lib/gdi/textparacache.h>
+#include <lib/python/python_helpers.h>
 #include <lib/base/elock.h>
 #include <lib/base/init.h>
 #include <lib/base/init_num.h>
@@ -57,10 +60,12 @@ struct fntColorCacheKey
 };
 
 std::map<fntColorCacheKey,gLookup> colorcache;
+static eSingleLock colorcache_lock;
 
 static gLookup &getColor(const gPalette &pal, const gRGB &start, const gRGB &end)
 {
 	fntColorCacheKey key(start, end);
+	eSingleLocker l(colorcache_lock);
 	std::map<fntColorCacheKey,gLookup>::iterator i=colorcache.find(key);
 	if (i != colorcache.end())
 		return i->second;
@@ -152,6 +157,116 @@ inline FT_Error fontRenderClass::getGlyphImage(FTC_Image_Desc *font, FT_UInt gly
 	return err;
 }
 
+static void copyGlyphMask(gGlyphMask &mask, int left, int top, int width, int height, int pitch, int pixel_mode, const unsigned char *buffer)
+{
+	mask.left = left;
+	mask.top = top;
+	mask.width = width;
+	mask.height = height;
+	mask.data = NULL;
+	if (!buffer || width <= 0 || height <= 0)
+		return;
+	mask.data = new uint8_t[width * height];
+	uint8_t *d = mask.data;
+	for (int y = 0; y < height; ++y, buffer += pitch, d += width)
+	{
+		if (pixel_mode == FT_PIXEL_MODE_MONO)
+		{
+			for (int x = 0; x < width; ++x)
+				d[x] = (buffer[x >> 3] & (0x80 >> (x & 7))) ? 0xFF : 0;
+		}
+		else
+			memcpy(d, buffer, width);
+	}
+}
+
+static int copyGlyphMask(gGlyphMask &mask, FT_Glyph &glyph)
+{
+	if (glyph->format != FT_GLYPH_FORMAT_BITMAP)
+	{
+		FT_Glyph_To_Bitmap(&glyph, FT_RENDER_MODE_NORMAL, NULL, 1);
+		if (glyph->format != FT_GLYPH_FORMAT_BITMAP)
+			return -1;
+	}
+	FT_BitmapGlyph bitmap = (FT_BitmapGlyph)glyph;
+	copyGlyphMask(mask, bitmap->left, bitmap->top, bitmap->bitmap.width, bitmap->bitmap.rows, bitmap->bitmap.pitch, bitmap->bitmap.pixel_mode, bitmap->bitmap.buffer);
+	return 0;
+}
+
+int fontRenderClass::loadFontMetrics(FTC_Image_Desc *font, gFontMetrics &metrics)
+{
+	singleLock s(ftlock);
+	FTC_ScalerRec scaler = { font->face_id, font->width, font->height, 1, 0, 0 };
+	FT_Face face;
+	FT_Size size;
+	if ((FTC_Manager_LookupFace(cacheManager, scaler.face_id, &face) < 0) ||
+	    (FTC_Manager_LookupSize(cacheManager, &scaler, &size) < 0))
+	{
+		eDebug("[Font] FTC_Manager_Lookup_Size failed!");
+		return -1;
+	}
+	metrics.height = size->metrics.height;
+	metrics.ascender = size->metrics.ascender;
+	metrics.ymax = FT_MulFix(face->bbox.yMax, size->metrics.y_scale);
+	metrics.ymin = FT_MulFix(face->bbox.yMin, size->metrics.y_scale);
+	metrics.kerning = FT_HAS_KERNING(face);
+	return 0;
+}
+
+void fontRenderClass::loadGlyph(FTC_Image_Desc *font, FT_UInt glyph_index, int bordersize, gAtlasGlyph &glyph)
+{
+	singleLock s(ftlock);
+	glyph.valid = false;
+	if (bordersize)
+	{
+		FT_Glyph image = NULL, borderimage = NULL;
+		/* TODO: scale border radius with current_font scaling */
+		if (!getGlyphImage(font, glyph_index, &image, &borderimage, 64 * bordersize)
+			&& !copyGlyphMask(glyph.image, image) && !copyGlyphMask(glyph.border, borderimage))
+		{
+			glyph.advance = borderimage->advance.x;
+			glyph.valid = true;
+		}
+		if (image)
+			FT_Done_Glyph(image);
+		if (borderimage)
+			FT_Done_Glyph(borderimage);
+	}
+	else
+	{
+		FTC_SBit sbit;
+		if (!getGlyphBitmap(font, glyph_index, &sbit))
+		{
+			copyGlyphMask(glyph.image, sbit->left, sbit->top, sbit->width, sbit->height, sbit->pitch, sbit->format, sbit->buffer);
+			glyph.advance = sbit->xadvance << 16;
+			glyph.valid = true;
+		}
+	}
+}
+
+FT_UInt fontRenderClass::loadCharIndex(FTC_Image_Desc *font, unsigned long chr)
+{
+	singleLock s(ftlock);
+	FT_Face face;
+	if (FTC_Manager_LookupFace(cacheManager, font->face_id, &face) < 0)
+		return 0;
+	return FT_Get_Char_Index(face, chr);
+}
+
+int fontRenderClass::loadKerning(FTC_Image_Desc *font, FT_UInt left, FT_UInt right)
+{
+	singleLock s(ftlock);
+	FTC_ScalerRec scaler = { font->face_id, font->width, font->height, 1, 0, 0 };
+	FT_Face face;
+	FT_Size size;
+	FT_Vector delta;
+	if ((FTC_Manager_LookupFace(cacheManager, scaler.face_id, &face) < 0) ||
+	    (FTC_Manager_LookupSize(cacheManager, &scaler, &size) < 0) ||
+	    FT_Get_Kerning(face, left, right, ft_kerning_default, &delta))
+		return 0;
+	return delta.x >> 6;
+}
+
 std::string fontRenderClass::AddFont(const std::string &filename, const std::string &name, int scale, int renderflags)
 {
 	eTrace("[Font] Adding font '%s'", filename.c_str());
@@ -240,22 +355,24 @@ float fontRenderClass::getLineHeight(const gFont& font)
 	getFont(fnt, font.family.c_str(), font.pointSize);
 	if (!fnt)
 		return 0;
-	singleLock s(ftlock);
-	FT_Face current_face;
-	if ((FTC_Manager_LookupFace(cacheManager, fnt->scaler.face_id, &current_face) < 0) ||
-	    (FTC_Manager_LookupSize(cacheManager, &fnt->scaler, &fnt->size) < 0))
-	{
-		eDebug("[Font] FTC_Manager_Lookup_Size failed!");
+	gGlyphAtlas *atlas = fnt->getAtlas(0);
+	if (!atlas)
 		return 0;
-	}
-	int height = current_face->size->metrics.height;
-	if (!height)
-	{
-		/* some fonts don't have height filled in. Estimate it based on the bbox dimensions. */
-		/* Usually, 'height' is less than the complete boundingbox height, so we use only yMax, to avoid getting a much too large line spacing */
-		height = FT_MulFix(current_face->bbox.yMax, current_face->size->metrics.y_scale);
-	}
-	return (height>>6);
+	float height = atlas->metrics().lineHeight()>>6;
+	atlas->release();
+	return height;
+}
+
+void fontRenderClass::setTextLayoutCacheSize(int entries)
+{
+	eTextParaCache::getInstance().setCapacity(entries);
+}
+
+PyObject *fontRenderClass::getTextLayoutStatistics()
+{
+	ePyObject dict = PyDict_New();
+	eTextParaCache::getInstance().getStatistics(dict);
+	return dict;
 }
 
 fontRenderClass::~fontRenderClass()
@@ -303,6 +420,8 @@ void addFont(const char *filename, const char *alias, int scale_factor, int is_r
 		eTextPara::setReplacementFont(alias);
 	else if (is_replacement == -1)
 		eTextPara::setFallbackFont(alias);
+	/* the same text may be laid out with another font now */
+	eTextParaCache::getInstance().clear();
 
 }
 
@@ -325,102 +444,63 @@ Font::Font(fontRenderClass *render, FTC_FaceID faceid, int isize, int tw, int re
 //	font.image_type |= ftc_image_flag_autohinted;
 }
 
-inline FT_Error Font::getGlyphBitmap(FT_UInt glyph_index, FTC_SBit *sbit)
-{
-	return renderer->getGlyphBitmap(&font, glyph_index, sbit);
-}
-
-inline FT_Error Font::getGlyphImage(FT_UInt glyph_index, FT_Glyph *glyph, FT_Glyph *borderglyph, int bordersize)
-{
-	return renderer->getGlyphImage(&font, glyph_index, glyph, borderglyph, bordersize);
-}
-
 Font::~Font()
 {
 }
 
 DEFINE_REF(eTextPara);
-int eTextPara::appendGlyph(Font *current_font, FT_Face current_face, FT_UInt glyphIndex, int flags, int rflags, int border, bool last,
+int eTextPara::appendGlyph(gGlyphAtlas *atlas, FT_UInt glyphIndex, int flags, int rflags, int border, bool last,
 		bool activate_newcolor, unsigned long newcolor)
 {
 	int xadvance, top, left, height;
 	pGlyph ng;
 	int xborder = 0;
 
+	const gAtlasGlyph *glyph = atlas->glyph(glyphIndex);
+	if (!glyph->valid)
+		return 1;
+
+	xadvance = glyph->advance;
 	if (border)
 	{
-		/* TODO: scale border radius with current_font scaling */
-		if (current_font->getGlyphImage(glyphIndex, &ng.image, &ng.borderimage, 64 * border))
-			return 1;
-		if (ng.image && ng.image->format != FT_GLYPH_FORMAT_BITMAP)
-		{
-			FT_Glyph_To_Bitmap(&ng.image, FT_RENDER_MODE_NORMAL, NULL, 1);
-			if (ng.image->format != FT_GLYPH_FORMAT_BITMAP) return 1;
-		}
-		if (ng.borderimage && ng.borderimage->format != FT_GLYPH_FORMAT_BITMAP)
-		{
-			FT_Glyph_To_Bitmap(&ng.borderimage, FT_RENDER_MODE_NORMAL, NULL, 1);
-			if (ng.borderimage->format != FT_GLYPH_FORMAT_BITMAP) return 1;
-		}
-		FT_BitmapGlyph glyph = NULL;
-		if (ng.borderimage)
-		{
-			xadvance = ng.borderimage->advance.x;
-			/*
-			 * NOTE: our boundingbox calculation uses xadvance, and ignores glyph width.
-			 * This is fine for all glyphs, except the last one (i.e. rightmost, for left-to-right rendering)
-			 * For border glyphs, xadvance is significantly smaller than the glyph width.
-			 * In fact, border glyphs often have the same xadvance as normal glyphs, borders
-			 * are allowed to overlap.
-			 * As a result, the boundingbox is calculated too small, the actual glyphs won't
-			 * fit into it, and depending on the alignment, one of the borders on the sides
-			 * will be cut off.
-			 * Ideally, the boundingbox calculation should be rewritten, to use both advance and glyph dimensions.
-			 * However, for now we adjust xadvance of the last glyph, so the current calculation will produce
-			 * a better fitting boundingbox for border glyphs.
-			 *
-			 * The compensation equals half of the difference between 'normal' glyph width,
-			 * and border glyph width. (half the width difference is on the left, and half on the right
-			 * of the glyph, we only need to compensate for the part on the right)
-			 * And since xadvance is in 16.16 units, we use (dW/2) << 16 = dW << 15
-			 */
-			if (last)
-			{
-				xadvance += (((FT_BitmapGlyph)ng.borderimage)->bitmap.width - ((FT_BitmapGlyph)ng.image)->bitmap.width) << 15;
-			}
-			if (!previous)
-			{
-				/* Move the first character, to make sure the border does not get cut off by the boundingbox (xborder is in pixel units, so just divide the width difference by two)  */
-				xborder = (((FT_BitmapGlyph)ng.borderimage)->bitmap.width - ((FT_BitmapGlyph)ng.image)->bitmap.width) / 2;
-			}
-			glyph = (FT_BitmapGlyph)ng.borderimage;
-		}
-		else if (ng.image)
+		/*
+		 * NOTE: our boundingbox calculation uses xadvance, and ignores glyph width.
+		 * This is fine for all glyphs, except the last one (i.e. rightmost, for left-to-right rendering)
+		 * For border glyphs, xadvance is significantly smaller than the glyph width.
+		 * In fact, border glyphs often have the same xadvance as normal glyphs, borders
+		 * are allowed to overlap.
+		 * As a result, the boundingbox is calculated too small, the actual glyphs won't
+		 * fit into it, and depending on the alignment, one of the borders on the sides
+		 * will be cut off.
+		 * Ideally, the boundingbox calculation should be rewritten, to use both advance and glyph dimensions.
+		 * However, for now we adjust xadvance of the last glyph, so the current calculation will produce
+		 * a better fitting boundingbox for border glyphs.
+		 *
+		 * The compensation equals half of the difference between 'normal' glyph width,
+		 * and border glyph width. (half the width difference is on the left, and half on the right
+		 * of the glyph, we only need to compensate for the part on the right)
+		 * And since xadvance is in 16.16 units, we use (dW/2) << 16 = dW << 15
+		 */
+		if (last)
 		{
-			xadvance = ng.image->advance.x;
-			glyph = (FT_BitmapGlyph)ng.image;
+			xadvance += (glyph->border.width - glyph->image.width) << 15;
 		}
-		else
+		if (!previous)
 		{
-			return 1;
+			/* Move the first character, to make sure the border does not get cut off by the boundingbox (xborder is in pixel units, so just divide the width difference by two)  */
+			xborder = (glyph->border.width - glyph->image.width) / 2;
 		}
-		xadvance >>= 16;
-
-		top = glyph->top;
-		left = glyph->left;
-		height = glyph->bitmap.rows;
+		top = glyph->border.top;
+		left = glyph->border.left;
+		height = glyph->border.height;
 	}
 	else
 	{
-		FTC_SBit glyph;
-		if (current_font->getGlyphBitmap(glyphIndex, &glyph))
-			return 1;
-
-		xadvance = glyph->xadvance;
-		top = glyph->top;
-		left = glyph->left;
-		height = glyph->height;
+		top = glyph->image.top;
+		left = glyph->image.left;
+		height = glyph->image.height;
 	}
+	xadvance >>= 16;
 
 	int nx=cursor.x();
 
@@ -490,11 +570,7 @@ int eTextPara::appendGlyph(Font *current_font, FT_Face current_face, FT_UInt gly
 
 	int kern=0;
 	if (previous && use_kerning)
-	{
-		FT_Vector delta;
-		FT_Get_Kerning(current_face, previous, glyphIndex, ft_kerning_default, &delta);
-		kern=delta.x>>6;
-	}
+		kern = atlas->kerning(previous, glyphIndex);
 
 	ng.bbox.setLeft(cursor.x() + left + xborder);
 	ng.bbox.setTop( cursor.y() - top );
@@ -507,7 +583,7 @@ int eTextPara::appendGlyph(Font *current_font, FT_Face current_face, FT_UInt gly
 	ng.y = cursor.y();
 	ng.w = xadvance;
 
-	ng.font = current_font;
+	ng.glyph = glyph;
 	ng.glyph_index = glyphIndex;
 	ng.flags = flags;
 
@@ -562,14 +638,7 @@ void eTextPara::newLine(int flags)
 	if (maximum.width()<cursor.x())
 		maximum.setWidth(cursor.x());
 	cursor.setX(left);
-	int height = current_face->size->metrics.height;
-	if (!height)
-	{
-		/* some fonts don't have height filled in. Estimate it based on the bbox dimensions. */
-		/* Usually, 'height' is less than the complete boundingbox height, so we use only yMax, to avoid getting a much too large line spacing */
-		height = FT_MulFix(current_face->bbox.yMax, current_face->size->metrics.y_scale);
-	}
-	height >>= 6;
+	int height = current_atlas->metrics().lineHeight() >> 6;
 
 	lineOffsets.push_back(cursor.y());
 	lineChars.push_back(charCount);
@@ -610,50 +679,19 @@ void eTextPara::setFont(Font *fnt, Font *replacement, Font *fallback)
 	current_font=fnt;
 	replacement_font=replacement;
 	fallback_font=fallback;
-	singleLock s(ftlock);
-
-			// we ask for replacment_font first becauseof the cache
-	if (replacement_font)
-	{
-		if ((FTC_Manager_LookupFace(fontRenderClass::instance->cacheManager,
-					    replacement_font->scaler.face_id,
-					    &replacement_face) < 0) ||
-		    (FTC_Manager_LookupSize(fontRenderClass::instance->cacheManager,
-					    &replacement_font->scaler,
-					    &replacement_font->size) < 0))
-		{
-			eDebug("[eTextPara] setFont: FTC_Manager_Lookup_Size replacement_font failed!");
-			return;
-		}
-	}
-	if (current_font)
-	{
-		if ((FTC_Manager_LookupFace(fontRenderClass::instance->cacheManager,
-					    current_font->scaler.face_id,
-					    &current_face) < 0) ||
-		    (FTC_Manager_LookupSize(fontRenderClass::instance->cacheManager,
-					    &current_font->scaler,
-					    &current_font->size) < 0))
-		{
-			eDebug("[eTextPara] setFont: FTC_Manager_Lookup_Size current_font failed!");
-			return;
-		}
-	}
-	if (fallback_font)
-	{
-		if ((FTC_Manager_LookupFace(fontRenderClass::instance->cacheManager,
-					    fallback_font->scaler.face_id,
-					    &fallback_face) < 0) ||
-		    (FTC_Manager_LookupSize(fontRenderClass::instance->cacheManager,
-					    &fallback_font->scaler,
-					    &fallback_font->size) < 0))
-		{
-			eDebug("[eTextPara] FTC_Manager_Lookup_Size failed!");
-			return;
-		}
-	}
 	previous=0;
-	use_kerning=FT_HAS_KERNING(current_face);
+}
+
+gGlyphAtlas *eTextPara::useAtlas(Font *font, int border)
+{
+	gGlyphAtlas *atlas = font->getAtlas(border);
+	if (!atlas)
+		return NULL;
+	if (std::find(atlases.begin(), atlases.end(), atlas) != atlases.end())
+		atlas->release();
+	else
+		atlases.push_back(atlas);
+	return atlas;
 }
 
 void
@@ -661,34 +699,33 @@ shape (std::vector<unsigned long> &string, const std::vector<unsigned long> &tex
 
 int eTextPara::renderString(const char *string, int rflags, int border, int markedpos)
 {
-	singleLock s(ftlock);
-
 	if (!current_font)
 		return -1;
 
-	if ((FTC_Manager_LookupFace(fontRenderClass::instance->cacheManager,
-				current_font->scaler.face_id,
-				&current_face) < 0) ||
-	    (FTC_Manager_LookupSize(fontRenderClass::instance->cacheManager,
-				&current_font->scaler,
-				&current_font->size) < 0))
+	/* the atlases are immutable once filled, no need for the font lock here */
+	current_atlas = useAtlas(current_font, border);
+	if (!current_atlas)
 	{
 		eDebug("[eTextPara] renderString: FTC_Manager_Lookup_Size current_font failed!");
 		return -1;
 	}
+	replacement_atlas = replacement_font ? useAtlas(replacement_font, border) : NULL;
+	fallback_atlas = fallback_font ? useAtlas(fallback_font, border) : NULL;
+	use_kerning = current_atlas->metrics().kerning;
 
 	if (cursor.y()==-1)
 	{
-		int height = current_face->size->metrics.height;
-		int ascender = current_face->size->metrics.ascender;
+		const gFontMetrics &metrics = current_atlas->metrics();
+		int height = metrics.height;
+		int ascender = metrics.ascender;
 		if (!height || !ascender)
 		{
-			int ymax = FT_MulFix(current_face->bbox.yMax, current_face->size->metrics.y_scale);
+			int ymax = metrics.ymax;
 			if (!height)
 			{
 				/* some fonts don't have height filled in. Estimate it based on the bbox dimensions. */
 				/* For the first line we calculate the full boundingbox height, this gives the best result when centering vertically */
-				height = ymax - FT_MulFix(current_face->bbox.yMin, current_face->size->metrics.y_scale);
+				height = ymax - metrics.ymin;
 			}
 			if (!ascender)
 			{
@@ -887,26 +924,26 @@ nprint:				isprintable=0;
 				chr = '-';
 
 			if (forced_replaces.find(chr) == forced_replaces.end())
-				index=(rflags&RS_DIRECT)? chr : FT_Get_Char_Index(current_face, chr);
+				index=(rflags&RS_DIRECT)? chr : current_atlas->charIndex(chr);
 
 			if (!index)
 			{
-				if (replacement_face)
-					index=(rflags&RS_DIRECT)? chr : FT_Get_Char_Index(replacement_face, chr);
+				if (replacement_atlas)
+					index=(rflags&RS_DIRECT)? chr : replacement_atlas->charIndex(chr);
 
 				if (!index)
 				{
-					if (fallback_face)
-						index=(rflags&RS_DIRECT)? chr : FT_Get_Char_Index(fallback_face, chr);
+					if (fallback_atlas)
+						index=(rflags&RS_DIRECT)? chr : fallback_atlas->charIndex(chr);
 					if (!index)
 						eDebug("[eTextPara] Unicode U+%4lx not present", chr);
 					else
-						appendGlyph(fallback_font, fallback_face, index, flags, rflags, border, i == uc_visual.end() - 1, activate_newcolor, newcolor);
+						appendGlyph(fallback_atlas, index, flags, rflags, border, i == uc_visual.end() - 1, activate_newcolor, newcolor);
 				}
 				else
-					appendGlyph(replacement_font, replacement_face, index, flags, rflags, border, i == uc_visual.end() - 1, activate_newcolor, newcolor);
+					appendGlyph(replacement_atlas, index, flags, rflags, border, i == uc_visual.end() - 1, activate_newcolor, newcolor);
 			} else
-				appendGlyph(current_font, current_face, index, flags, rflags, border, i == uc_visual.end() - 1, activate_newcolor, newcolor);
+				appendGlyph(current_atlas, index, flags, rflags, border, i == uc_visual.end() - 1, activate_newcolor, newcolor);
 
 			if (index)
 			{
@@ -936,26 +973,48 @@ nprint:				isprintable=0;
 	return 0;
 }
 
+/*
+ * Draws the pixels of a glyph's coverage mask, in the colour the upper 4 bits
+ * of the coverage select from the lookup. Runs of 8 uncovered pixels, which
+ * make up much of every glyph, are skipped in one go.
+ */
+template <class D, class L>
+static inline void blitGlyphMask(D *dst, int dst_stride, const __u8 *src, int src_stride, int width, int height, const L *lookup)
+{
+	for (int y = 0; y < height; ++y)
+	{
+		int x = 0;
+		for (; x + 8 <= width; x += 8)
+		{
+			uint64_t chunk;
+			memcpy(&chunk, src + x, 8);
+			if (!(chunk & 0xF0F0F0F0F0F0F0F0ULL))
+				continue;
+			for (int i = x; i < x + 8; ++i)
+			{
+				int b = src[i] >> 4;
+				if (b)
+					dst[i] = lookup[b];
+			}
+		}
+		for (; x < width; ++x)
+		{
+			int b = src[x] >> 4;
+			if (b)
+				dst[x] = lookup[b];
+		}
+		src += src_stride;
+		dst = (D*)((__u8*)dst + dst_stride);
+	}
+}
+
 void eTextPara::blit(gDC &dc, const ePoint &offset, const gRGB &background, const gRGB &foreground, bool border)
 {
 	if (glyphs.empty()) return;
 
-	singleLock s(ftlock);
-
-	if (!current_font)
+	if (!current_atlas)
 		return;
 
-	if ((FTC_Manager_LookupFace(fontRenderClass::instance->cacheManager,
- 				    current_font->scaler.face_id,
- 				    &current_face) < 0) ||
-	    (FTC_Manager_LookupSize(fontRenderClass::instance->cacheManager,
-				    &current_font->scaler,
-				    &current_font->size) < 0))
-	{
-		eDebug("[eTextPara] FTC_Manager_Lookup_Size failed!");
-		return;
-	}
-
 	ePtr<gPixmap> target;
 	dc.getPixmap(target);
 	gUnmanagedSurface *surface = target->surface;
@@ -975,7 +1034,7 @@ void eTextPara::blit(gDC &dc, const ePoint &offset, const gRGB &background, cons
 
 	gRegion sarea(eRect(0, 0, surface->x, surface->y));
 	gRegion clip = dc.getClip() & sarea;
-	clip &= eRect(area.left() + offset.x(), area.top() + offset.y(), area.width(), area.height()+(current_face->size->metrics.ascender>>6));
+	clip &= eRect(area.left() + offset.x(), area.top() + offset.y(), area.width(), area.height()+(current_atlas->metrics().ascender>>6));
 
 	int buffer_stride=surface->stride;
 
@@ -1084,44 +1143,20 @@ void eTextPara::blit(gDC &dc, const ePoint &offset, const gRGB &background, cons
 			lookup32 = lookup32_invert;
 		}
 
-		int rxbase, rybase;
-		__u8 *dbase;
-		__u8 *sbase;
-		int sxbase;
-		int sybase;
-		int pitch;
-		if (i->image)
-		{
-			FT_BitmapGlyph glyph = border ? (FT_BitmapGlyph)i->borderimage : (FT_BitmapGlyph)i->image;
-			if (!glyph->bitmap.buffer) continue;
-			rxbase = i->x + glyph->left + offset.x();
-			rybase = i->y - glyph->top + offset.y();
-			rybase=(doTopBottomReordering ? line_offs : i->y) - glyph->top + offset.y();
-			sbase = glyph->bitmap.buffer;
-			sxbase = glyph->bitmap.width;
-			sybase = glyph->bitmap.rows;
-			pitch = glyph->bitmap.pitch;
-		}
-		else
-		{
-			static FTC_SBit glyph_bitmap;
-			if (fontRenderClass::instance->getGlyphBitmap(&i->font->font, i->glyph_index, &glyph_bitmap))
-				continue;
-			rxbase=i->x+glyph_bitmap->left + offset.x();
-			rybase=(doTopBottomReordering ? line_offs : i->y) - glyph_bitmap->top + offset.y();
-			sbase=glyph_bitmap->buffer;
-			sxbase=glyph_bitmap->width;
-			sybase=glyph_bitmap->height;
-			pitch = glyph_bitmap->pitch;
-		}
-		dbase = (__u8*)(surface->data)+buffer_stride*rybase+rxbase*surface->bypp;
+		/* borders are drawn with the glyph itself when it was laid out without */
+		const gGlyphMask &mask = (border && i->glyph->border.data) ? i->glyph->border : i->glyph->image;
+		if (!mask.data)
+			continue;
+		int rxbase = i->x + mask.left + offset.x();
+		int rybase = (doTopBottomReordering ? line_offs : i->y) - mask.top + offset.y();
+		__u8 *dbase = (__u8*)(surface->data)+buffer_stride*rybase+rxbase*surface->bypp;
 		for (unsigned int c = 0; c < clip.rects.size(); ++c)
 		{
 			int rx = rxbase, ry = rybase;
 			__u8 *d = dbase;
-			__u8 *s = sbase;
-			register int sx = sxbase;
-			int sy = sybase;
+			const __u8 *s = mask.data;
+			int sx = mask.width;
+			int sy = mask.height;
 			if ((sy+ry) >= clip.rects[c].bottom())
 				sy = clip.rects[c].bottom()-ry;
 			if ((sx+rx) >= clip.rects[c].right())
@@ -1137,90 +1172,32 @@ void eTextPara::blit(gDC &dc, const ePoint &offset, const gRGB &background, cons
 			if (ry < clip.rects[c].top())
 			{
 				int diff=clip.rects[c].top()-ry;
-				s+=diff*pitch;
+				s+=diff*mask.width;
 				sy-=diff;
 				ry+=diff;
 				d+=diff*buffer_stride;
 			}
 			if ((sx>0) && (sy>0))
 			{
-				int extra_source_stride = pitch - sx;
 				switch (opcode)
 				{
 				case 0: 		// 4bit lookup to 8bit
-					{
-					register int extra_buffer_stride = buffer_stride - sx;
-					register __u8 *td=d;
-					for (int ay = 0; ay < sy; ay++)
-					{
-						register int ax;
-
-						for (ax=0; ax<sx; ax++)
-						{
-							register int b=(*s++)>>4;
-							if(b)
-								*td=lookup8[b];
-							++td;
-						}
-						s += extra_source_stride;
-						td += extra_buffer_stride;
-					}
-					}
+					blitGlyphMask(d, buffer_stride, s, mask.width, sx, sy, lookup8);
 					break;
 				case 1:	// 8bit direct
-					{
-					register int extra_buffer_stride = buffer_stride - sx;
-					register __u8 *td=d;
 					for (int ay = 0; ay < sy; ay++)
 					{
-						register int ax;
-						for (ax=0; ax<sx; ax++)
-						{
-							register int b=*s++;
-							*td++^=b;
-						}
-						s += extra_source_stride;
-						td += extra_buffer_stride;
-					}
+						for (int ax = 0; ax < sx; ax++)
+							d[ax] ^= s[ax];
+						s += mask.width;
+						d += buffer_stride;
 					}
 					break;
 				case 2: // 16bit
-                                        {
-                                        int extra_buffer_stride = (buffer_stride >> 1) - sx;
-                                        register __u16 *td = (__u16*)d;
-                                        for (int ay = 0; ay != sy; ay++)
-                                        {
-                                                register int ax;
-                                                for (ax = 0; ax != sx; ax++)
-                                                {
-                                                        register int b = (*s++) >> 4;
-							if (b)
-								*td = lookup16[b];
-                                                        ++td;
-                                                }
-                                                s += extra_source_stride;
-                                                td += extra_buffer_stride;
-                                        }
-                                        }
-                                        break;
+					blitGlyphMask((__u16*)d, buffer_stride, s, mask.width, sx, sy, lookup16);
+					break;
 				case 3: // 32bit
-					{
-					register int extra_buffer_stride = (buffer_stride >> 2) - sx;
-					register __u32 *td=(__u32*)d;
-					for (int ay = 0; ay < sy; ay++)
-					{
-						register int ax;
-						for (ax=0; ax<sx; ax++)
-						{
-							register int b=(*s++)>>4;
-							if(b)
-								*td=lookup32[b];
-							++td;
-						}
-						s += extra_source_stride;
-						td += extra_buffer_stride;
-					}
-					}
+					blitGlyphMask((__u32*)d, buffer_stride, s, mask.width, sx, sy, lookup32);
 					break;
 				}
 			}
@@ -1403,17 +1380,14 @@ void eTextPara::realign(int dir, int markedpos, int scrollpos)	// der code hier
 
 void eTextPara::clear()
 {
-	singleLock s(ftlock);
-
 	current_font = 0;
 	replacement_font = 0;
+	current_atlas = replacement_atlas = fallback_atlas = 0;
 
-	for (unsigned int i = 0; i < glyphs.size(); i++)
-	{
-		if (glyphs[i].image) FT_Done_Glyph(glyphs[i].image);
-		if (glyphs[i].borderimage) FT_Done_Glyph(glyphs[i].borderimage);
-	}
 	glyphs.clear();
+	for (std::vector<gGlyphAtlas *>::iterator i = atlases.begin(); i != atlases.end(); ++i)
+		(*i)->release();
+	atlases.clear();
 	totalheight = 0;
 	lineCount = 0;
 }
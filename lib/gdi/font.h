@@ -21,6 +21,8 @@ typedef FTC_SBitCache FTC_SBit_Cache;
 #include <string>
 #include <list>
 #include <lib/base/object.h>
+#include <lib/gdi/glyphatlas.h>
+#include <lib/python/python.h>
 
 #include <set>
 
@@ -36,6 +38,7 @@ class fontRenderClass
 #ifndef SWIG
 	friend class Font;
 	friend class eTextPara;
+	friend class gGlyphAtlas;
 	fbClass *fb;
 	struct fontListEntry
 	{
@@ -56,6 +59,11 @@ class fontRenderClass
 	int getFaceProperties(const std::string &face, FTC_FaceID &id, int &renderflags);
 	FT_Error getGlyphBitmap(FTC_Image_Desc *font, FT_UInt glyph_index, FTC_SBit *sbit);
 	FT_Error getGlyphImage(FTC_Image_Desc *font, FT_UInt glyph_index, FT_Glyph *glyph, FT_Glyph *borderglyph, int bordersize);
+	/* for gGlyphAtlas, these take the lock FreeType is called under */
+	int loadFontMetrics(FTC_Image_Desc *font, gFontMetrics &metrics);
+	void loadGlyph(FTC_Image_Desc *font, FT_UInt glyph_index, int bordersize, gAtlasGlyph &glyph);
+	FT_UInt loadCharIndex(FTC_Image_Desc *font, unsigned long chr);
+	int loadKerning(FTC_Image_Desc *font, FT_UInt left, FT_UInt right);
 	static fontRenderClass *instance;
 #else
 	fontRenderClass();
@@ -64,6 +72,9 @@ class fontRenderClass
 public:
 	float getLineHeight(const gFont& font);
 	static fontRenderClass *getInstance();
+	/* the cache of laid out texts, see eTextParaCache */
+	void setTextLayoutCacheSize(int entries);
+	PyObject *getTextLayoutStatistics();
 #ifndef SWIG
 	std::string AddFont(const std::string &filename, const std::string &name, int scale, int renderflags = 0);
 	FT_Error FTC_Face_Requester(FTC_FaceID	face_id, FT_Face* aface);
@@ -97,16 +108,10 @@ struct pGlyph
 {
 	int x, y, w;
 	unsigned long newcolor;
-	ePtr<Font> font;
 	FT_UInt glyph_index;
 	int flags;
 	eRect bbox;
-	FT_Glyph image, borderimage;
-	pGlyph()
-	{
-		image = NULL;
-		borderimage = NULL;
-	}
+	const gAtlasGlyph *glyph;
 };
 
 typedef std::vector<pGlyph> glyphString;
@@ -118,7 +123,9 @@ class eTextPara: public iObject
 {
 	DECLARE_REF(eTextPara);
 	ePtr<Font> current_font, replacement_font, fallback_font;
-	FT_Face current_face, replacement_face, fallback_face;
+	gGlyphAtlas *current_atlas, *replacement_atlas, *fallback_atlas;
+	/* referenced until clear(), the glyphs point into them */
+	std::vector<gGlyphAtlas *> atlases;
 	int use_kerning;
 	int previous;
 	static std::string replacement_facename;
@@ -140,15 +147,16 @@ class eTextPara: public iObject
 	bool doTopBottomReordering;
 	int m_offset;
 
-	int appendGlyph(Font *current_font, FT_Face current_face, FT_UInt glyphIndex, int flags, int rflags, int border, bool last,
+	int appendGlyph(gGlyphAtlas *atlas, FT_UInt glyphIndex, int flags, int rflags, int border, bool last,
 			bool activate_newcolor, unsigned long newcolor);
 	void newLine(int flags);
 	void setFont(Font *font, Font *replacement_font, Font *fallback_font);
+	gGlyphAtlas *useAtlas(Font *font, int border);
 	void calc_bbox();
 public:
 	eTextPara(eRect area, ePoint start=ePoint(-1, -1))
 		: current_font(0), replacement_font(0), fallback_font(0),
-		current_face(0), replacement_face(0), fallback_face(0),
+		current_atlas(0), replacement_atlas(0), fallback_atlas(0),
 		area(area), cursor(start), maximum(0, 0), left(start.x()), charCount(0), totalheight(0),
 		bboxValid(0), doTopBottomReordering(false), m_offset(0)
 	{
@@ -225,8 +233,7 @@ public:
 	FTC_ScalerRec scaler;
 	FTC_Image_Desc font;
 	fontRenderClass *renderer;
-	FT_Error getGlyphBitmap(FT_UInt glyph_index, FTC_SBit *sbit);
-	FT_Error getGlyphImage(FT_UInt glyph_index, FT_Glyph *glyph, FT_Glyph *borderglyph, int bordersize);
+	gGlyphAtlas *getAtlas(int border) { return gGlyphAtlas::get(renderer, font, border); }
 	FT_Face face;
 	FT_Size size;
 
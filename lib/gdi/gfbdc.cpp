@@ -4,10 +4,18 @@
 #include <lib/base/init_num.h>
 
 #include <lib/gdi/accel.h>
+#include <lib/python/python_helpers.h>
 
 #include <time.h>
 
+/* more blits than this cost more than the pixels they save */
+static const unsigned int max_damage_rects = 16;
+/* roughly what one more blit costs, in pixels copied */
+static const int damage_slack = 8192;
+
 gFBDC::gFBDC()
+	: m_clip_damaged(0), m_damage_full(1), m_show_damage(0),
+	m_frames(0), m_full_frames(0), m_pixels(0), m_max_pixels(0), m_rects(0), m_total_pixels(0)
 {
 	fb=new fbClass;
 
@@ -103,8 +111,41 @@ void gFBDC::exec(const gOpcode *o)
 	{
 		gDC::exec(o);
 		setPalette();
+		m_damage_full = 1;
 		break;
 	}
+	case gOpcode::renderText:
+	case gOpcode::renderPara:
+	case gOpcode::fill:
+	case gOpcode::fillRegion:
+	case gOpcode::clear:
+	case gOpcode::blit:
+	case gOpcode::gradient:
+	case gOpcode::line:
+		/* nothing is drawn outside the clip, whether the painter announced it or not */
+		if (!m_clip_damaged)
+		{
+			m_damage |= m_current_clip;
+			m_clip_damaged = 1;
+		}
+		gDC::exec(o);
+		break;
+	case gOpcode::setClip:
+	case gOpcode::addClip:
+	case gOpcode::popClip:
+		gDC::exec(o);
+		m_clip_damaged = 0;
+		break;
+	case gOpcode::enableSpinner:
+	case gOpcode::disableSpinner:
+	case gOpcode::incrementSpinner:
+		gDC::exec(o);
+		m_damage_full = 1;
+		break;
+	case gOpcode::damage:
+		m_damage |= o->parm.damage->region;
+		delete o->parm.damage;
+		break;
 	case gOpcode::flip:
 	{
 		if (surface_back.data_phys)
@@ -138,12 +179,12 @@ void gFBDC::exec(const gOpcode *o)
 
 		++t;
 
-		fb->blit();
+		blitDamage();
 		fb->waitVSync();
 		break;
 	}
 	case gOpcode::flush:
-		fb->blit();
+		blitDamage();
 		break;
 	default:
 		gDC::exec(o);
@@ -151,6 +192,87 @@ void gFBDC::exec(const gOpcode *o)
 	}
 }
 
+void gFBDC::blitDamage()
+{
+	eRect screen(0, 0, surface.x, surface.y);
+	std::vector<eRect> areas;
+	/* with two pages, the one flipped to has to be complete */
+	int full = m_damage_full || surface_back.data_phys;
+	if (full)
+		areas.push_back(screen);
+	else
+	{
+		m_damage &= screen;
+		m_damage.cover(areas, max_damage_rects, damage_slack);
+	}
+
+	int pixels = 0;
+	if (!areas.empty())
+	{
+		std::vector<std::pair<uint32_t *, uint32_t> > saved;
+		if (m_show_damage)
+			outlineDamage(areas, saved);
+		/* on scaled output the areas grow a little */
+		pixels = fb->blit(&areas[0], areas.size());
+		/* the screen keeps the outline until the area is copied again, the surface doesn't */
+		for (int i = (int)saved.size() - 1; i >= 0; --i)
+			*saved[i].first = saved[i].second;
+	}
+
+	m_damage = gRegion();
+	m_clip_damaged = 0;
+	m_damage_full = 0;
+
+	eSingleLocker l(m_stats_lock);
+	++m_frames;
+	if (full)
+		++m_full_frames;
+	m_pixels = pixels;
+	if (pixels > m_max_pixels)
+		m_max_pixels = pixels;
+	m_rects = areas.size();
+	m_total_pixels += pixels;
+}
+
+void gFBDC::outlineDamage(const std::vector<eRect> &areas, std::vector<std::pair<uint32_t *, uint32_t> > &saved)
+{
+	if (surface.bpp != 32)
+		return;
+	for (unsigned int i = 0; i < areas.size(); ++i)
+	{
+		const eRect &a = areas[i];
+		for (int y = a.top(); y < a.bottom(); ++y)
+		{
+			uint32_t *row = (uint32_t *)((uint8_t *)surface.data + y * surface.stride);
+			for (int x = a.left(); x < a.right(); ++x)
+			{
+				if (y != a.top() && y != a.bottom() - 1 && x != a.left() && x != a.right() - 1)
+				{
+					/* on to the right edge */
+					x = a.right() - 2;
+					continue;
+				}
+				saved.push_back(std::make_pair(row + x, row[x]));
+				row[x] = 0xFFFF00FF;
+			}
+		}
+	}
+}
+
+PyObject *gFBDC::getDamageStatistics()
+{
+	ePyObject dict = PyDict_New();
+	eSingleLocker l(m_stats_lock);
+	PutToDict(dict, "frames", m_frames);
+	PutToDict(dict, "full_frames", m_full_frames);
+	PutToDict(dict, "pixels", m_pixels);
+	PutToDict(dict, "max_pixels", m_max_pixels);
+	PutToDict(dict, "avg_pixels", m_frames ? (long)(m_total_pixels / m_frames) : 0L);
+	PutToDict(dict, "rects", m_rects);
+	PutToDict(dict, "screen_pixels", surface.x * surface.y);
+	return dict;
+}
+
 void gFBDC::setAlpha(int a)
 {
 	alpha=a;
@@ -15,12 +15,26 @@ class gFBDC: public gMainDC
 	void exec(const gOpcode *opcode);
 	void calcRamp();
 	void setPalette();
+
+	gRegion m_damage; /* since the last blit, in surface coordinates */
+	int m_clip_damaged; /* m_current_clip is already part of m_damage */
+	int m_damage_full;
+	int m_show_damage;
+	void blitDamage();
+	void outlineDamage(const std::vector<eRect> &areas, std::vector<std::pair<uint32_t *, uint32_t> > &saved);
+
+	eSingleLock m_stats_lock;
+	int m_frames, m_full_frames;
+	int m_pixels, m_max_pixels, m_rects;
+	long long m_total_pixels;
 public:
 	void setResolution(int xres, int yres, int bpp = 32);
 	void reloadSettings();
 	void setAlpha(int alpha);
 	void setBrightness(int brightness);
 	void setGamma(int gamma);
+	void setShowDamage(int show) { m_show_damage = show; }
+	PyObject *getDamageStatistics();
 
 	int getAlpha() const { return alpha; }
 	int getBrightness() const { return brightness; }
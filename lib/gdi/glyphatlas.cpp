@@ -0,0 +1,176 @@
+#include <lib/gdi/glyphatlas.h>
+#include <lib/gdi/font.h>
+#include <lib/base/eerror.h>
+
+struct gGlyphAtlasKey
+{
+	FTC_FaceID face_id;
+	int size, flags, border;
+	bool operator <(const gGlyphAtlasKey &c) const
+	{
+		if (face_id != c.face_id)
+			return face_id < c.face_id;
+		if (size != c.size)
+			return size < c.size;
+		if (flags != c.flags)
+			return flags < c.flags;
+		return border < c.border;
+	}
+};
+
+/* the glyph masks of all atlases, like the FreeType cache size in fontRenderClass */
+#define ATLAS_MAX_BYTES (4*1024*1024)
+
+static eSingleLock atlas_lock;
+static std::map<gGlyphAtlasKey, gGlyphAtlas *> atlases;
+static unsigned int atlas_tick;
+static std::atomic<size_t> atlas_bytes(0);
+
+gGlyphAtlas *gGlyphAtlas::get(fontRenderClass *renderer, const FTC_ImageTypeRec &desc, int border)
+{
+	gGlyphAtlasKey key = { desc.face_id, (int)desc.width, (int)desc.flags, border };
+	eSingleLocker l(atlas_lock);
+	gGlyphAtlas *atlas;
+	std::map<gGlyphAtlasKey, gGlyphAtlas *>::iterator i = atlases.find(key);
+	if (i != atlases.end())
+		atlas = i->second;
+	else
+	{
+		atlas = new gGlyphAtlas(renderer, desc, border);
+		if (renderer->loadFontMetrics(&atlas->m_desc, atlas->m_metrics))
+		{
+			delete atlas;
+			return NULL;
+		}
+		atlases[key] = atlas;
+		eDebug("[gGlyphAtlas] new atlas for size %d border %d, %zu atlases", (int)desc.width, border, atlases.size());
+	}
+	atlas->m_users.fetch_add(1, std::memory_order_relaxed);
+	atlas->m_last_used = ++atlas_tick;
+	if (atlas_bytes.load(std::memory_order_relaxed) > ATLAS_MAX_BYTES)
+		evict(atlas);
+	return atlas;
+}
+
+/* with atlas_lock held. a user only gets an atlas through get(), so one without users stays unused */
+void gGlyphAtlas::evict(gGlyphAtlas *keep)
+{
+	while (atlas_bytes.load(std::memory_order_relaxed) > ATLAS_MAX_BYTES)
+	{
+		std::map<gGlyphAtlasKey, gGlyphAtlas *>::iterator oldest = atlases.end();
+		for (std::map<gGlyphAtlasKey, gGlyphAtlas *>::iterator i = atlases.begin(); i != atlases.end(); ++i)
+		{
+			if (i->second == keep || i->second->m_users.load(std::memory_order_acquire))
+				continue;
+			if (oldest == atlases.end() || i->second->m_last_used < oldest->second->m_last_used)
+				oldest = i;
+		}
+		/* everything else is in use */
+		if (oldest == atlases.end())
+			break;
+		eDebug("[gGlyphAtlas] freeing atlas for size %d border %d, %zu bytes", (int)oldest->second->m_desc.width, oldest->second->m_border, oldest->second->m_bytes.load());
+		delete oldest->second;
+		atlases.erase(oldest);
+	}
+}
+
+gGlyphAtlas::gGlyphAtlas(fontRenderClass *renderer, const FTC_ImageTypeRec &desc, int border)
+	: m_renderer(renderer), m_desc(desc), m_border(border), m_metrics(), m_users(0), m_last_used(0), m_bytes(0)
+{
+	for (int i = 0; i < KERNING_SLOTS; ++i)
+		m_kerning[i].store(0, std::memory_order_relaxed);
+}
+
+gGlyphAtlas::~gGlyphAtlas()
+{
+	for (unsigned int index = 0; index < 0x10000; ++index)
+	{
+		gAtlasGlyph *glyph = m_glyphs.get(index);
+		if (glyph)
+			freeGlyph(glyph);
+	}
+	for (std::map<FT_UInt, gAtlasGlyph *>::iterator i = m_large_glyphs.begin(); i != m_large_glyphs.end(); ++i)
+		freeGlyph(i->second);
+	atlas_bytes.fetch_sub(m_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void gGlyphAtlas::freeGlyph(gAtlasGlyph *glyph)
+{
+	delete [] glyph->image.data;
+	delete [] glyph->border.data;
+	delete glyph;
+}
+
+gAtlasGlyph *gGlyphAtlas::addGlyph(FT_UInt index)
+{
+	if (index >= 0x10000)
+	{
+		eSingleLocker l(m_lock);
+		std::map<FT_UInt, gAtlasGlyph *>::iterator i = m_large_glyphs.find(index);
+		if (i != m_large_glyphs.end())
+			return i->second;
+	}
+	gAtlasGlyph *glyph = new gAtlasGlyph();
+	m_renderer->loadGlyph(&m_desc, index, m_border, *glyph);
+	gAtlasGlyph *stored;
+	if (index < 0x10000)
+		stored = m_glyphs.add(index, glyph);
+	else
+	{
+		eSingleLocker l(m_lock);
+		stored = m_large_glyphs.insert(std::make_pair(index, glyph)).first->second;
+	}
+	/* another thread rasterized it at the same time */
+	if (stored != glyph)
+		freeGlyph(glyph);
+	else
+	{
+		size_t bytes = (glyph->image.data ? glyph->image.width * glyph->image.height : 0) +
+			(glyph->border.data ? glyph->border.width * glyph->border.height : 0);
+		m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		atlas_bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+	return stored;
+}
+
+FT_UInt gGlyphAtlas::addChar(unsigned long chr)
+{
+	if (chr >= 0x10000)
+	{
+		eSingleLocker l(m_lock);
+		std::map<unsigned long, FT_UInt>::iterator i = m_large_chars.find(chr);
+		if (i != m_large_chars.end())
+			return i->second;
+	}
+	FT_UInt index = m_renderer->loadCharIndex(&m_desc, chr);
+	if (chr < 0x10000)
+		m_chars.add(chr, index + 1);
+	else
+	{
+		eSingleLocker l(m_lock);
+		m_large_chars[chr] = index;
+	}
+	return index;
+}
+
+int gGlyphAtlas::kerning(FT_UInt left, FT_UInt right)
+{
+	if (left >= 0x10000 || right >= 0x10000)
+		return m_renderer->loadKerning(&m_desc, left, right);
+	uint32_t key = (left << 16) | right;
+	unsigned int slot = (key * 2654435761U) >> 20;
+	for (int probe = 0; probe < KERNING_PROBES; ++probe, slot = (slot + 1) & (KERNING_SLOTS - 1))
+	{
+		uint64_t entry = m_kerning[slot].load(std::memory_order_acquire);
+		if (!entry)
+		{
+			int kerning = m_renderer->loadKerning(&m_desc, left, right);
+			/* when this fails some other pair took the slot, and we just don't cache this one */
+			m_kerning[slot].compare_exchange_strong(entry, ((uint64_t)key << 32) | 0x10000 | (uint16_t)kerning, std::memory_order_acq_rel);
+			return kerning;
+		}
+		if ((uint32_t)(entry >> 32) == key)
+			return (int16_t)(entry & 0xFFFF);
+	}
+	return m_renderer->loadKerning(&m_desc, left, right);
+}
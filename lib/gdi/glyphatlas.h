@@ -0,0 +1,165 @@
+#ifndef __lib_gdi_glyphatlas_h
+#define __lib_gdi_glyphatlas_h
+
+#include <atomic>
+#include <map>
+#include <stdint.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_CACHE_H
+#include <lib/base/elock.h>
+
+/*
+ * The glyphs of one face at one size and border width, rasterized once
+ * into 8 bit coverage masks which don't depend on the colour they are
+ * drawn in, together with their metrics, the character map and the
+ * kerning pairs in use.
+ *
+ * Entries are added on first use, with FreeType called under the global
+ * font lock, and never change after that. Text layout and drawing only
+ * read entries, so they don't take any lock.
+ *
+ * get() returns a referenced atlas, text paragraphs keep it until they
+ * are cleared because their glyphs point into it. When all atlases take
+ * more than ATLAS_MAX_BYTES, the least recently used ones without users
+ * are freed.
+ */
+
+class fontRenderClass;
+
+/* one byte of coverage per pixel, rows are width bytes apart */
+struct gGlyphMask
+{
+	int left, top;
+	int width, height;
+	uint8_t *data;
+};
+
+struct gAtlasGlyph
+{
+	bool valid;
+	FT_Pos advance; /* 16.16 */
+	gGlyphMask image;
+	gGlyphMask border; /* only in atlases with a border */
+};
+
+/* in 26.6, like FreeType's size metrics */
+struct gFontMetrics
+{
+	FT_Pos height, ascender;
+	FT_Pos ymax, ymin; /* of the face's bbox, scaled */
+	bool kerning;
+
+	FT_Pos lineHeight() const
+	{
+		/* some fonts don't have height filled in. Estimate it based on the bbox dimensions. */
+		/* Usually, 'height' is less than the complete boundingbox height, so we use only yMax, to avoid getting a much too large line spacing */
+		return height ? height : ymax;
+	}
+};
+
+/*
+ * 64K slots in pages of 256, the pages are allocated on first use.
+ * A slot is written once, the first value stored wins.
+ */
+template <class T>
+class gAtlasTable
+{
+	std::atomic<std::atomic<T> *> m_pages[256];
+	gAtlasTable(const gAtlasTable &);
+public:
+	gAtlasTable()
+	{
+		for (int i = 0; i < 256; ++i)
+			m_pages[i].store(NULL, std::memory_order_relaxed);
+	}
+	~gAtlasTable()
+	{
+		for (int i = 0; i < 256; ++i)
+			delete [] m_pages[i].load(std::memory_order_relaxed);
+	}
+	T get(unsigned int index) const
+	{
+		std::atomic<T> *page = m_pages[index >> 8].load(std::memory_order_acquire);
+		return page ? page[index & 0xFF].load(std::memory_order_acquire) : T();
+	}
+	/* returns the value in the slot, which is not value when another thread was faster */
+	T add(unsigned int index, T value)
+	{
+		std::atomic<T> *page = m_pages[index >> 8].load(std::memory_order_acquire);
+		if (!page)
+		{
+			std::atomic<T> *fresh = new std::atomic<T>[256]();
+			if (m_pages[index >> 8].compare_exchange_strong(page, fresh, std::memory_order_acq_rel))
+				page = fresh;
+			else
+				delete [] fresh;
+		}
+		T expected = T();
+		if (page[index & 0xFF].compare_exchange_strong(expected, value, std::memory_order_acq_rel))
+			return value;
+		return expected;
+	}
+};
+
+class gGlyphAtlas
+{
+	enum { KERNING_SLOTS = 4096, KERNING_PROBES = 8 };
+
+	fontRenderClass *m_renderer;
+	FTC_ImageTypeRec m_desc;
+	int m_border;
+	gFontMetrics m_metrics;
+	gAtlasTable<gAtlasGlyph *> m_glyphs;
+	gAtlasTable<uint32_t> m_chars; /* glyph index + 1 */
+	/* (left << 16 | right) << 32 | 0x10000 | kerning */
+	std::atomic<uint64_t> m_kerning[KERNING_SLOTS];
+
+	/* glyph indices and characters beyond 16 bit, rare enough for a lock */
+	eSingleLock m_lock;
+	std::map<FT_UInt, gAtlasGlyph *> m_large_glyphs;
+	std::map<unsigned long, FT_UInt> m_large_chars;
+
+	/*
+	 * taken in get() under the atlas list lock, dropped by release() without
+	 * it. evict() holds the lock, so an atlas it sees without users can't
+	 * gain one before it is freed, and the release ordering makes the last
+	 * user's reads happen before that.
+	 */
+	std::atomic<int> m_users;
+	unsigned int m_last_used;
+	/* of the glyph masks */
+	std::atomic<size_t> m_bytes;
+
+	gGlyphAtlas(fontRenderClass *renderer, const FTC_ImageTypeRec &desc, int border);
+	gGlyphAtlas(const gGlyphAtlas &);
+	gAtlasGlyph *addGlyph(FT_UInt index);
+	FT_UInt addChar(unsigned long chr);
+	static void freeGlyph(gAtlasGlyph *glyph);
+	static void evict(gGlyphAtlas *keep);
+public:
+	~gGlyphAtlas();
+
+	/* the atlas of a face, NULL when the face can't be loaded. call release() when done */
+	static gGlyphAtlas *get(fontRenderClass *renderer, const FTC_ImageTypeRec &desc, int border);
+	void release() { m_users.fetch_sub(1, std::memory_order_release); }
+
+	const gFontMetrics &metrics() const { return m_metrics; }
+
+	/* never NULL, but check valid */
+	const gAtlasGlyph *glyph(FT_UInt index)
+	{
+		gAtlasGlyph *glyph = index < 0x10000 ? m_glyphs.get(index) : NULL;
+		return glyph ? glyph : addGlyph(index);
+	}
+	/* 0 when the face doesn't have the character */
+	FT_UInt charIndex(unsigned long chr)
+	{
+		uint32_t index = chr < 0x10000 ? m_chars.get(chr) : 0;
+		return index ? index - 1 : addChar(chr);
+	}
+	/* in pixels */
+	int kerning(FT_UInt left, FT_UInt right);
+};
+
+#endif
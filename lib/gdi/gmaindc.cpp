@@ -26,3 +26,8 @@ gMainDC::~gMainDC()
 	m_instance = 0;
 }
 
+PyObject *gMainDC::getDamageStatistics()
+{
+	Py_RETURN_NONE;
+}
+
@@ -16,6 +16,10 @@ protected:
 	virtual ~gMainDC();
 public:
 	virtual void setResolution(int xres, int yres, int bpp = 32) = 0;
+		/* outline the areas which are copied to the screen */
+	virtual void setShowDamage(int show) { }
+		/* pixels copied to the screen per frame, None when the DC doesn't count them */
+	virtual PyObject *getDamageStatistics();
 #ifndef SWIG
 	static int getInstance(ePtr<gMainDC> &ptr) { if (!m_instance) return -1; ptr = m_instance; return 0; }
 #endif
@@ -4,7 +4,9 @@
 #include <lib/gdi/region.h>
 #include <lib/gdi/accel.h>
 #include <lib/gdi/color.h>
+#include <lib/gdi/blitter.h>
 #include <byteswap.h>
+#include <vector>
 
 #ifdef __GLIBC__
 #ifndef BYTE_ORDER
@@ -374,25 +376,6 @@ void gPixmap::fill(const gRegion &region, const gRGB &color)
 	}
 }
 
-static inline void blit_8i_to_32(uint32_t *dst, const uint8_t *src, const uint32_t *pal, int width)
-{
-	while (width--)
-		*dst++=pal[*src++];
-}
-
-static inline void blit_8i_to_32_at(uint32_t *dst, const uint8_t *src, const uint32_t *pal, int width)
-{
-	while (width--)
-	{
-		if (!(pal[*src]&0x80000000))
-		{
-			src++;
-			dst++;
-		} else
-			*dst++=pal[*src++];
-	}
-}
-
 static inline void blit_8i_to_16(uint16_t *dst, const uint8_t *src, const uint32_t *pal, int width)
 {
 	while (width--)
@@ -412,15 +395,6 @@ static inline void blit_8i_to_16_at(uint16_t *dst, const uint8_t *src, const uin
 	}
 }
 
-static void blit_8i_to_32_ab(gRGB *dst, const uint8_t *src, const gRGB *pal, int width)
-{
-	while (width--)
-	{
-		dst->alpha_blend(pal[*src++]);
-		++dst;
-	}
-}
-
 static void convert_palette(uint32_t* pal, const gPalette& clut)
 {
 	int i = 0;
@@ -554,6 +528,7 @@ void gPixmap::blit(const gPixmap &src, const eRect &_pos, const gRegion &clip, i
 	bool accel = (surface->data_phys && src.surface->data_phys);
 	bool accumulate = accel && (gAccel::getInstance()->accumulate() >= 0);
 	int accelerationthreshold = GFX_SURFACE_BLIT_ACCELERATION_THRESHOLD;
+	const gBlitKernels &kernels = gBlitKernels::get();
 //	eDebug("[gPixmap] blit: -> %d,%d+%d,%d -> %d,%d+%d,%d, flags=0x%x, accel=%d",
 //		_pos.x(), _pos.y(), _pos.width(), _pos.height(),
 //		clip.extends.x(), clip.extends.y(), clip.extends.width(), clip.extends.height(),
@@ -751,49 +726,33 @@ void gPixmap::blit(const gPixmap &src, const eRect &_pos, const gRegion &clip, i
 				const int height = area.height();
 				const int src_height = srcarea.height();
 				const int src_width = srcarea.width();
-				if (flag & blitAlphaTest)
+				std::vector<int> map(width);
+				gBlitKernels::buildScaleMap(&map[0], width, src_width);
+				std::vector<uint32_t> row(width);
+				int last_src_y = -1;
+				for (int y = 0; y < height; ++y)
 				{
-					for (int y = 0; y < height; ++y)
+					const int src_y = (y * src_height) / height;
+					uint32_t *dst = (uint32_t*)dstptr;
+					if (src_y == last_src_y && !(flag & (blitAlphaTest | blitAlphaBlend)))
 					{
-						const uint8_t *src_row_ptr = srcptr + (((y * src_height) / height) * src_stride);
-						uint32_t *dst = (uint32_t*)dstptr;
-						for (int x = 0; x < width; ++x)
-						{
-							uint32_t pixel = pal[src_row_ptr[(x *src_width) / width]];
-							if (pixel & 0x80000000)
-								*dst = pixel;
-							++dst;
-						}
-						dstptr += surface->stride;
+						/* same source row as the one above, when enlarging */
+						memcpy(dst, dstptr - surface->stride, width * sizeof(uint32_t));
 					}
-				}
-				else if (flag & blitAlphaBlend)
-				{
-					for (int y = 0; y < height; ++y)
-					{
-						const uint8_t *src_row_ptr = srcptr + (((y * src_height) / height) * src_stride);
-						gRGB *dst = (gRGB*)dstptr;
-						for (int x = 0; x < width; ++x)
-						{
-							dst->alpha_blend(pal[src_row_ptr[(x * src_width) / width]]);
-							++dst;
-						}
-						dstptr += surface->stride;
-					}
-				}
-				else
-				{
-					for (int y = 0; y < height; ++y)
+					else
 					{
-						const uint8_t *src_row_ptr = srcptr + (((y * src_height) / height) * src_stride);
-						uint32_t *dst = (uint32_t*)dstptr;
+						const uint8_t *src_row_ptr = srcptr + src_y * src_stride;
 						for (int x = 0; x < width; ++x)
-						{
-							*dst = pal[src_row_ptr[(x * src_width) / width]];
-							++dst;
-						}
-						dstptr += surface->stride;
+							row[x] = pal[src_row_ptr[map[x]]];
+						if (flag & blitAlphaTest)
+							kernels.alphatest(dst, &row[0], width, 0x80000000);
+						else if (flag & blitAlphaBlend)
+							kernels.blend(dst, &row[0], width);
+						else
+							memcpy(dst, &row[0], width * sizeof(uint32_t));
 					}
+					last_src_y = src_y;
+					dstptr += surface->stride;
 				}
 			}
 			else if ((surface->bpp == 32) && (src.surface->bpp == 32))
@@ -805,49 +764,36 @@ void gPixmap::blit(const gPixmap &src, const eRect &_pos, const gRegion &clip, i
 				const int height = area.height();
 				const int src_height = srcarea.height();
 				const int src_width = srcarea.width();
-				if (flag & blitAlphaTest)
+				std::vector<int> map(width);
+				gBlitKernels::buildScaleMap(&map[0], width, src_width);
+				std::vector<uint32_t> row;
+				if (flag & (blitAlphaTest | blitAlphaBlend))
+					row.resize(width);
+				int last_src_y = -1;
+				for (int y = 0; y < height; ++y)
 				{
-					for (int y = 0; y < height; ++y)
+					const int src_y = (y * src_height) / height;
+					const uint32_t *src_row_ptr = (const uint32_t*)(srcptr + src_y * src_stride);
+					uint32_t *dst = (uint32_t*)dstptr;
+					if (flag & blitAlphaTest)
 					{
-						const uint32_t *src_row_ptr = (uint32_t*)(srcptr + (((y * src_height) / height) * src_stride));
-						uint32_t *dst = (uint32_t*)dstptr;
-						for (int x = 0; x < width; ++x)
-						{
-							uint32_t pixel = src_row_ptr[(x *src_width) / width];
-							if (pixel & 0x80000000)
-								*dst = pixel;
-							++dst;
-						}
-						dstptr += surface->stride;
+						kernels.scale(&row[0], src_row_ptr, &map[0], width);
+						kernels.alphatest(dst, &row[0], width, 0x80000000);
 					}
-				}
-				else if (flag & blitAlphaBlend)
-				{
-					for (int y = 0; y < height; ++y)
+					else if (flag & blitAlphaBlend)
 					{
-						const gRGB *src_row_ptr = (gRGB *)(srcptr + (((y * src_height) / height) * src_stride));
-						gRGB *dst = (gRGB*)dstptr;
-						for (int x = 0; x < width; ++x)
-						{
-							dst->alpha_blend(src_row_ptr[(x * src_width) / width]);
-							++dst;
-						}
-						dstptr += surface->stride;
+						kernels.scale(&row[0], src_row_ptr, &map[0], width);
+						kernels.blend(dst, &row[0], width);
 					}
-				}
-				else
-				{
-					for (int y = 0; y < height; ++y)
+					else if (src_y == last_src_y)
 					{
-						const uint32_t *src_row_ptr = (uint32_t*)(srcptr + (((y * src_height) / height) * src_stride));
-						uint32_t *dst = (uint32_t*)dstptr;
-						for (int x = 0; x < width; ++x)
-						{
-							*dst = src_row_ptr[(x * src_width) / width];
-							++dst;
-						}
-						dstptr += surface->stride;
+						/* same source row as the one above, when enlarging */
+						memcpy(dst, dstptr - surface->stride, width * sizeof(uint32_t));
 					}
+					else
+						kernels.scale(dst, src_row_ptr, &map[0], width);
+					last_src_y = src_y;
+					dstptr += surface->stride;
 				}
 			}
 			else
@@ -920,31 +866,9 @@ void gPixmap::blit(const gPixmap &src, const eRect &_pos, const gRegion &clip, i
 			for (int y = area.height(); y != 0; --y)
 			{
 				if (flag & blitAlphaTest)
-				{
-					int width = area.width();
-					uint32_t *src = srcptr;
-					uint32_t *dst = dstptr;
-
-					while (width--)
-					{
-						if (!((*src)&0xFF000000))
-						{
-							src++;
-							dst++;
-						} else
-							*dst++=*src++;
-					}
-				} else if (flag & blitAlphaBlend)
-				{
-					int width = area.width();
-					gRGB *src = (gRGB*)srcptr;
-					gRGB *dst = (gRGB*)dstptr;
-					while (width--)
-					{
-						dst->alpha_blend(*src++);
-						++dst;
-					}
-				}
+					kernels.alphatest(dstptr, srcptr, area.width(), 0xFF000000);
+				else if (flag & blitAlphaBlend)
+					kernels.blend(dstptr, srcptr, area.width());
 				else
 					memcpy(dstptr, srcptr, area.width()*surface->bypp);
 				srcptr = (uint32_t*)((uint8_t*)srcptr + src.surface->stride);
@@ -961,14 +885,23 @@ void gPixmap::blit(const gPixmap &src, const eRect &_pos, const gRegion &clip, i
 			srcptr+=srcarea.left()*src.surface->bypp+srcarea.top()*src.surface->stride;
 			dstptr+=area.left()*surface->bypp+area.top()*surface->stride;
 			const int width=area.width();
+			std::vector<uint32_t> row;
+			if (flag & (blitAlphaTest | blitAlphaBlend))
+				row.resize(width);
 			for (int y = area.height(); y != 0; --y)
 			{
 				if (flag & blitAlphaTest)
-					blit_8i_to_32_at((uint32_t*)dstptr, srcptr, pal, width);
+				{
+					kernels.expand(&row[0], srcptr, pal, width);
+					kernels.alphatest((uint32_t*)dstptr, &row[0], width, 0x80000000);
+				}
 				else if (flag & blitAlphaBlend)
-					blit_8i_to_32_ab((gRGB*)dstptr, srcptr, (const gRGB*)pal, width);
+				{
+					kernels.expand(&row[0], srcptr, pal, width);
+					kernels.blend((uint32_t*)dstptr, &row[0], width);
+				}
 				else
-					blit_8i_to_32((uint32_t*)dstptr, srcptr, pal, width);
+					kernels.expand((uint32_t*)dstptr, srcptr, pal, width);
 				srcptr += src.surface->stride;
 				dstptr += surface->stride;
 			}
@@ -1,10 +1,16 @@
 #include <unistd.h>
+#include <errno.h>
+#include <sched.h>
 #include <fstream>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #include <lib/gdi/grc.h>
 #include <lib/gdi/font.h>
+#include <lib/gdi/textparacache.h>
 #include <lib/base/init.h>
 #include <lib/base/init_num.h>
 #include <lib/base/nconfig.h>
+#include <lib/python/python_helpers.h>
 
 #ifndef SYNC_PAINT
 void *gRC::thread_wrapper(void *ptr)
@@ -15,7 +21,35 @@ void *gRC::thread_wrapper(void *ptr)
 
 gRC *gRC::instance = 0;
 
-gRC::gRC() : rp(0), wp(0)
+static long long monotonic_us()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+#ifndef SYNC_PAINT
+/* returns 0 when woken, ETIMEDOUT, or EAGAIN when word didn't hold value anymore */
+static int futex_wait(std::atomic<int> &word, int value, int timeout_ms)
+{
+	struct timespec timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_nsec = (timeout_ms % 1000) * 1000 * 1000;
+	if (syscall(SYS_futex, reinterpret_cast<int *>(&word), FUTEX_WAIT_PRIVATE, value, &timeout, NULL, 0) < 0)
+		return errno;
+	return 0;
+}
+
+static void futex_wake(std::atomic<int> &word)
+{
+	syscall(SYS_futex, reinterpret_cast<int *>(&word), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+#endif
+
+gRC::gRC() : rp(0), wp(0), m_write(0), m_wakeup(0), m_consumer_sleeping(0), m_producer_waiting(0),
+			 m_main_thread(pthread_self()), m_foreign_producers(0), m_main_submitting(0),
+			 m_max_depth(0), m_stalls(0), m_stall_us(0), m_opcodes(0), m_batches(0),
+			 m_frame_start(0), m_frames(0), m_frame_us(0), m_max_frame_us(0), m_total_frame_us(0)
 #ifdef SYNC_PAINT
 			 ,
 			 m_notify_pump(eApp, 0, "gRC")
@@ -30,8 +64,6 @@ gRC::gRC() : rp(0), wp(0)
 	instance = this;
 	CONNECT(m_notify_pump.recv_msg, gRC::recv_notify);
 #ifndef SYNC_PAINT
-	pthread_mutex_init(&mutex, 0);
-	pthread_cond_init(&cond, 0);
 	pthread_attr_t attr;
 	pthread_attr_init(&attr);
 	if (pthread_attr_setstacksize(&attr, 2048 * 1024) != 0)
@@ -60,44 +92,152 @@ gRC::~gRC()
 #endif
 }
 
+int gRC::beginProducing()
+{
+	if (!pthread_equal(pthread_self(), m_main_thread))
+	{
+		/* either the main thread sees us and takes the lock, or we see it producing and wait */
+		m_foreign_producers.fetch_add(1, std::memory_order_seq_cst);
+		m_producer_lock.lock();
+		while (m_main_submitting.load(std::memory_order_seq_cst))
+			sched_yield();
+		return producerForeign;
+	}
+	m_main_submitting.store(1, std::memory_order_seq_cst);
+	if (m_foreign_producers.load(std::memory_order_seq_cst))
+	{
+		m_main_submitting.store(0, std::memory_order_release);
+		m_producer_lock.lock();
+		return producerLocked;
+	}
+	return producerMain;
+}
+
+void gRC::endProducing(int how)
+{
+	switch (how)
+	{
+	case producerForeign:
+		m_producer_lock.unlock();
+		m_foreign_producers.fetch_sub(1, std::memory_order_release);
+		break;
+	case producerLocked:
+		m_producer_lock.unlock();
+		break;
+	default:
+		m_main_submitting.store(0, std::memory_order_release);
+		break;
+	}
+}
+
 void gRC::submit(const gOpcode &o)
 {
-	while (1)
+	int how = beginProducing();
+	push(o);
+	endProducing(how);
+}
+
+void gRC::endBatch()
+{
+	int how = beginProducing();
+	publish(false);
+	endProducing(how);
+}
+
+void gRC::push(const gOpcode &o)
+{
+	int next = m_write + 1;
+	if (next == MAXSIZE)
+		next = 0;
+	if (next == rp.load(std::memory_order_acquire))
+		waitForSpace();
+	queue[m_write] = o;
+	m_write = next;
+	++m_opcodes;
+	if (o.opcode == gOpcode::flush || o.opcode == gOpcode::shutdown || o.opcode == gOpcode::notify)
+		publish(true);
+	else if (((m_write - wp.load(std::memory_order_relaxed)) & (MAXSIZE - 1)) >= PUBLISH_BATCH)
+		publish(false);
+}
+
+void gRC::publish(bool wakeup)
+{
+	if (m_write != wp.load(std::memory_order_relaxed))
 	{
+		int depth = (m_write - rp.load(std::memory_order_relaxed)) & (MAXSIZE - 1);
+		if (depth > m_max_depth)
+			m_max_depth = depth;
+		++m_batches;
+		wp.store(m_write, std::memory_order_seq_cst);
+	}
+	if (wakeup)
 #ifndef SYNC_PAINT
-		pthread_mutex_lock(&mutex);
+		wakeConsumer();
+#else
+		thread(); // paint
 #endif
-		int tmp = wp + 1;
-		if (tmp == MAXSIZE)
-			tmp = 0;
-		if (tmp == rp)
-		{
+}
+
+void gRC::waitForSpace()
+{
+	/* the render thread has to see everything queued so far to make room */
+	publish(true);
 #ifndef SYNC_PAINT
-			pthread_cond_signal(&cond); // wakeup gdi thread
-			pthread_mutex_unlock(&mutex);
-#else
-			thread();
+	int next = m_write + 1;
+	if (next == MAXSIZE)
+		next = 0;
+	long long start = monotonic_us();
+	while (1)
+	{
+		/* pairs with the check after the read index is stored in thread() */
+		m_producer_waiting.store(1, std::memory_order_seq_cst);
+		int read = rp.load(std::memory_order_seq_cst);
+		if (read != next)
+			break;
+		futex_wait(rp, read, 10);
+	}
+	m_producer_waiting.store(0, std::memory_order_relaxed);
+	++m_stalls;
+	m_stall_us += monotonic_us() - start;
+	// eDebug("[gRC] Render buffer full.");
 #endif
-			// eDebug("[gRC] Render buffer full.");
-			// fflush(stdout);
-			usleep(1000); // wait 1 msec
-			continue;
-		}
-		int free = rp - wp;
-		if (free <= 0)
-			free += MAXSIZE;
-		queue[wp++] = o;
-		if (wp == MAXSIZE)
-			wp = 0;
-		if (o.opcode == gOpcode::flush || o.opcode == gOpcode::shutdown || o.opcode == gOpcode::notify)
+}
+
 #ifndef SYNC_PAINT
-			pthread_cond_signal(&cond); // wakeup gdi thread
-		pthread_mutex_unlock(&mutex);
-#else
-			thread(); // paint
+void gRC::wakeConsumer()
+{
+	/* pairs with waitForWork: either it sees the new write index, or we see it sleeping */
+	m_wakeup.fetch_add(1, std::memory_order_seq_cst);
+	if (m_consumer_sleeping.load(std::memory_order_seq_cst))
+		futex_wake(m_wakeup);
+}
+
+int gRC::waitForWork(int timeout_ms)
+{
+	int res = 0;
+	long long start = m_frame_start ? monotonic_us() : 0;
+	m_consumer_sleeping.store(1, std::memory_order_seq_cst);
+	int wakeup = m_wakeup.load(std::memory_order_seq_cst);
+	if (rp.load(std::memory_order_relaxed) == wp.load(std::memory_order_seq_cst))
+		res = futex_wait(m_wakeup, wakeup, timeout_ms);
+	m_consumer_sleeping.store(0, std::memory_order_relaxed);
+	/* waiting for the main thread doesn't count as render time */
+	if (start)
+		m_frame_start += monotonic_us() - start;
+	return res;
+}
 #endif
-		break;
-	}
+
+void gRC::frameDone()
+{
+	int us = monotonic_us() - m_frame_start;
+	m_frame_start = 0;
+	eSingleLocker l(m_stats_lock);
+	++m_frames;
+	m_frame_us = us;
+	if (us > m_max_frame_us)
+		m_max_frame_us = us;
+	m_total_frame_us += us;
 }
 
 void *gRC::thread()
@@ -110,19 +250,22 @@ void *gRC::thread()
 	while (rp != wp)
 	{
 #endif
-#ifndef SYNC_PAINT
-		pthread_mutex_lock(&mutex);
-#endif
-		if (rp != wp)
+		int read = rp.load(std::memory_order_relaxed);
+		if (read != wp.load(std::memory_order_acquire))
 		{
 			/* make sure the spinner is not displayed when something is painted */
 			disableSpinner();
 
-			gOpcode o(queue[rp++]);
-			if (rp == MAXSIZE)
-				rp = 0;
+			gOpcode o(queue[read++]);
+			if (read == MAXSIZE)
+				read = 0;
+			rp.store(read, std::memory_order_seq_cst);
 #ifndef SYNC_PAINT
-			pthread_mutex_unlock(&mutex);
+			if (m_producer_waiting.load(std::memory_order_seq_cst))
+			{
+				m_producer_waiting.store(0, std::memory_order_relaxed);
+				futex_wake(rp);
+			}
 #endif
 			if (o.opcode == gOpcode::shutdown)
 				break;
@@ -135,9 +278,13 @@ void *gRC::thread()
 			}
 			else if (o.dc)
 			{
+				if (!m_frame_start && o.opcode != gOpcode::flush)
+					m_frame_start = monotonic_us();
 				o.dc->exec(&o);
 				// o.dc is a gDC* filled with grabref... so we must release it here
 				o.dc->Release();
+				if (o.opcode == gOpcode::flush && m_frame_start)
+					frameDone();
 			}
 		}
 		else
@@ -148,30 +295,13 @@ void *gRC::thread()
 				m_notify_pump.send(1);
 			}
 #ifndef SYNC_PAINT
-			while (rp == wp)
+			while (rp.load(std::memory_order_relaxed) == wp.load(std::memory_order_acquire))
 			{
-
 				/* when the main thread is non-idle for a too long time without any display output,
 				   we want to display a spinner. */
-				struct timespec timeout;
-				clock_gettime(CLOCK_REALTIME, &timeout);
-
-				if (m_spinner_enabled)
-				{
-					timeout.tv_nsec += 100 * 1000 * 1000;
-					/* yes, this is required. */
-					if (timeout.tv_nsec > 1000 * 1000 * 1000)
-					{
-						timeout.tv_nsec -= 1000 * 1000 * 1000;
-						timeout.tv_sec++;
-					}
-				}
-				else
-					timeout.tv_sec += 2;
-
 				int idle = 1;
 
-				if (pthread_cond_timedwait(&cond, &mutex, &timeout) == ETIMEDOUT)
+				if (waitForWork(m_spinner_enabled ? 100 : 2000) == ETIMEDOUT)
 				{
 					if (eApp && !eApp->isIdle())
 					{
@@ -196,7 +326,6 @@ void *gRC::thread()
 				else
 					disableSpinner();
 			}
-			pthread_mutex_unlock(&mutex);
 #endif
 		}
 	}
@@ -206,6 +335,30 @@ void *gRC::thread()
 	return 0;
 }
 
+PyObject *gRC::getStatistics()
+{
+	ePyObject dict = PyDict_New();
+	/* the producer counters are only stable while nothing else can queue */
+	int how = beginProducing();
+	int depth = (m_write - rp.load(std::memory_order_relaxed)) & (MAXSIZE - 1);
+	int max_depth = m_max_depth, stalls = m_stalls;
+	long long opcodes = m_opcodes, batches = m_batches, stall_us = m_stall_us;
+	endProducing(how);
+	PutToDict(dict, "queue_size", MAXSIZE - 1);
+	PutToDict(dict, "queue_depth", depth);
+	PutToDict(dict, "queue_max_depth", max_depth);
+	PutToDict(dict, "opcodes", opcodes);
+	PutToDict(dict, "batches", batches);
+	PutToDict(dict, "stalls", stalls);
+	PutToDict(dict, "stall_us", stall_us);
+	eSingleLocker l(m_stats_lock);
+	PutToDict(dict, "frames", m_frames);
+	PutToDict(dict, "frame_us", m_frame_us);
+	PutToDict(dict, "max_frame_us", m_max_frame_us);
+	PutToDict(dict, "avg_frame_us", m_frames ? (long)(m_total_frame_us / m_frames) : 0L);
+	return dict;
+}
+
 void gRC::recv_notify(const int &i)
 {
 	notify();
@@ -636,10 +789,24 @@ void gPainter::flush()
 	m_rc->submit(o);
 }
 
+void gPainter::damage(const gRegion &region)
+{
+	if (m_dc->islocked())
+		return;
+	gOpcode o;
+	o.opcode = gOpcode::damage;
+	o.dc = m_dc.grabRef();
+	o.parm.damage = new gOpcode::para::pdamage;
+	o.parm.damage->region = region;
+	m_rc->submit(o);
+}
+
 void gPainter::end()
 {
 	if (m_dc->islocked())
 		return;
+	/* hand what this painter queued to the render thread in one go */
+	m_rc->endBatch();
 }
 
 void gPainter::sendShow(ePoint point, eSize size)
@@ -716,7 +883,7 @@ void gDC::exec(const gOpcode *o)
 		break;
 	case gOpcode::renderText:
 	{
-		ePtr<eTextPara> para = new eTextPara(o->parm.renderText->area);
+		ePtr<eTextPara> para;
 		int flags = o->parm.renderText->flags;
 		int border = o->parm.renderText->border;
 		int markedpos = o->parm.renderText->markedpos;
@@ -724,53 +891,66 @@ void gDC::exec(const gOpcode *o)
 		if (markedpos != -1)
 			border = 0;
 		ASSERT(m_current_font);
-		para->setFont(m_current_font);
-
-		if (flags & gPainter::RT_ELLIPSIS)
+		/* texts without cursor and scrolling are laid out once, and then drawn from the cache */
+		bool cacheable = markedpos == -1 && !o->parm.renderText->offset && o->parm.renderText->text;
+		if (cacheable && eTextParaCache::getInstance().get(para, o->parm.renderText->text, *m_current_font, o->parm.renderText->area, flags, border))
+			free(o->parm.renderText->text);
+		else
 		{
-			if (flags & gPainter::RT_WRAP) // Remove wrap
-				flags -= gPainter::RT_WRAP;
-			std::string text = o->parm.renderText->text;
-			text += u8"…";
-
-			eTextPara testpara(o->parm.renderText->area);
-			testpara.setFont(m_current_font);
-			testpara.renderString(text.c_str(), 0);
-			int bw = testpara.getBoundBox().width();
-			int w = o->parm.renderText->area.width();
-			if (bw > w) // Available space not fit
+			std::string cache_text;
+			if (cacheable)
+				cache_text = o->parm.renderText->text;
+			para = new eTextPara(o->parm.renderText->area);
+			para->setFont(m_current_font);
+
+			if (flags & gPainter::RT_ELLIPSIS)
 			{
-				float pers = (float)w / (float)bw;
-				text = o->parm.renderText->text;
-				int ns = text.size() * pers;
-				if ((int)text.size() > ns)
+				if (flags & gPainter::RT_WRAP) // Remove wrap
+					flags -= gPainter::RT_WRAP;
+				std::string text = o->parm.renderText->text;
+				text += u8"…";
+
+				eTextPara testpara(o->parm.renderText->area);
+				testpara.setFont(m_current_font);
+				testpara.renderString(text.c_str(), 0);
+				int bw = testpara.getBoundBox().width();
+				int w = o->parm.renderText->area.width();
+				if (bw > w) // Available space not fit
 				{
-					text.resize(ns);
-					text += u8"…";
+					float pers = (float)w / (float)bw;
+					text = o->parm.renderText->text;
+					int ns = text.size() * pers;
+					if ((int)text.size() > ns)
+					{
+						text.resize(ns);
+						text += u8"…";
+					}
+					if (o->parm.renderText->text)
+						free(o->parm.renderText->text);
+					o->parm.renderText->text = strdup(text.c_str());
 				}
-				if (o->parm.renderText->text)
-					free(o->parm.renderText->text);
-				o->parm.renderText->text = strdup(text.c_str());
 			}
+			para->renderString(o->parm.renderText->text, (flags & gPainter::RT_WRAP) ? RS_WRAP : 0, border, markedpos);
+
+			if (o->parm.renderText->text)
+				free(o->parm.renderText->text);
+			if (o->parm.renderText->offset)
+				para->setTextOffset(*o->parm.renderText->offset);
+			if (flags & gPainter::RT_HALIGN_LEFT)
+				para->realign(eTextPara::dirLeft, markedpos, scrollpos);
+			else if (flags & gPainter::RT_HALIGN_RIGHT)
+				para->realign(eTextPara::dirRight, markedpos, scrollpos);
+			else if (flags & gPainter::RT_HALIGN_CENTER)
+				para->realign((flags & gPainter::RT_WRAP) ? eTextPara::dirCenter : eTextPara::dirCenterIfFits, markedpos, scrollpos);
+			else if (flags & gPainter::RT_HALIGN_BLOCK)
+				para->realign(eTextPara::dirBlock, markedpos, scrollpos);
+			else
+				para->realign(eTextPara::dirBidi, markedpos, scrollpos);
+			if (o->parm.renderText->offset)
+				*o->parm.renderText->offset = para->getTextOffset();
+			if (cacheable)
+				eTextParaCache::getInstance().put(para, cache_text.c_str(), *m_current_font, o->parm.renderText->area, o->parm.renderText->flags, border);
 		}
-		para->renderString(o->parm.renderText->text, (flags & gPainter::RT_WRAP) ? RS_WRAP : 0, border, markedpos);
-
-		if (o->parm.renderText->text)
-			free(o->parm.renderText->text);
-		if (o->parm.renderText->offset)
-			para->setTextOffset(*o->parm.renderText->offset);
-		if (flags & gPainter::RT_HALIGN_LEFT)
-			para->realign(eTextPara::dirLeft, markedpos, scrollpos);
-		else if (flags & gPainter::RT_HALIGN_RIGHT)
-			para->realign(eTextPara::dirRight, markedpos, scrollpos);
-		else if (flags & gPainter::RT_HALIGN_CENTER)
-			para->realign((flags & gPainter::RT_WRAP) ? eTextPara::dirCenter : eTextPara::dirCenterIfFits, markedpos, scrollpos);
-		else if (flags & gPainter::RT_HALIGN_BLOCK)
-			para->realign(eTextPara::dirBlock, markedpos, scrollpos);
-		else
-			para->realign(eTextPara::dirBidi, markedpos, scrollpos);
-		if (o->parm.renderText->offset)
-			*o->parm.renderText->offset = para->getTextOffset();
 
 		ePoint offset = m_current_offset;
 
@@ -985,6 +1165,9 @@ void gDC::exec(const gOpcode *o)
 		break;
 	case gOpcode::flush:
 		break;
+	case gOpcode::damage:
+		delete o->parm.damage;
+		break;
 	case gOpcode::sendShow:
 		break;
 	case gOpcode::sendHide:
@@ -12,6 +12,7 @@
 #undef SYNC_PAINT
 
 #include <pthread.h>
+#include <atomic>
 #include <stack>
 #include <list>
 
@@ -23,6 +24,7 @@
 #include <lib/gdi/region.h>
 #include <lib/gdi/gfont.h>
 #include <lib/gdi/compositing.h>
+#include <lib/python/python.h>
 
 class eTextPara;
 
@@ -59,6 +61,7 @@ struct gOpcode
 		popClip,
 
 		flush,
+		damage,
 
 		waitVSync,
 		flip,
@@ -166,6 +169,11 @@ struct gOpcode
 
 		gCompositingData *setCompositing;
 
+		struct pdamage
+		{
+			gRegion region;
+		} *damage;
+
 		struct psetShowHideInfo
 		{
 			ePoint point;
@@ -175,8 +183,21 @@ struct gOpcode
 };
 
 #define MAXSIZE 2048
+/* opcodes the producer writes before it makes them visible to the render thread */
+#define PUBLISH_BATCH 64
 
-/* gRC is the singleton which controls the fifo and dispatches commands */
+/*
+ * gRC is the singleton which controls the fifo and dispatches commands.
+ *
+ * The fifo is a ring with a single consumer, the render thread. It is
+ * filled by the main thread which owns the gPainters, and rarely by other
+ * threads like the crash handler. In the usual case neither side takes a
+ * lock: the producer fills slots behind the write index it has published
+ * and publishes them in spans, at the end of a gPainter, every
+ * PUBLISH_BATCH opcodes, and on flush. A sleeping render thread is woken
+ * through a futex on flush, notify and shutdown, a producer which finds
+ * the ring full sleeps on the read index until the render thread made room.
+ */
 class gRC : public iObject, public sigc::trackable
 {
 	DECLARE_REF(gRC);
@@ -186,13 +207,55 @@ class gRC : public iObject, public sigc::trackable
 #ifndef SYNC_PAINT
 	static void *thread_wrapper(void *ptr);
 	pthread_t the_thread;
-	pthread_mutex_t mutex;
-	pthread_cond_t cond;
 #endif
 	void *thread();
 
 	gOpcode queue[MAXSIZE];
-	int rp, wp;
+	std::atomic<int> rp, wp;
+	int m_write; /* producer only, slots up to here are filled but maybe not published */
+
+	std::atomic<int> m_wakeup; /* bumped to wake the render thread */
+	std::atomic<int> m_consumer_sleeping;
+	std::atomic<int> m_producer_waiting;
+
+	/*
+	 * Everything touching the producer side goes between beginProducing
+	 * and endProducing. Other threads than the main thread, like the crash
+	 * handler, produce under m_producer_lock. The main thread only takes
+	 * it while one of them is producing.
+	 */
+	pthread_t m_main_thread;
+	eSingleLock m_producer_lock;
+	std::atomic<int> m_foreign_producers;
+	std::atomic<int> m_main_submitting;
+
+	enum { producerMain, producerLocked, producerForeign };
+	int beginProducing();
+	void endProducing(int how);
+	void push(const gOpcode &o);
+	void publish(bool wakeup);
+	/* publishes what was queued so far, at the end of a gPainter */
+	void endBatch();
+	void waitForSpace();
+#ifndef SYNC_PAINT
+	void wakeConsumer();
+	int waitForWork(int timeout_ms);
+#endif
+
+	/* producer side, only touched while producing */
+	int m_max_depth;
+	int m_stalls;
+	long long m_stall_us;
+	long long m_opcodes;
+	long long m_batches;
+
+	/* render thread side */
+	eSingleLock m_stats_lock;
+	long long m_frame_start; /* us, 0 while no frame is drawn */
+	int m_frames;
+	int m_frame_us, m_max_frame_us;
+	long long m_total_frame_us;
+	void frameDone();
 
 	eFixedMessagePump<int> m_notify_pump;
 	void recv_notify(const int &i);
@@ -224,6 +287,9 @@ public:
 	void setSpinnerDC(gDC *dc) { m_spinner_dc = dc; }
 	void setSpinnerOnOff(int onoff) { m_spinneronoff = onoff; }
 
+	/* queue depth, producer stalls and frame render times */
+	PyObject *getStatistics();
+
 	static gRC *getInstance();
 };
 
@@ -320,6 +386,9 @@ public:
 	void setCompositing(gCompositingData *comp);
 
 	void flush();
+		/* announces what the next flush has to bring to the screen, in surface coordinates. */
+		/* a DC which gets drawn to without it updates everything. */
+	void damage(const gRegion &region);
 	void sendShow(ePoint point, eSize size);
 	void sendHide(ePoint point, eSize size);
 };
@@ -443,6 +443,48 @@ void gRegion::scale(int x_n, int x_d, int y_n, int y_d)
 		rects[i].scale(x_n, x_d, y_n, y_d);
 }
 
+void gRegion::cover(std::vector<eRect> &result, unsigned int max_rects, int slack) const
+{
+	result.clear();
+	if (!valid() || empty())
+		return;
+	result = rects;
+
+		/* a pairwise search is too slow for very fragmented regions, so first */
+		/* merge neighbours in band order until that's feasible. */
+	while (result.size() > 64)
+	{
+		unsigned int j = 0;
+		for (unsigned int i = 0; i < result.size(); i += 2)
+			result[j++] = (i + 1 < result.size()) ? (result[i] | result[i + 1]) : result[i];
+		result.resize(j);
+	}
+
+	while (result.size() > 1)
+	{
+		unsigned int best_i = 0, best_j = 1;
+		long long best_cost = 0;
+		bool found = false;
+		for (unsigned int i = 0; i < result.size(); ++i)
+			for (unsigned int j = i + 1; j < result.size(); ++j)
+			{
+					/* negative when the rectangles overlap */
+				long long cost = (long long)(result[i] | result[j]).surface() - result[i].surface() - result[j].surface();
+				if (!found || cost < best_cost)
+				{
+					best_i = i;
+					best_j = j;
+					best_cost = cost;
+					found = true;
+				}
+			}
+		if (result.size() <= max_rects && best_cost >= slack)
+			break;
+		result[best_i] |= result[best_j];
+		result.erase(result.begin() + best_j);
+	}
+}
+
 bool operator == (const gRegion &r1, const gRegion &r2)
 {
 	if (r1.rects.size() != r2.rects.size()) return false;
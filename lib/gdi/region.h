@@ -99,6 +99,11 @@ public:
 	static gRegion invalidRegion() { return gRegion(eRect::invalidRect()); }
 
 	void scale(int x_n, int x_d, int y_n, int y_d);
+
+		/* at most max_rects rectangles which together cover the region. */
+		/* rectangles are merged into their bounding box as long as that */
+		/* covers less than slack pixels which aren't in the region. */
+	void cover(std::vector<eRect> &result, unsigned int max_rects, int slack) const;
 };
 
 bool operator == (const gRegion &, const gRegion &);
@@ -0,0 +1,113 @@
+#include <lib/gdi/textparacache.h>
+
+#include <string.h>
+#include <lib/python/python_helpers.h>
+
+extern const uint32_t crc32_table[256];
+
+static uint32_t crcAdd(uint32_t crc, const char *data, size_t size)
+{
+	while (size--)
+		crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ (uint8_t)*data++) & 0xFF];
+	return crc;
+}
+
+static uint32_t paraHash(const char *text, const gFont &font, const eRect &area, int flags, int border)
+{
+	int params[] = { font.pointSize, area.left(), area.top(), area.width(), area.height(), flags, border };
+	uint32_t crc = crcAdd(0, text, strlen(text));
+	crc = crcAdd(crc, font.family.data(), font.family.size());
+	return crcAdd(crc, (const char*)params, sizeof(params));
+}
+
+eTextParaCache &eTextParaCache::getInstance()
+{
+	static eTextParaCache instance;
+	return instance;
+}
+
+eTextParaCache::eTextParaCache()
+	:m_capacity(512), m_hits(0), m_misses(0)
+{
+}
+
+void eTextParaCache::setCapacity(unsigned int capacity)
+{
+	eSingleLocker l(m_lock);
+	m_capacity = capacity;
+	while (m_entries.size() > m_capacity)
+	{
+		m_index.erase(m_entries.back().hash);
+		m_entries.pop_back();
+	}
+}
+
+void eTextParaCache::clear()
+{
+	eSingleLocker l(m_lock);
+	m_index.clear();
+	m_entries.clear();
+}
+
+bool eTextParaCache::get(ePtr<eTextPara> &para, const char *text, const gFont &font, const eRect &area, int flags, int border)
+{
+	uint32_t hash = paraHash(text, font, area, flags, border);
+	eSingleLocker l(m_lock);
+	EntryMap::iterator it = m_index.find(hash);
+	if (it != m_index.end())
+	{
+		const Entry &entry = *it->second;
+		if (entry.size == font.pointSize && entry.area == area && entry.flags == flags && entry.border == border
+			&& entry.text == text && entry.family == font.family)
+		{
+			m_entries.splice(m_entries.begin(), m_entries, it->second);
+			para = entry.para;
+			++m_hits;
+			return true;
+		}
+	}
+	++m_misses;
+	return false;
+}
+
+void eTextParaCache::put(eTextPara *para, const char *text, const gFont &font, const eRect &area, int flags, int border)
+{
+	uint32_t hash = paraHash(text, font, area, flags, border);
+	eSingleLocker l(m_lock);
+	if (!m_capacity)
+		return;
+	EntryMap::iterator it = m_index.find(hash);
+	if (it != m_index.end())
+	{
+		m_entries.erase(it->second);
+		m_index.erase(it);
+	}
+	Entry entry;
+	entry.hash = hash;
+	entry.text = text;
+	entry.family = font.family;
+	entry.size = font.pointSize;
+	entry.area = area;
+	entry.flags = flags;
+	entry.border = border;
+	entry.para = para;
+	m_entries.push_front(entry);
+	m_index[hash] = m_entries.begin();
+	if (m_entries.size() > m_capacity)
+	{
+		m_index.erase(m_entries.back().hash);
+		m_entries.pop_back();
+	}
+}
+
+void eTextParaCache::getStatistics(ePyObject &dict)
+{
+	size_t glyphs = 0;
+	eSingleLocker l(m_lock);
+	for (EntryList::iterator it(m_entries.begin()); it != m_entries.end(); ++it)
+		glyphs += it->para->size();
+	PutToDict(dict, "text_layout_entries", m_entries.size());
+	PutToDict(dict, "text_layout_glyphs", glyphs);
+	PutToDict(dict, "text_layout_hits", m_hits);
+	PutToDict(dict, "text_layout_misses", m_misses);
+}
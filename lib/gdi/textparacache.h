@@ -0,0 +1,64 @@
+#ifndef __lib_gdi_textparacache_h
+#define __lib_gdi_textparacache_h
+
+#include <list>
+#include <string>
+#include <stdint.h>
+#include <tr1/unordered_map>
+#include <lib/base/elock.h>
+#include <lib/gdi/font.h>
+#include <lib/gdi/gfont.h>
+#include <lib/python/python.h>
+
+/*
+ * LRU of laid out and aligned paragraphs, shared by everything that draws
+ * through gPainter::renderText.
+ *
+ * Listboxes repaint the same channel names and titles over and over while
+ * scrolling. A hit skips the UTF-8 decoding, shaping, bidi reordering,
+ * line breaking and aligning of the text. Entries are keyed by the text,
+ * the font, the area and the render flags. A cached paragraph is never
+ * changed again, it is only drawn.
+ *
+ * The cache is thread safe. A capacity of 0 disables it.
+ */
+class eTextParaCache
+{
+public:
+	static eTextParaCache &getInstance();
+
+	void setCapacity(unsigned int capacity);
+	/* drops all entries, needed when the fonts change */
+	void clear();
+	/* returns false and leaves para alone when the text is not cached */
+	bool get(ePtr<eTextPara> &para, const char *text, const gFont &font, const eRect &area, int flags, int border);
+	void put(eTextPara *para, const char *text, const gFont &font, const eRect &area, int flags, int border);
+
+	void getStatistics(ePyObject &dict);
+
+private:
+	eTextParaCache();
+
+	struct Entry
+	{
+		uint32_t hash;
+		std::string text;
+		std::string family;
+		int size;
+		eRect area;
+		int flags;
+		int border;
+		ePtr<eTextPara> para;
+	};
+	typedef std::list<Entry> EntryList;
+	typedef std::tr1::unordered_map<uint32_t, EntryList::iterator> EntryMap;
+
+	eSingleLock m_lock;
+	unsigned int m_capacity;
+	/* most recently used first */
+	EntryList m_entries;
+	EntryMap m_index;
+	unsigned long long m_hits, m_misses;
+};
+
+#endif
@@ -117,6 +117,10 @@ void eWidgetDesktop::recalcClipRegions(eWidget *root)
 
 			calcWidgetClipRegion(*i, m_screen.m_background_region);
 
+				/* most changes leave the other root windows as they were, comparing is cheaper than the region algebra. */
+			if (i->m_visible_with_childs == visible_before)
+				continue;
+
 			gRegion redraw = (i->m_visible_with_childs - visible_before) | (visible_before - i->m_visible_with_childs);
 
 			redraw.moveBy(i->position());
@@ -124,8 +128,11 @@ void eWidgetDesktop::recalcClipRegions(eWidget *root)
 			invalidate(redraw);
 		}
 
-		gRegion redraw = (background_before - m_screen.m_background_region) | (m_screen.m_background_region - background_before);
-		invalidate(redraw);
+		if (m_screen.m_background_region != background_before)
+		{
+			gRegion redraw = (background_before - m_screen.m_background_region) | (m_screen.m_background_region - background_before);
+			invalidate(redraw);
+		}
 	} else if (m_comp_mode == cmBuffered)
 	{
 		if (!(root->m_vis & eWidget::wVisShow))
@@ -309,6 +316,14 @@ void eWidgetDesktop::paint()
 {
 	m_require_redraw = 0;
 
+	gRegion damage = m_screen.m_dirty_region;
+	if (m_comp_mode == cmImmediate)
+	{
+			/* everything painted below is inside the dirty region, so only that has to be copied to the screen. */
+		gPainter painter(m_screen.m_dc);
+		painter.damage(damage);
+	}
+
 		/* walk all root windows. */
 	for (ePtrList<eWidget>::iterator i(m_root.begin()); i != m_root.end(); ++i)
 	{
@@ -327,7 +342,15 @@ void eWidgetDesktop::paint()
 	}
 
 	if (m_comp_mode == cmImmediate)
+	{
+			/* widgets may have invalidated more while painting */
+		if (m_screen.m_dirty_region != damage)
+		{
+			gPainter painter(m_screen.m_dc);
+			painter.damage(m_screen.m_dirty_region);
+		}
 		paintBackground(&m_screen);
+	}
 
 	if (m_comp_mode == cmBuffered)
 	{
@@ -507,6 +507,10 @@ def InitUsageConfig():
 		m = i / 60
 		choicelist.append((str(i), ngettext("%d minute", "%d minutes", m) % m))
 	config.usage.timeshift_start_delay = ConfigSelection(default="0", choices=choicelist)
+	choicelist = [("0", _("Unlimited"))]
+	for i in (1, 2, 4, 8, 16):
+		choicelist.append((str(i * 1024), _("%d GB") % i))
+	config.usage.timeshift_ring_size = ConfigSelection(default="0", choices=choicelist)
 
 	config.usage.alternatives_priority = ConfigSelection(default="1", choices=[
 		("0", _("DVB-S/-C/-T")),
@@ -524,6 +528,9 @@ def InitUsageConfig():
 
 	config.usage.http_startdelay = ConfigSelection(default="0", choices=choicelist)
 
+	# blocks of 32 kB, cached while seeking in recordings
+	config.usage.tstools_cache_blocks = ConfigSelection(default="16", choices=[("%d" % i, _("%d kB") % (i * 32)) for i in (4, 16, 64, 256)])
+
 	def remote_fallback_changed(configElement):
 		if configElement.value:
 			configElement.value = "%s%s" % (not configElement.value.startswith("http://") and "http://" or "", configElement.value)
@@ -1090,6 +1097,18 @@ def InitUsageConfig():
 	config.usage.show_slider_value = ConfigYesNo(default=True)
 	config.usage.cursorscroll = ConfigSelectionNumber(min=0, max=50, stepwidth=5, default=0, wraparound=True)
 
+	def textLayoutCacheChanged(configElement):
+		from enigma import fontRenderClass
+		fontRenderClass.getInstance().setTextLayoutCacheSize(configElement.value)
+	config.usage.text_layout_cache = ConfigSelectionNumber(min=0, max=2048, stepwidth=256, default=512)
+	config.usage.text_layout_cache.addNotifier(textLayoutCacheChanged)
+
+	def showDamageChanged(configElement):
+		from enigma import gMainDC
+		gMainDC.getInstance().setShowDamage(int(configElement.value))
+	config.usage.show_damage = ConfigYesNo(default=False)
+	config.usage.show_damage.addNotifier(showDamageChanged)
+
 	config.usage.multiboot_order = ConfigYesNo(default=True)
 
 	config.epg = ConfigSubsection()
@@ -1101,6 +1120,10 @@ def InitUsageConfig():
 	config.epg.virgin = ConfigYesNo(default=False)
 	config.epg.opentv = ConfigYesNo(default=False)
 	config.epg.saveepg = ConfigYesNo(default=True)
+	config.epg.searchindex = ConfigYesNo(default=True)
+	config.epg.snapshots = ConfigYesNo(default=True)
+	config.epg.ingestthreads = ConfigSelectionNumber(min=0, max=4, stepwidth=1, default=2)
+	config.epg.textcache = ConfigSelectionNumber(min=0, max=1024, stepwidth=128, default=256)
 
 	config.epg.maxdays = ConfigSelectionNumber(min=1, max=365, stepwidth=1, default=7, wraparound=True)
 
@@ -1348,6 +1371,8 @@ def InitUsageConfig():
 	config.seek.speeds_forward = ConfigSet(default=[2, 4, 8, 16, 32, 64, 128], choices=[2, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128])
 	config.seek.speeds_backward = ConfigSet(default=[2, 4, 8, 16, 32, 64, 128], choices=[1, 2, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128])
 	config.seek.speeds_slowmotion = ConfigSet(default=[2, 4, 8], choices=[2, 4, 6, 8, 12, 16, 25])
+	# I-frames shown per second while winding through a recording, 0 skips by frame count
+	config.seek.trickplay_fps = ConfigSelection(default=10, choices=[0, 4, 6, 8, 10, 12, 16, 25])
 
 	config.seek.enter_forward = ConfigSelection(default=2, choices=[2, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128])
 	config.seek.enter_backward = ConfigSelection(default=1, choices=[1, 2, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128])
@@ -1665,6 +1690,9 @@ def InitUsageConfig():
 	config.streaming.stream_ait = ConfigYesNo(default=True)
 	config.streaming.stream_sdtbat = ConfigYesNo(default=False)
 	config.streaming.authentication = ConfigYesNo(default=False)
+	config.streaming.shared = ConfigYesNo(default=True)
+	config.streaming.shared_backlog = ConfigSelectionNumber(min=1, max=16, stepwidth=1, default=4)
+	config.streaming.splice = ConfigYesNo(default=False)
 
 	config.mediaplayer = ConfigSubsection()
 	config.mediaplayer.useAlternateUserAgent = ConfigYesNo(default=False)
@@ -39,7 +39,7 @@ from Tools.Directories import fileReadLines, fileReadLinesISO, getRecordingFilen
 from Tools.Notifications import AddNotificationWithCallback, AddPopup, current_notifications, lock, notificationAdded, notifications, RemovePopup, AddNotification
 from keyids import KEYFLAGS, KEYIDS, KEYIDNAMES
 from Components.Console import Console
-from enigma import eTimer, eServiceCenter, eDVBServicePMTHandler, iServiceInformation, iPlayableService, eServiceReference, eEPGCache, eActionMap, getDesktop, eDVBDB
+from enigma import eTimer, eServiceCenter, eDVBServicePMTHandler, iServiceInformation, iPlayableService, eServiceReference, eEPGCache, eActionMap, getDesktop, eDVBDB, eRingFileUnroller
 from time import time, localtime, strftime
 from os.path import exists, isfile, join, splitext
 from os import listdir, remove
@@ -2288,10 +2288,15 @@ class InfoBarTimeshift():
 			fileList.append((self.current_timeshift_filename, filename))
 			if isfile(self.current_timeshift_filename + ".sc"):
 				fileList.append((self.current_timeshift_filename + ".sc", filename + ".sc"))
+			if isfile(self.current_timeshift_filename + ".ring"):
+				fileList.append((self.current_timeshift_filename + ".ring", filename + ".ring"))
 			if isfile(self.current_timeshift_filename + ".cuts"):
 				fileList.append((self.current_timeshift_filename + ".cuts", filename + ".cuts"))
 
 			moveFiles(fileList)
+			if isfile(filename + ".ring"):
+				# a ring buffer timeshift is rewritten as a plain recording where it ended up
+				eRingFileUnroller.getInstance().unroll(filename)
 			self.save_timeshift_file = False
 			self.setCurrentEventTimer()
 
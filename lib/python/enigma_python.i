@@ -105,6 +105,7 @@ is usually caused by not marking PSignals as immutable.
 #include <lib/dvb/metaparser.h>
 #include <lib/components/scan.h>
 #include <lib/components/file_eraser.h>
+#include <lib/base/ringfile.h>
 #include <lib/components/tuxtxtapp.h>
 #include <lib/driver/avswitch.h>
 #include <lib/driver/hdmi_cec.h>
@@ -268,6 +269,7 @@ typedef long time_t;
 %include <lib/dvb/cablescan.h>
 %include <lib/components/scan.h>
 %include <lib/components/file_eraser.h>
+%include <lib/base/ringfile.h>
 %include <lib/components/tuxtxtapp.h>
 %include <lib/driver/avswitch.h>
 %include <lib/driver/hdmi_cec.h>
@@ -432,6 +434,16 @@ void setSpinnerOnOff(int onoff)
 }
 %}
 
+PyObject *getRenderStatistics();
+%{
+PyObject *getRenderStatistics()
+{
+	gRC *rc = gRC::getInstance();
+	if (rc) return rc->getStatistics();
+	Py_RETURN_NONE;
+}
+%}
+
 void setEnableTtCachingOnOff(int);
 %{
 void setEnableTtCachingOnOff(int onoff)
@@ -4,6 +4,7 @@
 #include <lib/dvb/dvbtime.h>
 #include <lib/dvb/idvb.h>
 #include <lib/dvb/db.h>
+#include <lib/dvb/epgtextcache.h>
 #include <dvbsi++/event_information_section.h>
 #include <dvbsi++/short_event_descriptor.h>
 #include <dvbsi++/extended_event_descriptor.h>
@@ -21,6 +22,18 @@
 
 bool eServiceEvent::m_Debug = false;
 
+/* crc is the one of the cached descriptor holding the text, NULL when unknown */
+static inline std::string convertText(const std::string &text, int table, int tsidonid, const uint32_t *crc, int part)
+{
+	std::string output;
+	/* already UTF-8 text (as stored by the EPG cache) is just copied, no point in caching it */
+	if (crc && !(text.size() && (uint8_t)text[0] == UTF8_ENCODING))
+		eEPGTextCache::getInstance().convert(output, text, table, tsidonid, *crc, part);
+	else
+		convertDVBUTF8Into(output, (const unsigned char*)text.data(), text.size(), table, tsidonid);
+	return output;
+}
+
 // static members / methods
 std::string eServiceEvent::m_language = "";
 std::string eServiceEvent::m_language_alternative = "";
@@ -74,12 +87,14 @@ eServiceEvent::eServiceEvent():
 }
 
 /* search for the presence of language from given EIT event descriptors*/
-bool eServiceEvent::loadLanguage(Event *evt, const std::string &lang, int tsidonid, int sid)
+bool eServiceEvent::loadLanguage(Event *evt, const std::string &lang, int tsidonid, int sid, const std::vector<uint32_t> *crcs)
 {
 	bool retval=0;
 	std::string language = lang;
-	for (DescriptorConstIterator desc = evt->getDescriptors()->begin(); desc != evt->getDescriptors()->end(); ++desc)
+	int index = 0;
+	for (DescriptorConstIterator desc = evt->getDescriptors()->begin(); desc != evt->getDescriptors()->end(); ++desc, ++index)
 	{
+		const uint32_t *crc = crcs ? &(*crcs)[index] : NULL;
 		switch ((*desc)->getTag())
 		{
 			case LINKAGE_DESCRIPTOR:
@@ -95,8 +110,8 @@ bool eServiceEvent::loadLanguage(Event *evt, const std::string &lang, int tsidon
 				{
 					/* stick to this language, avoid merging or mixing descriptors of different languages */
 					language = cc;
-					m_event_name += replace_all(replace_all(convertDVBUTF8(sed->getEventName(), table, tsidonid), "\n", " ",table), "\t", " ",table);
-					m_short_description += convertDVBUTF8(sed->getText(), table, tsidonid);
+					m_event_name += replace_all(replace_all(convertText(sed->getEventName(), table, tsidonid, crc, 0), "\n", " ",table), "\t", " ",table);
+					m_short_description += convertText(sed->getText(), table, tsidonid, crc, 1);
 					retval=1;
 				}
 				break;
@@ -121,7 +136,7 @@ bool eServiceEvent::loadLanguage(Event *evt, const std::string &lang, int tsidon
 					}
 					else
 					{
-						m_extended_description += convertDVBUTF8(eed->getText(), table, tsidonid);
+						m_extended_description += convertText(eed->getText(), table, tsidonid, crc, 0);
 					}
 					const ExtendedEventList *itemlist = eed->getItems();
 					for (ExtendedEventConstIterator it = itemlist->begin(); it != itemlist->end(); ++it)
@@ -306,17 +321,24 @@ RESULT eServiceEvent::parseFrom(Event *evt, int tsidonid)
 
 RESULT eServiceEvent::parseFrom(Event *evt, int tsidonid, int sid)
 {
+	return parseFrom(evt, tsidonid, sid, std::vector<uint32_t>());
+}
+
+RESULT eServiceEvent::parseFrom(Event *evt, int tsidonid, int sid, const std::vector<uint32_t> &descriptor_crcs)
+{
+	/* only usable when every descriptor of evt has its crc */
+	const std::vector<uint32_t> *crcs = descriptor_crcs.size() == evt->getDescriptors()->size() ? &descriptor_crcs : NULL;
 	m_begin = parseDVBtime(evt->getStartTimeMjd(), evt->getStartTimeBcd());
 	m_event_id = evt->getEventId();
 	uint32_t duration = evt->getDuration();
 	m_duration = fromBCD(duration>>16)*3600+fromBCD(duration>>8)*60+fromBCD(duration);
 	uint8_t running_status = evt->getRunningStatus();
 	m_running_status = running_status;
-	if (m_language != "" && loadLanguage(evt, m_language, tsidonid, sid))
+	if (m_language != "" && loadLanguage(evt, m_language, tsidonid, sid, crcs))
 		return 0;
-	if (m_language_alternative != "" && loadLanguage(evt, m_language_alternative, tsidonid, sid))
+	if (m_language_alternative != "" && loadLanguage(evt, m_language_alternative, tsidonid, sid, crcs))
 		return 0;
-	if (loadLanguage(evt, "", tsidonid, sid))
+	if (loadLanguage(evt, "", tsidonid, sid, crcs))
 		return 0;
 	return 0;
 }
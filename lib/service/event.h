@@ -5,6 +5,7 @@
 #include <time.h>
 #include <list>
 #include <string>
+#include <vector>
 class Event;
 #endif
 
@@ -131,7 +132,7 @@ class eServiceEvent: public iObject
 	DECLARE_REF(eServiceEvent);
 	static std::string crid_scheme;
 	static std::string normalise_crid(std::string crid, ePtr<eDVBService> service);
-	bool loadLanguage(Event *event, const std::string &lang, int tsidonid, int sid);
+	bool loadLanguage(Event *event, const std::string &lang, int tsidonid, int sid, const std::vector<uint32_t> *crcs);
 	std::list<eComponentData> m_component_data;
 	std::list<eServiceReference> m_linkage_services;
 	std::list<eGenreData> m_genres;
@@ -151,6 +152,8 @@ public:
 	eServiceEvent();
 #ifndef SWIG
 	RESULT parseFrom(Event *evt, int tsidonid, int sid);
+	/* with the crcs of the descriptors of evt as cached by eEPGCache, used to look up converted texts */
+	RESULT parseFrom(Event *evt, int tsidonid, int sid, const std::vector<uint32_t> &descriptor_crcs);
 	RESULT parseFrom(Event *evt, int tsidonid=0);
 	RESULT parseFrom(ATSCEvent *evt);
 	RESULT parseFrom(const ExtendedTextTableSection *sct);
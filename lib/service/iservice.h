@@ -539,6 +539,11 @@ public:
 	virtual RESULT isCurrentlySeekable()=0;
 	virtual RESULT seekChapter(int) { return -1; }
 	virtual RESULT seekTitle(int) { return -1; }
+	/* seek and trick play statistics of the playback, as a dict */
+	virtual PyObject *getPlaybackStatistics()
+	{
+		return PyDict_New();
+	}
 };
 SWIG_TEMPLATE_TYPEDEF(ePtr<iSeekableService>, iSeekableServicePtr);
 
@@ -1075,6 +1080,11 @@ public:
 	{
 		return PyList_New(0);
 	}
+	/* write buffer usage of the recorder, as a dict */
+	virtual PyObject *getBufferStatistics()
+	{
+		return PyDict_New();
+	}
 };
 SWIG_TEMPLATE_TYPEDEF(ePtr<iRecordableService>, iRecordableServicePtr);
 
@@ -15,8 +15,10 @@
 #include <lib/service/event.h>
 #include <lib/dvb/metaparser.h>
 #include <lib/dvb/tstools.h>
+#include <lib/dvb/reindex.h>
 #include <lib/python/python.h>
 #include <lib/base/nconfig.h> // access to python config
+#include <lib/base/ringfile.h>
 #include <lib/base/httpsstream.h>
 #include <lib/base/httpstream.h>
 #if defined(HAVE_FCC_ABILITY)
@@ -605,7 +607,9 @@ RESULT eDVBPVRServiceOfflineOperations::getListOfFilenames(std::list<std::string
 	res.push_back(m_ref.path + ".meta");
 	res.push_back(m_ref.path + ".ap");
 	res.push_back(m_ref.path + ".sc");
+	res.push_back(m_ref.path + ".ring");
 	res.push_back(m_ref.path + ".cuts");
+	res.push_back(m_ref.path + ".samples");
 	std::string tmp = m_ref.path;
 	tmp.erase(m_ref.path.length()-3);
 	res.push_back(tmp + ".eit");
@@ -614,62 +618,29 @@ RESULT eDVBPVRServiceOfflineOperations::getListOfFilenames(std::list<std::string
 
 static int reindex_work(const std::string& filename)
 {
-	/* This does not work, need to call parser.setPid(pid, type) otherwise
-	 * the parser will not actually output any data! */
-
-	eRawFile f;
-
-	int err = f.open(filename.c_str());
-	if (err < 0)
-		return err;
-
-	eMPEGStreamParserTS parser; /* Missing packetsize, should be determined from stream? */
+	eDVBReindexer reindexer(filename);
 
 	{
-		unsigned int i;
-		bool timingpidset = false;
 		eDVBTSTools tstools;
 		tstools.openFile(filename.c_str(), 1);
 		eDVBPMTParser::program program;
-		err = tstools.findPMT(program);
-		if (err)
-		{
-			eDebug("[eDVBPVRServiceOfflineOperations] reindex - Failed to find PMT");
-			return err;
-		}
-		for (i = 0; i < program.videoStreams.size(); i++)
-		{
-			if (timingpidset) break;
-			eDebug("[eDVBPVRServiceOfflineOperations] reindex: video pid=0x%x", program.videoStreams[i].pid);
-			parser.setPid(program.videoStreams[i].pid, iDVBTSRecorder::video_pid, program.videoStreams[i].type);
-			timingpidset = true;
-		}
-		for (i = 0; i < program.audioStreams.size(); i++)
+		/* without a PMT the reindexer looks for the stream itself */
+		if (!tstools.findPMT(program))
 		{
-			if (timingpidset) break;
-			eDebug("[eDVBPVRServiceOfflineOperations] reindex: audio pid=0x%x", program.audioStreams[i].pid);
-			parser.setPid(program.audioStreams[i].pid, iDVBTSRecorder::audio_pid, program.audioStreams[i].type);
-			timingpidset = true;
+			if (!program.videoStreams.empty())
+			{
+				eDebug("[eDVBPVRServiceOfflineOperations] reindex: video pid=0x%x", program.videoStreams[0].pid);
+				reindexer.setPid(program.videoStreams[0].pid, program.videoStreams[0].type);
+			}
+			else if (!program.audioStreams.empty())
+			{
+				eDebug("[eDVBPVRServiceOfflineOperations] reindex: audio pid=0x%x", program.audioStreams[0].pid);
+				reindexer.setPid(program.audioStreams[0].pid, program.audioStreams[0].type, iDVBTSRecorder::audio_pid);
+			}
 		}
 	}
 
-	parser.startSave(filename);
-
-	off_t offset = 0;
-	std::vector<char> buffer(188*1024);
-	while (1)
-	{
-		int r = f.read(offset, &buffer[0], buffer.size());
-		if (!r)
-			break;
-		if (r < 0)
-			return r;
-		parser.parseData(offset, &buffer[0], r);
-		offset += r;
-	}
-
-	parser.stopSave();
-	return 0;
+	return reindexer.run();
 }
 
 RESULT eDVBPVRServiceOfflineOperations::reindex()
@@ -1081,6 +1052,7 @@ eDVBServicePlay::eDVBServicePlay(const eServiceReference &ref, eDVBService *serv
 	m_timeshift_changed(0),
 	m_save_timeshift(0),
 	m_timeshift_fd(-1),
+	m_timeshift_ring(false),
 	m_skipmode(0),
 	m_fastforward(0),
 	m_slowmotion(0),
@@ -1774,6 +1746,15 @@ RESULT eDVBServicePlay::isCurrentlySeekable()
 	return (m_is_pvr || m_timeshift_active) ? 3 : 0; // fast forward/backward possible and seeking possible
 }
 
+PyObject *eDVBServicePlay::getPlaybackStatistics()
+{
+	ePyObject dict = PyDict_New();
+	ePtr<iDVBPVRChannel> pvr_channel;
+	if (!(m_timeshift_enabled ? m_service_handler_timeshift : m_service_handler).getPVRChannel(pvr_channel))
+		((eDVBChannel *)(iDVBPVRChannel *)pvr_channel)->getPlaybackStatistics(dict);
+	return dict;
+}
+
 RESULT eDVBServicePlay::frontendInfo(ePtr<iFrontendInformation> &ptr)
 {
 	ptr = this;
@@ -2656,6 +2637,29 @@ RESULT eDVBServicePlay::startTimeshift()
 
 	m_record->setTargetFD(m_timeshift_fd);
 	m_record->setTargetFilename(m_timeshift_file);
+	int ring_size = eConfigManager::getConfigIntValue("config.usage.timeshift_ring_size");
+	if (ring_size > 0)
+	{
+		/*
+		 * A ring buffer of fixed size, its space is taken right away. Only
+		 * where the filesystem can do so without writing the file, the ring
+		 * grows as it is written otherwise.
+		 */
+		off_t size = (off_t)ring_size << 20;
+		int r = fallocate(m_timeshift_fd, 0, 0, size) < 0 ? errno : 0;
+		if (r == EOPNOTSUPP)
+		{
+			eDebug("[eDVBServicePlay] cannot preallocate the timeshift ring buffer");
+			r = 0;
+		}
+		if (r)
+			eWarning("[eDVBServicePlay] no room for a timeshift ring buffer of %d MB, timeshift is unbounded: %s", ring_size, strerror(r));
+		else
+		{
+			m_record->setRingBuffer(size);
+			m_timeshift_ring = true;
+		}
+	}
 	m_record->connectEvent(sigc::mem_fun(*this, &eDVBServicePlay::recordEvent), m_con_record_event);
 	m_record->enableAccessPoints(false); // no need for AP information during shift
 	m_timeshift_enabled = 1;
@@ -2696,6 +2700,11 @@ RESULT eDVBServicePlay::stopTimeshift(bool swToLive)
 	m_record->stop();
 	m_record = 0;
 
+	/* a saved ring is turned into a plain recording in the background */
+	if (m_save_timeshift && m_timeshift_ring && eRingFileUnroller::getInstance())
+		eRingFileUnroller::getInstance()->unroll(m_timeshift_file);
+	m_timeshift_ring = false;
+
 	if (m_timeshift_fd >= 0)
 	{
 		close(m_timeshift_fd);
@@ -2720,7 +2729,9 @@ RESULT eDVBServicePlay::stopTimeshift(bool swToLive)
 		eDebug("[eDVBServicePlay] remove timeshift files");
 		eBackgroundFileEraser::getInstance()->erase(m_timeshift_file);
 		eBackgroundFileEraser::getInstance()->erase(m_timeshift_file + ".sc");
+		eBackgroundFileEraser::getInstance()->erase(m_timeshift_file + ".ring");
 		eBackgroundFileEraser::getInstance()->erase(m_timeshift_file + ".cuts");
+		eBackgroundFileEraser::getInstance()->erase(m_timeshift_file + ".samples");
 	}
 	else
 	{
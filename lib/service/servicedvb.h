@@ -139,6 +139,7 @@ public:
 	RESULT getPlayPosition(pts_t &pos);
 	RESULT setTrickmode(int trick=0);
 	RESULT isCurrentlySeekable();
+	PyObject *getPlaybackStatistics();
 
 		// iServiceInformation
 	RESULT getName(std::string &name);
@@ -252,6 +253,7 @@ protected:
 
 	std::string m_timeshift_file, m_timeshift_file_next;
 	int m_timeshift_fd;
+	bool m_timeshift_ring;
 	ePtr<iDVBDemux> m_decode_demux;
 
 	int m_current_audio_stream;
@@ -1,6 +1,7 @@
 #include <lib/service/servicedvbrecord.h>
 #include <lib/base/eerror.h>
 #include <lib/dvb/db.h>
+#include <lib/dvb/demux.h>
 #include <lib/dvb/epgcache.h>
 #include <lib/dvb/metaparser.h>
 #include <lib/base/nconfig.h> 
@@ -683,6 +684,14 @@ PyObject *eDVBServiceRecord::getCutList()
 	return list;
 }
 
+PyObject *eDVBServiceRecord::getBufferStatistics()
+{
+	ePyObject dict = PyDict_New();
+	if (m_record)
+		((eDVBTSRecorder *)(iDVBTSRecorder *)m_record)->getBufferStatistics(dict);
+	return dict;
+}
+
 void eDVBServiceRecord::saveCutlist()
 {
 	// Save cuts only when main file is accessible.
@@ -33,6 +33,7 @@ public:
 	RESULT subServices(ePtr<iSubserviceList> &ptr);
 	RESULT getFilenameExtension(std::string &ext) { ext = ".ts"; return 0; };
 	PyObject *getCutList();
+	PyObject *getBufferStatistics();
 
 		// iStreamableService
 	ePtr<iStreamData> getStreamingData();
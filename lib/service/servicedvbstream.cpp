@@ -144,10 +144,7 @@ int eDVBServiceStream::doRecord()
 			eDebug("[eDVBServiceStream] NO DEMUX available");
 			return -1;
 		}
-		if (m_ref.path.empty())
-			demux->createTSRecorder(m_record, /*packetsize*/ 188, /*streaming*/ true);
-		else
-			demux->createTSRecorder(m_record, /*packetsize*/ 188, /*streaming*/ false);
+		createRecorder(demux);
 		if (!m_record)
 		{
 			eDebug("[eDVBServiceStream] no ts recorder available.");
@@ -311,6 +308,14 @@ int eDVBServiceStream::doRecord()
 	return 0;
 }
 
+void eDVBServiceStream::createRecorder(ePtr<iDVBDemux> &demux)
+{
+	if (m_ref.path.empty())
+		demux->createTSRecorder(m_record, /*packetsize*/ 188, /*streaming*/ true);
+	else
+		demux->createTSRecorder(m_record, /*packetsize*/ 188, /*streaming*/ false);
+}
+
 bool eDVBServiceStream::recordCachedPids()
 {
 	eServiceReferenceDVB ref = m_ref.getParentServiceReference();
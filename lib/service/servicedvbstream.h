@@ -36,6 +36,8 @@ protected:
 
 	int doPrepare();
 	int doRecord();
+	/* sets m_record to a recorder on the given demux */
+	virtual void createRecorder(ePtr<iDVBDemux> &demux);
 
 	/* events */
 	void serviceEvent(int event);
@@ -310,6 +310,9 @@ int main(int argc, char **argv)
 		debugLvl = 0;
 	if (getenv("ENIGMA_DEBUG_TIME"))
 		setDebugTime(atoi(getenv("ENIGMA_DEBUG_TIME")));
+	// watch socket notifiers with epoll instead of poll
+	if (getenv("ENIGMA_EPOLL"))
+		eMainloop::setUseEpoll(atoi(getenv("ENIGMA_EPOLL")) != 0);
 
 	eLog(0, "[Enigma] Python path is '%s'.", getenv("PYTHONPATH"));
 	eLog(0, "[Enigma] DVB API version %d, DVB API version minor %d.", DVB_API_VERSION, DVB_API_VERSION_MINOR);
@@ -0,0 +1,97 @@
+/*
+ * enigma2-reindex: rebuilds the .ap and .sc files of recordings, without
+ * a running enigma2, e.g. on the server the recordings are stored on.
+ * Interrupting it keeps the finished parts, running it again resumes.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <lib/dvb/reindex.h>
+
+static volatile sig_atomic_t interrupted;
+
+static void interrupt(int)
+{
+	interrupted = 1;
+}
+
+/* eFatal ends up here, there is no bsod to show */
+void bsodFatal(const char *component)
+{
+	fprintf(stderr, "%s: fatal error\n", component);
+	abort();
+}
+
+class eReindexCommand: public eDVBReindexer
+{
+	int m_percent;
+public:
+	eReindexCommand(const std::string &filename): eDVBReindexer(filename), m_percent(-1) {}
+protected:
+	void progress(off_t done, off_t total)
+	{
+		if (interrupted)
+			stop();
+		int percent = total ? done * 100 / total : 100;
+		if (percent != m_percent)
+		{
+			m_percent = percent;
+			fprintf(stderr, "\r%3d%%", percent);
+		}
+	}
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-j threads] recording.ts...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+	int threads = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'j':
+			threads = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (optind == argc)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	signal(SIGINT, interrupt);
+	signal(SIGTERM, interrupt);
+
+	int result = 0;
+	for (int i = optind; i < argc && !interrupted; ++i)
+	{
+		fprintf(stderr, "%s\n", argv[i]);
+		eReindexCommand reindexer(argv[i]);
+		int err = reindexer.run(threads);
+		fprintf(stderr, "\r");
+		if (err == -EINTR)
+		{
+			fprintf(stderr, "interrupted, run again to resume\n");
+			return 130;
+		}
+		if (err < 0)
+		{
+			fprintf(stderr, "failed: %s\n", strerror(-err));
+			result = 1;
+		}
+	}
+	return result;
+}
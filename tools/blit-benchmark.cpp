@@ -0,0 +1,73 @@
+/*
+ * blit-benchmark: runs each blit kernel of the plain C set and of the set
+ * gPixmap uses on this CPU over a 720p surface, and reports the time each
+ * took and whether the result differs from the C version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <lib/base/benchmark.h>
+#include <lib/gdi/blitter.h>
+
+/* eFatal ends up here, there is no bsod to show */
+void bsodFatal(const char *component)
+{
+	fprintf(stderr, "%s: fatal error\n", component);
+	abort();
+}
+
+int main()
+{
+	const int width = 1280, height = 720, size = width * height;
+	std::vector<uint32_t> src(size), dst(size), reference[4];
+	std::vector<uint8_t> src8(size);
+	std::vector<int> map(width);
+	uint32_t pal[256];
+	uint32_t seed = 1;
+	for (int i = 0; i < size; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		/* a third fully transparent, like the borders of most skin images */
+		src[i] = (i % 3) ? seed : seed & 0xFFFFFF;
+		src8[i] = seed >> 24;
+	}
+	for (int i = 0; i < 256; ++i)
+		pal[i] = src[i * 97];
+	gBlitKernels::buildScaleMap(&map[0], width, width * 2 / 3);
+
+	int differs = 0;
+	const gBlitKernels *sets[] = { &gBlitKernels::reference(), &gBlitKernels::get() };
+	for (unsigned int k = 0; k < sizeof(sets) / sizeof(sets[0]); ++k)
+	{
+		const gBlitKernels &set = *sets[k];
+		for (int op = 0; op < 4; ++op)
+		{
+			static const char *names[] = { "blend", "alphatest", "expand", "scale" };
+			for (int i = 0; i < size; ++i)
+				dst[i] = 0x80402010 + i;
+			Stopwatch s;
+			for (int y = 0; y < height; ++y)
+			{
+				int row = y * width;
+				switch (op)
+				{
+				case 0: set.blend(&dst[row], &src[row], width); break;
+				case 1: set.alphatest(&dst[row], &src[row], width, 0xFF000000); break;
+				case 2: set.expand(&dst[row], &src8[row], pal, width); break;
+				case 3: set.scale(&dst[row], &src[row], &map[0], width); break;
+				}
+			}
+			s.stop();
+			bool same = true;
+			if (k == 0)
+				reference[op] = dst;
+			else
+				same = (dst == reference[op]);
+			if (!same)
+				++differs;
+			printf("%s %s %dx%d took %u us%s\n", set.name, names[op], width, height, s.elapsed_us(), same ? "" : ", result differs from C");
+		}
+	}
+	return differs ? 1 : 0;
+}
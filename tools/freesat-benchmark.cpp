@@ -0,0 +1,72 @@
+/*
+ * freesat-benchmark: decodes a corpus of FreeSat strings with the lookup
+ * tables and with the table lists alone, and reports the time of both and
+ * the strings they decode differently.
+ *
+ * The corpus has one string per line, the descriptor text bytes in hex,
+ * starting with the 0x1f marker. The tables are loaded from where enigma2
+ * loads them.
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <lib/base/benchmark.h>
+#include <lib/base/freesatv2.h>
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s corpus\n", argv[0]);
+		return 2;
+	}
+	FILE *fp = fopen(argv[1], "r");
+	if (!fp)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	std::vector<std::string> titles;
+	char buf[2048];
+	while (fgets(buf, sizeof(buf), fp) != NULL)
+	{
+		std::string title;
+		unsigned int byte;
+		for (const char *p = buf; sscanf(p, "%02x", &byte) == 1; p += 2)
+			title.push_back((char)byte);
+		if (title.size() > 2)
+			titles.push_back(title);
+	}
+	fclose(fp);
+	if (titles.empty())
+	{
+		fprintf(stderr, "%s: no strings\n", argv[1]);
+		return 1;
+	}
+
+	freesatHuffmanDecoder decoder;
+	size_t bytes = 0;
+	int mismatches = 0;
+	unsigned int list_us = 0, lookup_us = 0;
+	Stopwatch s;
+	for (std::vector<std::string>::const_iterator it(titles.begin()); it != titles.end(); ++it)
+	{
+		const unsigned char *src = (const unsigned char*)it->data();
+		bytes += it->size();
+		s.start();
+		std::string list = decoder.decode(src, it->size(), false);
+		s.stop();
+		list_us += s.elapsed_us();
+		s.start();
+		std::string lookup = decoder.decode(src, it->size(), true);
+		s.stop();
+		lookup_us += s.elapsed_us();
+		if (list != lookup)
+			mismatches++;
+	}
+
+	printf("%d strings, %d bytes: list %u us, lookup %u us, %d mismatches\n",
+		(int)titles.size(), (int)bytes, list_us, lookup_us, mismatches);
+	return mismatches ? 1 : 0;
+}
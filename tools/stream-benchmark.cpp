@@ -0,0 +1,155 @@
+/*
+ * stream-benchmark: streams a transport stream file into a socket the two
+ * ways eDVBRecordStreamThread does, reading into a buffer and writing it,
+ * and splicing through a pipe, and reports the CPU time used per Mbit.
+ *
+ * The buffer and pipe have the size the thread uses for 188 byte packets.
+ * The CPU time includes the receiver, which is the same in both modes.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define BUFFER_SIZE (188 * 1024)
+
+struct Sender
+{
+	int source;
+	int target;
+	bool splice;
+};
+
+static double cpuTime()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static double wallTime()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool writeAll(int fd, const unsigned char *buffer, ssize_t len)
+{
+	while (len > 0)
+	{
+		ssize_t w = ::write(fd, buffer, len);
+		if (w <= 0)
+			return false;
+		buffer += w;
+		len -= w;
+	}
+	return true;
+}
+
+static void *sendFile(void *arg)
+{
+	Sender *s = (Sender*)arg;
+	if (s->splice)
+	{
+		int pipefd[2];
+		if (::pipe2(pipefd, O_CLOEXEC) < 0)
+		{
+			perror("pipe");
+			return NULL;
+		}
+		::fcntl(pipefd[1], F_SETPIPE_SZ, BUFFER_SIZE);
+		while (1)
+		{
+			ssize_t len = ::splice(s->source, NULL, pipefd[1], NULL, BUFFER_SIZE, SPLICE_F_MOVE);
+			if (len <= 0)
+				break;
+			while (len > 0)
+			{
+				ssize_t w = ::splice(pipefd[0], NULL, s->target, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+				if (w <= 0)
+					break;
+				len -= w;
+			}
+			if (len)
+				break;
+		}
+		::close(pipefd[0]);
+		::close(pipefd[1]);
+	}
+	else
+	{
+		static unsigned char buffer[BUFFER_SIZE];
+		while (1)
+		{
+			ssize_t len = ::read(s->source, buffer, sizeof(buffer));
+			if (len <= 0 || !writeAll(s->target, buffer, len))
+				break;
+		}
+	}
+	::shutdown(s->target, SHUT_WR);
+	return NULL;
+}
+
+static int run(const char *filename, bool splice)
+{
+	int source = ::open(filename, O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	int sv[2];
+	if (source < 0 || ::fstat(source, &st) < 0 || ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+	{
+		perror(filename);
+		if (source >= 0)
+			::close(source);
+		return 1;
+	}
+	Sender sender = { source, sv[0], splice };
+	double cpu = cpuTime(), wall = wallTime();
+	pthread_t thread;
+	pthread_create(&thread, NULL, sendFile, &sender);
+
+	static unsigned char buffer[256 * 1024];
+	off_t received = 0;
+	while (received < st.st_size)
+	{
+		struct pollfd pfd = { sv[1], POLLIN, 0 };
+		if (::poll(&pfd, 1, 1000) <= 0)
+			break;
+		ssize_t r = ::read(sv[1], buffer, sizeof(buffer));
+		if (r <= 0)
+			break;
+		received += r;
+	}
+	pthread_join(thread, NULL);
+	cpu = cpuTime() - cpu;
+	wall = wallTime() - wall;
+	::close(sv[0]);
+	::close(sv[1]);
+	::close(source);
+
+	double mbit = received * 8 / 1e6;
+	printf("%s: %.1f Mbit in %.3f s (%.1f Mbit/s), %.3f s cpu, %.1f us cpu per Mbit\n",
+		splice ? "splice" : "read/write", mbit, wall, wall > 0 ? mbit / wall : 0, cpu, mbit > 0 ? cpu * 1e6 / mbit : 0);
+	return received == st.st_size ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: %s file.ts\n", argv[0]);
+		return 2;
+	}
+	int r = run(argv[1], false);
+	r |= run(argv[1], true);
+	return r;
+}